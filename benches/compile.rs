@@ -0,0 +1,214 @@
+//! Cost of every compilation phase on the modules in `examples/`, and on synthetic modules that
+//! stress how the compiler scales with the number of functions, the nesting of blocks and the
+//! number of distinct constants.
+//!
+//! Run with `cargo bench --bench compile`, enabling the backend features (e.g. `khronos-all` or
+//! `naga-all`) to measure validation, optimization and cross-compilation too.
+
+use std::{
+    fmt::Write,
+    hint::black_box,
+    time::{Duration, Instant},
+};
+use wasm2spirv::{config::Config, error::Result, fg::module::ModuleBuilder, Compilation};
+
+const EXAMPLE_ITERATIONS: u32 = 100;
+const SYNTHETIC_ITERATIONS: u32 = 10;
+
+const FUNCTION_COUNT: u32 = 2000;
+const NESTING_DEPTH: u32 = 256;
+const CONSTANT_COUNT: u32 = 4096;
+
+macro_rules! examples {
+    ($($name:literal),+ $(,)?) => {
+        &[$((
+            $name,
+            include_str!(concat!("../examples/", $name, "/", $name, ".wat")),
+            include_str!(concat!("../examples/", $name, "/", $name, ".json")),
+        )),+]
+    };
+}
+
+const EXAMPLES: &[(&str, &str, &str)] =
+    examples!["cast", "dot", "fragment", "min", "saxpy", "square"];
+
+/// Synthetic modules share the entry point (and thus the configuration) of `square`.
+const SYNTHETIC_CONFIG: &str = include_str!("../examples/square/square.json");
+
+fn main() -> color_eyre::Result<()> {
+    let _ = color_eyre::install();
+
+    for (name, wat, config) in EXAMPLES {
+        let wasm = wat::parse_str(wat)?;
+        let config: Config = serde_json::from_str(config)?;
+        bench_module(name, &config, &wasm, EXAMPLE_ITERATIONS)?;
+    }
+
+    let config: Config = serde_json::from_str(SYNTHETIC_CONFIG)?;
+    for (name, wat) in [
+        ("functions", many_functions(FUNCTION_COUNT)),
+        ("nesting", deep_nesting(NESTING_DEPTH)),
+        ("constants", many_constants(CONSTANT_COUNT)),
+    ] {
+        let wasm = wat::parse_str(wat)?;
+        bench_module(name, &config, &wasm, SYNTHETIC_ITERATIONS)?;
+    }
+
+    return Ok(());
+}
+
+fn bench_module(name: &str, config: &Config, wasm: &[u8], iterations: u32) -> Result<()> {
+    let compile = || Compilation::new(config.clone(), wasm);
+
+    bench(
+        name,
+        "build",
+        iterations,
+        || Ok(()),
+        |_| ModuleBuilder::new(config.clone(), wasm),
+    )?;
+
+    bench(
+        name,
+        "translate",
+        iterations,
+        || ModuleBuilder::new(config.clone(), wasm),
+        ModuleBuilder::translate,
+    )?;
+
+    bench(
+        name,
+        "assemble",
+        iterations,
+        || ModuleBuilder::new(config.clone(), wasm)?.translate(),
+        |builder| Ok(builder.assemble()),
+    )?;
+
+    #[cfg(any(feature = "spvt-validate", feature = "naga-validate"))]
+    bench(name, "validate", iterations, compile, |x| x.validate())?;
+
+    #[cfg(feature = "spirv-tools")]
+    bench(
+        name,
+        "optimize",
+        iterations,
+        compile,
+        Compilation::into_optimized,
+    )?;
+
+    #[cfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
+    bench(name, "glsl", iterations, compile, |x| x.glsl())?;
+
+    #[cfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
+    bench(name, "hlsl", iterations, compile, |x| x.hlsl())?;
+
+    #[cfg(any(feature = "spvc-msl", feature = "naga-msl"))]
+    bench(name, "msl", iterations, compile, |x| x.msl())?;
+
+    #[cfg(feature = "naga-wgsl")]
+    bench(name, "wgsl", iterations, compile, |x| x.wgsl())?;
+
+    let _ = compile;
+    return Ok(());
+}
+
+/// Times `f` over the result of `setup`, which isn't measured.
+fn bench<S, T>(
+    name: &str,
+    phase: &str,
+    iterations: u32,
+    mut setup: impl FnMut() -> Result<S>,
+    mut f: impl FnMut(S) -> Result<T>,
+) -> Result<()> {
+    // Warm up
+    let _ = f(setup()?)?;
+
+    let mut elapsed = Duration::ZERO;
+    for _ in 0..iterations {
+        let input = setup()?;
+        let start = Instant::now();
+        let output = black_box(f(input)?);
+        elapsed += start.elapsed();
+        drop(output);
+    }
+
+    println!(
+        "{name:<10} {phase:<10} {:>12?}/iteration",
+        elapsed / iterations
+    );
+    return Ok(());
+}
+
+/// Entry point of `square`, applying `body` to the loaded value before storing it back.
+///
+/// `body` may use local `3` as scratch space.
+fn entry_point(body: &str, functions: &str) -> String {
+    return format!(
+        r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32 i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+{body}    i32.store)
+{functions}  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#
+    );
+}
+
+/// Chain of `count` small functions, all of them called by the entry point.
+fn many_functions(count: u32) -> String {
+    let mut body = String::new();
+    let mut functions = String::new();
+    for i in 0..count {
+        let _ = writeln!(body, "    call {}", i + 2);
+        let _ = writeln!(
+            functions,
+            "  (func (type 0) (param i32) (result i32)\n    local.get 0\n    i32.const {i}\n    i32.add\n    i32.const {}\n    i32.xor)",
+            i.wrapping_mul(7919)
+        );
+    }
+    return entry_point(&body, &functions);
+}
+
+/// `depth` nested blocks, every one of them with a conditional branch out of it.
+fn deep_nesting(depth: u32) -> String {
+    let mut body = String::from("    local.set 3\n");
+    for i in 0..depth {
+        let _ = writeln!(
+            body,
+            "    block\n    local.get 3\n    i32.eqz\n    br_if 0\n    local.get 3\n    i32.const {i}\n    i32.add\n    local.set 3"
+        );
+    }
+    for _ in 0..depth {
+        body.push_str("    end\n");
+    }
+    body.push_str("    local.get 3\n");
+    return entry_point(&body, "");
+}
+
+/// `count` distinct 32-bit constants, all of them used by the entry point.
+fn many_constants(count: u32) -> String {
+    let mut body = String::new();
+    for i in 0..count {
+        let _ = writeln!(
+            body,
+            "    i32.const {}\n    i32.add",
+            i.wrapping_mul(2654435761) as i32
+        );
+    }
+    return entry_point(&body, "");
+}
@@ -0,0 +1,69 @@
+//! Per-operator cost of building the function graphs of the modules in `examples/`.
+//!
+//! Run with `cargo bench --bench dispatch`, and compare the results against another revision
+//! to measure changes on the operator dispatch.
+
+use std::{
+    hint::black_box,
+    time::{Duration, Instant},
+};
+use wasm2spirv::{config::Config, error::Result, fg::module::ModuleBuilder};
+
+const ITERATIONS: u32 = 1000;
+
+macro_rules! examples {
+    ($($name:literal),+ $(,)?) => {
+        &[$((
+            $name,
+            include_str!(concat!("../examples/", $name, "/", $name, ".wat")),
+            include_str!(concat!("../examples/", $name, "/", $name, ".json")),
+        )),+]
+    };
+}
+
+const EXAMPLES: &[(&str, &str, &str)] =
+    examples!["cast", "dot", "fragment", "min", "saxpy", "square"];
+
+fn main() -> color_eyre::Result<()> {
+    let _ = color_eyre::install();
+
+    for (name, wat, config) in EXAMPLES {
+        let wasm = wat::parse_str(wat)?;
+        let config: Config = serde_json::from_str(config)?;
+        let operators = count_operators(&wasm)?;
+
+        // Warm up
+        let _ = ModuleBuilder::new(config.clone(), &wasm)?;
+
+        let mut elapsed = Duration::ZERO;
+        for _ in 0..ITERATIONS {
+            let config = config.clone();
+            let start = Instant::now();
+            let builder = black_box(ModuleBuilder::new(config, &wasm)?);
+            elapsed += start.elapsed();
+            drop(builder);
+        }
+
+        let per_module = elapsed / ITERATIONS;
+        println!(
+            "{name:<10} {operators:>6} operators {:>12?}/module {:>10.2} ns/operator",
+            per_module,
+            per_module.as_nanos() as f64 / operators.max(1) as f64
+        );
+    }
+
+    return Ok(());
+}
+
+fn count_operators(wasm: &[u8]) -> Result<usize> {
+    let mut count = 0;
+    for payload in wasmparser::Parser::new(0).parse_all(wasm) {
+        if let wasmparser::Payload::CodeSectionEntry(body) = payload? {
+            for op in body.get_operators_reader()? {
+                let _ = op?;
+                count += 1;
+            }
+        }
+    }
+    return Ok(count);
+}
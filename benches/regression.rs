@@ -0,0 +1,373 @@
+//! Regression harness for the compile time, memory use and output size of the compiler.
+//!
+//! Every case in `examples/` is compiled from it's `.wat`, and from the `examples/out/<name>.wasm`
+//! that `just test <name>` builds out of it's Zig source, if there's one. So is every `<name>.wasm`
+//! (with it's `<name>.json` config next to it) in the directories given with `--corpus`, which is
+//! how compiled Rust and Zig kernels are added to the run. For each of them, the harness records
+//! the median time of a compilation, it's peak of heap memory, the size of the SPIR-V in words (and
+//! after [`Compilation::into_optimized`], when `spirv-tools` is enabled) and how many times every
+//! instruction is used.
+//!
+//! The metrics are compared against the baseline checked in at `benches/baseline.json`, and the
+//! harness fails if any of them grows past it's threshold. Sizes are deterministic, so by default
+//! any growth is a regression, and the histogram of the grown cases is printed to find out which
+//! instructions are to blame. Run with `just regression`, and record the current metrics as the
+//! new baseline with `just regression --bless`.
+//!
+//! ```text
+//! --bless                   overwrites the baseline with the current metrics
+//! --baseline <path>         baseline to compare against (defaults to `benches/baseline.json`)
+//! --corpus <dir>            also compiles the modules in `dir`, may be given more than once
+//! --iterations <n>          compilations timed per case (defaults to 20)
+//! --time-threshold <%>      allowed growth of the compile time (defaults to 10)
+//! --memory-threshold <%>    allowed growth of the peak memory (defaults to 5)
+//! --size-threshold <%>      allowed growth of the output size (defaults to 0)
+//! ```
+
+use color_eyre::eyre::{bail, eyre};
+use serde::{Deserialize, Serialize};
+use std::{
+    collections::BTreeMap,
+    hint::black_box,
+    path::{Path, PathBuf},
+    time::{Duration, Instant},
+};
+use wasm2spirv::{
+    config::Config,
+    error::Result,
+    timings::{live_memory, peak_memory, reset_peak_memory, CountingAllocator},
+    Compilation,
+};
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+/// Words of the SPIR-V header, before the first instruction
+const HEADER_WORDS: usize = 5;
+
+#[derive(Debug)]
+struct Options {
+    bless: bool,
+    baseline: PathBuf,
+    corpus: Vec<PathBuf>,
+    iterations: u32,
+    time_threshold: f64,
+    memory_threshold: f64,
+    size_threshold: f64,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        return Self {
+            bless: false,
+            baseline: Path::new(env!("CARGO_MANIFEST_DIR")).join("benches/baseline.json"),
+            corpus: Vec::new(),
+            iterations: 20,
+            time_threshold: 10.0,
+            memory_threshold: 5.0,
+            size_threshold: 0.0,
+        };
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+struct Metrics {
+    /// Median wall time of [`Compilation::new`], in nanoseconds
+    compile_ns: u64,
+    /// Most heap memory held at once during [`Compilation::new`], in bytes
+    peak_bytes: u64,
+    words: u64,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    optimized_words: Option<u64>,
+    /// Number of uses of every instruction, by opcode
+    histogram: BTreeMap<String, u64>,
+}
+
+struct Case {
+    name: String,
+    config: Config,
+    wasm: Vec<u8>,
+}
+
+fn main() -> color_eyre::Result<()> {
+    let _ = color_eyre::install();
+    let options = parse_options()?;
+
+    let mut current = BTreeMap::new();
+    for case in cases(&options)? {
+        let metrics = measure(&case, options.iterations)?;
+        current.insert(case.name, metrics);
+    }
+
+    if options.bless {
+        std::fs::write(
+            &options.baseline,
+            serde_json::to_string_pretty(&current)? + "\n",
+        )?;
+        println!(
+            "Recorded the metrics of {} cases into {}",
+            current.len(),
+            options.baseline.display()
+        );
+        return Ok(());
+    }
+
+    let baseline = match std::fs::read_to_string(&options.baseline) {
+        Ok(baseline) => serde_json::from_str::<BTreeMap<String, Metrics>>(&baseline)?,
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound => bail!(
+            "There's no baseline at {}, record one with `--bless`",
+            options.baseline.display()
+        ),
+        Err(e) => return Err(e.into()),
+    };
+
+    let mut regressions = 0;
+    println!(
+        "{:<20} {:<16} {:>14} {:>14} {:>9}",
+        "case", "metric", "baseline", "current", "change"
+    );
+
+    for (name, metrics) in &current {
+        let prev = match baseline.get(name) {
+            Some(prev) => prev,
+            None => {
+                println!("{name:<20} not in the baseline");
+                continue;
+            }
+        };
+
+        regressions += compare(name, prev, metrics, &options);
+    }
+
+    for name in baseline.keys().filter(|x| !current.contains_key(*x)) {
+        println!("{name:<20} not compiled by this run");
+    }
+
+    if regressions > 0 {
+        bail!("{regressions} metrics regressed past their threshold");
+    }
+
+    return Ok(());
+}
+
+fn parse_options() -> color_eyre::Result<Options> {
+    let mut options = Options::default();
+    let mut args = std::env::args().skip(1);
+
+    while let Some(arg) = args.next() {
+        let mut value = || {
+            args.next()
+                .ok_or_else(|| eyre!("Missing the value of `{arg}`"))
+        };
+        match arg.as_str() {
+            "--bless" => options.bless = true,
+            "--baseline" => options.baseline = value()?.into(),
+            "--corpus" => options.corpus.push(value()?.into()),
+            "--iterations" => options.iterations = value()?.parse::<u32>()?.max(1),
+            "--time-threshold" => options.time_threshold = value()?.parse()?,
+            "--memory-threshold" => options.memory_threshold = value()?.parse()?,
+            "--size-threshold" => options.size_threshold = value()?.parse()?,
+            // Passed by `cargo bench`
+            "--bench" => continue,
+            _ => bail!("Unknown argument `{arg}`"),
+        }
+    }
+
+    return Ok(options);
+}
+
+/// Every module to compile, sorted by name within each of their directories.
+fn cases(options: &Options) -> color_eyre::Result<Vec<Case>> {
+    let examples = Path::new(env!("CARGO_MANIFEST_DIR")).join("examples");
+    let mut result = Vec::new();
+
+    for name in sorted_entries(&examples)? {
+        let dir = examples.join(&name);
+        let config = dir.join(format!("{name}.json"));
+        if !config.is_file() {
+            continue;
+        }
+
+        let config = read_config(&config)?;
+        let wat = dir.join(format!("{name}.wat"));
+        if wat.is_file() {
+            result.push(Case {
+                name: name.clone(),
+                config: config.clone(),
+                wasm: wat::parse_file(wat)?,
+            });
+        }
+
+        let wasm = examples.join("out").join(format!("{name}.wasm"));
+        if wasm.is_file() {
+            result.push(Case {
+                name: format!("{name}.wasm"),
+                config,
+                wasm: std::fs::read(wasm)?,
+            });
+        }
+    }
+
+    for dir in &options.corpus {
+        let prefix = dir
+            .file_name()
+            .map(|x| x.to_string_lossy().into_owned())
+            .unwrap_or_default();
+
+        for file in sorted_entries(dir)? {
+            let name = match file.strip_suffix(".wasm") {
+                Some(name) => name,
+                None => continue,
+            };
+
+            result.push(Case {
+                name: format!("{prefix}/{name}"),
+                config: read_config(&dir.join(format!("{name}.json")))?,
+                wasm: std::fs::read(dir.join(&file))?,
+            });
+        }
+    }
+
+    return Ok(result);
+}
+
+fn sorted_entries(dir: &Path) -> color_eyre::Result<Vec<String>> {
+    let mut entries = std::fs::read_dir(dir)?
+        .map(|entry| Ok(entry?.file_name().to_string_lossy().into_owned()))
+        .collect::<std::io::Result<Vec<_>>>()?;
+
+    entries.sort();
+    return Ok(entries);
+}
+
+fn read_config(path: &Path) -> color_eyre::Result<Config> {
+    let config = std::fs::read_to_string(path)
+        .map_err(|e| eyre!("Couldn't read {}: {e}", path.display()))?;
+    return Ok(serde_json::from_str(&config)?);
+}
+
+fn measure(case: &Case, iterations: u32) -> Result<Metrics> {
+    let compile = || Compilation::new(case.config.clone(), &case.wasm);
+
+    // Warms up, and measures the memory of a single compilation
+    let live = live_memory();
+    reset_peak_memory();
+    let compilation = compile()?;
+    let peak_bytes = peak_memory().saturating_sub(live) as u64;
+
+    let mut times = Vec::with_capacity(iterations as usize);
+    for _ in 0..iterations {
+        let start = Instant::now();
+        let output = black_box(compile()?);
+        times.push(start.elapsed());
+        drop(output);
+    }
+    times.sort();
+
+    let words = compilation.words()?;
+    return Ok(Metrics {
+        compile_ns: nanos(times[times.len() / 2]),
+        peak_bytes,
+        words: words.len() as u64,
+        optimized_words: optimized_words(compile()?)?,
+        histogram: histogram(words),
+    });
+}
+
+#[cfg(feature = "spirv-tools")]
+fn optimized_words(compilation: Compilation) -> Result<Option<u64>> {
+    return Ok(Some(compilation.into_optimized()?.words()?.len() as u64));
+}
+
+#[cfg(not(feature = "spirv-tools"))]
+fn optimized_words(_compilation: Compilation) -> Result<Option<u64>> {
+    return Ok(None);
+}
+
+fn histogram(words: &[u32]) -> BTreeMap<String, u64> {
+    let mut result = BTreeMap::new();
+
+    let mut i = HEADER_WORDS;
+    while let Some(word) = words.get(i) {
+        let opcode = word & 0xffff;
+        let name = match spirv::Op::from_u32(opcode) {
+            Some(op) => format!("{op:?}"),
+            None => format!("Op{opcode}"),
+        };
+
+        *result.entry(name).or_default() += 1;
+        i += usize::max((word >> 16) as usize, 1);
+    }
+
+    return result;
+}
+
+/// Prints how every metric of `name` changed, returning how many of them regressed.
+fn compare(name: &str, prev: &Metrics, metrics: &Metrics, options: &Options) -> u32 {
+    let mut regressions = 0;
+    let mut grown = false;
+
+    for (metric, prev, current, threshold) in [
+        (
+            "compile_ns",
+            Some(prev.compile_ns),
+            Some(metrics.compile_ns),
+            options.time_threshold,
+        ),
+        (
+            "peak_bytes",
+            Some(prev.peak_bytes),
+            Some(metrics.peak_bytes),
+            options.memory_threshold,
+        ),
+        (
+            "words",
+            Some(prev.words),
+            Some(metrics.words),
+            options.size_threshold,
+        ),
+        (
+            "optimized_words",
+            prev.optimized_words,
+            metrics.optimized_words,
+            options.size_threshold,
+        ),
+    ] {
+        let (prev, current) = match (prev, current) {
+            (Some(prev), Some(current)) => (prev, current),
+            _ => continue,
+        };
+
+        let change = match prev {
+            0 if current == 0 => 0.0,
+            0 => f64::INFINITY,
+            prev => (current as f64 / prev as f64 - 1.0) * 100.0,
+        };
+
+        let regressed = change > threshold;
+        println!(
+            "{name:<20} {metric:<16} {prev:>14} {current:>14} {change:>+8.1}%{}",
+            if regressed { "  REGRESSION" } else { "" }
+        );
+
+        if regressed {
+            regressions += 1;
+            grown |= metric.ends_with("words");
+        }
+    }
+
+    if grown {
+        for (op, count) in &metrics.histogram {
+            let prev = prev.histogram.get(op).copied().unwrap_or_default();
+            if *count > prev {
+                println!("{:<20} {op:<32} {prev:>6} -> {count}", "");
+            }
+        }
+    }
+
+    return regressions;
+}
+
+fn nanos(duration: Duration) -> u64 {
+    return u64::try_from(duration.as_nanos()).unwrap_or(u64::MAX);
+}
@@ -1,13 +1,26 @@
 use crate::{
-    compiler::{rust::RustCompiler, zig::ZigCompiler, Compiler},
+    compiler::{compile_cached, rust::RustCompiler, zig::ZigCompiler},
+    pool::{CompilePool, PoolMetrics},
     rate_limit::{LimitHandler, LimitInfo, RateLimit},
     Result,
 };
-use axum::{routing::post, Json, Router};
+use axum::{
+    routing::{get, post},
+    Json, Router,
+};
 use color_eyre::Report;
 use serde::{Deserialize, Serialize};
-use std::{borrow::Cow, panic::catch_unwind, time::Duration};
-use wasm2spirv::config::Config;
+use std::{borrow::Cow, panic::catch_unwind, sync::OnceLock, time::Duration};
+use wasm2spirv::{
+    cache::{CacheFlags, CachedCompilation, MemoryCache},
+    config::Config,
+    timings::Timings,
+};
+
+const CACHE_CAPACITY: usize = 256;
+/// Compilations waiting for a worker, per worker, before new ones are rejected
+const QUEUED_PER_WORKER: u64 = 4;
+const COMPILE_DEADLINE: Duration = Duration::from_secs(30);
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Deserialize, Serialize)]
 #[serde(rename_all = "snake_case")]
@@ -36,10 +49,12 @@ pub struct CompileBody {
     optimization_runs: u8,
 }
 
-#[derive(Debug, Clone, PartialEq, Serialize)]
+#[derive(Debug, Clone, Serialize)]
 pub struct CompileResponse {
     wat: String,
     result: Result<String, Cow<'static, str>>,
+    /// Phases run by the compiler for this request (none on a cache hit)
+    timings: Timings,
 }
 
 async fn compile(Json(body): Json<CompileBody>) -> Result<Json<CompileResponse>> {
@@ -61,42 +76,87 @@ async fn compile(Json(body): Json<CompileBody>) -> Result<Json<CompileResponse>>
         };
     }
 
+    // Rust and Zig sources are compiled by external processes, which are awaited on the runtime
     let wasm = match body.lang {
-        Language::Wasm => wat::parse_str(&body.source)?,
-        Language::Rust => RustCompiler.compile(&body.source).await?,
-        Language::Zig => ZigCompiler.compile(&body.source).await?,
+        Language::Wasm => None,
+        Language::Rust => Some(compile_cached(&RustCompiler, &body.source).await?),
+        Language::Zig => Some(compile_cached(&ZigCompiler, &body.source).await?),
     };
 
-    let wat = match body.lang {
-        Language::Wasm => body.source,
-        _ => wasmprinter::print_bytes(&wasm).map_err(Report::msg)?,
+    let flags = CacheFlags {
+        validate: true,
+        optimization_runs: u8::min(body.optimization_runs, 3),
     };
 
-    let mut result = tri!(wasm2spirv::Compilation::new(body.config, &wasm))
-        .and_then(|result| tri!(result.validate()).map(|_| result));
+    let response = pool()
+        .run(move || -> Result<CompileResponse> {
+            let (wasm, wat) = match wasm {
+                None => (wat::parse_str(&body.source)?.into(), body.source),
+                Some(wasm) => {
+                    let wat = wasmprinter::print_bytes(&wasm).map_err(Report::msg)?;
+                    (wasm, wat)
+                }
+            };
 
-    for _ in 0..u8::min(body.optimization_runs, 3) {
-        result = result.and_then(|result| tri!(result.into_optimized()));
-    }
+            let (result, timings) = Timings::record(|| {
+                let result = tri!(CachedCompilation::new(body.config, &wasm, flags, cache()));
+                result.and_then(|mut result| {
+                    tri!(match body.compile_lang {
+                        CompilationLanguage::Spirv => {
+                            result.compilation().assembly().map(String::from)
+                        }
+                        CompilationLanguage::Glsl => result.glsl().map(String::from),
+                        CompilationLanguage::Hlsl => result.hlsl().map(String::from),
+                        CompilationLanguage::Msl => result.msl().map(String::from),
+                        CompilationLanguage::Wgsl => result.wgsl().map(String::from),
+                    })
+                })
+            });
 
-    let result = result.and_then(|result| {
-        tri!(match body.compile_lang {
-            CompilationLanguage::Spirv => result.into_assembly(),
-            CompilationLanguage::Glsl => result.glsl(),
-            CompilationLanguage::Hlsl => result.hlsl(),
-            CompilationLanguage::Msl => result.msl(),
-            CompilationLanguage::Wgsl => result.wgsl(),
+            Ok(CompileResponse {
+                wat,
+                result,
+                timings,
+            })
         })
+        .await??;
+
+    return Ok(response.into());
+}
+
+async fn metrics() -> Json<PoolMetrics> {
+    return Json(pool().metrics());
+}
+
+fn pool() -> &'static CompilePool {
+    static POOL: OnceLock<CompilePool> = OnceLock::new();
+    return POOL.get_or_init(|| {
+        let workers = workers();
+        CompilePool::new(
+            workers,
+            QUEUED_PER_WORKER * workers as u64,
+            COMPILE_DEADLINE,
+        )
     });
+}
+
+fn workers() -> usize {
+    return std::thread::available_parallelism().map_or(1, usize::from);
+}
 
-    return Ok(CompileResponse { wat, result }.into());
+fn cache() -> &'static MemoryCache {
+    static CACHE: OnceLock<MemoryCache> = OnceLock::new();
+    return CACHE.get_or_init(|| MemoryCache::new(CACHE_CAPACITY));
 }
 
 pub fn router() -> Router {
+    // The pool bounds how many compilations run at once, so a single client may use all of it's
+    // workers every second
     return Router::new()
         .route("/compile", post(compile))
         .layer(RateLimit::new(
             None,
-            LimitInfo::new(1, Duration::SECOND, LimitHandler::Wait),
-        ));
+            LimitInfo::new(workers() as u64, Duration::SECOND, LimitHandler::Wait),
+        ))
+        .route("/metrics", get(metrics));
 }
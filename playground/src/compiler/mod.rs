@@ -1,6 +1,178 @@
+use crate::tmp::work_dir;
+use std::{
+    collections::{hash_map::DefaultHasher, HashMap},
+    fmt::Display,
+    hash::{Hash, Hasher},
+    path::PathBuf,
+    sync::{Arc, Mutex, OnceLock, PoisonError},
+};
+use tracing::{error, info};
+
 pub mod rust;
 pub mod zig;
 
+/// Compiled programs kept by [`compile_cached`]
+const CACHE_CAPACITY: usize = 256;
+
 pub trait Compiler {
+    /// Name of the toolchain, which tells apart it's entries in the cache and it's directory in
+    /// the [`work_dir`]
+    const NAME: &'static str;
+
     async fn compile(&self, source: &str) -> Result<Vec<u8>, crate::Error>;
+
+    /// Compiles an empty program, so that the toolchain's shared caches are already populated
+    /// when the first request comes in.
+    async fn warm_up(&self) -> Result<(), crate::Error>;
+}
+
+/// Compiler that exited with an error, with what it wrote into it's standard error.
+#[derive(Debug, Clone)]
+pub struct CompileError(pub String);
+
+impl CompileError {
+    /// Error of a compiler process that didn't exit successfully.
+    pub fn from_stderr(stderr: &[u8]) -> Self {
+        return Self(String::from_utf8_lossy(stderr).into_owned());
+    }
+}
+
+impl Display for CompileError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(&self.0)
+    }
+}
+
+impl std::error::Error for CompileError {}
+
+/// Directory shared by every compilation of a toolchain, where it keeps it's incremental and
+/// build caches.
+pub fn toolchain_dir<C: Compiler>() -> PathBuf {
+    return work_dir().join(C::NAME);
+}
+
+/// Compiles `source`, or returns the result of the last time it was compiled. Sources that only
+/// differ in their trailing whitespace are considered to be the same.
+///
+/// Compilation errors ([`CompileError`]s) are cached too, since they're just as likely to be
+/// resubmitted. Other failures (like being unable to start the compiler) aren't, so that they're
+/// retried the next time.
+pub async fn compile_cached<C: Compiler>(
+    compiler: &C,
+    source: &str,
+) -> Result<Arc<[u8]>, crate::Error> {
+    let source = normalize(source);
+    let mut hasher = DefaultHasher::new();
+    (C::NAME, &source).hash(&mut hasher);
+    let key = hasher.finish();
+
+    if let Some(result) = cache().load(key, C::NAME, &source) {
+        info!("Reusing {} compilation", C::NAME);
+        return result.map_err(crate::Error::msg);
+    }
+
+    let result = match compiler.compile(&source).await {
+        Ok(wasm) => Ok(Arc::from(wasm)),
+        Err(e) => match e.0.downcast_ref::<CompileError>() {
+            Some(e) => Err(Arc::<str>::from(e.0.as_str())),
+            None => return Err(e),
+        },
+    };
+
+    cache().store(key, C::NAME, source, result.clone());
+    return result.map_err(crate::Error::msg);
+}
+
+/// Warms up every toolchain in the background.
+pub fn warm_up() {
+    async fn warm<C: Compiler>(compiler: C) {
+        match compiler.warm_up().await {
+            Ok(()) => info!("{} toolchain is ready", C::NAME),
+            Err(e) => error!("Failed to warm up the {} toolchain: {}", C::NAME, e.0),
+        }
+    }
+
+    tokio::spawn(warm(rust::RustCompiler));
+    tokio::spawn(warm(zig::ZigCompiler));
+}
+
+fn normalize(source: &str) -> String {
+    let mut result = String::with_capacity(source.len());
+    for line in source.trim_end().lines() {
+        result.push_str(line.trim_end());
+        result.push('\n');
+    }
+    return result;
+}
+
+type CompileResult = Result<Arc<[u8]>, Arc<str>>;
+
+/// Compiled programs, evicting the least recently used one once it's full.
+#[derive(Debug, Default)]
+struct WasmCache {
+    inner: Mutex<WasmCacheInner>,
+}
+
+#[derive(Debug, Default)]
+struct WasmCacheInner {
+    tick: u64,
+    entries: HashMap<u64, CacheEntry>,
+}
+
+#[derive(Debug)]
+struct CacheEntry {
+    last_use: u64,
+    toolchain: &'static str,
+    source: String,
+    result: CompileResult,
+}
+
+impl WasmCache {
+    fn load(&self, key: u64, toolchain: &'static str, source: &str) -> Option<CompileResult> {
+        let mut inner = self.inner.lock().unwrap_or_else(PoisonError::into_inner);
+        inner.tick += 1;
+
+        let tick = inner.tick;
+        let entry = inner.entries.get_mut(&key)?;
+        // Hash collisions are resolved in favour of the newest source
+        if entry.toolchain != toolchain || entry.source != source {
+            return None;
+        }
+
+        entry.last_use = tick;
+        return Some(entry.result.clone());
+    }
+
+    fn store(&self, key: u64, toolchain: &'static str, source: String, result: CompileResult) {
+        let mut inner = self.inner.lock().unwrap_or_else(PoisonError::into_inner);
+        inner.tick += 1;
+
+        if inner.entries.len() >= CACHE_CAPACITY && !inner.entries.contains_key(&key) {
+            let oldest = inner
+                .entries
+                .iter()
+                .min_by_key(|(_, entry)| entry.last_use)
+                .map(|(key, _)| *key);
+
+            if let Some(oldest) = oldest {
+                inner.entries.remove(&oldest);
+            }
+        }
+
+        let last_use = inner.tick;
+        inner.entries.insert(
+            key,
+            CacheEntry {
+                last_use,
+                toolchain,
+                source,
+                result,
+            },
+        );
+    }
+}
+
+fn cache() -> &'static WasmCache {
+    static CACHE: OnceLock<WasmCache> = OnceLock::new();
+    return CACHE.get_or_init(WasmCache::default);
 }
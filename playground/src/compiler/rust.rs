@@ -1,57 +1,72 @@
-use super::Compiler;
-use crate::tmp::{TmpFile, TmpPath};
+use super::{toolchain_dir, CompileError, Compiler};
+use crate::tmp::{work_dir, TmpPath};
 use color_eyre::Report;
 use std::process::Stdio;
 use tokio::io::AsyncWriteExt;
 
+const PRELUDE: &str =
+    "#![no_std]\n#[panic_handler]\nfn panic(_:&core::panic::PanicInfo) -> ! { loop {} }";
+
 #[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash, Default)]
 pub struct RustCompiler;
 
 impl Compiler for RustCompiler {
+    const NAME: &'static str = "rust";
+
     async fn compile(&self, source: &str) -> Result<Vec<u8>, crate::Error> {
-        let source = format!("#![no_std]\n#[panic_handler]\nfn panic(_:&core::panic::PanicInfo) -> ! {{ loop {{}} }}{source}");
-
-        let mut tmp_file = TmpFile::new("rs").await?;
-        tmp_file.write_all(source.as_bytes()).await?;
-
-        let file_name = tmp_file
-            .path()
-            .file_name()
-            .ok_or_else(|| Report::msg("File name not found"))?;
-
-        let parent_dir = tmp_file
-            .path()
-            .parent()
-            .ok_or_else(|| Report::msg("Parent directory not found"))?;
-
-        let output = tokio::process::Command::new("rustc")
-            .arg(file_name)
-            .args([
-                "--crate-type",
-                "cdylib",
-                "-C",
-                "opt-level=s",
-                "--target",
-                "wasm32-unknown-unknown",
-                "--out-dir",
-                ".",
-            ])
-            .kill_on_drop(true)
-            .stderr(Stdio::piped())
-            .current_dir(parent_dir)
-            .output()
-            .await?;
-
-        if !output.status.success() {
-            let message = String::from_utf8_lossy(&output.stderr);
-            return Err(color_eyre::Report::msg(message.into_owned()).into());
-        }
-
-        let target_path = tmp_file.drop_handle().await?;
-        let target_wasm_path = TmpPath::from(target_path.with_extension("wasm"));
-        let content = tokio::fs::read(&target_wasm_path).await?;
-
-        drop(target_wasm_path);
-        return Ok(content);
+        return rustc(&format!("{PRELUDE}{source}")).await;
+    }
+
+    async fn warm_up(&self) -> Result<(), crate::Error> {
+        return rustc(PRELUDE).await.map(drop);
+    }
+}
+
+/// Compiles `source`, which is piped into `rustc`.
+///
+/// Every program is compiled as the same crate, so that they all share the incremental cache
+/// in the [`toolchain_dir`], and near-repeat sources only recompile what changed.
+async fn rustc(source: &str) -> Result<Vec<u8>, crate::Error> {
+    let incremental = toolchain_dir::<RustCompiler>().join("incremental");
+    tokio::fs::create_dir_all(&incremental).await?;
+
+    let target_wasm_path =
+        TmpPath::from(work_dir().join(format!("{}.wasm", rand::random::<u64>())));
+
+    let mut child = tokio::process::Command::new("rustc")
+        .arg("-")
+        .args([
+            "--crate-type",
+            "cdylib",
+            "--crate-name",
+            "playground",
+            "-C",
+            "opt-level=s",
+            "--target",
+            "wasm32-unknown-unknown",
+        ])
+        .arg("-C")
+        .arg(format!("incremental={}", incremental.display()))
+        .arg("-o")
+        .arg(&target_wasm_path)
+        .kill_on_drop(true)
+        .stdin(Stdio::piped())
+        .stderr(Stdio::piped())
+        .spawn()?;
+
+    let mut stdin = child
+        .stdin
+        .take()
+        .ok_or_else(|| Report::msg("Standard input not found"))?;
+    stdin.write_all(source.as_bytes()).await?;
+    drop(stdin);
+
+    let output = child.wait_with_output().await?;
+    if !output.status.success() {
+        return Err(CompileError::from_stderr(&output.stderr).into());
     }
+
+    let content = tokio::fs::read(&target_wasm_path).await?;
+    drop(target_wasm_path);
+    return Ok(content);
 }
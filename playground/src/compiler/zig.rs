@@ -1,4 +1,4 @@
-use super::Compiler;
+use super::{toolchain_dir, CompileError, Compiler};
 use crate::tmp::{TmpFile, TmpPath};
 use std::process::Stdio;
 use tokio::io::AsyncWriteExt;
@@ -7,41 +7,58 @@ use tokio::io::AsyncWriteExt;
 pub struct ZigCompiler;
 
 impl Compiler for ZigCompiler {
+    const NAME: &'static str = "zig";
+
     async fn compile(&self, source: &str) -> Result<Vec<u8>, crate::Error> {
-        let mut tmp_file = TmpFile::new("zig").await?;
-        tmp_file.write_all(source.as_bytes()).await?;
-
-        let target_path = tmp_file.drop_handle().await?;
-        let target_wasm_path = TmpPath::from(target_path.with_extension("wasm"));
-
-        // zig build-lib examples/{{TEST}}/{{TEST}}.zig -target wasm32-freestanding -O ReleaseSmall -femit-bin=examples/out/{{TEST}}.wasm -dynamic -rdynamic
-        let output = tokio::process::Command::new("zig")
-            .arg("build-lib")
-            .arg(&target_path)
-            .args([
-                "-target",
-                "wasm32-freestanding",
-                "-O",
-                "ReleaseSmall",
-                "-dynamic",
-                "-rdynamic",
-            ])
-            .arg(format!("-femit-bin={}", target_wasm_path.display()))
-            .kill_on_drop(true)
-            .stderr(Stdio::piped())
-            .output()
-            .await?;
-
-        // delete ".o" file
-        drop(TmpPath::from(target_path.with_extension("wasm.o")));
-
-        if !output.status.success() {
-            let message = String::from_utf8_lossy(&output.stderr);
-            return Err(color_eyre::Report::msg(message.into_owned()).into());
-        }
-
-        let content = tokio::fs::read(&target_wasm_path).await?;
-        drop(target_wasm_path);
-        return Ok(content);
+        return zig(source).await;
+    }
+
+    async fn warm_up(&self) -> Result<(), crate::Error> {
+        return zig("").await.map(drop);
+    }
+}
+
+/// Compiles `source` with the local and global caches of the [`toolchain_dir`], so that the
+/// runtime libraries are only built once.
+async fn zig(source: &str) -> Result<Vec<u8>, crate::Error> {
+    let cache_dir = toolchain_dir::<ZigCompiler>();
+
+    let mut tmp_file = TmpFile::new("zig").await?;
+    tmp_file.write_all(source.as_bytes()).await?;
+
+    let target_path = tmp_file.drop_handle().await?;
+    let target_wasm_path = TmpPath::from(target_path.with_extension("wasm"));
+
+    // zig build-lib examples/{{TEST}}/{{TEST}}.zig -target wasm32-freestanding -O ReleaseSmall -femit-bin=examples/out/{{TEST}}.wasm -dynamic -rdynamic
+    let output = tokio::process::Command::new("zig")
+        .arg("build-lib")
+        .arg(&target_path)
+        .args([
+            "-target",
+            "wasm32-freestanding",
+            "-O",
+            "ReleaseSmall",
+            "-dynamic",
+            "-rdynamic",
+        ])
+        .arg("--cache-dir")
+        .arg(cache_dir.join("local"))
+        .arg("--global-cache-dir")
+        .arg(cache_dir.join("global"))
+        .arg(format!("-femit-bin={}", target_wasm_path.display()))
+        .kill_on_drop(true)
+        .stderr(Stdio::piped())
+        .output()
+        .await?;
+
+    // delete ".o" file
+    drop(TmpPath::from(target_path.with_extension("wasm.o")));
+
+    if !output.status.success() {
+        return Err(CompileError::from_stderr(&output.stderr).into());
     }
+
+    let content = tokio::fs::read(&target_wasm_path).await?;
+    drop(target_wasm_path);
+    return Ok(content);
 }
@@ -23,6 +23,7 @@ use crate::rate_limit::{LimitHandler, LimitInfo, RateLimit};
 
 pub mod api;
 pub mod compiler;
+pub mod pool;
 pub mod rate_limit;
 pub mod tmp;
 
@@ -41,6 +42,7 @@ async fn main() -> color_eyre::Result<()> {
         .join("web");
 
     info!("Path of the HTML file: {}", html_path.display());
+    compiler::warm_up();
 
     // build our application with a single route
     let app = Router::new()
@@ -87,10 +89,10 @@ impl<T: Into<Report>> From<T> for Error {
 impl IntoResponse for Error {
     fn into_response(self) -> axum::response::Response {
         error!("{}", self.0);
-        (
-            StatusCode::INTERNAL_SERVER_ERROR,
-            self.0.root_cause().to_string(),
-        )
-            .into_response()
+        let status = match self.0.downcast_ref::<pool::PoolError>() {
+            Some(e) => e.status(),
+            None => StatusCode::INTERNAL_SERVER_ERROR,
+        };
+        (status, self.0.root_cause().to_string()).into_response()
     }
 }
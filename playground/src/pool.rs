@@ -0,0 +1,224 @@
+//! Bounded pool of blocking threads that run the compilations, so that they never block the
+//! async runtime.
+//!
+//! Jobs wait for one of a fixed number of permits, and are rejected when too many are already
+//! waiting. A job is cancelled if it's request is dropped (e.g. because the client disconnected)
+//! before it starts, and the request fails once it's deadline passes, counting the time spent
+//! waiting in the queue. Jobs that already started run to completion, holding their permit, so
+//! the number of running compilations never goes over the size of the pool.
+
+use axum::http::StatusCode;
+use serde::Serialize;
+use std::{
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Arc,
+    },
+    time::Duration,
+};
+use tokio::{
+    sync::Semaphore,
+    time::{timeout_at, Instant},
+};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, thiserror::Error)]
+pub enum PoolError {
+    #[error("The compilation queue is full, try again later")]
+    QueueFull,
+    #[error("The compilation took too long")]
+    DeadlineExceeded,
+    #[error("The compilation panicked")]
+    Panicked,
+}
+
+impl PoolError {
+    pub fn status(self) -> StatusCode {
+        match self {
+            PoolError::QueueFull => StatusCode::SERVICE_UNAVAILABLE,
+            PoolError::DeadlineExceeded => StatusCode::GATEWAY_TIMEOUT,
+            PoolError::Panicked => StatusCode::INTERNAL_SERVER_ERROR,
+        }
+    }
+}
+
+#[derive(Debug)]
+pub struct CompilePool {
+    permits: Arc<Semaphore>,
+    workers: usize,
+    max_queued: u64,
+    deadline: Duration,
+    metrics: Arc<Metrics>,
+}
+
+/// Counters of a [`CompilePool`]. Latencies are accumulated in microseconds.
+#[derive(Debug, Default)]
+struct Metrics {
+    queued: AtomicU64,
+    running: AtomicU64,
+    completed: AtomicU64,
+    rejected: AtomicU64,
+    cancelled: AtomicU64,
+    timed_out: AtomicU64,
+    queue_micros: AtomicU64,
+    run_micros: AtomicU64,
+    max_queue_micros: AtomicU64,
+    max_run_micros: AtomicU64,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Serialize)]
+pub struct PoolMetrics {
+    pub workers: usize,
+    pub max_queued: u64,
+    pub queued: u64,
+    pub running: u64,
+    pub completed: u64,
+    pub rejected: u64,
+    pub cancelled: u64,
+    pub timed_out: u64,
+    /// Mean time spent waiting for a worker, in milliseconds
+    pub mean_queue_ms: f64,
+    pub max_queue_ms: f64,
+    /// Mean time spent compiling, in milliseconds
+    pub mean_run_ms: f64,
+    pub max_run_ms: f64,
+}
+
+impl CompilePool {
+    pub fn new(workers: usize, max_queued: u64, deadline: Duration) -> Self {
+        return Self {
+            permits: Arc::new(Semaphore::new(workers)),
+            workers,
+            max_queued,
+            deadline,
+            metrics: Arc::default(),
+        };
+    }
+
+    /// Runs `f` on one of the pool's threads once one is free.
+    pub async fn run<T: 'static + Send>(
+        &self,
+        f: impl 'static + Send + FnOnce() -> T,
+    ) -> Result<T, PoolError> {
+        let deadline = Instant::now() + self.deadline;
+        let metrics = &self.metrics;
+
+        if metrics.queued.fetch_add(1, Ordering::AcqRel) >= self.max_queued {
+            metrics.queued.fetch_sub(1, Ordering::AcqRel);
+            metrics.rejected.fetch_add(1, Ordering::Relaxed);
+            return Err(PoolError::QueueFull);
+        }
+
+        // Set when the request is dropped or times out, so that a job that hasn't started yet
+        // never does.
+        let cancelled = Arc::new(AtomicBool::new(false));
+        let mut guard = CancelGuard {
+            cancelled: cancelled.clone(),
+            metrics: metrics.clone(),
+            queued: true,
+            finished: false,
+        };
+
+        let enqueued = Instant::now();
+        let permit = match timeout_at(deadline, self.permits.clone().acquire_owned()).await {
+            Ok(permit) => permit.map_err(|_| PoolError::Panicked)?,
+            Err(_) => {
+                metrics.timed_out.fetch_add(1, Ordering::Relaxed);
+                guard.finished = true;
+                return Err(PoolError::DeadlineExceeded);
+            }
+        };
+
+        guard.queued = false;
+        metrics.queued.fetch_sub(1, Ordering::AcqRel);
+        record(
+            &metrics.queue_micros,
+            &metrics.max_queue_micros,
+            enqueued.elapsed(),
+        );
+
+        let job_metrics = metrics.clone();
+        let job = tokio::task::spawn_blocking(move || {
+            let _permit = permit;
+            if cancelled.load(Ordering::Acquire) {
+                return None;
+            }
+
+            job_metrics.running.fetch_add(1, Ordering::AcqRel);
+            let start = Instant::now();
+            let result = f();
+            job_metrics.running.fetch_sub(1, Ordering::AcqRel);
+            record(
+                &job_metrics.run_micros,
+                &job_metrics.max_run_micros,
+                start.elapsed(),
+            );
+            job_metrics.completed.fetch_add(1, Ordering::Relaxed);
+            Some(result)
+        });
+
+        let result = match timeout_at(deadline, job).await {
+            Ok(Ok(Some(result))) => Ok(result),
+            Ok(Ok(None)) | Ok(Err(_)) => Err(PoolError::Panicked),
+            Err(_) => {
+                metrics.timed_out.fetch_add(1, Ordering::Relaxed);
+                guard.finished = true;
+                return Err(PoolError::DeadlineExceeded);
+            }
+        };
+
+        guard.finished = true;
+        return result;
+    }
+
+    pub fn metrics(&self) -> PoolMetrics {
+        let metrics = &self.metrics;
+        let load = |x: &AtomicU64| x.load(Ordering::Relaxed);
+        let mean = |total: &AtomicU64, count: u64| match count {
+            0 => 0.0,
+            count => load(total) as f64 / count as f64 / 1000.0,
+        };
+
+        let completed = load(&metrics.completed);
+        let started = completed + load(&metrics.running);
+        return PoolMetrics {
+            workers: self.workers,
+            max_queued: self.max_queued,
+            queued: load(&metrics.queued),
+            running: load(&metrics.running),
+            completed,
+            rejected: load(&metrics.rejected),
+            cancelled: load(&metrics.cancelled),
+            timed_out: load(&metrics.timed_out),
+            mean_queue_ms: mean(&metrics.queue_micros, started),
+            max_queue_ms: load(&metrics.max_queue_micros) as f64 / 1000.0,
+            mean_run_ms: mean(&metrics.run_micros, completed),
+            max_run_ms: load(&metrics.max_run_micros) as f64 / 1000.0,
+        };
+    }
+}
+
+/// Cancels the job of a request that's dropped before it's done.
+struct CancelGuard {
+    cancelled: Arc<AtomicBool>,
+    metrics: Arc<Metrics>,
+    queued: bool,
+    finished: bool,
+}
+
+impl Drop for CancelGuard {
+    fn drop(&mut self) {
+        self.cancelled.store(true, Ordering::Release);
+        if self.queued {
+            self.metrics.queued.fetch_sub(1, Ordering::AcqRel);
+        }
+        if !self.finished {
+            self.metrics.cancelled.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+fn record(total: &AtomicU64, max: &AtomicU64, elapsed: Duration) {
+    let micros = u64::try_from(elapsed.as_micros()).unwrap_or(u64::MAX);
+    total.fetch_add(micros, Ordering::Relaxed);
+    max.fetch_max(micros, Ordering::Relaxed);
+}
@@ -6,6 +6,7 @@ use std::{
     ops::{Deref, DerefMut},
     path::{Path, PathBuf},
     pin::Pin,
+    sync::OnceLock,
 };
 use tokio::{
     fs::File,
@@ -25,6 +26,19 @@ macro_rules! tri {
     };
 }
 
+/// Directory where temporary files are created. It's memory backed when `/dev/shm` is available,
+/// so that sources and compiled programs are handed over without touching the disk.
+pub fn work_dir() -> &'static Path {
+    static WORK_DIR: OnceLock<PathBuf> = OnceLock::new();
+    return WORK_DIR.get_or_init(|| {
+        let shm = Path::new("/dev/shm");
+        match shm.is_dir() {
+            true => shm.join("wasm2spirv-playground"),
+            false => PathBuf::from("./.tmp"),
+        }
+    });
+}
+
 #[derive(Debug, Clone)]
 #[repr(transparent)]
 pub struct TmpPath(ManuallyDrop<PathBuf>);
@@ -73,10 +87,7 @@ pub struct TmpFile {
 
 impl TmpFile {
     pub async fn new(extension: impl AsRef<OsStr>) -> std::io::Result<Self> {
-        match tokio::fs::create_dir(".tmp/").await {
-            Err(e) if e.kind() != ErrorKind::AlreadyExists => return Err(e),
-            _ => {}
-        }
+        tokio::fs::create_dir_all(work_dir()).await?;
 
         let mut options = tokio::fs::OpenOptions::new();
         options.write(true);
@@ -85,7 +96,8 @@ impl TmpFile {
         let mut path = OsString::new();
         let inner = loop {
             path.clear();
-            path.write_fmt(format_args!("./.tmp/{}.", rand::random::<u64>()))
+            path.push(work_dir());
+            path.write_fmt(format_args!("/{}.", rand::random::<u64>()))
                 .map_err(|e| std::io::Error::new(ErrorKind::Other, e))?;
             path.push(extension.as_ref());
 
@@ -0,0 +1,629 @@
+//! Content-addressed cache of compilation results.
+//!
+//! Entries are keyed by a hash of the WebAssembly bytes, the parts of the [`Config`] that change the
+//! output, the crate's version, the enabled backends and the [`CacheFlags`], so any change on the
+//! inputs results in a different key. Options that only change how the compilation runs (like
+//! [`Config::parallel`]) aren't part of the key.
+
+use crate::{
+    config::Config,
+    error::{Error, Result},
+    version::TargetPlatform,
+    Compilation,
+};
+use docfg::docfg;
+use once_cell::unsync::OnceCell;
+use serde::Serialize;
+use std::{
+    collections::HashMap,
+    fmt::Display,
+    io::ErrorKind,
+    path::{Path, PathBuf},
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Mutex, PoisonError,
+    },
+};
+
+const FNV_OFFSET: u128 = 0x6c62272e07bb014262b821756295c58d;
+const FNV_PRIME: u128 = 0x0000000001000000000000000000013B;
+
+/// Bitmask of the backends enabled at compile time, since they change the shader outputs.
+const BACKENDS: u8 = (cfg!(feature = "spirv-tools") as u8)
+    | (cfg!(feature = "spirvcross") as u8) << 1
+    | (cfg!(feature = "naga") as u8) << 2;
+
+/// Steps applied to the compilation before it's cached.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Default)]
+pub struct CacheFlags {
+    pub validate: bool,
+    pub optimization_runs: u8,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+#[repr(transparent)]
+pub struct CacheKey(u128);
+
+impl CacheKey {
+    pub fn new(bytes: &[u8], config: &Config, flags: CacheFlags) -> Result<Self> {
+        let mut hasher = Fnv1a::new();
+        hasher.write(env!("CARGO_PKG_VERSION").as_bytes());
+        hasher.write(&[BACKENDS, flags.validate as u8, flags.optimization_runs]);
+        hasher.write_config(config)?;
+        hasher.write(bytes);
+
+        return Ok(Self(hasher.finish()));
+    }
+}
+
+impl Display for CacheKey {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "{:032x}", self.0)
+    }
+}
+
+pub(crate) struct Fnv1a(u128);
+
+impl Fnv1a {
+    pub(crate) fn new() -> Self {
+        return Self(FNV_OFFSET);
+    }
+
+    #[inline]
+    pub(crate) fn finish(&self) -> u128 {
+        self.0
+    }
+
+    /// Length-prefixed, so that consecutive fields can't collide with each other.
+    pub(crate) fn write(&mut self, bytes: &[u8]) {
+        for byte in u64::to_le_bytes(bytes.len() as u64).iter().chain(bytes) {
+            self.0 ^= *byte as u128;
+            self.0 = self.0.wrapping_mul(FNV_PRIME);
+        }
+    }
+
+    /// Writes every field of `config` that changes the compiled output. Fields are listed one by
+    /// one, so that new ones have to be accounted for here.
+    pub(crate) fn write_config(&mut self, config: &Config) -> Result<()> {
+        let Config {
+            platform,
+            features,
+            addressing_model,
+            memory_model,
+            capabilities,
+            extensions,
+            memory_grow_error,
+            bounds_checks,
+            functions,
+            parallel: _,
+            workgroup_arrays,
+            optimization,
+            spec_constants,
+            debug_info,
+        } = config;
+
+        self.write(&to_json(platform)?);
+        self.write(&to_json(features)?);
+        self.write(&to_json(addressing_model)?);
+        self.write(&to_json(memory_model)?);
+        self.write(&to_json(capabilities)?);
+        self.write(&to_json(extensions)?);
+        self.write(&to_json(memory_grow_error)?);
+        self.write(&to_json(bounds_checks)?);
+        self.write(&to_json(functions)?);
+        self.write(&to_json(workgroup_arrays)?);
+        self.write(&to_json(optimization)?);
+        self.write(&to_json(spec_constants)?);
+        self.write(&to_json(debug_info)?);
+        return Ok(());
+    }
+}
+
+fn to_json(value: &impl Serialize) -> Result<Vec<u8>> {
+    serde_json::to_vec(value).map_err(Error::custom)
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct CacheEntry {
+    pub words: Box<[u32]>,
+    pub glsl: Option<Box<str>>,
+    pub hlsl: Option<Box<str>>,
+    pub msl: Option<Box<str>>,
+    pub wgsl: Option<Box<str>>,
+}
+
+pub trait CompilationCache: Send + Sync {
+    fn load(&self, key: CacheKey) -> Result<Option<CacheEntry>>;
+
+    /// Stores an entry, replacing any previous one with the same key.
+    fn store(&self, key: CacheKey, entry: &CacheEntry) -> Result<()>;
+}
+
+/// In-memory cache that evicts the least recently used entry once it's full.
+#[derive(Debug)]
+pub struct MemoryCache {
+    capacity: usize,
+    inner: Mutex<MemoryCacheInner>,
+}
+
+#[derive(Debug, Default)]
+struct MemoryCacheInner {
+    tick: u64,
+    entries: HashMap<CacheKey, (u64, CacheEntry)>,
+}
+
+impl MemoryCache {
+    pub fn new(capacity: usize) -> Self {
+        return Self {
+            capacity,
+            inner: Mutex::default(),
+        };
+    }
+
+    pub fn len(&self) -> usize {
+        self.inner
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .entries
+            .len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+}
+
+impl CompilationCache for MemoryCache {
+    fn load(&self, key: CacheKey) -> Result<Option<CacheEntry>> {
+        let mut inner = self.inner.lock().unwrap_or_else(PoisonError::into_inner);
+        inner.tick += 1;
+
+        let tick = inner.tick;
+        return Ok(inner.entries.get_mut(&key).map(|(last_use, entry)| {
+            *last_use = tick;
+            entry.clone()
+        }));
+    }
+
+    fn store(&self, key: CacheKey, entry: &CacheEntry) -> Result<()> {
+        if self.capacity == 0 {
+            return Ok(());
+        }
+
+        let mut inner = self.inner.lock().unwrap_or_else(PoisonError::into_inner);
+        inner.tick += 1;
+
+        if !inner.entries.contains_key(&key) && inner.entries.len() >= self.capacity {
+            let lru = inner
+                .entries
+                .iter()
+                .min_by_key(|(_, (last_use, _))| *last_use)
+                .map(|(key, _)| *key);
+
+            if let Some(lru) = lru {
+                inner.entries.remove(&lru);
+            }
+        }
+
+        let tick = inner.tick;
+        inner.entries.insert(key, (tick, entry.clone()));
+        return Ok(());
+    }
+}
+
+/// On-disk cache, storing every entry as a set of `<key>.<extension>` files inside a directory.
+#[derive(Debug, Clone)]
+pub struct DiskCache {
+    path: PathBuf,
+}
+
+impl DiskCache {
+    pub fn new(path: impl Into<PathBuf>) -> Result<Self> {
+        let path = path.into();
+        std::fs::create_dir_all(&path)?;
+        return Ok(Self { path });
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    fn entry_path(&self, key: CacheKey, extension: &str) -> PathBuf {
+        self.path.join(format!("{key}.{extension}"))
+    }
+
+    fn write(&self, key: CacheKey, extension: &str, contents: &[u8]) -> Result<()> {
+        // Write to a temporary file first, so that readers never see a partial entry. Every write
+        // gets it's own file, since other threads and processes may be writing the same entry.
+        static WRITES: AtomicU64 = AtomicU64::new(0);
+        let tmp = self.entry_path(
+            key,
+            &format!(
+                "{extension}.{}.{}.tmp",
+                std::process::id(),
+                WRITES.fetch_add(1, Ordering::Relaxed)
+            ),
+        );
+        std::fs::write(&tmp, contents)?;
+        std::fs::rename(&tmp, self.entry_path(key, extension))?;
+        return Ok(());
+    }
+
+    fn read_str(&self, key: CacheKey, extension: &str) -> Result<Option<Box<str>>> {
+        match std::fs::read_to_string(self.entry_path(key, extension)) {
+            Ok(x) => Ok(Some(x.into_boxed_str())),
+            Err(e) if e.kind() == ErrorKind::NotFound => Ok(None),
+            Err(e) => Err(e.into()),
+        }
+    }
+}
+
+impl CompilationCache for DiskCache {
+    fn load(&self, key: CacheKey) -> Result<Option<CacheEntry>> {
+        let bytes = match std::fs::read(self.entry_path(key, "spv")) {
+            Ok(x) => x,
+            Err(e) if e.kind() == ErrorKind::NotFound => return Ok(None),
+            Err(e) => return Err(e.into()),
+        };
+
+        if bytes.len() % 4 != 0 {
+            return Err(Error::msg(format!("Corrupted cache entry {key}")));
+        }
+
+        let words = bytes
+            .chunks_exact(4)
+            .map(|chunk| u32::from_le_bytes([chunk[0], chunk[1], chunk[2], chunk[3]]))
+            .collect();
+
+        return Ok(Some(CacheEntry {
+            words,
+            glsl: self.read_str(key, "glsl")?,
+            hlsl: self.read_str(key, "hlsl")?,
+            msl: self.read_str(key, "msl")?,
+            wgsl: self.read_str(key, "wgsl")?,
+        }));
+    }
+
+    fn store(&self, key: CacheKey, entry: &CacheEntry) -> Result<()> {
+        let bytes = entry
+            .words
+            .iter()
+            .flat_map(|x| x.to_le_bytes())
+            .collect::<Vec<_>>();
+
+        // Shader outputs are written before the binary, which is what marks the entry as present.
+        for (extension, output) in [
+            ("glsl", &entry.glsl),
+            ("hlsl", &entry.hlsl),
+            ("msl", &entry.msl),
+            ("wgsl", &entry.wgsl),
+        ] {
+            if let Some(output) = output {
+                self.write(key, extension, output.as_bytes())?;
+            }
+        }
+
+        return self.write(key, "spv", &bytes);
+    }
+}
+
+/// Compilation backed by a [`CompilationCache`].
+///
+/// On a cache hit, neither parsing nor translation are performed, and shader outputs that were
+/// previously generated are returned as-is.
+pub struct CachedCompilation<'a> {
+    key: CacheKey,
+    platform: TargetPlatform,
+    cache: &'a dyn CompilationCache,
+    entry: CacheEntry,
+    compilation: OnceCell<Compilation>,
+}
+
+impl<'a> CachedCompilation<'a> {
+    pub fn new(
+        config: Config,
+        bytes: &[u8],
+        flags: CacheFlags,
+        cache: &'a dyn CompilationCache,
+    ) -> Result<Self> {
+        let key = CacheKey::new(bytes, &config, flags)?;
+        let platform = config.platform;
+
+        if let Some(entry) = cache.load(key)? {
+            return Ok(Self {
+                key,
+                platform,
+                cache,
+                entry,
+                compilation: OnceCell::new(),
+            });
+        }
+
+        #[allow(unused_mut)]
+        let mut compilation = Compilation::new(config, bytes)?;
+
+        if flags.validate {
+            cfg_if::cfg_if! {
+                if #[cfg(any(feature = "spvt-validate", feature = "naga-validate"))] {
+                    compilation.validate()?;
+                } else {
+                    return Err(Error::msg("Validation isn't enabled"));
+                }
+            }
+        }
+
+        for _ in 0..flags.optimization_runs {
+            cfg_if::cfg_if! {
+                if #[cfg(feature = "spirv-tools")] {
+                    compilation = compilation.into_optimized()?;
+                } else {
+                    return Err(Error::msg("Optimization isn't enabled"));
+                }
+            }
+        }
+
+        let entry = CacheEntry {
+            words: compilation.words()?.into(),
+            ..Default::default()
+        };
+        cache.store(key, &entry)?;
+
+        return Ok(Self {
+            key,
+            platform,
+            cache,
+            entry,
+            compilation: OnceCell::with_value(compilation),
+        });
+    }
+
+    pub fn key(&self) -> CacheKey {
+        self.key
+    }
+
+    pub fn words(&self) -> &[u32] {
+        &self.entry.words
+    }
+
+    pub fn entry(&self) -> &CacheEntry {
+        &self.entry
+    }
+
+    /// Underlying compilation, rebuilt from the cached binary if required.
+    pub fn compilation(&self) -> &Compilation {
+        self.compilation
+            .get_or_init(|| Compilation::from_words(self.platform, self.entry.words.clone()))
+    }
+
+    pub fn into_compilation(self) -> Compilation {
+        let Self {
+            platform,
+            entry,
+            compilation,
+            ..
+        } = self;
+
+        compilation
+            .into_inner()
+            .unwrap_or_else(|| Compilation::from_words(platform, entry.words))
+    }
+
+    #[docfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
+    pub fn glsl(&mut self) -> Result<&str> {
+        self.output(|entry| &mut entry.glsl, Compilation::glsl)
+    }
+
+    #[docfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
+    pub fn hlsl(&mut self) -> Result<&str> {
+        self.output(|entry| &mut entry.hlsl, Compilation::hlsl)
+    }
+
+    #[docfg(any(feature = "spvc-msl", feature = "naga-msl"))]
+    pub fn msl(&mut self) -> Result<&str> {
+        self.output(|entry| &mut entry.msl, Compilation::msl)
+    }
+
+    #[docfg(feature = "naga-wgsl")]
+    pub fn wgsl(&mut self) -> Result<&str> {
+        self.output(|entry| &mut entry.wgsl, Compilation::wgsl)
+    }
+
+    #[allow(unused)]
+    fn output(
+        &mut self,
+        slot: impl Fn(&mut CacheEntry) -> &mut Option<Box<str>>,
+        f: impl FnOnce(&Compilation) -> Result<String>,
+    ) -> Result<&str> {
+        if slot(&mut self.entry).is_none() {
+            let output = f(self.compilation())?.into_boxed_str();
+            *slot(&mut self.entry) = Some(output);
+            self.cache.store(self.key, &self.entry)?;
+        }
+
+        return slot(&mut self.entry)
+            .as_deref()
+            .ok_or_else(Error::unexpected);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn config() -> Config {
+        serde_json::from_str(include_str!("../examples/saxpy/saxpy.json")).unwrap()
+    }
+
+    fn key(value: u128) -> CacheKey {
+        CacheKey(value)
+    }
+
+    fn entry(word: u32) -> CacheEntry {
+        CacheEntry {
+            words: vec![word; 4].into_boxed_slice(),
+            ..Default::default()
+        }
+    }
+
+    /// Empty directory of it's own for every test, removed once it's dropped.
+    struct TempDir(PathBuf);
+
+    impl TempDir {
+        fn new(name: &str) -> Self {
+            let path = std::env::temp_dir()
+                .join(format!("wasm2spirv-cache-{name}-{}", std::process::id()));
+            let _ = std::fs::remove_dir_all(&path);
+            return Self(path);
+        }
+    }
+
+    impl Drop for TempDir {
+        fn drop(&mut self) {
+            let _ = std::fs::remove_dir_all(&self.0);
+        }
+    }
+
+    #[test]
+    fn key_is_stable() {
+        let flags = CacheFlags::default();
+        let a = CacheKey::new(b"module", &config(), flags).unwrap();
+        let b = CacheKey::new(b"module", &config(), flags).unwrap();
+        assert_eq!(a, b);
+        assert_eq!(a.to_string().len(), 32);
+    }
+
+    #[test]
+    fn key_ignores_parallel() {
+        let flags = CacheFlags::default();
+        let mut parallel = config();
+        parallel.parallel = !parallel.parallel;
+
+        assert_eq!(
+            CacheKey::new(b"module", &config(), flags).unwrap(),
+            CacheKey::new(b"module", &parallel, flags).unwrap()
+        );
+    }
+
+    #[test]
+    fn key_tracks_inputs() {
+        let flags = CacheFlags::default();
+        let base = CacheKey::new(b"module", &config(), flags).unwrap();
+
+        let mut debug_info = config();
+        debug_info.debug_info = !debug_info.debug_info;
+        let validated = CacheFlags {
+            validate: true,
+            ..flags
+        };
+
+        assert_ne!(base, CacheKey::new(b"other", &config(), flags).unwrap());
+        assert_ne!(base, CacheKey::new(b"module", &debug_info, flags).unwrap());
+        assert_ne!(
+            base,
+            CacheKey::new(b"module", &config(), validated).unwrap()
+        );
+    }
+
+    #[test]
+    fn memory_cache_evicts_least_recently_used() {
+        let cache = MemoryCache::new(2);
+        cache.store(key(1), &entry(1)).unwrap();
+        cache.store(key(2), &entry(2)).unwrap();
+
+        // Loading the first entry makes the second one the least recently used
+        assert_eq!(cache.load(key(1)).unwrap(), Some(entry(1)));
+        cache.store(key(3), &entry(3)).unwrap();
+
+        assert_eq!(cache.len(), 2);
+        assert_eq!(cache.load(key(1)).unwrap(), Some(entry(1)));
+        assert_eq!(cache.load(key(2)).unwrap(), None);
+        assert_eq!(cache.load(key(3)).unwrap(), Some(entry(3)));
+
+        // Replacing an entry never evicts another one
+        cache.store(key(3), &entry(4)).unwrap();
+        assert_eq!(cache.len(), 2);
+        assert_eq!(cache.load(key(3)).unwrap(), Some(entry(4)));
+    }
+
+    #[test]
+    fn memory_cache_without_capacity_is_empty() {
+        let cache = MemoryCache::new(0);
+        cache.store(key(1), &entry(1)).unwrap();
+        assert!(cache.is_empty());
+        assert_eq!(cache.load(key(1)).unwrap(), None);
+    }
+
+    #[test]
+    fn disk_cache_round_trip() {
+        let dir = TempDir::new("round-trip");
+        let cache = DiskCache::new(&dir.0).unwrap();
+        let entry = CacheEntry {
+            words: vec![0x07230203, 0x00010000, 1, 2, 0].into_boxed_slice(),
+            glsl: Some("void main() {}".into()),
+            wgsl: Some("@compute fn main() {}".into()),
+            ..Default::default()
+        };
+
+        assert_eq!(cache.load(key(1)).unwrap(), None);
+        cache.store(key(1), &entry).unwrap();
+        assert_eq!(cache.load(key(1)).unwrap(), Some(entry.clone()));
+
+        // A new cache over the same directory sees the same entries
+        let reopened = DiskCache::new(&dir.0).unwrap();
+        assert_eq!(reopened.load(key(1)).unwrap(), Some(entry));
+        assert_eq!(reopened.load(key(2)).unwrap(), None);
+    }
+
+    #[test]
+    fn disk_cache_leaves_no_temporary_files() {
+        let dir = TempDir::new("temporary");
+        let cache = DiskCache::new(&dir.0).unwrap();
+        let entry = CacheEntry {
+            glsl: Some("void main() {}".into()),
+            ..entry(1)
+        };
+
+        cache.store(key(1), &entry).unwrap();
+        cache.store(key(1), &entry).unwrap();
+
+        let mut files = std::fs::read_dir(&dir.0)
+            .unwrap()
+            .map(|x| x.unwrap().file_name().to_string_lossy().into_owned())
+            .collect::<Vec<_>>();
+        files.sort();
+
+        assert_eq!(
+            files,
+            [format!("{}.glsl", key(1)), format!("{}.spv", key(1))]
+        );
+    }
+
+    #[test]
+    fn disk_cache_concurrent_writers() {
+        let dir = TempDir::new("concurrent");
+        let cache = DiskCache::new(&dir.0).unwrap();
+        let entry = entry(1);
+
+        // Writers of the same entry on different threads never share a temporary file
+        std::thread::scope(|s| {
+            for _ in 0..8 {
+                s.spawn(|| {
+                    for _ in 0..16 {
+                        cache.store(key(1), &entry).unwrap();
+                    }
+                });
+            }
+        });
+
+        assert_eq!(cache.load(key(1)).unwrap(), Some(entry));
+        assert_eq!(std::fs::read_dir(&dir.0).unwrap().count(), 1);
+    }
+
+    #[test]
+    fn disk_cache_rejects_corrupted_entries() {
+        let dir = TempDir::new("corrupted");
+        let cache = DiskCache::new(&dir.0).unwrap();
+        std::fs::write(cache.entry_path(key(1), "spv"), [0u8; 5]).unwrap();
+        assert!(cache.load(key(1)).is_err());
+    }
+}
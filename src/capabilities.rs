@@ -13,7 +13,8 @@ pub fn instruction_capabilities<'a>(
     opcode.chain(operands)
 }
 
-fn operand_capabilities(op: &Operand) -> Vec<Capability> {
+/// Capabilities required by an operand, regardless of the instruction it belongs to.
+pub fn operand_capabilities(op: &Operand) -> Vec<Capability> {
     use Operand::*;
 
     match op {
@@ -88,7 +89,7 @@ fn execution_mode_capabilities(execution_mode: ExecutionMode) -> Vec<Capability>
             vec![Capability::Shader]
         }
         LocalSizeHint => vec![Capability::Kernel],
-        LocalSize => Vec::new(),
+        LocalSize | LocalSizeId => Vec::new(),
         other => {
             warn!("Not yet implemented execution mode: {other:?}");
             return Vec::new();
@@ -2,18 +2,40 @@ use clap::Parser;
 use color_eyre::{Report, Result};
 #[cfg(feature = "tree-sitter")]
 use colored::{Color, Colorize};
-use std::{fs::File, io::BufReader, path::PathBuf};
+use memmap2::Mmap;
+use serde::Deserialize;
+use std::{
+    fs::File,
+    io::{BufReader, BufWriter},
+    ops::Deref,
+    path::{Path, PathBuf},
+};
 use tracing::info;
+use tracing_subscriber::{filter::LevelFilter, fmt, prelude::*};
 #[cfg(feature = "tree-sitter")]
 use tree_sitter_highlight::{Highlight, HighlightConfiguration, HighlightEvent, Highlighter};
-use wasm2spirv::{config::Config, Compilation};
+use wasm2spirv::{
+    config::{Config, OptimizationLevel},
+    fg::module::ModuleBuilder,
+    timings::{CountingAllocator, Timings},
+    Compilation,
+};
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
 
 /// Simple program to greet a person
 #[derive(Parser, Debug)]
 #[command(author, version, about, long_about = None)]
 struct Cli {
     /// File to be converted. Has to be a WebAssembly text or binary file
-    source: PathBuf,
+    #[arg(required_unless_present = "manifest")]
+    source: Option<PathBuf>,
+
+    /// Compile every entry of a JSON manifest (a list of `{ "source", "config", "output" }` objects,
+    /// with paths relative to the manifest) on a pool of worker threads
+    #[arg(long, conflicts_with_all = ["source", "from_wasm", "from_json", "output"])]
+    manifest: Option<PathBuf>,
 
     /// Import compilation configuration from a custom section on the WebAssemly program itself
     #[arg(long, default_value_t = false)]
@@ -31,17 +53,40 @@ struct Cli {
     #[arg(long, short, default_value_t = false)]
     quiet: bool,
 
+    /// Prints the wall time, instruction count and allocation count of every compilation phase
+    /// to the standard error once done
+    #[arg(long, default_value_t = false)]
+    timings: bool,
+
+    /// Builds function bodies on multiple threads
+    #[arg(long, default_value_t = false)]
+    parallel: bool,
+
+    /// Carries the function names, local names and code offsets of the module over as debug info
+    #[arg(long, short = 'g', default_value_t = false)]
+    debug_info: bool,
+
+    /// Directory where compilation results are cached, keyed by their inputs
+    #[cfg(feature = "cache")]
+    #[arg(long)]
+    cache_dir: Option<PathBuf>,
+
     /// When printing to the standard output, syntax highlights will be added.
     /// (Currently, it only works for assembly and GLSL outputs)
     #[arg(long)]
     #[cfg(feature = "tree-sitter")]
     highlight: bool,
 
-    /// Optimizes the compiled result
+    /// Optimizes the compiled result (same as `--opt-level 2`)
     #[cfg(feature = "spirv-tools")]
     #[arg(long, short = 'O', default_value_t = false)]
     optimize: bool,
 
+    /// Optimization level. 1 runs the built-in passes over the function graph, and 2 also runs
+    /// the SPIR-V Tools optimizer on the compiled result
+    #[arg(long, default_value_t = 0, value_parser = clap::value_parser!(u8).range(0..=2))]
+    opt_level: u8,
+
     /// Validates the resulting SPIR-V
     #[cfg(any(feature = "naga-validate", feature = "spvt-validate"))]
     #[arg(long, default_value_t = false)]
@@ -77,14 +122,21 @@ pub fn main() -> color_eyre::Result<()> {
 
     let Cli {
         source,
+        manifest,
         from_wasm,
         from_json,
         output,
         quiet,
+        timings,
+        parallel,
+        debug_info,
+        #[cfg(feature = "cache")]
+        cache_dir,
         #[cfg(feature = "tree-sitter")]
         highlight,
         #[cfg(feature = "spirv-tools")]
         optimize,
+        opt_level,
         #[cfg(any(feature = "naga-validate", feature = "spvt-validate"))]
         validate,
         show_asm,
@@ -98,11 +150,45 @@ pub fn main() -> color_eyre::Result<()> {
         show_wgsl,
     } = Cli::parse();
 
-    #[cfg(not(feature = "spirv-tools"))]
-    let optimize = false;
+    #[cfg(feature = "spirv-tools")]
+    let opt_level = match optimize {
+        true => opt_level.max(2),
+        false => opt_level,
+    };
+
+    let optimization = match opt_level {
+        0 => OptimizationLevel::None,
+        _ => OptimizationLevel::Basic,
+    };
 
-    if !quiet {
-        tracing_subscriber::fmt::try_init().map_err(Report::msg)?;
+    let optimize = opt_level >= 2;
+    #[cfg(not(feature = "spirv-tools"))]
+    if optimize {
+        return Err(Report::msg(
+            "Optimization level 2 requires the 'spirv-tools' feature",
+        ));
+    }
+    #[cfg(not(any(feature = "naga-validate", feature = "spvt-validate")))]
+    let validate = false;
+
+    let recorded = Timings::new();
+    tracing_subscriber::registry()
+        .with((!quiet).then(|| fmt::layer().with_filter(LevelFilter::INFO)))
+        .with(timings.then(|| recorded.layer()))
+        .try_init()
+        .map_err(Report::msg)?;
+
+    let _report = TimingReport(timings.then_some(recorded));
+
+    if let Some(manifest) = manifest {
+        return compile_manifest(
+            &manifest,
+            optimization,
+            parallel,
+            debug_info,
+            validate,
+            optimize,
+        );
     }
 
     let mut config: Config = match (from_wasm, from_json) {
@@ -123,23 +209,83 @@ pub fn main() -> color_eyre::Result<()> {
         }
     };
 
-    let bytes = wat::parse_file(source)?;
+    config.parallel |= parallel;
+    config.debug_info |= debug_info;
+    config.optimization = config.optimization.max(optimization);
+
+    let bytes = load_source(&source.ok_or_else(|| Report::msg("No source file provided"))?)?;
+
+    #[cfg(not(feature = "tree-sitter"))]
+    let highlight = false;
+    #[cfg(not(any(feature = "spvc-glsl", feature = "naga-glsl")))]
+    let show_glsl = false;
+    #[cfg(not(any(feature = "spvc-hlsl", feature = "naga-hlsl")))]
+    let show_hlsl = false;
+    #[cfg(not(any(feature = "spvc-msl", feature = "naga-msl")))]
+    let show_msl = false;
+    #[cfg(not(feature = "naga-wgsl"))]
+    let show_wgsl = false;
+
+    #[cfg(feature = "cache")]
+    if let Some(cache_dir) = cache_dir {
+        use wasm2spirv::cache::{CacheFlags, CachedCompilation, DiskCache};
+
+        let cache = DiskCache::new(cache_dir)?;
+        let flags = CacheFlags {
+            #[cfg(any(feature = "naga-validate", feature = "spvt-validate"))]
+            validate,
+            optimization_runs: optimize as u8,
+            ..Default::default()
+        };
+
+        #[allow(unused_mut)]
+        let mut compilation = CachedCompilation::new(config, &bytes, flags, &cache)?;
+
+        if show_asm {
+            print_asm(compilation.compilation().assembly()?, highlight)?;
+        }
+
+        if let Some(output) = output {
+            std::fs::write(output, compilation.compilation().bytes()?)?;
+        }
+
+        #[cfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
+        if show_glsl {
+            print_glsl(compilation.glsl()?, highlight)?;
+        }
+
+        #[cfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
+        if show_hlsl {
+            print_hlsl(compilation.hlsl()?, highlight)?;
+        }
+
+        #[cfg(any(feature = "spvc-msl", feature = "naga-msl"))]
+        if show_msl {
+            print_msl(compilation.msl()?, highlight)?;
+        }
+
+        #[cfg(feature = "naga-wgsl")]
+        if show_wgsl {
+            println!("{}", compilation.wgsl()?);
+        }
+
+        return Ok(());
+    }
+
+    // When the binary is the only thing asked for, it's sections are written into the output
+    // file straight from the buffers they were emitted into, instead of being assembled first.
+    if !(show_asm || validate || optimize || show_glsl || show_hlsl || show_msl || show_wgsl) {
+        let builder = ModuleBuilder::new(config, &bytes)?.translate()?;
+        if let Some(output) = output {
+            builder.assemble_to(BufWriter::new(File::create(output)?))?;
+        }
+        return Ok(());
+    }
+
     let mut compilation = Compilation::new(config, &bytes)?;
 
     if show_asm && !optimize {
-        cfg_if::cfg_if! {
-            if #[cfg(feature = "tree-sitter")] {
-                use tree_sitter_asm::HIGHLIGHTS_QUERY;
-                print_to_stdout(
-                    tree_sitter_asm::language,
-                    HIGHLIGHTS_QUERY,
-                    highlight,
-                    compilation.assembly()?,
-                )?;
-            } else {
-                println!("{}", compilation.assembly()?);
-            }
-        }
+        print_asm(compilation.assembly()?, highlight)?;
     }
 
     #[cfg(any(feature = "naga-validate", feature = "spvt-validate"))]
@@ -153,74 +299,26 @@ pub fn main() -> color_eyre::Result<()> {
     }
 
     if show_asm && optimize {
-        cfg_if::cfg_if! {
-            if #[cfg(feature = "tree-sitter")] {
-                use tree_sitter_asm::HIGHLIGHTS_QUERY;
-                print_to_stdout(
-                    tree_sitter_asm::language,
-                    HIGHLIGHTS_QUERY,
-                    highlight,
-                    compilation.assembly()?,
-                )?;
-            } else {
-                println!("{}", compilation.assembly()?);
-            }
-        }
+        print_asm(compilation.assembly()?, highlight)?;
     }
 
     if let Some(output) = output {
-        let bytes = compilation.bytes()?;
-        std::fs::write(output, &bytes)?;
+        std::fs::write(output, compilation.bytes()?)?;
     }
 
     #[cfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
     if show_glsl {
-        cfg_if::cfg_if! {
-            if #[cfg(feature = "tree-sitter")] {
-                use tree_sitter_glsl::HIGHLIGHTS_QUERY;
-                print_to_stdout(
-                    tree_sitter_glsl::language,
-                    HIGHLIGHTS_QUERY,
-                    highlight,
-                    compilation.glsl()?,
-                )?;
-            } else {
-                println!("{}", compilation.glsl()?);
-            }
-        }
+        print_glsl(&compilation.glsl()?, highlight)?;
     }
 
     #[cfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
     if show_hlsl {
-        cfg_if::cfg_if! {
-            if #[cfg(feature = "tree-sitter")] {
-                print_to_stdout(
-                    tree_sitter_hlsl::language,
-                    include_str!("../queries/hlsl-highlights.scm"),
-                    highlight,
-                    compilation.hlsl()?,
-                )?;
-            } else {
-                println!("{}", compilation.hlsl()?);
-            }
-        }
+        print_hlsl(&compilation.hlsl()?, highlight)?;
     }
 
     #[cfg(any(feature = "spvc-msl", feature = "naga-msl"))]
     if show_msl {
-        cfg_if::cfg_if! {
-            if #[cfg(feature = "tree-sitter")] {
-                use tree_sitter_c::HIGHLIGHT_QUERY;
-                print_to_stdout(
-                    tree_sitter_c::language,
-                    HIGHLIGHT_QUERY,
-                    highlight,
-                    compilation.msl()?,
-                )?;
-            } else {
-                println!("{}", compilation.msl()?);
-            }
-        }
+        print_msl(&compilation.msl()?, highlight)?;
     }
 
     #[cfg(feature = "naga-wgsl")]
@@ -231,6 +329,201 @@ pub fn main() -> color_eyre::Result<()> {
     return Ok(());
 }
 
+/// Contents of a source file. Binary modules are mapped into memory as they are, and only text
+/// modules are parsed into a buffer.
+enum Source {
+    Mapped(Mmap),
+    Parsed(Vec<u8>),
+}
+
+impl Deref for Source {
+    type Target = [u8];
+
+    fn deref(&self) -> &Self::Target {
+        match self {
+            Source::Mapped(x) => x,
+            Source::Parsed(x) => x,
+        }
+    }
+}
+
+fn load_source(path: &Path) -> Result<Source> {
+    let file = File::open(path)?;
+    // Empty files can't be mapped on every platform
+    if file.metadata()?.len() == 0 {
+        return Ok(Source::Parsed(wat::parse_bytes(&[])?.into_owned()));
+    }
+
+    // SAFETY: the source file isn't expected to be modified while it's being compiled
+    let map = unsafe { Mmap::map(&file)? };
+    if map.starts_with(b"\0asm") {
+        return Ok(Source::Mapped(map));
+    }
+
+    return Ok(Source::Parsed(wat::parse_bytes(&map)?.into_owned()));
+}
+
+/// Prints the recorded timings once the compilation is done, whether it succeeded or not.
+struct TimingReport(Option<Timings>);
+
+impl Drop for TimingReport {
+    fn drop(&mut self) {
+        if let Some(timings) = &self.0 {
+            eprint!("{timings}");
+        }
+    }
+}
+
+#[derive(Debug, Deserialize)]
+struct ManifestEntry {
+    source: PathBuf,
+    config: PathBuf,
+    output: PathBuf,
+}
+
+fn compile_manifest(
+    manifest: &Path,
+    optimization: OptimizationLevel,
+    parallel: bool,
+    debug_info: bool,
+    validate: bool,
+    optimize: bool,
+) -> Result<()> {
+    let root = manifest.parent().unwrap_or(Path::new(""));
+    let entries: Vec<ManifestEntry> =
+        serde_json::from_reader(BufReader::new(File::open(manifest)?))?;
+
+    let load = |entry: &ManifestEntry| -> Result<(Config, Source)> {
+        let mut file = BufReader::new(File::open(root.join(&entry.config))?);
+        let mut config: Config = serde_json::from_reader(&mut file)?;
+        config.parallel |= parallel;
+        config.debug_info |= debug_info;
+        config.optimization = config.optimization.max(optimization);
+        let bytes = load_source(&root.join(&entry.source))?;
+        Ok((config, bytes))
+    };
+
+    let mut results = Vec::with_capacity(entries.len());
+    let mut items = Vec::with_capacity(entries.len());
+    for entry in entries.iter() {
+        match load(entry) {
+            Ok(item) => {
+                results.push(None);
+                items.push(item);
+            }
+            Err(e) => results.push(Some(Err(e))),
+        }
+    }
+
+    let mut compilations = Compilation::batch_with(
+        items
+            .iter()
+            .map(|(config, bytes)| (config.clone(), bytes.deref())),
+        || (),
+        |_, compilation| {
+            if validate {
+                #[cfg(any(feature = "naga-validate", feature = "spvt-validate"))]
+                compilation.validate()?;
+            }
+
+            if optimize {
+                #[cfg(feature = "spirv-tools")]
+                return compilation.into_optimized();
+            }
+
+            Ok(compilation)
+        },
+    )
+    .into_iter();
+
+    let mut failed = 0;
+    for (entry, result) in entries.iter().zip(results) {
+        let result = match result {
+            Some(result) => result,
+            None => compilations
+                .next()
+                .ok_or_else(|| Report::msg("Missing compilation result"))?
+                .map_err(Report::from)
+                .and_then(|compilation| {
+                    std::fs::write(root.join(&entry.output), compilation.bytes()?)?;
+                    Ok(())
+                }),
+        };
+
+        match result {
+            Ok(()) => info!("{} -> {}", entry.source.display(), entry.output.display()),
+            Err(e) => {
+                failed += 1;
+                eprintln!("{}: {e}", entry.source.display());
+            }
+        }
+    }
+
+    if failed > 0 {
+        return Err(Report::msg(format!(
+            "{failed} out of {} compilations failed",
+            entries.len()
+        )));
+    }
+
+    return Ok(());
+}
+
+fn print_asm(asm: &str, #[allow(unused)] highlight: bool) -> color_eyre::Result<()> {
+    cfg_if::cfg_if! {
+        if #[cfg(feature = "tree-sitter")] {
+            use tree_sitter_asm::HIGHLIGHTS_QUERY;
+            print_to_stdout(tree_sitter_asm::language, HIGHLIGHTS_QUERY, highlight, asm)
+        } else {
+            println!("{asm}");
+            Ok(())
+        }
+    }
+}
+
+#[cfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
+fn print_glsl(glsl: &str, #[allow(unused)] highlight: bool) -> color_eyre::Result<()> {
+    cfg_if::cfg_if! {
+        if #[cfg(feature = "tree-sitter")] {
+            use tree_sitter_glsl::HIGHLIGHTS_QUERY;
+            print_to_stdout(tree_sitter_glsl::language, HIGHLIGHTS_QUERY, highlight, glsl)
+        } else {
+            println!("{glsl}");
+            Ok(())
+        }
+    }
+}
+
+#[cfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
+fn print_hlsl(hlsl: &str, #[allow(unused)] highlight: bool) -> color_eyre::Result<()> {
+    cfg_if::cfg_if! {
+        if #[cfg(feature = "tree-sitter")] {
+            print_to_stdout(
+                tree_sitter_hlsl::language,
+                include_str!("../queries/hlsl-highlights.scm"),
+                highlight,
+                hlsl,
+            )
+        } else {
+            println!("{hlsl}");
+            Ok(())
+        }
+    }
+}
+
+#[cfg(any(feature = "spvc-msl", feature = "naga-msl"))]
+fn print_msl(msl: &str, #[allow(unused)] highlight: bool) -> color_eyre::Result<()> {
+    cfg_if::cfg_if! {
+        if #[cfg(feature = "tree-sitter")] {
+            use tree_sitter_c::HIGHLIGHT_QUERY;
+            print_to_stdout(tree_sitter_c::language, HIGHLIGHT_QUERY, highlight, msl)
+        } else {
+            println!("{msl}");
+            Ok(())
+        }
+    }
+}
+
 #[cfg(feature = "tree-sitter")]
 fn print_to_stdout(
     language: impl FnOnce() -> tree_sitter::Language,
@@ -0,0 +1,170 @@
+//! Generation of several shading languages from a single compilation, each one on it's own thread.
+
+use crate::{
+    error::{Error, Result},
+    parallel, Compilation,
+};
+use serde::{Deserialize, Serialize};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Serialize, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub enum ShadingLanguage {
+    Glsl,
+    Hlsl,
+    Msl,
+    Wgsl,
+}
+
+impl ShadingLanguage {
+    pub const ALL: [ShadingLanguage; 4] = [Self::Glsl, Self::Hlsl, Self::Msl, Self::Wgsl];
+
+    /// Whether the language is generated from naga's IR (instead of by SPIR-V Cross).
+    pub fn uses_naga(self) -> bool {
+        match self {
+            ShadingLanguage::Glsl => cfg!(all(feature = "naga-glsl", not(feature = "spvc-glsl"))),
+            ShadingLanguage::Hlsl => cfg!(all(feature = "naga-hlsl", not(feature = "spvc-hlsl"))),
+            ShadingLanguage::Msl => cfg!(all(feature = "naga-msl", not(feature = "spvc-msl"))),
+            ShadingLanguage::Wgsl => cfg!(feature = "naga-wgsl"),
+        }
+    }
+}
+
+impl Compilation {
+    /// Generates every one of `targets`, returning one result per target.
+    ///
+    /// The SPIR-V is parsed and validated into naga's IR only once, and kept for later calls,
+    /// regardless of how many targets are generated from it. Every target is then generated
+    /// concurrently, on it's own thread (SPIR-V Cross backends with a context per thread).
+    pub fn emit_all(&self, targets: &[ShadingLanguage]) -> Result<Vec<Result<String>>> {
+        let _span = tracing::info_span!("emit_all").entered();
+
+        #[cfg(feature = "naga")]
+        let naga = match targets.iter().any(|x| x.uses_naga()) {
+            true => Some(self.naga_input(targets).map_err(|e| e.to_string())),
+            false => None,
+        };
+
+        let shared = Shared {
+            words: self.words()?,
+            vulkan: self.platform.is_vulkan(),
+            #[cfg(feature = "naga")]
+            naga,
+        };
+
+        return Ok(parallel::map(targets.to_vec(), |target| {
+            shared.emit(target)
+        }));
+    }
+
+    #[cfg(feature = "naga")]
+    fn naga_input(&self, targets: &[ShadingLanguage]) -> Result<NagaInput<'_>> {
+        let (module, info) = self.naga_module()?;
+        let entry_point = match targets
+            .iter()
+            .any(|x| *x == ShadingLanguage::Glsl && x.uses_naga())
+        {
+            true => Some(self.naga_info()?),
+            false => None,
+        };
+
+        return Ok(NagaInput {
+            module,
+            info,
+            entry_point,
+        });
+    }
+}
+
+/// Parsed naga module, shared by the threads of [`Compilation::emit_all`].
+#[cfg(feature = "naga")]
+struct NagaInput<'a> {
+    module: &'a ::naga::Module,
+    info: &'a ::naga::valid::ModuleInfo,
+    #[allow(unused)]
+    entry_point: Option<(spirv::ExecutionModel, &'a str)>,
+}
+
+/// Inputs of [`Compilation::emit_all`] that, unlike the compilation itself, can be shared between
+/// threads.
+#[allow(unused)]
+struct Shared<'a> {
+    words: &'a [u32],
+    vulkan: bool,
+    /// Error messages are kept instead of errors, since the latter can't be shared between threads
+    #[cfg(feature = "naga")]
+    naga: Option<std::result::Result<NagaInput<'a>, String>>,
+}
+
+impl<'a> Shared<'a> {
+    fn emit(&self, target: ShadingLanguage) -> Result<String> {
+        match target {
+            ShadingLanguage::Glsl => {
+                let _span = tracing::info_span!("glsl").entered();
+                cfg_if::cfg_if! {
+                    if #[cfg(feature = "spvc-glsl")] {
+                        let mut ctx = spirvcross::Context::new()?;
+                        return super::spvc::glsl(&mut ctx, self.words, self.vulkan);
+                    } else if #[cfg(feature = "naga-glsl")] {
+                        let input = self.naga()?;
+                        let entry_point = input.entry_point.ok_or_else(Error::unexpected)?;
+                        return super::naga::glsl(input.module, input.info, entry_point);
+                    } else {
+                        return Err(Error::msg("No GLSL backend is enabled"));
+                    }
+                }
+            }
+
+            ShadingLanguage::Hlsl => {
+                let _span = tracing::info_span!("hlsl").entered();
+                cfg_if::cfg_if! {
+                    if #[cfg(feature = "spvc-hlsl")] {
+                        let mut ctx = spirvcross::Context::new()?;
+                        return super::spvc::hlsl(&mut ctx, self.words);
+                    } else if #[cfg(feature = "naga-hlsl")] {
+                        let input = self.naga()?;
+                        return super::naga::hlsl(input.module, input.info);
+                    } else {
+                        return Err(Error::msg("No HLSL backend is enabled"));
+                    }
+                }
+            }
+
+            ShadingLanguage::Msl => {
+                let _span = tracing::info_span!("msl").entered();
+                cfg_if::cfg_if! {
+                    if #[cfg(feature = "spvc-msl")] {
+                        let mut ctx = spirvcross::Context::new()?;
+                        return super::spvc::msl(&mut ctx, self.words);
+                    } else if #[cfg(feature = "naga-msl")] {
+                        let input = self.naga()?;
+                        return super::naga::msl(input.module, input.info);
+                    } else {
+                        return Err(Error::msg("No MSL backend is enabled"));
+                    }
+                }
+            }
+
+            ShadingLanguage::Wgsl => {
+                let _span = tracing::info_span!("wgsl").entered();
+                cfg_if::cfg_if! {
+                    if #[cfg(feature = "naga-wgsl")] {
+                        let input = self.naga()?;
+                        return super::naga::wgsl(input.module, input.info);
+                    } else {
+                        return Err(Error::msg("No WGSL backend is enabled"));
+                    }
+                }
+            }
+        }
+    }
+
+    #[cfg(feature = "naga")]
+    #[allow(unused)]
+    fn naga(&self) -> Result<&NagaInput<'a>> {
+        match &self.naga {
+            Some(Ok(input)) => Ok(input),
+            Some(Err(e)) => Err(Error::msg(e.clone())),
+            None => Err(Error::unexpected()),
+        }
+    }
+}
@@ -2,6 +2,8 @@ use docfg::docfg;
 
 use crate::error::Error;
 
+pub mod emit;
+
 #[cfg(feature = "naga")]
 pub mod naga;
 
@@ -16,91 +16,30 @@ impl Compilation {
 
     #[docfg(feature = "naga-glsl")]
     pub fn naga_glsl(&self) -> Result<String> {
-        use naga::back::glsl;
-
-        tracing::warn!("GLSL is currently on secondary support for naga.");
-        let (exec_model, name) = self.naga_info()?;
+        let entry_point = self.naga_info()?;
         let (module, info) = self.naga_module()?;
-
-        let pipeline_options = glsl::PipelineOptions {
-            shader_stage: match exec_model {
-                ExecutionModel::Vertex => naga::ShaderStage::Vertex,
-                ExecutionModel::Fragment => naga::ShaderStage::Fragment,
-                ExecutionModel::GLCompute => naga::ShaderStage::Compute,
-                other => {
-                    return Err(Error::msg(format!(
-                        "Unsupported execution model '{other:?}'"
-                    )))
-                }
-            },
-            entry_point: name.into(),
-            multiview: None,
-        };
-
-        let version = match 0 {
-            // TODO
-            _ => glsl::Version::Desktop(450),
-        };
-
-        let options = glsl::Options {
-            version,
-            ..Default::default()
-        };
-
-        let mut result = String::new();
-        let mut writer = glsl::Writer::new(
-            &mut result,
-            &module,
-            &info,
-            &options,
-            &pipeline_options,
-            BoundsCheckPolicies::default(),
-        )?;
-
-        writer.write()?;
-        return Ok(result);
+        return glsl(module, info, entry_point);
     }
 
     #[docfg(feature = "naga-hlsl")]
     pub fn naga_hlsl(&self) -> Result<String> {
-        use naga::back::hlsl;
-
         let (module, info) = self.naga_module()?;
-        let options = hlsl::Options::default();
-
-        let mut result = String::new();
-        let mut writer = hlsl::Writer::new(&mut result, &options);
-
-        writer.write(&module, &info)?;
-        return Ok(result);
+        return hlsl(module, info);
     }
 
     #[docfg(feature = "naga-msl")]
     pub fn naga_msl(&self) -> Result<String> {
-        use naga::back::msl;
-
         let (module, info) = self.naga_module()?;
-        let pipeline_options = msl::PipelineOptions::default();
-        let options = msl::Options::default();
-
-        let mut writer = msl::Writer::new(String::new());
-        writer.write(&module, &info, &options, &pipeline_options)?;
-        return Ok(writer.finish());
+        return msl(module, info);
     }
 
     #[docfg(feature = "naga-wgsl")]
     pub fn naga_wgsl(&self) -> Result<String> {
-        use naga::back::wgsl;
-
-        tracing::warn!("WGSL is currently on secondary support for naga.");
         let (module, info) = self.naga_module()?;
-
-        let mut writer = wgsl::Writer::new(String::new(), wgsl::WriterFlags::EXPLICIT_TYPES);
-        writer.write(&module, &info)?;
-        return Ok(writer.finish());
+        return wgsl(module, info);
     }
 
-    fn naga_module(&self) -> Result<&(naga::Module, naga::valid::ModuleInfo)> {
+    pub(crate) fn naga_module(&self) -> Result<&(naga::Module, naga::valid::ModuleInfo)> {
         match self.naga_module.get_or_try_init(|| {
             let options = &naga::front::spv::Options::default();
             let module =
@@ -117,7 +56,7 @@ impl Compilation {
         }
     }
 
-    fn naga_info(&self) -> Result<(ExecutionModel, &str)> {
+    pub(crate) fn naga_info(&self) -> Result<(ExecutionModel, &str)> {
         let module = self.module()?;
         if module.entry_points.len() != 1 {
             return Err(Error::msg("Exactly one entry point must be specified"));
@@ -139,3 +78,86 @@ impl Compilation {
         Ok((*execution_model, name))
     }
 }
+
+#[cfg(feature = "naga-glsl")]
+pub(crate) fn glsl(
+    module: &naga::Module,
+    info: &valid::ModuleInfo,
+    (exec_model, name): (ExecutionModel, &str),
+) -> Result<String> {
+    use naga::back::glsl;
+
+    tracing::warn!("GLSL is currently on secondary support for naga.");
+    let pipeline_options = glsl::PipelineOptions {
+        shader_stage: match exec_model {
+            ExecutionModel::Vertex => naga::ShaderStage::Vertex,
+            ExecutionModel::Fragment => naga::ShaderStage::Fragment,
+            ExecutionModel::GLCompute => naga::ShaderStage::Compute,
+            other => {
+                return Err(Error::msg(format!(
+                    "Unsupported execution model '{other:?}'"
+                )))
+            }
+        },
+        entry_point: name.into(),
+        multiview: None,
+    };
+
+    let version = match 0 {
+        // TODO
+        _ => glsl::Version::Desktop(450),
+    };
+
+    let options = glsl::Options {
+        version,
+        ..Default::default()
+    };
+
+    let mut result = String::new();
+    let mut writer = glsl::Writer::new(
+        &mut result,
+        module,
+        info,
+        &options,
+        &pipeline_options,
+        BoundsCheckPolicies::default(),
+    )?;
+
+    writer.write()?;
+    return Ok(result);
+}
+
+#[cfg(feature = "naga-hlsl")]
+pub(crate) fn hlsl(module: &naga::Module, info: &valid::ModuleInfo) -> Result<String> {
+    use naga::back::hlsl;
+
+    let options = hlsl::Options::default();
+
+    let mut result = String::new();
+    let mut writer = hlsl::Writer::new(&mut result, &options);
+
+    writer.write(module, info)?;
+    return Ok(result);
+}
+
+#[cfg(feature = "naga-msl")]
+pub(crate) fn msl(module: &naga::Module, info: &valid::ModuleInfo) -> Result<String> {
+    use naga::back::msl;
+
+    let pipeline_options = msl::PipelineOptions::default();
+    let options = msl::Options::default();
+
+    let mut writer = msl::Writer::new(String::new());
+    writer.write(module, info, &options, &pipeline_options)?;
+    return Ok(writer.finish());
+}
+
+#[cfg(feature = "naga-wgsl")]
+pub(crate) fn wgsl(module: &naga::Module, info: &valid::ModuleInfo) -> Result<String> {
+    use naga::back::wgsl;
+
+    tracing::warn!("WGSL is currently on secondary support for naga.");
+    let mut writer = wgsl::Writer::new(String::new(), wgsl::WriterFlags::EXPLICIT_TYPES);
+    writer.write(module, info)?;
+    return Ok(writer.finish());
+}
@@ -7,38 +7,21 @@ use std::cell::UnsafeCell;
 impl Compilation {
     #[cfg(feature = "spvc-glsl")]
     pub fn spvc_glsl(&self) -> Result<String> {
-        use spirvcross::{compiler::GlslCompiler, Compiler};
-
-        let ctx = self.spvc_context()?;
-        let res = GlslCompiler::new(ctx, self.words()?)?
-            .vulkan_semantics(self.platform.is_vulkan())?
-            .compile()?;
-
-        ctx.release_allocations();
-        return Ok(res);
+        return glsl(
+            self.spvc_context()?,
+            self.words()?,
+            self.platform.is_vulkan(),
+        );
     }
 
     #[docfg(feature = "spvc-hlsl")]
     pub fn spvc_hlsl(&self) -> Result<String> {
-        use spirvcross::{compiler::HlslCompiler, Compiler};
-
-        let ctx = self.spvc_context()?;
-        let res = HlslCompiler::new(ctx, self.words()?)?.compile()?;
-        ctx.release_allocations();
-        return Ok(res);
+        return hlsl(self.spvc_context()?, self.words()?);
     }
 
     #[docfg(feature = "spvc-msl")]
     pub fn spvc_msl(&self) -> Result<String> {
-        use spirvcross::{compiler::MslCompiler, Compiler};
-
-        let ctx = self.spvc_context()?;
-        let res = MslCompiler::new(ctx, self.words()?)?
-            .enable_point_size_builtin(true)?
-            .compile()?;
-
-        ctx.release_allocations();
-        return Ok(res);
+        return msl(self.spvc_context()?, self.words()?);
     }
 
     fn spvc_context(&self) -> Result<&mut Context, spirvcross::Error> {
@@ -51,3 +34,36 @@ impl Compilation {
         };
     }
 }
+
+#[cfg(feature = "spvc-glsl")]
+pub(crate) fn glsl(ctx: &mut Context, words: &[u32], vulkan: bool) -> Result<String> {
+    use spirvcross::{compiler::GlslCompiler, Compiler};
+
+    let res = GlslCompiler::new(ctx, words)?
+        .vulkan_semantics(vulkan)?
+        .compile()?;
+
+    ctx.release_allocations();
+    return Ok(res);
+}
+
+#[cfg(feature = "spvc-hlsl")]
+pub(crate) fn hlsl(ctx: &mut Context, words: &[u32]) -> Result<String> {
+    use spirvcross::{compiler::HlslCompiler, Compiler};
+
+    let res = HlslCompiler::new(ctx, words)?.compile()?;
+    ctx.release_allocations();
+    return Ok(res);
+}
+
+#[cfg(feature = "spvc-msl")]
+pub(crate) fn msl(ctx: &mut Context, words: &[u32]) -> Result<String> {
+    use spirvcross::{compiler::MslCompiler, Compiler};
+
+    let res = MslCompiler::new(ctx, words)?
+        .enable_point_size_builtin(true)?
+        .compile()?;
+
+    ctx.release_allocations();
+    return Ok(res);
+}
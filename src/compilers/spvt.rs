@@ -1,17 +1,23 @@
 use crate::error::{Error, Result};
+use crate::version::TargetPlatform;
 use crate::Compilation;
 use docfg::docfg;
-use once_cell::unsync::OnceCell;
-use std::mem::ManuallyDrop;
+use spirv_tools::TargetEnv;
+use std::{cell::RefCell, mem::ManuallyDrop};
 
 impl Compilation {
     #[docfg(feature = "spvt-validate")]
     pub fn spvt_validate(&self) -> Result<()> {
-        use spirv_tools::val::Validator;
+        return Toolchain::with_local(self.platform, |toolchain| {
+            self.spvt_validate_with(toolchain)
+        });
+    }
 
+    /// Validates the compilation with an already initialized toolchain.
+    #[docfg(feature = "spvt-validate")]
+    pub fn spvt_validate_with(&self, toolchain: &Toolchain) -> Result<()> {
         let res = self.validate.get_or_try_init(|| {
-            let validator = spirv_tools::val::create(Some(self.target_env));
-            Ok::<_, Error>(validator.validate(self.words()?, None).err())
+            Ok::<_, Error>(toolchain.validator.validate(self.words()?).err())
         })?;
 
         return match res {
@@ -22,14 +28,18 @@ impl Compilation {
 
     #[docfg(feature = "spirv-tools")]
     pub fn into_optimized(self) -> Result<Self> {
-        use spirv_tools::opt::Optimizer;
+        return Toolchain::with_local(self.platform, |toolchain| {
+            self.into_optimized_with(toolchain)
+        });
+    }
 
-        let mut optimizer = spirv_tools::opt::create(Some(self.target_env));
-        let optimizer = optimizer
-            .register_hlsl_legalization_passes()
-            .register_performance_passes();
+    /// Optimizes the compilation with an already initialized toolchain.
+    #[docfg(feature = "spirv-tools")]
+    pub fn into_optimized_with(self, toolchain: &Toolchain) -> Result<Self> {
+        let _span = tracing::info_span!("optimize").entered();
+        let binary = toolchain.optimizer.optimize(self.words()?)?;
 
-        let words = match optimizer.optimize(self.words()?, &mut spirv_tools_message, None)? {
+        let words = match binary {
             spirv_tools::binary::Binary::External(words) => AsRef::<[u32]>::as_ref(&words).into(),
             spirv_tools::binary::Binary::OwnedU32(words) => words,
             spirv_tools::binary::Binary::OwnedU8(bytes) => {
@@ -54,20 +64,99 @@ impl Compilation {
             }
         };
 
-        return Ok(Self {
-            platform: self.platform,
-            module: OnceCell::new(),
-            #[cfg(feature = "naga")]
-            naga_module: OnceCell::new(),
-            #[cfg(feature = "spirvcross")]
-            spvc_context: OnceCell::new(),
-            words: OnceCell::with_value(words.into_boxed_slice()),
-            #[cfg(feature = "spirv-tools")]
-            target_env: self.target_env,
-            assembly: OnceCell::new(),
-            #[cfg(feature = "spirv-tools")]
-            validate: OnceCell::new(),
-        });
+        return Ok(Self::from_words(self.platform, words));
+    }
+}
+
+/// Object-safe view of a [`spirv_tools::val::Validator`]
+trait DynValidator {
+    fn validate(&self, words: &[u32]) -> Result<(), spirv_tools::error::Error>;
+}
+
+impl<T: spirv_tools::val::Validator> DynValidator for T {
+    fn validate(&self, words: &[u32]) -> Result<(), spirv_tools::error::Error> {
+        spirv_tools::val::Validator::validate(self, words, None)
+    }
+}
+
+/// Object-safe view of a [`spirv_tools::opt::Optimizer`]
+trait DynOptimizer {
+    fn optimize(
+        &self,
+        words: &[u32],
+    ) -> Result<spirv_tools::binary::Binary, spirv_tools::error::Error>;
+}
+
+impl<T: spirv_tools::opt::Optimizer> DynOptimizer for T {
+    fn optimize(
+        &self,
+        words: &[u32],
+    ) -> Result<spirv_tools::binary::Binary, spirv_tools::error::Error> {
+        spirv_tools::opt::Optimizer::optimize(self, words, &mut spirv_tools_message, None)
+    }
+}
+
+/// Pre-initialized SPIR-V Tools validator and optimizer for a target environment.
+///
+/// Setting these up (specially registering the optimization passes) is expensive, so a toolchain is
+/// meant to be created once and reused across compilations.
+pub struct Toolchain {
+    platform: TargetPlatform,
+    target_env: TargetEnv,
+    #[cfg_attr(not(feature = "spvt-validate"), allow(dead_code))]
+    validator: Box<dyn DynValidator>,
+    optimizer: Box<dyn DynOptimizer>,
+}
+
+thread_local! {
+    /// Toolchains of the current thread, by target platform
+    static LOCAL_TOOLCHAINS: RefCell<Vec<Toolchain>> = RefCell::new(Vec::new());
+}
+
+impl Toolchain {
+    pub fn new(platform: TargetPlatform) -> Self {
+        use spirv_tools::opt::Optimizer;
+
+        let target_env = TargetEnv::from(&platform);
+        let mut optimizer = spirv_tools::opt::create(Some(target_env));
+        optimizer
+            .register_hlsl_legalization_passes()
+            .register_performance_passes();
+
+        return Self {
+            platform,
+            target_env,
+            validator: Box::new(spirv_tools::val::create(Some(target_env))),
+            optimizer: Box::new(optimizer),
+        };
+    }
+
+    /// Runs `f` with the current thread's toolchain for `platform`, creating it on first use.
+    ///
+    /// SPIR-V Tools' contexts can't be shared between threads, so this pool is what long-lived, multi-threaded
+    /// programs (like an async server) should use: every worker thread pays the setup cost only once.
+    pub fn with_local<T>(platform: TargetPlatform, f: impl FnOnce(&Toolchain) -> T) -> T {
+        LOCAL_TOOLCHAINS.with(|toolchains| {
+            let mut toolchains = toolchains.borrow_mut();
+            let i = match toolchains.iter().position(|x| x.platform == platform) {
+                Some(i) => i,
+                None => {
+                    toolchains.push(Toolchain::new(platform));
+                    toolchains.len() - 1
+                }
+            };
+            f(&toolchains[i])
+        })
+    }
+
+    #[inline]
+    pub fn platform(&self) -> TargetPlatform {
+        self.platform
+    }
+
+    #[inline]
+    pub fn target_env(&self) -> TargetEnv {
+        self.target_env
     }
 }
 
@@ -3,6 +3,7 @@
 use crate::{
     error::{Error, Result},
     fg::function::{FunctionConfig, FunctionConfigBuilder},
+    r#type::Type,
     version::TargetPlatform,
     Str,
 };
@@ -10,7 +11,7 @@ use docfg::docfg;
 use num_enum::TryFromPrimitive;
 use rspirv::spirv::{Capability, MemoryModel};
 use serde::{Deserialize, Serialize};
-use std::cell::RefCell;
+use std::sync::{PoisonError, RwLock};
 use vector_mapp::vec::VecMap;
 
 #[derive(Debug, Clone)]
@@ -30,8 +31,64 @@ pub struct Config {
     pub extensions: Box<[Str<'static>]>,
     #[serde(default)]
     pub memory_grow_error: MemoryGrowErrorKind,
+    /// Guards against accessing linear memory out of bounds
+    #[serde(default)]
+    pub bounds_checks: BoundsCheckKind,
     #[serde(default)]
     pub functions: VecMap<u32, FunctionConfig>,
+    /// Build the function bodies on multiple threads
+    #[serde(default)]
+    pub parallel: bool,
+    /// Workgroup (shared) arrays, imported by name from the `spir_workgroup` module
+    #[serde(default)]
+    pub workgroup_arrays: Box<[WorkgroupArray]>,
+    #[serde(default)]
+    pub optimization: OptimizationLevel,
+    /// Immutable globals (by index) declared as specialization constants with the given `SpecId`,
+    /// defaulting to their initial value
+    #[serde(default)]
+    pub spec_constants: VecMap<u32, u32>,
+    /// Carry the names and code offsets of the WebAssembly module over as debug info
+    #[serde(default)]
+    pub debug_info: bool,
+}
+
+/// Fixed-size array in workgroup memory, shared by all the invocations of a workgroup.
+///
+/// It's imported as a pointer to it's first element, either through an immutable global or a
+/// function without parameters.
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct WorkgroupArray {
+    pub name: Str<'static>,
+    #[serde(rename = "type")]
+    pub ty: Type,
+    pub length: u32,
+}
+
+/// Passes run over the function graph before it's translated, independently of any SPIR-V optimizer.
+#[derive(
+    Debug,
+    Clone,
+    Copy,
+    PartialEq,
+    Eq,
+    PartialOrd,
+    Ord,
+    Hash,
+    Default,
+    TryFromPrimitive,
+    Serialize,
+    Deserialize,
+)]
+#[serde(rename_all = "snake_case")]
+#[repr(u8)]
+pub enum OptimizationLevel {
+    /// Translate the function graph as-is
+    #[default]
+    None,
+    /// Redundant load and dead store elimination within basic blocks, folding of constant
+    /// branches and simplification of trivial branch chains
+    Basic,
 }
 
 #[derive(
@@ -47,6 +104,27 @@ pub enum MemoryGrowErrorKind {
     Soft,
 }
 
+/// How accesses through fat pointers (into buffers and workgroup arrays) are kept within the
+/// bounds of their array.
+///
+/// Guarded stores and atomics always land on the last element of the array when out of bounds,
+/// the same way robust buffer access is allowed to handle them. Guards are elided when the index
+/// is known to be in bounds, and computed once per block for every pair of array and index.
+#[derive(
+    Debug, Clone, Copy, PartialEq, Eq, Hash, Default, TryFromPrimitive, Serialize, Deserialize,
+)]
+#[serde(rename_all = "snake_case")]
+#[repr(u8)]
+pub enum BoundsCheckKind {
+    /// Accesses are translated as-is, so out of bounds accesses are undefined behavior
+    #[default]
+    Unchecked,
+    /// Out of bounds indices are clamped to the last element of the array
+    Clamped,
+    /// Like [`Clamped`](BoundsCheckKind::Clamped), but out of bounds loads result in zero
+    Checked,
+}
+
 #[derive(
     Debug, Clone, Copy, PartialEq, Eq, Hash, Default, TryFromPrimitive, Serialize, Deserialize,
 )]
@@ -71,24 +149,26 @@ impl AddressingModel {
     }
 }
 
-#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+#[derive(Debug, Serialize, Deserialize)]
 #[serde(rename_all = "lowercase")]
 pub enum CapabilityModel {
     /// The compilation will fail if a required capability isn't manually enabled
     Static(#[serde(default)] Box<[Capability]>),
     /// The compiler may add new capabilities whenever required.
-    Dynamic(#[serde(default)] RefCell<Vec<Capability>>),
+    Dynamic(#[serde(default)] RwLock<Vec<Capability>>),
 }
 
 impl CapabilityModel {
     pub fn dynamic(values: impl Into<Vec<Capability>>) -> Self {
-        return Self::Dynamic(RefCell::new(values.into()));
+        return Self::Dynamic(RwLock::new(values.into()));
     }
 
     pub fn iter(&mut self) -> std::slice::Iter<'_, Capability> {
         match self {
             CapabilityModel::Static(x) => x.iter(),
-            CapabilityModel::Dynamic(x) => x.get_mut().iter(),
+            CapabilityModel::Dynamic(x) => {
+                x.get_mut().unwrap_or_else(PoisonError::into_inner).iter()
+            }
         }
     }
 
@@ -100,7 +180,14 @@ impl CapabilityModel {
                 }
             }
             CapabilityModel::Dynamic(x) => {
-                let mut x = x.borrow_mut();
+                if x.read()
+                    .unwrap_or_else(PoisonError::into_inner)
+                    .contains(&capability)
+                {
+                    return Ok(());
+                }
+
+                let mut x = x.write().unwrap_or_else(PoisonError::into_inner);
                 if !x.contains(&capability) {
                     x.push(capability);
                 }
@@ -117,7 +204,7 @@ impl CapabilityModel {
                 }
             }
             CapabilityModel::Dynamic(x) => {
-                let x = x.get_mut();
+                let x = x.get_mut().unwrap_or_else(PoisonError::into_inner);
                 if !x.contains(&capability) {
                     x.push(capability);
                 }
@@ -134,11 +221,45 @@ impl IntoIterator for CapabilityModel {
     fn into_iter(self) -> Self::IntoIter {
         match self {
             CapabilityModel::Static(x) => x.into_vec().into_iter(),
-            CapabilityModel::Dynamic(x) => x.into_inner().into_iter(),
+            CapabilityModel::Dynamic(x) => x
+                .into_inner()
+                .unwrap_or_else(PoisonError::into_inner)
+                .into_iter(),
         }
     }
 }
 
+impl Clone for CapabilityModel {
+    fn clone(&self) -> Self {
+        match self {
+            CapabilityModel::Static(x) => CapabilityModel::Static(x.clone()),
+            CapabilityModel::Dynamic(x) => {
+                CapabilityModel::dynamic(x.read().unwrap_or_else(PoisonError::into_inner).clone())
+            }
+        }
+    }
+}
+
+impl PartialEq for CapabilityModel {
+    fn eq(&self, other: &Self) -> bool {
+        match (self, other) {
+            (CapabilityModel::Static(x), CapabilityModel::Static(y)) => x == y,
+            (CapabilityModel::Dynamic(x), CapabilityModel::Dynamic(y)) => {
+                if std::ptr::eq(x, y) {
+                    return true;
+                }
+
+                let x = x.read().unwrap_or_else(PoisonError::into_inner);
+                let y = y.read().unwrap_or_else(PoisonError::into_inner);
+                *x == *y
+            }
+            _ => false,
+        }
+    }
+}
+
+impl Eq for CapabilityModel {}
+
 impl Config {
     pub fn builder(
         platform: TargetPlatform,
@@ -156,6 +277,12 @@ impl Config {
             capabilities,
             extensions: extensions.into_iter().map(Into::into).collect(),
             memory_grow_error: Default::default(),
+            bounds_checks: Default::default(),
+            parallel: false,
+            workgroup_arrays: Box::default(),
+            optimization: OptimizationLevel::default(),
+            spec_constants: VecMap::new(),
+            debug_info: false,
         };
 
         return Ok(ConfigBuilder { inner });
@@ -199,11 +326,54 @@ impl ConfigBuilder {
         self
     }
 
+    pub fn set_bounds_checks(&mut self, bounds_checks: BoundsCheckKind) -> &mut Self {
+        self.inner.bounds_checks = bounds_checks;
+        self
+    }
+
     pub fn set_features(&mut self, features: WasmFeatures) -> &mut Self {
         self.inner.features = features;
         self
     }
 
+    pub fn set_parallel(&mut self, parallel: bool) -> &mut Self {
+        self.inner.parallel = parallel;
+        self
+    }
+
+    pub fn set_debug_info(&mut self, debug_info: bool) -> &mut Self {
+        self.inner.debug_info = debug_info;
+        self
+    }
+
+    pub fn set_optimization(&mut self, optimization: OptimizationLevel) -> &mut Self {
+        self.inner.optimization = optimization;
+        self
+    }
+
+    /// Declares the immutable global `global_idx` as a specialization constant.
+    pub fn set_spec_constant(&mut self, global_idx: u32, spec_id: u32) -> &mut Self {
+        self.inner.spec_constants.insert(global_idx, spec_id);
+        self
+    }
+
+    pub fn append_workgroup_array(
+        &mut self,
+        name: impl Into<Str<'static>>,
+        ty: impl Into<Type>,
+        length: u32,
+    ) -> &mut Self {
+        let mut arrays = std::mem::take(&mut self.inner.workgroup_arrays).into_vec();
+        arrays.push(WorkgroupArray {
+            name: name.into(),
+            ty: ty.into(),
+            length,
+        });
+
+        self.inner.workgroup_arrays = arrays.into_boxed_slice();
+        self
+    }
+
     pub fn function<'a>(&'a mut self, f_idx: u32) -> FunctionConfigBuilder<'a> {
         return FunctionConfigBuilder {
             inner: Default::default(),
@@ -231,6 +401,12 @@ impl ConfigBuilder {
 pub struct WasmFeatures {
     pub memory64: bool,
     pub saturating_float_to_int: bool,
+    /// 128-bit packed SIMD, lowered to SPIR-V vectors
+    #[serde(default)]
+    pub simd: bool,
+    /// Shared memory and atomics, lowered to SPIR-V atomic and barrier instructions
+    #[serde(default)]
+    pub threads: bool,
 }
 
 impl Into<wasmparser::WasmFeatures> for WasmFeatures {
@@ -238,6 +414,8 @@ impl Into<wasmparser::WasmFeatures> for WasmFeatures {
         return wasmparser::WasmFeatures {
             memory64: self.memory64,
             saturating_float_to_int: self.saturating_float_to_int,
+            simd: self.simd,
+            threads: self.threads,
             ..Default::default()
         };
     }
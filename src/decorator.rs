@@ -1,3 +1,4 @@
+use crate::emitter::Emitter;
 use rspirv::{
     dr::Operand,
     spirv::{BuiltIn, Decoration},
@@ -26,7 +27,7 @@ pub enum TypeMemberDecorator {
 }
 
 impl VariableDecorator {
-    pub fn translate(&self, target: rspirv::spirv::Word, builder: &mut rspirv::dr::Builder) {
+    pub fn translate(&self, target: rspirv::spirv::Word, builder: &mut Emitter) {
         match self {
             VariableDecorator::BuiltIn(x) => {
                 builder.decorate(target, Decoration::BuiltIn, [Operand::BuiltIn(*x)])
@@ -0,0 +1,1515 @@
+//! SPIR-V emitter that encodes every instruction straight into the words of the section of the
+//! module it belongs to. Sections are only concatenated when the module is assembled, so no
+//! instruction is ever held as anything other than it's words.
+
+use crate::{
+    capabilities::operand_capabilities,
+    error::{Error, Result},
+};
+use rspirv::{binary::Assemble, dr::Operand, grammar::CoreInstructionTable};
+use spirv::{
+    AddressingModel, Capability, Decoration, ExecutionMode, ExecutionModel, FunctionControl,
+    GroupOperation, LoopControl, MemoryAccess, MemoryModel, Op, SelectionControl, SourceLanguage,
+    StorageClass, Word,
+};
+use std::{collections::HashMap, io::Write, ops::Range};
+
+/// Words taken by the module header
+pub const HEADER_WORDS: usize = 5;
+
+/// Generator magic number registered by rspirv, which earlier versions assembled every module with
+const GENERATOR: u32 = 0x000f_0000;
+
+/// Sections of a SPIR-V module, in the order they're laid out in.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+#[repr(usize)]
+pub enum Section {
+    Capabilities,
+    Extensions,
+    ExtInstImports,
+    MemoryModel,
+    EntryPoints,
+    ExecutionModes,
+    /// `OpString` and `OpSource` instructions
+    DebugStrings,
+    /// `OpName` and `OpMemberName` instructions
+    DebugNames,
+    Annotations,
+    /// Types, constants and global variables
+    Globals,
+    Functions,
+}
+
+impl Section {
+    pub const COUNT: usize = Section::Functions as usize + 1;
+}
+
+/// Position of an id in the words of a [`Words`] buffer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct IdSlot {
+    pub offset: u32,
+    /// Whether it's the id defined by the instruction
+    pub is_result: bool,
+}
+
+/// Encoded instructions, along with the positions of their ids when they're tracked.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Words {
+    pub words: Vec<u32>,
+    pub ids: Vec<IdSlot>,
+}
+
+impl Words {
+    pub fn iter(&self) -> Instructions<'_> {
+        return Instructions {
+            words: self,
+            offset: 0,
+            id: 0,
+        };
+    }
+
+    /// Copy of the instructions in `words`, which hold the ids in `ids`.
+    pub fn slice(&self, words: Range<usize>, ids: Range<usize>) -> Words {
+        let base = words.start as u32;
+        return Words {
+            words: self.words[words].to_vec(),
+            ids: self.ids[ids]
+                .iter()
+                .map(|x| IdSlot {
+                    offset: x.offset - base,
+                    ..*x
+                })
+                .collect(),
+        };
+    }
+
+    pub fn append(&mut self, other: &Words) {
+        let base = self.words.len() as u32;
+        self.ids.extend(other.ids.iter().map(|x| IdSlot {
+            offset: x.offset + base,
+            ..*x
+        }));
+        self.words.extend_from_slice(&other.words);
+    }
+
+    /// Replaces every id by it's new value. Results without a new value are kept as they are.
+    pub fn remap(&mut self, ids: &HashMap<Word, Word>) -> Result<()> {
+        for slot in self.ids.iter() {
+            let id = &mut self.words[slot.offset as usize];
+            match (ids.get(id), slot.is_result) {
+                (Some(new_id), _) => *id = *new_id,
+                (None, true) => {}
+                (None, false) => return Err(Error::unexpected()),
+            }
+        }
+        return Ok(());
+    }
+
+    fn push_id(&mut self, id: Word, is_result: bool, track_ids: bool) {
+        if track_ids {
+            self.ids.push(IdSlot {
+                offset: self.words.len() as u32,
+                is_result,
+            });
+        }
+        self.words.push(id);
+    }
+}
+
+/// Iterator over the instructions of a [`Words`] buffer.
+#[derive(Debug, Clone)]
+pub struct Instructions<'a> {
+    words: &'a Words,
+    offset: usize,
+    id: usize,
+}
+
+impl<'a> Iterator for Instructions<'a> {
+    type Item = InstructionWords<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let buffer: &'a Words = self.words;
+        let first = *buffer.words.get(self.offset)?;
+        let end = self.offset + usize::max(1, (first >> 16) as usize);
+        let words = buffer.words.get(self.offset..end)?;
+
+        let start_id = self.id;
+        while let Some(slot) = buffer.ids.get(self.id) {
+            if slot.offset as usize >= end {
+                break;
+            }
+            self.id += 1;
+        }
+
+        let instruction = InstructionWords {
+            words,
+            ids: &buffer.ids[start_id..self.id],
+            offset: self.offset as u32,
+        };
+        self.offset = end;
+        return Some(instruction);
+    }
+}
+
+/// Words of a single instruction.
+#[derive(Debug, Clone, Copy)]
+pub struct InstructionWords<'a> {
+    pub words: &'a [u32],
+    ids: &'a [IdSlot],
+    /// Offset of the instruction into it's buffer
+    offset: u32,
+}
+
+impl<'a> InstructionWords<'a> {
+    pub fn opcode(&self) -> u32 {
+        return self.words[0] & 0xffff;
+    }
+
+    pub fn result_id(&self) -> Option<Word> {
+        let slot = self.ids.iter().find(|x| x.is_result)?;
+        return Some(self.words[(slot.offset - self.offset) as usize]);
+    }
+
+    /// Ids the instruction refers to, including it's result type, in the order they're encoded.
+    pub fn referenced_ids(&self) -> impl 'a + Iterator<Item = Word> {
+        let (words, ids, offset) = (self.words, self.ids, self.offset);
+        return ids
+            .iter()
+            .filter(|x| !x.is_result)
+            .map(move |x| words[(x.offset - offset) as usize]);
+    }
+
+    /// Literal string starting at the `index`-th word of the instruction.
+    pub fn literal_string(&self, index: usize) -> Option<String> {
+        let bytes = self
+            .words
+            .get(index..)?
+            .iter()
+            .flat_map(|x| x.to_le_bytes())
+            .take_while(|x| *x != 0)
+            .collect::<Vec<_>>();
+        return String::from_utf8(bytes).ok();
+    }
+
+    pub fn to_words(&self) -> Words {
+        return Words {
+            words: self.words.to_vec(),
+            ids: self
+                .ids
+                .iter()
+                .map(|x| IdSlot {
+                    offset: x.offset - self.offset,
+                    ..*x
+                })
+                .collect(),
+        };
+    }
+}
+
+/// Function emitted into the functions section of an [`Emitter`].
+#[derive(Debug, Clone)]
+pub struct EmittedFunction {
+    pub id: Word,
+    /// Range of the function's words in the functions section
+    pub words: Range<usize>,
+    /// Range of the function's ids in the functions section
+    pub ids: Range<usize>,
+    /// Capabilities required by the function's instructions
+    pub capabilities: Vec<Capability>,
+    pub instructions: u64,
+}
+
+/// Part of the current function, which are only joined once it ends.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Part {
+    /// `OpFunction`, it's parameters and it's first label
+    Header,
+    /// Function variables, which must all be at the start of the first block
+    Variables,
+    Body,
+}
+
+#[derive(Debug, Default)]
+struct FunctionWords {
+    id: Word,
+    header: Words,
+    variables: Words,
+    body: Words,
+    has_block: bool,
+    capabilities: Vec<Capability>,
+    instructions: u64,
+}
+
+/// Emitter of a SPIR-V module, which allocates it's ids and encodes it's instructions.
+#[derive(Debug)]
+pub struct Emitter {
+    version: u32,
+    bound: Word,
+    sections: [Words; Section::COUNT],
+    /// Whether the positions of ids are recorded, so that instructions can be moved into other modules
+    track_ids: bool,
+    function: Option<FunctionWords>,
+    functions: Vec<EmittedFunction>,
+    /// Capabilities required by the emitted instructions, in the order they were first required
+    capabilities: Vec<Capability>,
+    instructions: u64,
+}
+
+impl Emitter {
+    pub fn new() -> Self {
+        return Self {
+            version: ((spirv::MAJOR_VERSION as u32) << 16) | ((spirv::MINOR_VERSION as u32) << 8),
+            bound: 1,
+            sections: Default::default(),
+            track_ids: false,
+            function: None,
+            functions: Vec::new(),
+            capabilities: Vec::new(),
+            instructions: 0,
+        };
+    }
+
+    /// Emitter that records where every id is (see [`Words::ids`]).
+    pub fn with_tracked_ids() -> Self {
+        return Self {
+            track_ids: true,
+            ..Self::new()
+        };
+    }
+
+    pub fn set_version(&mut self, major: u8, minor: u8) {
+        self.version = ((major as u32) << 16) | ((minor as u32) << 8);
+    }
+
+    pub fn id(&mut self) -> Word {
+        let id = self.bound;
+        self.bound += 1;
+        return id;
+    }
+
+    pub fn section(&self, section: Section) -> &Words {
+        return &self.sections[section as usize];
+    }
+
+    /// Functions emitted so far, in the order they were emitted.
+    pub fn functions(&self) -> &[EmittedFunction] {
+        return &self.functions;
+    }
+
+    /// Capabilities required by every instruction emitted so far.
+    pub fn capabilities(&self) -> &[Capability] {
+        return &self.capabilities;
+    }
+
+    /// Requires `capability` for the instructions being emitted, when it doesn't follow from the
+    /// grammar alone (like the width of an atomic's operands).
+    pub fn require(&mut self, capability: Capability) {
+        match self.function.as_mut() {
+            Some(function) => require(&mut function.capabilities, [capability]),
+            None => require(&mut self.capabilities, [capability]),
+        }
+    }
+
+    pub fn instruction_count(&self) -> u64 {
+        return self.instructions;
+    }
+
+    pub fn header(&self) -> [u32; HEADER_WORDS] {
+        return [spirv::MAGIC_NUMBER, self.version, GENERATOR, self.bound, 0];
+    }
+
+    /// Number of words of the assembled module.
+    pub fn word_count(&self) -> usize {
+        return HEADER_WORDS + self.sections.iter().map(|x| x.words.len()).sum::<usize>();
+    }
+
+    /// Concatenates the header and every section into a single buffer, sized upfront.
+    pub fn assemble(self) -> Vec<u32> {
+        let mut words = Vec::with_capacity(self.word_count());
+        words.extend_from_slice(&self.header());
+        for section in self.sections.iter() {
+            words.extend_from_slice(&section.words);
+        }
+        return words;
+    }
+
+    /// Writes the module into `writer`, in native byte order (like
+    /// [`Compilation::bytes`](crate::Compilation::bytes)). The header and every section are
+    /// written straight from their buffers, without ever assembling the whole binary.
+    pub fn assemble_to(self, mut writer: impl Write) -> std::io::Result<()> {
+        writer.write_all(words_as_bytes(&self.header()))?;
+        for section in self.sections.iter() {
+            writer.write_all(words_as_bytes(&section.words))?;
+        }
+        return writer.flush();
+    }
+
+    /// Appends already encoded instructions to `section`, which require `capabilities`.
+    pub fn append(&mut self, section: Section, words: &Words, capabilities: &[Capability]) {
+        let instructions = words.iter().count() as u64;
+        let target = &mut self.sections[section as usize];
+        let (start_word, start_id) = (target.words.len(), target.ids.len());
+        target.append(words);
+
+        if section == Section::Functions {
+            self.functions.push(EmittedFunction {
+                id: words.iter().next().and_then(|x| x.result_id()).unwrap_or(0),
+                words: start_word..target.words.len(),
+                ids: start_id..target.ids.len(),
+                capabilities: capabilities.to_vec(),
+                instructions,
+            });
+        }
+
+        require(&mut self.capabilities, capabilities.iter().copied());
+        self.instructions += instructions;
+    }
+
+    fn emit(
+        &mut self,
+        section: Section,
+        op: Op,
+        result_type: Option<Word>,
+        result_id: Option<Word>,
+        operands: impl IntoIterator<Item = Operand>,
+    ) {
+        self.instructions += 1;
+        encode(
+            &mut self.sections[section as usize],
+            self.track_ids,
+            Some(&mut self.capabilities),
+            op,
+            result_type,
+            result_id,
+            operands,
+        );
+    }
+
+    fn emit_function(
+        &mut self,
+        part: Part,
+        op: Op,
+        result_type: Option<Word>,
+        result_id: Option<Word>,
+        operands: impl IntoIterator<Item = Operand>,
+    ) -> Result<()> {
+        let function = self
+            .function
+            .as_mut()
+            .ok_or_else(|| Error::msg("Instructions must be inside a function"))?;
+
+        let words = match part {
+            Part::Header => &mut function.header,
+            Part::Variables => &mut function.variables,
+            Part::Body => &mut function.body,
+        };
+
+        encode(
+            words,
+            self.track_ids,
+            Some(&mut function.capabilities),
+            op,
+            result_type,
+            result_id,
+            operands,
+        );
+        function.instructions += 1;
+        self.instructions += 1;
+        return Ok(());
+    }
+
+    /// Emits an instruction at the end of the current block.
+    pub fn instruction(
+        &mut self,
+        op: Op,
+        result_type: Option<Word>,
+        result_id: Option<Word>,
+        operands: impl IntoIterator<Item = Operand>,
+    ) -> Result<()> {
+        match &self.function {
+            Some(function) if function.has_block => {}
+            _ => return Err(Error::msg("Instructions must be inside a block")),
+        }
+        return self.emit_function(Part::Body, op, result_type, result_id, operands);
+    }
+
+    fn value(
+        &mut self,
+        op: Op,
+        result_type: Word,
+        result_id: Option<Word>,
+        operands: impl IntoIterator<Item = Operand>,
+    ) -> Result<Word> {
+        let id = result_id.unwrap_or_else(|| self.id());
+        self.instruction(op, Some(result_type), Some(id), operands)?;
+        return Ok(id);
+    }
+
+    /* MODULE */
+    pub fn capability(&mut self, capability: Capability) {
+        self.instructions += 1;
+        encode(
+            &mut self.sections[Section::Capabilities as usize],
+            self.track_ids,
+            None,
+            Op::Capability,
+            None,
+            None,
+            [Operand::Capability(capability)],
+        );
+    }
+
+    pub fn extension(&mut self, name: impl Into<String>) {
+        self.instructions += 1;
+        encode(
+            &mut self.sections[Section::Extensions as usize],
+            self.track_ids,
+            None,
+            Op::Extension,
+            None,
+            None,
+            [Operand::LiteralString(name.into())],
+        );
+    }
+
+    pub fn ext_inst_import(&mut self, name: impl Into<String>) -> Word {
+        let id = self.id();
+        self.emit(
+            Section::ExtInstImports,
+            Op::ExtInstImport,
+            None,
+            Some(id),
+            [Operand::LiteralString(name.into())],
+        );
+        return id;
+    }
+
+    pub fn memory_model(&mut self, addressing_model: AddressingModel, memory_model: MemoryModel) {
+        self.emit(
+            Section::MemoryModel,
+            Op::MemoryModel,
+            None,
+            None,
+            [
+                Operand::AddressingModel(addressing_model),
+                Operand::MemoryModel(memory_model),
+            ],
+        );
+    }
+
+    pub fn entry_point(
+        &mut self,
+        execution_model: ExecutionModel,
+        entry_point: Word,
+        name: impl Into<String>,
+        interface: impl AsRef<[Word]>,
+    ) {
+        let operands = [
+            Operand::ExecutionModel(execution_model),
+            Operand::IdRef(entry_point),
+            Operand::LiteralString(name.into()),
+        ];
+        let interface = interface.as_ref().iter().copied().map(Operand::IdRef);
+        self.emit(
+            Section::EntryPoints,
+            Op::EntryPoint,
+            None,
+            None,
+            operands.into_iter().chain(interface),
+        );
+    }
+
+    pub fn execution_mode(
+        &mut self,
+        entry_point: Word,
+        mode: ExecutionMode,
+        params: impl AsRef<[u32]>,
+    ) {
+        let operands = [Operand::IdRef(entry_point), Operand::ExecutionMode(mode)];
+        let params = params.as_ref().iter().copied().map(Operand::LiteralInt32);
+        self.emit(
+            Section::ExecutionModes,
+            Op::ExecutionMode,
+            None,
+            None,
+            operands.into_iter().chain(params),
+        );
+    }
+
+    pub fn execution_mode_id(
+        &mut self,
+        entry_point: Word,
+        mode: ExecutionMode,
+        params: impl AsRef<[Word]>,
+    ) {
+        let operands = [Operand::IdRef(entry_point), Operand::ExecutionMode(mode)];
+        let params = params.as_ref().iter().copied().map(Operand::IdRef);
+        self.emit(
+            Section::ExecutionModes,
+            Op::ExecutionModeId,
+            None,
+            None,
+            operands.into_iter().chain(params),
+        );
+    }
+
+    pub fn string(&mut self, s: impl Into<String>) -> Word {
+        let id = self.id();
+        self.emit(
+            Section::DebugStrings,
+            Op::String,
+            None,
+            Some(id),
+            [Operand::LiteralString(s.into())],
+        );
+        return id;
+    }
+
+    pub fn source(
+        &mut self,
+        source_language: SourceLanguage,
+        version: u32,
+        file: Option<Word>,
+        source: Option<impl Into<String>>,
+    ) {
+        let operands = [
+            Some(Operand::SourceLanguage(source_language)),
+            Some(Operand::LiteralInt32(version)),
+            file.map(Operand::IdRef),
+            source.map(|x| Operand::LiteralString(x.into())),
+        ];
+        self.emit(
+            Section::DebugStrings,
+            Op::Source,
+            None,
+            None,
+            operands.into_iter().flatten(),
+        );
+    }
+
+    pub fn name(&mut self, target: Word, name: impl Into<String>) {
+        self.emit(
+            Section::DebugNames,
+            Op::Name,
+            None,
+            None,
+            [Operand::IdRef(target), Operand::LiteralString(name.into())],
+        );
+    }
+
+    pub fn decorate(
+        &mut self,
+        target: Word,
+        decoration: Decoration,
+        params: impl IntoIterator<Item = Operand>,
+    ) {
+        let operands = [Operand::IdRef(target), Operand::Decoration(decoration)];
+        self.emit(
+            Section::Annotations,
+            Op::Decorate,
+            None,
+            None,
+            operands.into_iter().chain(params),
+        );
+    }
+
+    pub fn member_decorate(
+        &mut self,
+        structure: Word,
+        member: u32,
+        decoration: Decoration,
+        params: impl IntoIterator<Item = Operand>,
+    ) {
+        let operands = [
+            Operand::IdRef(structure),
+            Operand::LiteralInt32(member),
+            Operand::Decoration(decoration),
+        ];
+        self.emit(
+            Section::Annotations,
+            Op::MemberDecorate,
+            None,
+            None,
+            operands.into_iter().chain(params),
+        );
+    }
+
+    /// Declares a type, constant or global variable with a new id.
+    pub fn global(
+        &mut self,
+        op: Op,
+        result_type: Option<Word>,
+        operands: impl IntoIterator<Item = Operand>,
+    ) -> Word {
+        let id = self.id();
+        self.declare(op, result_type, id, operands);
+        return id;
+    }
+
+    /// Declares a type, constant or global variable as `result_id`.
+    pub fn declare(
+        &mut self,
+        op: Op,
+        result_type: Option<Word>,
+        result_id: Word,
+        operands: impl IntoIterator<Item = Operand>,
+    ) {
+        self.emit(Section::Globals, op, result_type, Some(result_id), operands);
+    }
+
+    pub fn spec_constant_u32(&mut self, result_type: Word, value: u32) -> Word {
+        return self.global(
+            Op::SpecConstant,
+            Some(result_type),
+            [Operand::LiteralInt32(value)],
+        );
+    }
+
+    pub fn spec_constant_u64(&mut self, result_type: Word, value: u64) -> Word {
+        return self.global(
+            Op::SpecConstant,
+            Some(result_type),
+            [Operand::LiteralInt64(value)],
+        );
+    }
+
+    pub fn spec_constant_f32(&mut self, result_type: Word, value: f32) -> Word {
+        return self.global(
+            Op::SpecConstant,
+            Some(result_type),
+            [Operand::LiteralFloat32(value)],
+        );
+    }
+
+    pub fn spec_constant_f64(&mut self, result_type: Word, value: f64) -> Word {
+        return self.global(
+            Op::SpecConstant,
+            Some(result_type),
+            [Operand::LiteralFloat64(value)],
+        );
+    }
+
+    pub fn spec_constant_composite(
+        &mut self,
+        result_type: Word,
+        constituents: impl IntoIterator<Item = Word>,
+    ) -> Word {
+        return self.global(
+            Op::SpecConstantComposite,
+            Some(result_type),
+            constituents.into_iter().map(Operand::IdRef),
+        );
+    }
+
+    /// Function variables are declared at the start of the function's first block, and every
+    /// other variable is declared as a global.
+    pub fn variable(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        storage_class: StorageClass,
+        initializer: Option<Word>,
+    ) -> Word {
+        let id = result_id.unwrap_or_else(|| self.id());
+        let operands = [
+            Some(Operand::StorageClass(storage_class)),
+            initializer.map(Operand::IdRef),
+        ];
+
+        let operands = operands.into_iter().flatten();
+
+        self.instructions += 1;
+        match self.function.as_mut() {
+            Some(function) if storage_class == StorageClass::Function => {
+                function.instructions += 1;
+                encode(
+                    &mut function.variables,
+                    self.track_ids,
+                    Some(&mut function.capabilities),
+                    Op::Variable,
+                    Some(result_type),
+                    Some(id),
+                    operands,
+                )
+            }
+            _ => encode(
+                &mut self.sections[Section::Globals as usize],
+                self.track_ids,
+                Some(&mut self.capabilities),
+                Op::Variable,
+                Some(result_type),
+                Some(id),
+                operands,
+            ),
+        }
+        return id;
+    }
+
+    /* FUNCTIONS */
+    pub fn begin_function(
+        &mut self,
+        return_type: Word,
+        function_id: Option<Word>,
+        control: FunctionControl,
+        function_type: Word,
+    ) -> Result<Word> {
+        if self.function.is_some() {
+            return Err(Error::msg("Functions can't be nested"));
+        }
+
+        let id = function_id.unwrap_or_else(|| self.id());
+        self.function = Some(FunctionWords {
+            id,
+            ..Default::default()
+        });
+
+        self.emit_function(
+            Part::Header,
+            Op::Function,
+            Some(return_type),
+            Some(id),
+            [
+                Operand::FunctionControl(control),
+                Operand::IdRef(function_type),
+            ],
+        )?;
+        return Ok(id);
+    }
+
+    pub fn function_parameter(&mut self, result_type: Word) -> Result<Word> {
+        if self.function.as_ref().is_some_and(|x| x.has_block) {
+            return Err(Error::msg(
+                "Function parameters must be declared before the function's first block",
+            ));
+        }
+
+        let id = self.id();
+        self.emit_function(
+            Part::Header,
+            Op::FunctionParameter,
+            Some(result_type),
+            Some(id),
+            [],
+        )?;
+        return Ok(id);
+    }
+
+    pub fn begin_block(&mut self, label: Option<Word>) -> Result<Word> {
+        let id = label.unwrap_or_else(|| self.id());
+        let function = self
+            .function
+            .as_mut()
+            .ok_or_else(|| Error::msg("Blocks must be inside a function"))?;
+
+        let part = match function.has_block {
+            true => Part::Body,
+            false => Part::Header,
+        };
+        function.has_block = true;
+
+        self.emit_function(part, Op::Label, None, Some(id), [])?;
+        return Ok(id);
+    }
+
+    pub fn end_function(&mut self) -> Result<()> {
+        self.emit_function(Part::Body, Op::FunctionEnd, None, None, [])?;
+        let function = self.function.take().ok_or_else(Error::unexpected)?;
+
+        let section = &mut self.sections[Section::Functions as usize];
+        let (start_word, start_id) = (section.words.len(), section.ids.len());
+        section.append(&function.header);
+        section.append(&function.variables);
+        section.append(&function.body);
+
+        require(
+            &mut self.capabilities,
+            function.capabilities.iter().copied(),
+        );
+        self.functions.push(EmittedFunction {
+            id: function.id,
+            words: start_word..section.words.len(),
+            ids: start_id..section.ids.len(),
+            capabilities: function.capabilities,
+            instructions: function.instructions,
+        });
+        return Ok(());
+    }
+
+    pub fn line(&mut self, file: Word, line: u32, column: u32) -> Result<()> {
+        return self.instruction(
+            Op::Line,
+            None,
+            None,
+            [
+                Operand::IdRef(file),
+                Operand::LiteralInt32(line),
+                Operand::LiteralInt32(column),
+            ],
+        );
+    }
+
+    pub fn load(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        pointer: Word,
+        memory_access: Option<MemoryAccess>,
+        additional_params: impl IntoIterator<Item = Operand>,
+    ) -> Result<Word> {
+        let operands = [
+            Some(Operand::IdRef(pointer)),
+            memory_access.map(Operand::MemoryAccess),
+        ];
+        return self.value(
+            Op::Load,
+            result_type,
+            result_id,
+            operands.into_iter().flatten().chain(additional_params),
+        );
+    }
+
+    pub fn store(
+        &mut self,
+        pointer: Word,
+        object: Word,
+        memory_access: Option<MemoryAccess>,
+        additional_params: impl IntoIterator<Item = Operand>,
+    ) -> Result<()> {
+        let operands = [
+            Some(Operand::IdRef(pointer)),
+            Some(Operand::IdRef(object)),
+            memory_access.map(Operand::MemoryAccess),
+        ];
+        return self.instruction(
+            Op::Store,
+            None,
+            None,
+            operands.into_iter().flatten().chain(additional_params),
+        );
+    }
+
+    pub fn copy_memory(
+        &mut self,
+        target: Word,
+        source: Word,
+        memory_access: Option<MemoryAccess>,
+        memory_access_2: Option<MemoryAccess>,
+        additional_params: impl IntoIterator<Item = Operand>,
+    ) -> Result<()> {
+        let operands = [
+            Some(Operand::IdRef(target)),
+            Some(Operand::IdRef(source)),
+            memory_access.map(Operand::MemoryAccess),
+            memory_access_2.map(Operand::MemoryAccess),
+        ];
+        return self.instruction(
+            Op::CopyMemory,
+            None,
+            None,
+            operands.into_iter().flatten().chain(additional_params),
+        );
+    }
+
+    pub fn access_chain(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        base: Word,
+        indexes: impl IntoIterator<Item = Word>,
+    ) -> Result<Word> {
+        let operands = std::iter::once(base).chain(indexes).map(Operand::IdRef);
+        return self.value(Op::AccessChain, result_type, result_id, operands);
+    }
+
+    pub fn function_call(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        function: Word,
+        arguments: impl IntoIterator<Item = Word>,
+    ) -> Result<Word> {
+        let operands = std::iter::once(function)
+            .chain(arguments)
+            .map(Operand::IdRef);
+        return self.value(Op::FunctionCall, result_type, result_id, operands);
+    }
+
+    pub fn ext_inst(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        set: Word,
+        instruction: u32,
+        operands: impl IntoIterator<Item = Operand>,
+    ) -> Result<Word> {
+        let set = [
+            Operand::IdRef(set),
+            Operand::LiteralExtInstInteger(instruction),
+        ];
+        return self.value(
+            Op::ExtInst,
+            result_type,
+            result_id,
+            set.into_iter().chain(operands),
+        );
+    }
+
+    pub fn composite_construct(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        constituents: impl IntoIterator<Item = Word>,
+    ) -> Result<Word> {
+        let operands = constituents.into_iter().map(Operand::IdRef);
+        return self.value(Op::CompositeConstruct, result_type, result_id, operands);
+    }
+
+    pub fn composite_extract(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        composite: Word,
+        indexes: impl IntoIterator<Item = u32>,
+    ) -> Result<Word> {
+        let indexes = indexes.into_iter().map(Operand::LiteralInt32);
+        return self.value(
+            Op::CompositeExtract,
+            result_type,
+            result_id,
+            std::iter::once(Operand::IdRef(composite)).chain(indexes),
+        );
+    }
+
+    pub fn composite_insert(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        object: Word,
+        composite: Word,
+        indexes: impl IntoIterator<Item = u32>,
+    ) -> Result<Word> {
+        let operands = [Operand::IdRef(object), Operand::IdRef(composite)];
+        let indexes = indexes.into_iter().map(Operand::LiteralInt32);
+        return self.value(
+            Op::CompositeInsert,
+            result_type,
+            result_id,
+            operands.into_iter().chain(indexes),
+        );
+    }
+
+    pub fn vector_shuffle(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        vector_1: Word,
+        vector_2: Word,
+        components: impl IntoIterator<Item = u32>,
+    ) -> Result<Word> {
+        let operands = [Operand::IdRef(vector_1), Operand::IdRef(vector_2)];
+        let components = components.into_iter().map(Operand::LiteralInt32);
+        return self.value(
+            Op::VectorShuffle,
+            result_type,
+            result_id,
+            operands.into_iter().chain(components),
+        );
+    }
+
+    pub fn array_length(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        structure: Word,
+        array_member: u32,
+    ) -> Result<Word> {
+        return self.value(
+            Op::ArrayLength,
+            result_type,
+            result_id,
+            [
+                Operand::IdRef(structure),
+                Operand::LiteralInt32(array_member),
+            ],
+        );
+    }
+
+    pub fn atomic_load(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        pointer: Word,
+        memory: Word,
+        semantics: Word,
+    ) -> Result<Word> {
+        return self.value(
+            Op::AtomicLoad,
+            result_type,
+            result_id,
+            [
+                Operand::IdRef(pointer),
+                Operand::IdScope(memory),
+                Operand::IdMemorySemantics(semantics),
+            ],
+        );
+    }
+
+    pub fn atomic_store(
+        &mut self,
+        pointer: Word,
+        memory: Word,
+        semantics: Word,
+        value: Word,
+    ) -> Result<()> {
+        return self.instruction(
+            Op::AtomicStore,
+            None,
+            None,
+            [
+                Operand::IdRef(pointer),
+                Operand::IdScope(memory),
+                Operand::IdMemorySemantics(semantics),
+                Operand::IdRef(value),
+            ],
+        );
+    }
+
+    #[allow(clippy::too_many_arguments)]
+    pub fn atomic_compare_exchange(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        pointer: Word,
+        memory: Word,
+        equal: Word,
+        unequal: Word,
+        value: Word,
+        comparator: Word,
+    ) -> Result<Word> {
+        return self.value(
+            Op::AtomicCompareExchange,
+            result_type,
+            result_id,
+            [
+                Operand::IdRef(pointer),
+                Operand::IdScope(memory),
+                Operand::IdMemorySemantics(equal),
+                Operand::IdMemorySemantics(unequal),
+                Operand::IdRef(value),
+                Operand::IdRef(comparator),
+            ],
+        );
+    }
+
+    pub fn group_non_uniform_elect(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        execution: Word,
+    ) -> Result<Word> {
+        return self.value(
+            Op::GroupNonUniformElect,
+            result_type,
+            result_id,
+            [Operand::IdScope(execution)],
+        );
+    }
+
+    pub fn group_non_uniform_shuffle(
+        &mut self,
+        result_type: Word,
+        result_id: Option<Word>,
+        execution: Word,
+        value: Word,
+        id: Word,
+    ) -> Result<Word> {
+        return self.value(
+            Op::GroupNonUniformShuffle,
+            result_type,
+            result_id,
+            [
+                Operand::IdScope(execution),
+                Operand::IdRef(value),
+                Operand::IdRef(id),
+            ],
+        );
+    }
+
+    pub fn memory_barrier(&mut self, memory: Word, semantics: Word) -> Result<()> {
+        return self.instruction(
+            Op::MemoryBarrier,
+            None,
+            None,
+            [
+                Operand::IdScope(memory),
+                Operand::IdMemorySemantics(semantics),
+            ],
+        );
+    }
+
+    pub fn control_barrier(
+        &mut self,
+        execution: Word,
+        memory: Word,
+        semantics: Word,
+    ) -> Result<()> {
+        return self.instruction(
+            Op::ControlBarrier,
+            None,
+            None,
+            [
+                Operand::IdScope(execution),
+                Operand::IdScope(memory),
+                Operand::IdMemorySemantics(semantics),
+            ],
+        );
+    }
+
+    pub fn selection_merge(
+        &mut self,
+        merge_block: Word,
+        selection_control: SelectionControl,
+    ) -> Result<()> {
+        return self.instruction(
+            Op::SelectionMerge,
+            None,
+            None,
+            [
+                Operand::IdRef(merge_block),
+                Operand::SelectionControl(selection_control),
+            ],
+        );
+    }
+
+    pub fn loop_merge(
+        &mut self,
+        merge_block: Word,
+        continue_target: Word,
+        loop_control: LoopControl,
+        additional_params: impl IntoIterator<Item = Operand>,
+    ) -> Result<()> {
+        let operands = [
+            Operand::IdRef(merge_block),
+            Operand::IdRef(continue_target),
+            Operand::LoopControl(loop_control),
+        ];
+        return self.instruction(
+            Op::LoopMerge,
+            None,
+            None,
+            operands.into_iter().chain(additional_params),
+        );
+    }
+
+    pub fn branch(&mut self, target_label: Word) -> Result<()> {
+        return self.instruction(Op::Branch, None, None, [Operand::IdRef(target_label)]);
+    }
+
+    pub fn branch_conditional(
+        &mut self,
+        condition: Word,
+        true_label: Word,
+        false_label: Word,
+        branch_weights: impl IntoIterator<Item = u32>,
+    ) -> Result<()> {
+        let operands = [
+            Operand::IdRef(condition),
+            Operand::IdRef(true_label),
+            Operand::IdRef(false_label),
+        ];
+        let weights = branch_weights.into_iter().map(Operand::LiteralInt32);
+        return self.instruction(
+            Op::BranchConditional,
+            None,
+            None,
+            operands.into_iter().chain(weights),
+        );
+    }
+
+    pub fn switch(
+        &mut self,
+        selector: Word,
+        default: Word,
+        target: impl IntoIterator<Item = (Operand, Word)>,
+    ) -> Result<()> {
+        let operands = [Operand::IdRef(selector), Operand::IdRef(default)];
+        let target = target
+            .into_iter()
+            .flat_map(|(literal, label)| [literal, Operand::IdRef(label)]);
+        return self.instruction(Op::Switch, None, None, operands.into_iter().chain(target));
+    }
+
+    pub fn ret(&mut self) -> Result<()> {
+        return self.instruction(Op::Return, None, None, []);
+    }
+
+    pub fn ret_value(&mut self, value: Word) -> Result<()> {
+        return self.instruction(Op::ReturnValue, None, None, [Operand::IdRef(value)]);
+    }
+
+    pub fn unreachable(&mut self) -> Result<()> {
+        return self.instruction(Op::Unreachable, None, None, []);
+    }
+
+    pub fn nop(&mut self) -> Result<()> {
+        return self.instruction(Op::Nop, None, None, []);
+    }
+}
+
+impl Default for Emitter {
+    fn default() -> Self {
+        return Self::new();
+    }
+}
+
+/// Instructions that take a result type and only ids as operands.
+macro_rules! values {
+    ($($name:ident => $op:ident($($operand:ident),+);)*) => {
+        impl Emitter {
+            $(
+                pub fn $name(
+                    &mut self,
+                    result_type: Word,
+                    result_id: Option<Word>,
+                    $($operand: Word),+
+                ) -> Result<Word> {
+                    return self.value(
+                        Op::$op,
+                        result_type,
+                        result_id,
+                        [$(Operand::IdRef($operand)),+],
+                    );
+                }
+            )*
+        }
+    };
+}
+
+values! {
+    select => Select(condition, object_1, object_2);
+    bitcast => Bitcast(operand);
+    u_convert => UConvert(unsigned_value);
+    s_convert => SConvert(signed_value);
+    f_convert => FConvert(float_value);
+    convert_f_to_s => ConvertFToS(float_value);
+    convert_f_to_u => ConvertFToU(float_value);
+    convert_s_to_f => ConvertSToF(signed_value);
+    convert_u_to_f => ConvertUToF(unsigned_value);
+    convert_ptr_to_u => ConvertPtrToU(pointer);
+    convert_u_to_ptr => ConvertUToPtr(integer_value);
+    vector_extract_dynamic => VectorExtractDynamic(vector, index);
+    not => Not(operand);
+    s_negate => SNegate(operand);
+    f_negate => FNegate(operand);
+    bit_count => BitCount(base);
+    u_count_leading_zeros_intel => UCountLeadingZerosINTEL(operand);
+    u_count_trailing_zeros_intel => UCountTrailingZerosINTEL(operand);
+    i_add => IAdd(operand_1, operand_2);
+    i_sub => ISub(operand_1, operand_2);
+    i_mul => IMul(operand_1, operand_2);
+    s_div => SDiv(operand_1, operand_2);
+    u_div => UDiv(operand_1, operand_2);
+    s_rem => SRem(operand_1, operand_2);
+    u_mod => UMod(operand_1, operand_2);
+    f_add => FAdd(operand_1, operand_2);
+    f_sub => FSub(operand_1, operand_2);
+    f_mul => FMul(operand_1, operand_2);
+    f_div => FDiv(operand_1, operand_2);
+    bitwise_and => BitwiseAnd(operand_1, operand_2);
+    bitwise_or => BitwiseOr(operand_1, operand_2);
+    bitwise_xor => BitwiseXor(operand_1, operand_2);
+    shift_left_logical => ShiftLeftLogical(base, shift);
+    shift_right_logical => ShiftRightLogical(base, shift);
+    shift_right_arithmetic => ShiftRightArithmetic(base, shift);
+    logical_or => LogicalOr(operand_1, operand_2);
+    logical_not => LogicalNot(operand);
+    is_nan => IsNan(x);
+    i_equal => IEqual(operand_1, operand_2);
+    i_not_equal => INotEqual(operand_1, operand_2);
+    u_greater_than => UGreaterThan(operand_1, operand_2);
+    u_greater_than_equal => UGreaterThanEqual(operand_1, operand_2);
+    u_less_than => ULessThan(operand_1, operand_2);
+    u_less_than_equal => ULessThanEqual(operand_1, operand_2);
+    s_greater_than => SGreaterThan(operand_1, operand_2);
+    s_greater_than_equal => SGreaterThanEqual(operand_1, operand_2);
+    s_less_than => SLessThan(operand_1, operand_2);
+    s_less_than_equal => SLessThanEqual(operand_1, operand_2);
+    f_ord_equal => FOrdEqual(operand_1, operand_2);
+    f_unord_not_equal => FUnordNotEqual(operand_1, operand_2);
+    f_ord_less_than => FOrdLessThan(operand_1, operand_2);
+    f_ord_less_than_equal => FOrdLessThanEqual(operand_1, operand_2);
+    f_ord_greater_than => FOrdGreaterThan(operand_1, operand_2);
+    f_ord_greater_than_equal => FOrdGreaterThanEqual(operand_1, operand_2);
+    f_unord_less_than_equal => FUnordLessThanEqual(operand_1, operand_2);
+    f_unord_greater_than_equal => FUnordGreaterThanEqual(operand_1, operand_2);
+}
+
+/// Atomic read-modify-write instructions.
+macro_rules! atomics {
+    ($($name:ident => $op:ident;)*) => {
+        impl Emitter {
+            $(
+                pub fn $name(
+                    &mut self,
+                    result_type: Word,
+                    result_id: Option<Word>,
+                    pointer: Word,
+                    memory: Word,
+                    semantics: Word,
+                    value: Word,
+                ) -> Result<Word> {
+                    return self.value(
+                        Op::$op,
+                        result_type,
+                        result_id,
+                        [
+                            Operand::IdRef(pointer),
+                            Operand::IdScope(memory),
+                            Operand::IdMemorySemantics(semantics),
+                            Operand::IdRef(value),
+                        ],
+                    );
+                }
+            )*
+        }
+    };
+}
+
+atomics! {
+    atomic_exchange => AtomicExchange;
+    atomic_i_add => AtomicIAdd;
+    atomic_i_sub => AtomicISub;
+    atomic_and => AtomicAnd;
+    atomic_or => AtomicOr;
+    atomic_xor => AtomicXor;
+}
+
+/// Subgroup instructions over a single value.
+macro_rules! group_non_uniform {
+    ($($name:ident => $op:ident;)*) => {
+        impl Emitter {
+            $(
+                pub fn $name(
+                    &mut self,
+                    result_type: Word,
+                    result_id: Option<Word>,
+                    execution: Word,
+                    value: Word,
+                ) -> Result<Word> {
+                    return self.value(
+                        Op::$op,
+                        result_type,
+                        result_id,
+                        [Operand::IdScope(execution), Operand::IdRef(value)],
+                    );
+                }
+            )*
+        }
+    };
+}
+
+group_non_uniform! {
+    group_non_uniform_all => GroupNonUniformAll;
+    group_non_uniform_any => GroupNonUniformAny;
+    group_non_uniform_ballot => GroupNonUniformBallot;
+    group_non_uniform_broadcast_first => GroupNonUniformBroadcastFirst;
+}
+
+/// Subgroup reductions and scans.
+macro_rules! group_non_uniform_arithmetic {
+    ($($name:ident => $op:ident;)*) => {
+        impl Emitter {
+            $(
+                pub fn $name(
+                    &mut self,
+                    result_type: Word,
+                    result_id: Option<Word>,
+                    execution: Word,
+                    operation: GroupOperation,
+                    value: Word,
+                    cluster_size: Option<Word>,
+                ) -> Result<Word> {
+                    let operands = [
+                        Some(Operand::IdScope(execution)),
+                        Some(Operand::GroupOperation(operation)),
+                        Some(Operand::IdRef(value)),
+                        cluster_size.map(Operand::IdRef),
+                    ];
+                    return self.value(
+                        Op::$op,
+                        result_type,
+                        result_id,
+                        operands.into_iter().flatten(),
+                    );
+                }
+            )*
+        }
+    };
+}
+
+group_non_uniform_arithmetic! {
+    group_non_uniform_i_add => GroupNonUniformIAdd;
+    group_non_uniform_f_add => GroupNonUniformFAdd;
+    group_non_uniform_s_min => GroupNonUniformSMin;
+    group_non_uniform_u_min => GroupNonUniformUMin;
+    group_non_uniform_f_min => GroupNonUniformFMin;
+    group_non_uniform_s_max => GroupNonUniformSMax;
+    group_non_uniform_u_max => GroupNonUniformUMax;
+    group_non_uniform_f_max => GroupNonUniformFMax;
+}
+
+/// Encodes an instruction at the end of `words`, recording the capabilities it requires.
+fn encode(
+    words: &mut Words,
+    track_ids: bool,
+    mut capabilities: Option<&mut Vec<Capability>>,
+    op: Op,
+    result_type: Option<Word>,
+    result_id: Option<Word>,
+    operands: impl IntoIterator<Item = Operand>,
+) {
+    if let Some(capabilities) = capabilities.as_deref_mut() {
+        require(
+            capabilities,
+            CoreInstructionTable::get(op).capabilities.iter().copied(),
+        );
+    }
+
+    let start = words.words.len();
+    words.words.push(0);
+    if let Some(id) = result_type {
+        words.push_id(id, false, track_ids);
+    }
+    if let Some(id) = result_id {
+        words.push_id(id, true, track_ids);
+    }
+
+    for operand in operands {
+        if let Some(capabilities) = capabilities.as_deref_mut() {
+            require(capabilities, operand_capabilities(&operand));
+        }
+
+        match operand {
+            Operand::IdRef(id) | Operand::IdScope(id) | Operand::IdMemorySemantics(id) => {
+                words.push_id(id, false, track_ids)
+            }
+            operand => operand.assemble_into(&mut words.words),
+        }
+    }
+
+    let word_count = (words.words.len() - start) as u32;
+    words.words[start] = (word_count << 16) | op as u32;
+}
+
+fn require(capabilities: &mut Vec<Capability>, required: impl IntoIterator<Item = Capability>) {
+    for capability in required {
+        if !capabilities.contains(&capability) {
+            capabilities.push(capability);
+        }
+    }
+}
+
+#[inline]
+pub(crate) fn words_as_bytes(words: &[u32]) -> &[u8] {
+    unsafe { core::slice::from_raw_parts(words.as_ptr().cast(), std::mem::size_of_val(words)) }
+}
@@ -0,0 +1,66 @@
+//! Memory scopes and semantics used to lower the Wasm threads proposal.
+
+use super::module::ModuleBuilder;
+use rspirv::spirv::{MemoryModel, MemorySemantics, Scope, StorageClass};
+
+/// Kinds of memory access an atomic operation or barrier performs.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum AtomicAccess {
+    Read,
+    Write,
+    ReadWrite,
+}
+
+/// Widest scope available to the whole device.
+pub fn device_scope(module: &ModuleBuilder) -> Scope {
+    match module.memory_model {
+        // Device scope requires `VulkanMemoryModelDeviceScope` under the Vulkan memory model
+        MemoryModel::Vulkan => Scope::QueueFamily,
+        _ => Scope::Device,
+    }
+}
+
+/// Scope of the invocations that can access memory of the storage class.
+pub fn memory_scope(storage_class: StorageClass, module: &ModuleBuilder) -> Scope {
+    match storage_class {
+        StorageClass::Workgroup => Scope::Workgroup,
+        StorageClass::Function | StorageClass::Private => Scope::Invocation,
+        _ => device_scope(module),
+    }
+}
+
+/// Memory ordering of Wasm atomics.
+///
+/// Wasm atomics are sequentially consistent, which the Vulkan memory model doesn't support, so
+/// acquire/release semantics are used instead.
+pub fn ordering(access: AtomicAccess, module: &ModuleBuilder) -> MemorySemantics {
+    match (module.memory_model, access) {
+        (MemoryModel::Vulkan, AtomicAccess::Read) => MemorySemantics::ACQUIRE,
+        (MemoryModel::Vulkan, AtomicAccess::Write) => MemorySemantics::RELEASE,
+        (MemoryModel::Vulkan, AtomicAccess::ReadWrite) => MemorySemantics::ACQUIRE_RELEASE,
+        _ => MemorySemantics::SEQUENTIALLY_CONSISTENT,
+    }
+}
+
+/// Memory semantics bits for the storage class.
+pub fn storage_semantics(storage_class: StorageClass) -> MemorySemantics {
+    match storage_class {
+        StorageClass::Uniform
+        | StorageClass::StorageBuffer
+        | StorageClass::PhysicalStorageBuffer => MemorySemantics::UNIFORM_MEMORY,
+        StorageClass::Workgroup => MemorySemantics::WORKGROUP_MEMORY,
+        StorageClass::CrossWorkgroup => MemorySemantics::CROSS_WORKGROUP_MEMORY,
+        StorageClass::AtomicCounter => MemorySemantics::ATOMIC_COUNTER_MEMORY,
+        StorageClass::Image => MemorySemantics::IMAGE_MEMORY,
+        _ => MemorySemantics::NONE,
+    }
+}
+
+/// Memory semantics of an atomic access on memory of the storage class.
+pub fn semantics(
+    storage_class: StorageClass,
+    access: AtomicAccess,
+    module: &ModuleBuilder,
+) -> MemorySemantics {
+    ordering(access, module) | storage_semantics(storage_class)
+}
@@ -9,12 +9,13 @@ use crate::{
     fg::values::{
         float::{Float, FloatKind, FloatSource},
         integer::{Integer, IntegerKind, IntegerSource},
+        vector::{Vector, VectorSource},
     },
-    r#type::{ScalarType, Type},
+    r#type::{CompositeType, ScalarType, Type},
 };
-use std::rc::Rc;
+use std::sync::Arc;
 use std::{collections::VecDeque, fmt::Debug};
-use wasmparser::{BinaryReaderError, Operator, OperatorsReader};
+use wasmparser::{BinaryReader, BinaryReaderError, Operator, OperatorsReader};
 
 macro_rules! tri {
     ($e:expr) => {
@@ -34,13 +35,15 @@ macro_rules! tri {
 }
 
 pub mod mvp;
+pub mod simd;
+pub mod threads;
 
 #[derive(Debug, Clone)]
 pub enum StackValue {
     Value(Value),
     Schrodinger {
-        pointer_variable: Rc<Pointer>,
-        loaded_integer: Rc<Integer>,
+        pointer_variable: Arc<Pointer>,
+        loaded_integer: Arc<Integer>,
     },
 }
 
@@ -55,8 +58,8 @@ impl StackValue {
         self,
         size_hint: PointerSize,
         pointee: impl Into<Type>,
-        module: &mut ModuleBuilder,
-    ) -> Result<Rc<Pointer>> {
+        module: &ModuleBuilder,
+    ) -> Result<Arc<Pointer>> {
         match self {
             StackValue::Value(x) => x.to_pointer(size_hint, pointee, module),
             StackValue::Schrodinger {
@@ -65,7 +68,7 @@ impl StackValue {
         }
     }
 
-    pub fn convert(self, ty: impl Into<Type>, module: &mut ModuleBuilder) -> Result<Value> {
+    pub fn convert(self, ty: impl Into<Type>, module: &ModuleBuilder) -> Result<Value> {
         let ty = ty.into();
         let instr = match self {
             StackValue::Value(x) => x,
@@ -96,6 +99,9 @@ impl StackValue {
                 }
             }
             Type::Scalar(ScalarType::Bool) => instr.to_bool(module)?.into(),
+            Type::Composite(CompositeType::Vector(elem, count)) => {
+                instr.into_vector()?.reinterpret(elem, count)?.into()
+            }
             _ => instr,
         });
     }
@@ -106,15 +112,15 @@ pub struct BlockBuilder<'a> {
     pub reader: BlockReader<'a>,
     pub stack: Vec<StackValue>,
     pub end: End,
-    pub outer_labels: VecDeque<Rc<Label>>,
+    pub outer_labels: VecDeque<Arc<Label>>,
 }
 
 pub fn translate_block<'a>(
     reader: BlockReader<'a>,
-    labels: VecDeque<Rc<Label>>,
+    labels: VecDeque<Arc<Label>>,
     end: End,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<BlockBuilder<'a>> {
     let mut result = BlockBuilder {
         stack: Vec::new(),
@@ -123,7 +129,17 @@ pub fn translate_block<'a>(
         outer_labels: labels,
     };
 
-    while let Some(op) = result.reader.next().transpose()? {
+    loop {
+        let position = result.reader.original_position();
+        let op = match result.reader.next().transpose()? {
+            Some(op) => op,
+            None => break,
+        };
+
+        if let Some(debug_info) = &module.debug_info {
+            debug_info.mark_line(function, position);
+        }
+
         tri!(continue mvp::translate_all(&op, &mut result, function, module));
         return Err(Error::msg(format!("Unknown instruction: {op:?}")));
     }
@@ -134,10 +150,7 @@ pub fn translate_block<'a>(
 impl<'a> BlockBuilder<'a> {
     pub fn dummy() -> Self {
         return Self {
-            reader: BlockReader {
-                reader: None,
-                cache: VecDeque::new(),
-            },
+            reader: BlockReader::empty(),
             stack: Vec::new(),
             end: End::Unreachable,
             outer_labels: VecDeque::new(),
@@ -155,13 +168,13 @@ impl<'a> BlockBuilder<'a> {
         Ok(self.stack.remove(self.stack.len() - 1))
     }
 
-    pub fn stack_pop(&mut self, ty: impl Into<Type>, module: &mut ModuleBuilder) -> Result<Value> {
+    pub fn stack_pop(&mut self, ty: impl Into<Type>, module: &ModuleBuilder) -> Result<Value> {
         let ty = ty.into();
         let instr = self.stack_pop_any()?;
         return instr.convert(ty, module);
     }
 
-    pub fn stack_peek(&mut self, ty: impl Into<Type>, module: &mut ModuleBuilder) -> Result<Value> {
+    pub fn stack_peek(&mut self, ty: impl Into<Type>, module: &ModuleBuilder) -> Result<Value> {
         let ty = ty.into();
         let instr = self.stack_peek_any()?;
         return instr.convert(ty, module);
@@ -178,11 +191,15 @@ impl<'a> BlockBuilder<'a> {
         &mut self,
         f: &CallableFunction,
         function: &mut FunctionBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<()> {
         match f {
             CallableFunction::Callback(f) => f(self, function, module),
             CallableFunction::Defined { function_id, ty: f } => {
+                if !function.callees.iter().any(|x| Arc::ptr_eq(x, function_id)) {
+                    function.callees.push(function_id.clone());
+                }
+
                 let mut args = Vec::with_capacity(f.params().len());
                 for ty in f.params().iter().rev() {
                     let raw_arg = self.stack_pop(Type::from(*ty), module)?;
@@ -222,6 +239,12 @@ impl<'a> BlockBuilder<'a> {
                             kind: FloatKind::Double,
                         }))
                     }
+                    Some(wasmparser::ValType::V128) => {
+                        self.stack_push(Vector::v128(VectorSource::FunctionCall {
+                            function_id: function_id.clone(),
+                            args,
+                        }))
+                    }
                     None => function.anchors.push(Operation::FunctionCall {
                         function_id: function_id.clone(),
                         args,
@@ -234,63 +257,84 @@ impl<'a> BlockBuilder<'a> {
     }
 }
 
+/// Operator reader over a (sub-)range of a function body.
+///
+/// The byte ranges of every structured block are recorded by a single pre-pass, so splitting a
+/// branch is just a lookup and a jump over the original bytes, without buffering any operators.
 #[derive(Clone)]
 pub struct BlockReader<'a> {
-    pub reader: Option<OperatorsReader<'a>>,
-    pub cache: VecDeque<Operator<'a>>,
+    reader: BinaryReader<'a>,
+    /// Original offset at which this reader ends
+    end: usize,
+    /// Original offsets of the first operator in a block, and of the operator after it's matching `end`.
+    branches: Arc<[(usize, usize)]>,
 }
 
 impl<'a> BlockReader<'a> {
-    pub fn new(reader: OperatorsReader<'a>) -> Self {
-        return Self {
-            reader: Some(reader),
-            cache: VecDeque::new(),
-        };
-    }
-
-    /// Returns the reader for the current branch
-    pub fn split_branch(&mut self) -> Result<BlockReader<'a>, BinaryReaderError> {
-        let mut inner_branches = 0u32;
-
-        for (i, op) in self.cache.iter().enumerate() {
-            match op {
-                Operator::Loop { .. } | Operator::Block { .. } => inner_branches += 1,
-                Operator::End => match inner_branches.checked_sub(1) {
-                    Some(x) => inner_branches = x,
-                    None => {
-                        let mut cache = self.cache.split_off(i + 1);
-                        core::mem::swap(&mut cache, &mut self.cache);
-                        return Ok(BlockReader {
-                            reader: None,
-                            cache,
-                        });
+    pub fn new(reader: OperatorsReader<'a>) -> Result<Self, BinaryReaderError> {
+        let reader = reader.get_binary_reader();
+
+        let mut branches = Vec::new();
+        let mut open_branches = Vec::new();
+        let mut pre_pass = reader.clone();
+
+        while !pre_pass.eof() {
+            match pre_pass.read_operator()? {
+                Operator::Loop { .. } | Operator::Block { .. } | Operator::If { .. } => {
+                    open_branches.push(branches.len());
+                    branches.push((pre_pass.original_position(), usize::MAX));
+                }
+                Operator::End => {
+                    if let Some(i) = open_branches.pop() {
+                        branches[i].1 = pre_pass.original_position();
                     }
-                },
+                }
                 _ => continue,
             }
         }
 
-        let mut cache = core::mem::take(&mut self.cache);
-        if let Some(ref mut reader) = self.reader {
-            loop {
-                let op = reader.read()?;
-                cache.push_back(op.clone());
-
-                match op {
-                    Operator::Loop { .. } | Operator::Block { .. } => inner_branches += 1,
-                    Operator::End => match inner_branches.checked_sub(1) {
-                        Some(x) => inner_branches = x,
-                        None => break,
-                    },
-                    _ => continue,
-                }
-            }
+        return Ok(Self {
+            end: pre_pass.original_position(),
+            reader,
+            branches: branches.into(),
+        });
+    }
+
+    pub fn empty() -> Self {
+        return Self {
+            reader: BinaryReader::new(&[]),
+            end: 0,
+            branches: Arc::from([]),
+        };
+    }
+
+    pub fn original_position(&self) -> usize {
+        return self.reader.original_position();
+    }
+
+    /// Returns the reader for the current branch, skipping it on `self`.
+    pub fn split_branch(&mut self) -> Result<BlockReader<'a>> {
+        let start = self.reader.original_position();
+        let end = match self
+            .branches
+            .binary_search_by_key(&start, |(start, _)| *start)
+        {
+            Ok(i) => self.branches[i].1,
+            Err(_) => return Err(Error::msg("Unexpected start of branch")),
+        };
+
+        if end > self.end {
+            return Err(Error::msg("Unterminated branch"));
         }
 
-        return Ok(BlockReader {
-            reader: None,
-            cache,
-        });
+        let branch = BlockReader {
+            reader: self.reader.clone(),
+            end,
+            branches: self.branches.clone(),
+        };
+
+        let _ = self.reader.read_bytes(end - start)?;
+        return Ok(branch);
     }
 }
 
@@ -298,24 +342,18 @@ impl<'a> Iterator for BlockReader<'a> {
     type Item = Result<Operator<'a>, BinaryReaderError>;
 
     fn next(&mut self) -> Option<Self::Item> {
-        if let Some(op) = self.cache.pop_front() {
-            return Some(Ok(op));
-        } else if let Some(ref mut reader) = self.reader {
-            return reader.read().map(Some).transpose();
+        if self.reader.eof() || self.reader.original_position() >= self.end {
+            return None;
         }
-        return None;
-    }
-
-    fn size_hint(&self) -> (usize, Option<usize>) {
-        let len = self.cache.len();
-        return (len, self.reader.is_none().then_some(len));
+        return Some(self.reader.read_operator());
     }
 }
 
 impl<'a> Debug for BlockReader<'a> {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         f.debug_struct("BlockReader")
-            .field("cache", &self.cache)
+            .field("position", &self.reader.original_position())
+            .field("end", &self.end)
             .finish_non_exhaustive()
     }
 }
@@ -1,6 +1,6 @@
-use super::{translate_block, BlockBuilder, StackValue};
+use super::{simd, threads, translate_block, BlockBuilder, StackValue};
 use crate::{
-    config::MemoryGrowErrorKind,
+    config::{MemoryGrowErrorKind, OptimizationLevel},
     error::{Error, Result},
     fg::{
         function::{FunctionBuilder, Storeable},
@@ -18,7 +18,7 @@ use crate::{
     },
     r#type::{PointerSize, ScalarType, Type},
 };
-use std::rc::Rc;
+use std::sync::Arc;
 use tracing::debug;
 use wasmparser::{MemArg, Operator};
 use Operator::*;
@@ -30,21 +30,166 @@ pub enum TranslationResult {
     Eof,
 }
 
+/// Group of translators an operator is handled by.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum OperatorClass {
+    Constant,
+    ControlFlow,
+    Conversion,
+    Variable,
+    Memory,
+    Arith,
+    Logic,
+    Comparison,
+    Simd,
+    Atomic,
+}
+
+impl OperatorClass {
+    /// Classifies an operator with a single `match` on its discriminant.
+    pub fn of(op: &Operator) -> Option<Self> {
+        return Some(match op {
+            I32Const { .. } | I64Const { .. } | F32Const { .. } | F64Const { .. } => Self::Constant,
+
+            Loop { .. }
+            | Block { .. }
+            | Br { .. }
+            | BrIf { .. }
+            | End
+            | Return
+            | Call { .. }
+            | Select => Self::ControlFlow,
+
+            I32WrapI64 | F32DemoteF64 | F64PromoteF32 | I64ExtendI32S | I64ExtendI32U
+            | F32ConvertI32S | F32ConvertI32U | F32ConvertI64S | F32ConvertI64U
+            | F64ConvertI32S | F64ConvertI32U | F64ConvertI64S | F64ConvertI64U | I32TruncF32S
+            | I32TruncF32U | I64TruncF32S | I64TruncF32U | I32TruncF64S | I32TruncF64U
+            | I64TruncF64S | I64TruncF64U | F32ReinterpretI32 | F64ReinterpretI64
+            | I32ReinterpretF32 | I64ReinterpretF64 => Self::Conversion,
+
+            LocalGet { .. }
+            | LocalSet { .. }
+            | LocalTee { .. }
+            | GlobalGet { .. }
+            | GlobalSet { .. }
+            | Drop => Self::Variable,
+
+            I32Load { .. }
+            | F32Load { .. }
+            | I64Load { .. }
+            | F64Load { .. }
+            | I32Store { .. }
+            | F32Store { .. }
+            | I64Store { .. }
+            | F64Store { .. }
+            | I32Load8U { .. }
+            | I64Load8U { .. }
+            | I32Load16U { .. }
+            | MemorySize { .. }
+            | MemoryGrow { .. } => Self::Memory,
+
+            I32Add | I64Add | I32Sub | I64Sub | I32Mul | I64Mul | I32DivS | I64DivS | I32DivU
+            | I64DivU | I32RemS | I64RemS | I32RemU | I64RemU | F32Add | F64Add | F32Sub
+            | F64Sub | F32Mul | F64Mul | F32Div | F64Div => Self::Arith,
+
+            I32And | I64And | I32Or | I64Or | I32Xor | I64Xor | I32Shl | I64Shl | I32ShrS
+            | I64ShrS | I32ShrU | I64ShrU | I32Clz | I64Clz | I32Ctz | I64Ctz | I32Popcnt
+            | I64Popcnt | I32Rotl | I64Rotl | I32Rotr | I64Rotr | F32Abs | F64Abs | F32Neg
+            | F64Neg | F32Ceil | F64Ceil | F32Floor | F64Floor | F32Trunc | F64Trunc
+            | F32Nearest | F64Nearest | F32Min | F64Min | F32Max | F64Max => Self::Logic,
+
+            I32GeU | I64GeU | I32GeS | I64GeS | I32GtU | I64GtU | I32GtS | I64GtS | I32Eq
+            | I64Eq | I32Eqz | I64Eqz | I32Ne | I64Ne | I32LtU | I64LtU | I32LtS | I64LtS
+            | I32LeU | I64LeU | I32LeS | I64LeS | F32Le | F64Le | F32Lt | F64Lt | F32Eq | F64Eq
+            | F32Ne | F64Ne | F32Gt | F64Gt | F32Ge | F64Ge => Self::Comparison,
+
+            V128Load { .. }
+            | V128Store { .. }
+            | V128Const { .. }
+            | I8x16Shuffle { .. }
+            | I32x4Splat
+            | I64x2Splat
+            | F32x4Splat
+            | F64x2Splat
+            | I32x4ExtractLane { .. }
+            | I64x2ExtractLane { .. }
+            | F32x4ExtractLane { .. }
+            | F64x2ExtractLane { .. }
+            | I32x4ReplaceLane { .. }
+            | I64x2ReplaceLane { .. }
+            | F32x4ReplaceLane { .. }
+            | F64x2ReplaceLane { .. }
+            | V128Not
+            | V128And
+            | V128AndNot
+            | V128Or
+            | V128Xor
+            | I32x4Neg
+            | I64x2Neg
+            | F32x4Neg
+            | F64x2Neg
+            | I32x4Add
+            | I64x2Add
+            | F32x4Add
+            | F64x2Add
+            | I32x4Sub
+            | I64x2Sub
+            | F32x4Sub
+            | F64x2Sub
+            | I32x4Mul
+            | I64x2Mul
+            | F32x4Mul
+            | F64x2Mul
+            | F32x4Div
+            | F64x2Div => Self::Simd,
+
+            I32AtomicLoad { .. }
+            | I64AtomicLoad { .. }
+            | I32AtomicStore { .. }
+            | I64AtomicStore { .. }
+            | I32AtomicRmwAdd { .. }
+            | I64AtomicRmwAdd { .. }
+            | I32AtomicRmwSub { .. }
+            | I64AtomicRmwSub { .. }
+            | I32AtomicRmwAnd { .. }
+            | I64AtomicRmwAnd { .. }
+            | I32AtomicRmwOr { .. }
+            | I64AtomicRmwOr { .. }
+            | I32AtomicRmwXor { .. }
+            | I64AtomicRmwXor { .. }
+            | I32AtomicRmwXchg { .. }
+            | I64AtomicRmwXchg { .. }
+            | I32AtomicRmwCmpxchg { .. }
+            | I64AtomicRmwCmpxchg { .. }
+            | MemoryAtomicWait32 { .. }
+            | MemoryAtomicWait64 { .. }
+            | MemoryAtomicNotify { .. }
+            | AtomicFence { .. } => Self::Atomic,
+
+            _ => return None,
+        });
+    }
+}
+
 pub fn translate_all<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
-    tri!(translate_constants(op, block));
-    tri!(translate_control_flow(op, block, function, module));
-    tri!(translate_conversion(op, block, module));
-    tri!(translate_variables(op, block, function, module));
-    tri!(translate_memory(op, block, function, module));
-    tri!(translate_arith(op, block, module));
-    tri!(translate_logic(op, block, module));
-    tri!(translate_comparison(op, block, module));
-    return Ok(TranslationResult::NotFound);
+    return match OperatorClass::of(op) {
+        Some(OperatorClass::Constant) => translate_constants(op, block),
+        Some(OperatorClass::ControlFlow) => translate_control_flow(op, block, function, module),
+        Some(OperatorClass::Conversion) => translate_conversion(op, block, module),
+        Some(OperatorClass::Variable) => translate_variables(op, block, function, module),
+        Some(OperatorClass::Memory) => translate_memory(op, block, function, module),
+        Some(OperatorClass::Arith) => translate_arith(op, block, module),
+        Some(OperatorClass::Logic) => translate_logic(op, block, module),
+        Some(OperatorClass::Comparison) => translate_comparison(op, block, module),
+        Some(OperatorClass::Simd) => simd::translate_simd(op, block, function, module),
+        Some(OperatorClass::Atomic) => threads::translate_threads(op, block, function, module),
+        None => Ok(TranslationResult::NotFound),
+    };
 }
 
 pub fn translate_constants<'a>(
@@ -67,16 +212,16 @@ pub fn translate_control_flow<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     match op {
         Loop { blockty } => {
-            let start_label = Rc::new(Label::default());
+            let start_label = Arc::new(Label::default());
 
             function.anchors.push(Operation::Branch {
                 label: start_label.clone(),
             });
-            function.anchors.push(Operation::Label(start_label.clone()));
+            function.begin_block(start_label.clone());
 
             let mut outer_labels = block.outer_labels.clone();
             outer_labels.push_front(start_label);
@@ -92,13 +237,13 @@ pub fn translate_control_flow<'a>(
         }
 
         Block { blockty } => {
-            let start_label = Rc::new(Label::default());
-            let end_label = Rc::new(Label::default());
+            let start_label = Arc::new(Label::default());
+            let end_label = Arc::new(Label::default());
 
             function.anchors.push(Operation::Branch {
                 label: start_label.clone(),
             });
-            function.anchors.push(Operation::Label(start_label));
+            function.begin_block(start_label);
 
             let mut outer_labels = block.outer_labels.clone();
             outer_labels.push_front(end_label.clone());
@@ -124,7 +269,7 @@ pub fn translate_control_flow<'a>(
                 debug!("{:?}", function.anchors.last());
             }
 
-            function.anchors.push(Operation::Label(end_label));
+            function.begin_block(end_label);
         }
 
         Br { relative_depth } => {
@@ -139,7 +284,7 @@ pub fn translate_control_flow<'a>(
         }
 
         BrIf { relative_depth } => {
-            let false_label = Rc::new(Label::default());
+            let false_label = Arc::new(Label::default());
             let true_label = block
                 .outer_labels
                 .get(*relative_depth as usize)
@@ -152,7 +297,7 @@ pub fn translate_control_flow<'a>(
                 true_label: true_label.clone(),
                 false_label: false_label.clone(),
             });
-            function.anchors.push(Operation::Label(false_label))
+            function.begin_block(false_label)
         }
 
         End | Return => {
@@ -263,15 +408,22 @@ pub fn translate_variables<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     match op {
         LocalGet { local_index } => {
+            if let Some(value) = function.local_value(*local_index) {
+                block.stack.push(value);
+                return Ok(TranslationResult::Found);
+            }
+
             let var = function
                 .local_variables
                 .get(*local_index as usize)
+                .cloned()
                 .ok_or_else(Error::element_not_found)?;
 
+            function.loaded_locals[*local_index as usize] = true;
             match var {
                 Storeable::Pointer {
                     variable,
@@ -292,12 +444,16 @@ pub fn translate_variables<'a>(
                     variable,
                     integer_variable: None,
                 } => {
-                    let value = variable.clone().load(None, block, module)?;
-                    block.stack_push(value)
+                    let value = StackValue::Value(variable.clone().load(None, block, module)?);
+                    cache_local_load(*local_index, &value, function, module);
+                    block.stack.push(value)
                 }
 
                 Storeable::Schrodinger(sch) => {
                     let value = sch.load(block, module)?;
+                    if let Some(ref value) = value {
+                        cache_local_load(*local_index, value, function, module);
+                    }
                     block.stack.extend(value)
                 }
             }
@@ -353,7 +509,7 @@ pub fn translate_memory<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     match op {
         I32Load { memarg } | F32Load { memarg } | I64Load { memarg } | F64Load { memarg } => {
@@ -370,7 +526,7 @@ pub fn translate_memory<'a>(
                 .stack_pop_any()?
                 .to_pointer(PointerSize::Skinny, pointee, module)?
                 .access(offset, module)
-                .map(Rc::new)?;
+                .map(Arc::new)?;
 
             let value = pointer.load(Some(memarg.align as u32), block, module)?;
             block.stack_push(value);
@@ -391,7 +547,7 @@ pub fn translate_memory<'a>(
                 .stack_pop_any()?
                 .to_pointer(PointerSize::Skinny, pointee, module)?
                 .access(offset, module)
-                .map(Rc::new)?;
+                .map(Arc::new)?;
 
             function.anchors.push(pointer.store(
                 value,
@@ -427,7 +583,7 @@ pub fn translate_memory<'a>(
 pub fn translate_conversion<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     let instr: Value = match op {
         I32WrapI64 => {
@@ -570,7 +726,7 @@ pub fn translate_conversion<'a>(
 pub fn translate_arith<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     let instr: Value = match op {
         I32Add | I64Add => {
@@ -614,7 +770,7 @@ pub fn translate_arith<'a>(
                     },
                     StackValue::Value(Value::Integer(int)),
                 ) => {
-                    let pointer_variable = Rc::new(pointer_variable.access(int.clone(), module)?);
+                    let pointer_variable = Arc::new(pointer_variable.access(int.clone(), module)?);
                     let loaded_integer = int.add(loaded_integer, module)?;
                     StackValue::Schrodinger {
                         pointer_variable,
@@ -668,9 +824,9 @@ pub fn translate_arith<'a>(
                 } => {
                     block.stack.push(StackValue::Schrodinger {
                         pointer_variable: pointer_variable
-                            .access(Rc::new(op2.clone().negate()), module)
-                            .map(Rc::new)?,
-                        loaded_integer: loaded_integer.sub(op2, module).map(Rc::new)?,
+                            .access(Arc::new(op2.clone().negate()), module)
+                            .map(Arc::new)?,
+                        loaded_integer: loaded_integer.sub(op2, module).map(Arc::new)?,
                     });
                     return Ok(TranslationResult::Found);
                 }
@@ -795,7 +951,7 @@ pub fn translate_arith<'a>(
 pub fn translate_logic<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     let instr: Value = match op {
         I32And | I64And => {
@@ -1045,7 +1201,7 @@ pub fn translate_logic<'a>(
 pub fn translate_comparison<'a>(
     op: &Operator<'a>,
     block: &mut BlockBuilder<'a>,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<TranslationResult> {
     let instr: Value = match op {
         I32GeU | I64GeU | I32GeS | I64GeS => {
@@ -1103,8 +1259,8 @@ pub fn translate_comparison<'a>(
 
         I32Eqz | I64Eqz => {
             let (ty, op2) = match op {
-                I32Eqz => (ScalarType::I32, Rc::new(Integer::new_constant_i32(0))),
-                I64Eqz => (ScalarType::I64, Rc::new(Integer::new_constant_i64(0))),
+                I32Eqz => (ScalarType::I32, Arc::new(Integer::new_constant_i32(0))),
+                I64Eqz => (ScalarType::I64, Arc::new(Integer::new_constant_i64(0))),
                 _ => return Err(Error::unexpected()),
             };
 
@@ -1283,21 +1439,21 @@ fn load_byte<'a>(
     kind: IntegerKind,
     memarg: &MemArg,
     block: &mut BlockBuilder<'a>,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<()> {
-    let zero = Rc::new(Integer::new_constant_usize(0, module));
-    let eight = Rc::new(Integer::new_constant_usize(8, module));
+    let zero = Arc::new(Integer::new_constant_usize(0, module));
+    let eight = Arc::new(Integer::new_constant_usize(8, module));
 
     let (shift_offset, stride, mask) = match kind {
         IntegerKind::Short => (
-            Rc::new(Integer::new_constant_usize(3, &module)),
-            Rc::new(Integer::new_constant_u32(4)),
-            Rc::new(Integer::new_constant_u32(0xff)),
+            Arc::new(Integer::new_constant_usize(3, &module)),
+            Arc::new(Integer::new_constant_u32(4)),
+            Arc::new(Integer::new_constant_u32(0xff)),
         ),
         IntegerKind::Long => (
-            Rc::new(Integer::new_constant_usize(7, &module)),
-            Rc::new(Integer::new_constant_u64(8)),
-            Rc::new(Integer::new_constant_u64(0xff)),
+            Arc::new(Integer::new_constant_usize(7, &module)),
+            Arc::new(Integer::new_constant_u64(8)),
+            Arc::new(Integer::new_constant_u64(0xff)),
         ),
     };
 
@@ -1308,7 +1464,7 @@ fn load_byte<'a>(
     let byte_offset = pointer.byte_offset();
 
     // Calculate true offset
-    let constant_offset = Rc::new(Integer::new_constant_usize(memarg.offset as u32, module));
+    let constant_offset = Arc::new(Integer::new_constant_usize(memarg.offset as u32, module));
     let byte_offset = match byte_offset {
         Some(byte_offset) => byte_offset.add(constant_offset, module)?,
         None => constant_offset,
@@ -1317,13 +1473,13 @@ fn load_byte<'a>(
     // Get value of unadapted integer
     let value = pointer
         .access(byte_offset.clone(), module)
-        .map(Rc::new)?
+        .map(Arc::new)?
         .load(Some(memarg.align as u32), block, module)?
         .into_integer()?;
 
     let shift = shift_offset
         .sub(byte_offset.u_rem(stride, module)?, module)
-        .map(Rc::new)?
+        .map(Arc::new)?
         .mul(eight, module)?;
 
     let result = value.u_shr(shift, false, module)?.and(mask, module)?;
@@ -1336,13 +1492,14 @@ fn local_set<'a>(
     peek: bool,
     block: &mut BlockBuilder<'a>,
     function: &mut FunctionBuilder,
-    module: &mut ModuleBuilder,
+    module: &ModuleBuilder,
 ) -> Result<()> {
     let var = function
         .local_variables
         .get(local_index as usize)
         .ok_or_else(Error::element_not_found)?;
 
+    let first_store = function.anchors.len();
     match var {
         Storeable::Pointer {
             variable: pointer,
@@ -1352,6 +1509,7 @@ fn local_set<'a>(
                 true => block.stack_peek(pointer.pointee.clone(), module)?,
                 false => block.stack_pop(pointer.pointee.clone(), module)?,
             };
+            forward_local(local_index, Some(value.clone().into()), function, module);
 
             function
                 .anchors
@@ -1406,8 +1564,7 @@ fn local_set<'a>(
                 true => block.stack_peek_any()?,
                 false => block.stack_pop_any()?,
             };
-
-            let ops = match value {
+            let ops = match value.clone() {
                 StackValue::Value(Value::Integer(int)) => {
                     vec![sch.store_integer(int, block, module)?]
                 }
@@ -1435,9 +1592,45 @@ fn local_set<'a>(
                 _ => return Err(Error::unexpected()),
             };
 
+            // Only forward the value if it has the shape a load of the local would have now
+            let forwarded = match (&value, sch.pointer.get(), sch.integer.get()) {
+                (StackValue::Value(Value::Integer(_)), None, _)
+                | (StackValue::Value(Value::Pointer(_)), _, None)
+                | (StackValue::Schrodinger { .. }, _, _) => Some(value),
+                _ => None,
+            };
+            forward_local(local_index, forwarded, function, module);
+
             function.anchors.extend(ops);
         }
     };
 
+    if module.optimization >= OptimizationLevel::Basic {
+        function.eliminate_dead_store(local_index, first_store..function.anchors.len());
+    }
+
     return Ok(());
 }
+
+/// Later reads of the local on the same basic block reuse the loaded value.
+fn cache_local_load(
+    local_index: u32,
+    value: &StackValue,
+    function: &mut FunctionBuilder,
+    module: &ModuleBuilder,
+) {
+    forward_local(local_index, Some(value.clone()), function, module);
+}
+
+/// Later reads of the local on the same basic block reuse the assigned value, instead of loading
+/// it from the local's variable. Without a value, they'll load it again.
+fn forward_local(
+    local_index: u32,
+    value: Option<StackValue>,
+    function: &mut FunctionBuilder,
+    module: &ModuleBuilder,
+) {
+    if module.optimization >= OptimizationLevel::Basic {
+        function.local_values[local_index as usize] = value;
+    }
+}
@@ -0,0 +1,224 @@
+use super::{mvp::TranslationResult, BlockBuilder};
+use crate::{
+    error::{Error, Result},
+    fg::{
+        function::FunctionBuilder,
+        module::ModuleBuilder,
+        values::{
+            integer::Integer,
+            vector::{Vector, VectorSource},
+            Value,
+        },
+    },
+    r#type::{CompositeType, PointerSize, ScalarType},
+};
+use std::sync::Arc;
+use wasmparser::Operator;
+use Operator::*;
+
+/// Translates `v128` operators into SPIR-V vector operations.
+///
+/// Values of type `v128` are kept with the lane shape of the last operation that produced them,
+/// and bitcasted into the shape each operator expects when they are popped from the stack.
+pub fn translate_simd<'a>(
+    op: &Operator<'a>,
+    block: &mut BlockBuilder<'a>,
+    function: &mut FunctionBuilder,
+    module: &ModuleBuilder,
+) -> Result<TranslationResult> {
+    match op {
+        V128Load { memarg } => {
+            let offset = Integer::new_constant_usize(memarg.offset as u32, module);
+            let pointer = block
+                .stack_pop_any()?
+                .to_pointer(PointerSize::Skinny, CompositeType::V128, module)?
+                .access(offset, module)
+                .map(Arc::new)?;
+
+            let value = pointer.load(Some(memarg.align as u32), block, module)?;
+            block.stack_push(value);
+        }
+
+        V128Store { memarg } => {
+            let value = block.stack_pop(CompositeType::V128, module)?;
+            let offset = Integer::new_constant_usize(memarg.offset as u32, module);
+            let pointer = block
+                .stack_pop_any()?
+                .to_pointer(PointerSize::Skinny, CompositeType::V128, module)?
+                .access(offset, module)
+                .map(Arc::new)?;
+
+            function.anchors.push(pointer.store(
+                value,
+                Some(memarg.align as u32),
+                block,
+                module,
+            )?);
+        }
+
+        V128Const { value } => {
+            let components = value
+                .bytes()
+                .chunks_exact(4)
+                .map(|x| u32::from_le_bytes([x[0], x[1], x[2], x[3]]))
+                .map(|x| Value::from(Integer::new_constant_u32(x)))
+                .collect::<Box<[_]>>();
+
+            block.stack_push(Vector::v128(VectorSource::Construct(components)));
+        }
+
+        I32x4Splat | I64x2Splat | F32x4Splat | F64x2Splat => {
+            let (elem, count) = lane_shape(op)?;
+            let value = block.stack_pop(elem, module)?;
+            block.stack_push(Vector::splat(value, elem, count));
+        }
+
+        I32x4ExtractLane { lane }
+        | I64x2ExtractLane { lane }
+        | F32x4ExtractLane { lane }
+        | F64x2ExtractLane { lane } => {
+            let (elem, count) = lane_shape(op)?;
+            if *lane as u32 >= count {
+                return Err(Error::msg(format!("Lane {lane} is out of bounds")));
+            }
+
+            let vector = pop_vector(elem, count, block, module)?;
+            block.stack_push(vector.extract(Integer::new_constant_u32(*lane as u32)));
+        }
+
+        I32x4ReplaceLane { lane }
+        | I64x2ReplaceLane { lane }
+        | F32x4ReplaceLane { lane }
+        | F64x2ReplaceLane { lane } => {
+            let (elem, count) = lane_shape(op)?;
+            let value = block.stack_pop(elem, module)?;
+            let vector = pop_vector(elem, count, block, module)?;
+            block.stack_push(vector.insert(value, *lane as u32)?);
+        }
+
+        I8x16Shuffle { lanes } => {
+            let components = shuffle_components(lanes)?;
+            let op2 = pop_vector(ScalarType::I32, 4, block, module)?;
+            let op1 = pop_vector(ScalarType::I32, 4, block, module)?;
+            block.stack_push(op1.shuffle(op2, components)?);
+        }
+
+        V128Not => {
+            let op1 = pop_vector(ScalarType::I32, 4, block, module)?;
+            block.stack_push(op1.not()?);
+        }
+
+        I32x4Neg | I64x2Neg | F32x4Neg | F64x2Neg => {
+            let (elem, count) = lane_shape(op)?;
+            let op1 = pop_vector(elem, count, block, module)?;
+            block.stack_push(op1.negate());
+        }
+
+        V128And | V128AndNot | V128Or | V128Xor | I32x4Add | I64x2Add | F32x4Add | F64x2Add
+        | I32x4Sub | I64x2Sub | F32x4Sub | F64x2Sub | I32x4Mul | I64x2Mul | F32x4Mul | F64x2Mul
+        | F32x4Div | F64x2Div => {
+            let (elem, count) = lane_shape(op)?;
+            let op2 = pop_vector(elem, count, block, module)?;
+            let op1 = pop_vector(elem, count, block, module)?;
+
+            block.stack_push(match op {
+                V128And => op1.and(op2)?,
+                V128AndNot => op1.and(Arc::new(op2.not()?))?,
+                V128Or => op1.or(op2)?,
+                V128Xor => op1.xor(op2)?,
+                I32x4Add | I64x2Add | F32x4Add | F64x2Add => op1.add(op2)?,
+                I32x4Sub | I64x2Sub | F32x4Sub | F64x2Sub => op1.sub(op2)?,
+                I32x4Mul | I64x2Mul | F32x4Mul | F64x2Mul => op1.mul(op2)?,
+                F32x4Div | F64x2Div => op1.div(op2)?,
+                _ => return Err(Error::unexpected()),
+            });
+        }
+
+        _ => return Ok(TranslationResult::NotFound),
+    }
+
+    return Ok(TranslationResult::Found);
+}
+
+/// Lane shape an operator interprets it's operands with.
+fn lane_shape(op: &Operator) -> Result<(ScalarType, u32)> {
+    return Ok(match op {
+        V128Not
+        | V128And
+        | V128AndNot
+        | V128Or
+        | V128Xor
+        | I32x4Splat
+        | I32x4ExtractLane { .. }
+        | I32x4ReplaceLane { .. }
+        | I32x4Neg
+        | I32x4Add
+        | I32x4Sub
+        | I32x4Mul => (ScalarType::I32, 4),
+
+        I64x2Splat
+        | I64x2ExtractLane { .. }
+        | I64x2ReplaceLane { .. }
+        | I64x2Neg
+        | I64x2Add
+        | I64x2Sub
+        | I64x2Mul => (ScalarType::I64, 2),
+
+        F32x4Splat
+        | F32x4ExtractLane { .. }
+        | F32x4ReplaceLane { .. }
+        | F32x4Neg
+        | F32x4Add
+        | F32x4Sub
+        | F32x4Mul
+        | F32x4Div => (ScalarType::F32, 4),
+
+        F64x2Splat
+        | F64x2ExtractLane { .. }
+        | F64x2ReplaceLane { .. }
+        | F64x2Neg
+        | F64x2Add
+        | F64x2Sub
+        | F64x2Mul
+        | F64x2Div => (ScalarType::F64, 2),
+
+        _ => return Err(Error::unexpected()),
+    });
+}
+
+fn pop_vector(
+    elem: ScalarType,
+    count: u32,
+    block: &mut BlockBuilder,
+    module: &ModuleBuilder,
+) -> Result<Arc<Vector>> {
+    return block
+        .stack_pop(CompositeType::vector(elem, count), module)?
+        .into_vector();
+}
+
+/// Maps a byte shuffle into a shuffle of 32-bit lanes.
+///
+/// SPIR-V has no 8-bit vector components by default, so only shuffles that move whole, aligned
+/// 32-bit lanes are supported.
+fn shuffle_components(lanes: &[u8; 16]) -> Result<[u32; 4]> {
+    let mut components = [0; 4];
+    for (component, bytes) in components.iter_mut().zip(lanes.chunks_exact(4)) {
+        let first = bytes[0];
+        let is_whole_lane = first % 4 == 0
+            && bytes
+                .iter()
+                .enumerate()
+                .all(|(i, byte)| *byte as usize == first as usize + i);
+
+        if !is_whole_lane {
+            return Err(Error::msg(format!(
+                "Unsupported byte-level shuffle: {lanes:?}"
+            )));
+        }
+
+        *component = first as u32 / 4;
+    }
+
+    return Ok(components);
+}
@@ -0,0 +1,194 @@
+use super::{mvp::TranslationResult, BlockBuilder};
+use crate::{
+    error::{Error, Result},
+    fg::{
+        atomic::{device_scope, ordering, AtomicAccess},
+        function::FunctionBuilder,
+        module::ModuleBuilder,
+        values::{
+            bool::{Bool, BoolSource, Equality},
+            integer::{AtomicSource, Integer, IntegerSource},
+            pointer::Pointer,
+            Value,
+        },
+        Operation,
+    },
+    r#type::{PointerSize, ScalarType},
+};
+use rspirv::spirv::MemorySemantics;
+use std::sync::Arc;
+use wasmparser::{MemArg, Operator};
+use Operator::*;
+
+/// Translates the atomic operators of the threads proposal.
+///
+/// Only full-width atomics are supported, since SPIR-V can't atomically access less than 32 bits.
+pub fn translate_threads<'a>(
+    op: &Operator<'a>,
+    block: &mut BlockBuilder<'a>,
+    function: &mut FunctionBuilder,
+    module: &ModuleBuilder,
+) -> Result<TranslationResult> {
+    match op {
+        I32AtomicLoad { memarg } | I64AtomicLoad { memarg } => {
+            let ty = atomic_type(op)?;
+            let pointer = atomic_pointer(ty, memarg, block, module)?;
+            let value = pointer.atomic(AtomicSource::Load, block, module)?;
+            push_atomic(value, block, function);
+        }
+
+        I32AtomicStore { memarg } | I64AtomicStore { memarg } => {
+            let ty = atomic_type(op)?;
+            let value = block.stack_pop(ty, module)?;
+            let pointer = atomic_pointer(ty, memarg, block, module)?;
+            function
+                .anchors
+                .push(pointer.atomic_store(value, block, module)?);
+        }
+
+        I32AtomicRmwAdd { memarg }
+        | I64AtomicRmwAdd { memarg }
+        | I32AtomicRmwSub { memarg }
+        | I64AtomicRmwSub { memarg }
+        | I32AtomicRmwAnd { memarg }
+        | I64AtomicRmwAnd { memarg }
+        | I32AtomicRmwOr { memarg }
+        | I64AtomicRmwOr { memarg }
+        | I32AtomicRmwXor { memarg }
+        | I64AtomicRmwXor { memarg }
+        | I32AtomicRmwXchg { memarg }
+        | I64AtomicRmwXchg { memarg } => {
+            let ty = atomic_type(op)?;
+            let value = block.stack_pop(ty, module)?.into_integer()?;
+            let pointer = atomic_pointer(ty, memarg, block, module)?;
+
+            let source = match op {
+                I32AtomicRmwAdd { .. } | I64AtomicRmwAdd { .. } => AtomicSource::Add(value),
+                I32AtomicRmwSub { .. } | I64AtomicRmwSub { .. } => AtomicSource::Sub(value),
+                I32AtomicRmwAnd { .. } | I64AtomicRmwAnd { .. } => AtomicSource::And(value),
+                I32AtomicRmwOr { .. } | I64AtomicRmwOr { .. } => AtomicSource::Or(value),
+                I32AtomicRmwXor { .. } | I64AtomicRmwXor { .. } => AtomicSource::Xor(value),
+                I32AtomicRmwXchg { .. } | I64AtomicRmwXchg { .. } => AtomicSource::Exchange(value),
+                _ => return Err(Error::unexpected()),
+            };
+
+            let value = pointer.atomic(source, block, module)?;
+            push_atomic(value, block, function);
+        }
+
+        I32AtomicRmwCmpxchg { memarg } | I64AtomicRmwCmpxchg { memarg } => {
+            let ty = atomic_type(op)?;
+            let replacement = block.stack_pop(ty, module)?.into_integer()?;
+            let expected = block.stack_pop(ty, module)?.into_integer()?;
+            let pointer = atomic_pointer(ty, memarg, block, module)?;
+
+            let value = pointer.atomic(
+                AtomicSource::CompareExchange {
+                    expected,
+                    replacement,
+                },
+                block,
+                module,
+            )?;
+            push_atomic(value, block, function);
+        }
+
+        // Invocations can't be suspended, so a wait either finds a different value or times out.
+        MemoryAtomicWait32 { memarg } | MemoryAtomicWait64 { memarg } => {
+            let ty = match op {
+                MemoryAtomicWait32 { .. } => ScalarType::I32,
+                MemoryAtomicWait64 { .. } => ScalarType::I64,
+                _ => return Err(Error::unexpected()),
+            };
+
+            let _timeout = block.stack_pop(ScalarType::I64, module)?;
+            let expected = block.stack_pop(ty, module)?.into_integer()?;
+            let pointer = atomic_pointer(ty, memarg, block, module)?;
+
+            let loaded = Arc::new(pointer.atomic(AtomicSource::Load, block, module)?);
+            function
+                .anchors
+                .push(Operation::Value(Value::Integer(loaded.clone())));
+
+            let is_equal = Bool::new(BoolSource::IntEquality {
+                kind: Equality::Eq,
+                op1: loaded,
+                op2: expected,
+            });
+
+            block.stack_push(Integer::new(IntegerSource::Select {
+                selector: Arc::new(is_equal),
+                true_value: Arc::new(Integer::new_constant_i32(2)),
+                false_value: Arc::new(Integer::new_constant_i32(1)),
+            }));
+        }
+
+        // Since no invocation can be waiting, there's never anyone to wake up.
+        MemoryAtomicNotify { .. } => {
+            let _count = block.stack_pop(ScalarType::I32, module)?;
+            let _pointer = block.stack_pop_any()?;
+            block.stack_push(Integer::new_constant_i32(0));
+        }
+
+        AtomicFence { .. } => function.anchors.push(Operation::MemoryBarrier {
+            scope: device_scope(module),
+            semantics: ordering(AtomicAccess::ReadWrite, module)
+                | MemorySemantics::UNIFORM_MEMORY
+                | MemorySemantics::WORKGROUP_MEMORY,
+        }),
+
+        _ => return Ok(TranslationResult::NotFound),
+    }
+
+    return Ok(TranslationResult::Found);
+}
+
+fn atomic_type(op: &Operator) -> Result<ScalarType> {
+    return Ok(match op {
+        I32AtomicLoad { .. }
+        | I32AtomicStore { .. }
+        | I32AtomicRmwAdd { .. }
+        | I32AtomicRmwSub { .. }
+        | I32AtomicRmwAnd { .. }
+        | I32AtomicRmwOr { .. }
+        | I32AtomicRmwXor { .. }
+        | I32AtomicRmwXchg { .. }
+        | I32AtomicRmwCmpxchg { .. } => ScalarType::I32,
+
+        I64AtomicLoad { .. }
+        | I64AtomicStore { .. }
+        | I64AtomicRmwAdd { .. }
+        | I64AtomicRmwSub { .. }
+        | I64AtomicRmwAnd { .. }
+        | I64AtomicRmwOr { .. }
+        | I64AtomicRmwXor { .. }
+        | I64AtomicRmwXchg { .. }
+        | I64AtomicRmwCmpxchg { .. } => ScalarType::I64,
+
+        _ => return Err(Error::unexpected()),
+    });
+}
+
+fn atomic_pointer(
+    ty: ScalarType,
+    memarg: &MemArg,
+    block: &mut BlockBuilder,
+    module: &ModuleBuilder,
+) -> Result<Arc<Pointer>> {
+    let offset = Integer::new_constant_usize(memarg.offset as u32, module);
+    return block
+        .stack_pop_any()?
+        .to_pointer(PointerSize::Skinny, ty, module)?
+        .access(offset, module)
+        .map(Arc::new);
+}
+
+/// Atomics have side effects, so they are anchored where they appear instead of where their
+/// result is first used.
+fn push_atomic(value: Integer, block: &mut BlockBuilder, function: &mut FunctionBuilder) {
+    let value = Arc::new(value);
+    function
+        .anchors
+        .push(Operation::Value(Value::Integer(value.clone())));
+    block.stack_push(value);
+}
@@ -0,0 +1,127 @@
+//! Debug info carried over from the WebAssembly module, only collected when
+//! [`Config::debug_info`](crate::config::Config::debug_info) is enabled.
+//!
+//! Functions and locals are named after the `name` section. Lines are the offsets of operators
+//! into the code section, which is how DWARF addresses WebAssembly code, so tools that read the
+//! module's DWARF (like `llvm-dwarfdump --lookup`) can map them back to source lines.
+
+use super::{
+    function::{FunctionBuilder, Storeable},
+    values::pointer::Pointer,
+    IdCell, Operation,
+};
+use crate::{error::Result, translation::Builder};
+use std::collections::HashMap;
+use wasmparser::{Name, NameSectionReader};
+
+/// File name of modules without a name of their own
+const DEFAULT_FILE: &str = "module.wasm";
+
+#[derive(Debug, Default)]
+pub struct DebugInfo<'a> {
+    /// Original offset of the code section's contents, which lines are relative to
+    pub code_offset: usize,
+    pub module_name: Option<&'a str>,
+    pub function_names: HashMap<u32, &'a str>,
+    pub local_names: HashMap<u32, HashMap<u32, &'a str>>,
+    /// `OpString` of the file every line belongs to
+    pub(crate) file: IdCell,
+}
+
+impl<'a> DebugInfo<'a> {
+    pub fn read_names(&mut self, data: &'a [u8], offset: usize) -> Result<()> {
+        for name in NameSectionReader::new(data, offset) {
+            match name? {
+                Name::Module { name, .. } => self.module_name = Some(name),
+                Name::Function(names) => {
+                    for naming in names {
+                        let naming = naming?;
+                        self.function_names.insert(naming.index, naming.name);
+                    }
+                }
+                Name::Local(functions) => {
+                    for function in functions {
+                        let function = function?;
+                        let locals = self.local_names.entry(function.index).or_default();
+                        for naming in function.names {
+                            let naming = naming?;
+                            locals.insert(naming.index, naming.name);
+                        }
+                    }
+                }
+                _ => continue,
+            }
+        }
+
+        return Ok(());
+    }
+
+    pub fn file_name(&self) -> &str {
+        return self.module_name.unwrap_or(DEFAULT_FILE);
+    }
+
+    /// Marks the anchors pushed from now on as translated from the operator at `position`.
+    ///
+    /// Operators that don't push any anchor have their line replaced by the next one, and no line
+    /// is pushed right after a block terminator, where it couldn't be declared (and where it would
+    /// hide the terminator from the operators that look for it).
+    pub fn mark_line(&self, function: &mut FunctionBuilder, position: usize) {
+        let line = position.saturating_sub(self.code_offset) as u32;
+        match function.anchors.last_mut() {
+            Some(Operation::Line(x)) => *x = line,
+            Some(x) if x.is_block_terminating() => {}
+            _ => function.anchors.push(Operation::Line(line)),
+        }
+    }
+
+    /// Names the translation of the `index`-th function of the module, along with it's locals.
+    pub fn name_function(&self, index: u32, function: &FunctionBuilder, builder: &mut Builder) {
+        if let (Some(id), Some(name)) =
+            (function.function_id.get(), self.function_names.get(&index))
+        {
+            builder.name(id, *name);
+        }
+
+        let names = match self.local_names.get(&index) {
+            Some(names) => names,
+            None => return,
+        };
+
+        for (local, i) in function.local_variables.iter().zip(0..) {
+            let name = match names.get(&i) {
+                Some(name) => *name,
+                None => continue,
+            };
+
+            match local {
+                Storeable::Pointer {
+                    variable,
+                    integer_variable,
+                } => {
+                    name_variable(variable, name, builder);
+                    if let Some(variable) = integer_variable {
+                        name_variable(variable, &format!("{name}.integer"), builder);
+                    }
+                }
+                Storeable::Schrodinger(x) => {
+                    for (variable, suffix) in [
+                        (&x.integer, ""),
+                        (&x.pointer, ".pointer"),
+                        (&x.offset, ".offset"),
+                    ] {
+                        if let Some(variable) = variable.get() {
+                            name_variable(variable, &format!("{name}{suffix}"), builder);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Variables that have been optimized away are never translated, and thus never named.
+fn name_variable(variable: &Pointer, name: &str, builder: &mut Builder) {
+    if let Some(id) = variable.translation.get() {
+        builder.name(id, name);
+    }
+}
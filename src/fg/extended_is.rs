@@ -1,6 +1,7 @@
+use super::IdCell;
 use crate::translation::Translation;
 use serde::{Deserialize, Serialize};
-use std::{cell::Cell, fmt::Display};
+use std::fmt::Display;
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
 #[non_exhaustive]
@@ -54,14 +55,14 @@ impl Display for ExtendedSet {
 
 #[derive(Debug)]
 pub struct ExtendedIs {
-    pub(crate) translation: Cell<Option<spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub kind: ExtendedSet,
 }
 
 impl ExtendedIs {
     pub fn new(kind: ExtendedSet) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             kind,
         };
     }
@@ -1,36 +1,41 @@
 use super::{
     block::{translate_block, BlockBuilder, BlockReader, StackValue},
     module::ModuleBuilder,
-    values::{integer::Integer, pointer::Pointer, Value},
-    End, Label, Operation,
+    opt,
+    values::{
+        integer::Integer,
+        pointer::{Pointer, PointerSource},
+        Value,
+    },
+    vectorize, End, IdCell, Label, Operation,
 };
 use crate::{
-    config::ConfigBuilder,
+    config::{ConfigBuilder, OptimizationLevel},
     decorator::VariableDecorator,
     error::{Error, Result},
     r#type::{PointerSize, ScalarType, Type},
     version::Version,
 };
-use once_cell::unsync::OnceCell;
+use once_cell::sync::OnceCell;
 use rspirv::spirv::{Capability, ExecutionModel, StorageClass};
 use serde::{Deserialize, Serialize};
-use std::{borrow::Cow, cell::Cell, collections::VecDeque, rc::Rc};
+use std::{borrow::Cow, collections::VecDeque, ops::Range, sync::Arc};
 use vector_mapp::vec::VecMap;
 use wasmparser::{Export, FuncType, FunctionBody, ValType};
 
 /// May be a pointer or an integer, but you won't know until you try to store into it.
 #[derive(Debug, Clone)]
 pub struct Schrodinger {
-    pub pointer: OnceCell<Rc<Pointer>>,
-    pub offset: OnceCell<Rc<Pointer>>,
-    pub integer: OnceCell<Rc<Pointer>>,
+    pub pointer: OnceCell<Arc<Pointer>>,
+    pub offset: OnceCell<Arc<Pointer>>,
+    pub integer: OnceCell<Arc<Pointer>>,
 }
 
 impl Schrodinger {
-    fn offset_variable(&self, module: &ModuleBuilder) -> &Rc<Pointer> {
+    fn offset_variable(&self, module: &ModuleBuilder) -> &Arc<Pointer> {
         self.offset.get_or_init(|| {
-            let init = Rc::new(Integer::new_constant_usize(0, module));
-            Rc::new(Pointer::new_variable(
+            let init = Arc::new(Integer::new_constant_usize(0, module));
+            Arc::new(Pointer::new_variable(
                 PointerSize::Skinny,
                 StorageClass::Function,
                 module.isize_type(),
@@ -40,9 +45,9 @@ impl Schrodinger {
         })
     }
 
-    fn integer_variable(&self, module: &ModuleBuilder) -> &Rc<Pointer> {
+    fn integer_variable(&self, module: &ModuleBuilder) -> &Arc<Pointer> {
         self.integer.get_or_init(|| {
-            Rc::new(Pointer::new_variable(
+            Arc::new(Pointer::new_variable(
                 PointerSize::Skinny,
                 StorageClass::Function,
                 module.isize_type(),
@@ -54,9 +59,9 @@ impl Schrodinger {
 
     pub fn store_integer(
         &self,
-        value: Rc<Integer>,
+        value: Arc<Integer>,
         block: &mut BlockBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Operation> {
         self.integer_variable(module)
             .clone()
@@ -65,13 +70,13 @@ impl Schrodinger {
 
     pub fn store_pointer(
         &self,
-        value: Rc<Pointer>,
+        value: Arc<Pointer>,
         block: &mut BlockBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<(Operation, Option<Operation>)> {
         let (value, offset) = value.take_byte_offset();
         let pointer = self.pointer.get_or_init(|| {
-            Rc::new(Pointer::new_variable(
+            Arc::new(Pointer::new_variable(
                 PointerSize::Skinny,
                 StorageClass::Function,
                 Type::pointer(
@@ -91,7 +96,7 @@ impl Schrodinger {
                     .store(offset, None, block, module)?,
             )
         } else if let Some(sch_offset) = self.offset.get() {
-            let zero = Rc::new(Integer::new_constant_usize(0, module));
+            let zero = Arc::new(Integer::new_constant_usize(0, module));
             Some(sch_offset.clone().store(zero, None, block, module)?)
         } else {
             None
@@ -104,7 +109,7 @@ impl Schrodinger {
     pub fn load(
         &self,
         block: &mut BlockBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Option<StackValue>> {
         let mut pointer_variable = match self.pointer.get() {
             Some(pointer) => Some(pointer.clone().load(None, block, module)?),
@@ -138,10 +143,10 @@ impl Schrodinger {
 #[derive(Debug, Clone)]
 pub enum Storeable {
     Pointer {
-        variable: Rc<Pointer>,
-        integer_variable: Option<Rc<Pointer>>, // integer.is_some() --> is_extern_pointer
+        variable: Arc<Pointer>,
+        integer_variable: Option<Arc<Pointer>>, // integer.is_some() --> is_extern_pointer
     },
-    Schrodinger(Rc<Schrodinger>),
+    Schrodinger(Arc<Schrodinger>),
 }
 
 #[derive(Debug, Clone)]
@@ -149,12 +154,12 @@ pub struct EntryPoint<'a> {
     pub execution_model: ExecutionModel,
     pub execution_modes: Box<[ExecutionMode]>,
     pub name: &'a str,
-    pub interface: Vec<Rc<Pointer>>,
+    pub interface: Vec<Arc<Pointer>>,
 }
 
 #[derive(Debug, Default)]
 pub struct FunctionBuilder<'a> {
-    pub(crate) function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+    pub(crate) function_id: Arc<IdCell>,
     pub entry_point: Option<EntryPoint<'a>>,
     pub parameters: Box<[Value]>,
     pub local_variables: Box<[Storeable]>,
@@ -162,17 +167,28 @@ pub struct FunctionBuilder<'a> {
     /// Instructions who's order **must** be followed
     pub anchors: Vec<Operation>,
     pub variable_initializers: Box<[Operation]>,
-    pub outside_vars: Box<[Rc<Pointer>]>,
+    pub outside_vars: Box<[Arc<Pointer>]>,
+    /// Schrodinger pointer variables replaced by the only pointer ever stored into them
+    pub promoted_pointers: Box<[(Arc<Pointer>, Arc<Pointer>)]>,
+    /// Value last assigned to (or, when optimizing, loaded from) each local within the current
+    /// basic block
+    pub(crate) local_values: Box<[Option<StackValue>]>,
+    /// Whether each local is ever read from it's variable
+    pub(crate) loaded_locals: Box<[bool]>,
+    /// Anchors of the last assignment to each local within the current basic block
+    pub(crate) local_stores: Box<[Range<usize>]>,
+    /// Defined functions called by this one (including calls who's result is never used)
+    pub(crate) callees: Vec<Arc<IdCell>>,
 }
 
 impl<'a> FunctionBuilder<'a> {
     pub fn new(
-        function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+        function_id: Arc<IdCell>,
         export: Option<Export<'a>>,
         config: &FunctionConfig,
         ty: &FuncType,
         body: FunctionBody<'a>,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Self> {
         if ty.results().len() >= 2 {
             return Err(Error::msg("Function can only have a single result value"));
@@ -202,7 +218,7 @@ impl<'a> FunctionBuilder<'a> {
                         *pointee,
                         size,
                         storage_class,
-                        Some(Rc::new(Pointer::new_variable(
+                        Some(Arc::new(Pointer::new_variable(
                             PointerSize::Skinny,
                             StorageClass::Function,
                             ScalarType::Isize(module),
@@ -216,7 +232,7 @@ impl<'a> FunctionBuilder<'a> {
             let variable = match param.kind {
                 ParameterKind::FunctionParameter => {
                     let param = Value::function_parameter(ty.clone());
-                    let var = Rc::new(Pointer::new_variable(
+                    let var = Arc::new(Pointer::new_variable(
                         pointer_size,
                         StorageClass::Function,
                         ty,
@@ -240,7 +256,7 @@ impl<'a> FunctionBuilder<'a> {
                         _ => {}
                     };
 
-                    let param = Rc::new(Pointer::new_variable(
+                    let param = Arc::new(Pointer::new_variable(
                         pointer_size,
                         storage_class,
                         ty.clone(),
@@ -250,7 +266,7 @@ impl<'a> FunctionBuilder<'a> {
                     outside_vars.push(param.clone());
                     interface.push(param.clone());
 
-                    let variable = Rc::new(Pointer::new_variable(
+                    let variable = Arc::new(Pointer::new_variable(
                         pointer_size,
                         StorageClass::Function,
                         ty,
@@ -270,7 +286,7 @@ impl<'a> FunctionBuilder<'a> {
 
                 ParameterKind::Output(location) => {
                     let decorators = vec![VariableDecorator::Location(location)];
-                    let param = Rc::new(Pointer::new_variable(
+                    let param = Arc::new(Pointer::new_variable(
                         pointer_size,
                         storage_class,
                         ty,
@@ -281,7 +297,7 @@ impl<'a> FunctionBuilder<'a> {
                 }
 
                 ParameterKind::DescriptorSet { set, binding, .. } => {
-                    let param = Rc::new(Pointer::new_variable(
+                    let param = Arc::new(Pointer::new_variable(
                         pointer_size,
                         storage_class,
                         ty,
@@ -320,7 +336,7 @@ impl<'a> FunctionBuilder<'a> {
                 || matches!(ty, ValType::I64 if module.wasm_memory64)
             {
                 for _ in 0..count {
-                    let storeable = Storeable::Schrodinger(Rc::new(Schrodinger {
+                    let storeable = Storeable::Schrodinger(Arc::new(Schrodinger {
                         pointer: OnceCell::new(),
                         offset: OnceCell::new(),
                         integer: OnceCell::new(),
@@ -330,7 +346,7 @@ impl<'a> FunctionBuilder<'a> {
             } else {
                 let ty = Type::from(ty);
                 for _ in 0..count {
-                    let pointer = Rc::new(Pointer::new_variable(
+                    let pointer = Arc::new(Pointer::new_variable(
                         PointerSize::Skinny,
                         StorageClass::Function,
                         ty.clone(),
@@ -357,18 +373,24 @@ impl<'a> FunctionBuilder<'a> {
             _ => None,
         };
 
+        let local_count = locals.len();
         let mut result = Self {
             anchors: Vec::new(),
             parameters: params.into_boxed_slice(),
             local_variables: locals.into_boxed_slice(),
             outside_vars: outside_vars.into_boxed_slice(),
             variable_initializers: variable_initializers.into_boxed_slice(),
+            promoted_pointers: Box::default(),
+            local_values: vec![None; local_count].into_boxed_slice(),
+            loaded_locals: vec![false; local_count].into_boxed_slice(),
+            local_stores: vec![0..0; local_count].into_boxed_slice(),
+            callees: Vec::new(),
             function_id,
             entry_point,
             return_type,
         };
 
-        let reader = BlockReader::new(body.get_operators_reader()?);
+        let reader = BlockReader::new(body.get_operators_reader()?)?;
         translate_block(
             reader,
             VecDeque::new(),
@@ -377,10 +399,232 @@ impl<'a> FunctionBuilder<'a> {
             module,
         )?;
 
+        if module.optimization >= OptimizationLevel::Basic {
+            opt::simplify_cfg(&mut result);
+        }
+
+        if module.optimization >= OptimizationLevel::Basic {
+            result.remove_unread_locals();
+        }
+        result.promote_schrodinger_pointers();
+
+        if module.optimization >= OptimizationLevel::Basic {
+            vectorize::vectorize_stores(&mut result, module);
+        }
         return Ok(result);
     }
 
-    pub fn block_of(&self, op: &Operation) -> Option<&Rc<Label>> {
+    /// Starts a new basic block, after which locals must be read from their variables again.
+    pub fn begin_block(&mut self, label: Arc<Label>) {
+        self.anchors.push(Operation::Label(label));
+        self.local_values.iter_mut().for_each(|x| *x = None);
+        self.local_stores.iter_mut().for_each(|x| *x = 0..0);
+    }
+
+    /// Records the anchors that assigned the local. If it was already assigned on the current basic
+    /// block, the previous assignment has been overwritten before any read from the variable (reads
+    /// after an assignment are forwarded), so the stores into variables that have been stored into
+    /// again are replaced by the stored values. Assignments that aren't forwarded may be read from
+    /// the variable, so they're never removed.
+    pub(crate) fn eliminate_dead_store(&mut self, local_index: u32, stores: Range<usize>) {
+        let i = local_index as usize;
+        if self.local_values.get(i).map_or(true, Option::is_none) {
+            if let Some(previous) = self.local_stores.get_mut(i) {
+                *previous = 0..0;
+            }
+            return;
+        }
+
+        let targets = self.anchors[stores.clone()]
+            .iter()
+            .filter_map(|x| match x {
+                Operation::Store { target, .. } => Some(target.clone()),
+                _ => None,
+            })
+            .collect::<Vec<_>>();
+
+        let previous = std::mem::replace(&mut self.local_stores[i], stores);
+        for op in self.anchors[previous].iter_mut() {
+            if let Operation::Store { target, value, .. } = op {
+                if targets.iter().any(|x| Arc::ptr_eq(x, target)) {
+                    *op = Operation::Value(value.clone());
+                }
+            }
+        }
+    }
+
+    /// Value of the local, if it was assigned earlier on the current basic block.
+    pub fn local_value(&self, local_index: u32) -> Option<StackValue> {
+        return self.local_values.get(local_index as usize)?.clone();
+    }
+
+    /// Locals that are never read from their variables (every read was forwarded from an
+    /// assignment on the same basic block) don't need a variable at all. Their stores are
+    /// replaced by the stored values, which keeps those values evaluated at the same point.
+    fn remove_unread_locals(&mut self) {
+        let mut unread = Vec::new();
+        for (local, loaded) in self.local_variables.iter().zip(self.loaded_locals.iter()) {
+            if *loaded {
+                continue;
+            }
+
+            match local {
+                Storeable::Pointer {
+                    variable,
+                    integer_variable: None,
+                } if variable.storage_class == StorageClass::Function => {
+                    unread.push(variable.clone())
+                }
+                Storeable::Schrodinger(sch) => unread.extend(
+                    [&sch.pointer, &sch.offset, &sch.integer]
+                        .into_iter()
+                        .filter_map(OnceCell::get)
+                        .cloned(),
+                ),
+                _ => {}
+            }
+        }
+
+        if unread.is_empty() {
+            return;
+        }
+
+        let remove_store = |op: &mut Operation| {
+            if let Operation::Store { target, value, .. } = op {
+                if unread.iter().any(|x| Arc::ptr_eq(x, target)) {
+                    *op = Operation::Value(value.clone());
+                }
+            }
+        };
+
+        self.anchors.iter_mut().for_each(remove_store);
+        self.variable_initializers.iter_mut().for_each(remove_store);
+    }
+
+    /// Most Schrodinger locals that hold pointers only ever point into a single buffer, with only
+    /// their byte offset changing. For those, the pointer variable is removed, its stores are
+    /// dropped, and its loads are replaced by the pointer it would always contain.
+    fn promote_schrodinger_pointers(&mut self) {
+        let mut promoted = Vec::new();
+
+        for local in self.local_variables.iter() {
+            let variable = match local {
+                Storeable::Schrodinger(sch) => match sch.pointer.get() {
+                    Some(variable) => variable,
+                    None => continue,
+                },
+                _ => continue,
+            };
+
+            let mut stores = self.anchors.iter().filter_map(|x| match x {
+                Operation::Store { target, value, .. } if Arc::ptr_eq(target, variable) => {
+                    Some(value)
+                }
+                _ => None,
+            });
+
+            let value = match stores.next() {
+                Some(Value::Pointer(value)) => value,
+                _ => continue,
+            };
+
+            let base = match invariant_base(value) {
+                Some(base) => base,
+                None => continue,
+            };
+
+            if stores.all(|x| match x {
+                Value::Pointer(x) => invariant_base(x).is_some_and(|x| Arc::ptr_eq(x, base)),
+                _ => false,
+            }) {
+                promoted.push((variable.clone(), value.clone()));
+            }
+        }
+
+        if promoted.is_empty() {
+            return;
+        }
+
+        self.anchors.retain(|x| match x {
+            Operation::Store { target, .. } => {
+                !promoted.iter().any(|(x, _)| Arc::ptr_eq(x, target))
+            }
+            _ => true,
+        });
+
+        // Translated on the entry block, so that the value dominates every former load
+        let mut variable_initializers = std::mem::take(&mut self.variable_initializers).into_vec();
+        variable_initializers.extend(
+            promoted
+                .iter()
+                .map(|(_, value)| Operation::Value(Value::Pointer(value.clone()))),
+        );
+
+        self.variable_initializers = variable_initializers.into_boxed_slice();
+        self.promoted_pointers = promoted.into_boxed_slice();
+    }
+
+    pub fn promoted_pointer(&self, variable: &Arc<Pointer>) -> Option<&Arc<Pointer>> {
+        return self
+            .promoted_pointers
+            .iter()
+            .find(|(x, _)| Arc::ptr_eq(x, variable))
+            .map(|(_, value)| value);
+    }
+
+    /// Merge block and continue target of a conditional branch, inferred from the shape of the
+    /// blocks it branches to.
+    pub fn structure_of(
+        &self,
+        branch: &Operation,
+    ) -> Result<(Option<Arc<Label>>, Option<Arc<Label>>)> {
+        let (true_label, false_label) = match branch {
+            Operation::BranchConditional {
+                true_label,
+                false_label,
+                ..
+            } => (true_label, false_label),
+            _ => return Err(Error::unexpected()),
+        };
+
+        let current_block = self.block_of(branch).ok_or_else(Error::unexpected)?;
+        let true_block = self.block(true_label).last();
+        let false_block = self.block(false_label).last();
+
+        return Ok(match (true_block, false_block) {
+            // Both blocks end up branching to the same block.
+            // This is probably a structured if
+            (Some(Operation::Branch { label }), Some(Operation::Branch { label: label1 }))
+                if Arc::ptr_eq(label, label1) =>
+            {
+                (Some(label.clone()), None)
+            }
+
+            // True block ends up branching to the current label.
+            // True block is probably the continue target, leaving the false block as the "exit" branch
+            (Some(Operation::Branch { label }), _) if label == current_block => {
+                (Some(false_label.clone()), Some(true_label.clone()))
+            }
+
+            // True block ends up branching to the false label.
+            (Some(Operation::Branch { label }), _) if label == false_label => {
+                (Some(false_label.clone()), None)
+            }
+
+            (_, Some(Operation::Branch { label })) if label == true_label => {
+                (Some(true_label.clone()), None)
+            }
+
+            // False block ends up branching to the current label.
+            // False block is probably the continue target, leaving the true block as the "exit" branch
+            (_, Some(Operation::Branch { label })) if label == current_block => {
+                (Some(true_label.clone()), Some(false_label.clone()))
+            }
+            _ => (None, None),
+        });
+    }
+
+    pub fn block_of(&self, op: &Operation) -> Option<&Arc<Label>> {
         let mut current_blocks = Vec::new();
 
         for anchor in self.anchors.iter() {
@@ -403,7 +647,7 @@ impl<'a> FunctionBuilder<'a> {
         return None;
     }
 
-    pub fn block(&self, label: &Rc<Label>) -> impl Iterator<Item = &Operation> {
+    pub fn block(&self, label: &Arc<Label>) -> impl Iterator<Item = &Operation> {
         let mut start_idx = None;
         for (i, anchor) in self.anchors.iter().enumerate() {
             if anchor == label {
@@ -433,6 +677,19 @@ impl<'a> FunctionBuilder<'a> {
     }
 }
 
+/// Global variable a pointer is derived from, as long as it always evaluates to the same value
+/// regardless of where it's computed.
+fn invariant_base(pointer: &Arc<Pointer>) -> Option<&Arc<Pointer>> {
+    match &pointer.source {
+        PointerSource::Casted { prev } => invariant_base(prev),
+        PointerSource::Decayed { array } => invariant_base(array),
+        PointerSource::Variable { .. } if pointer.storage_class != StorageClass::Function => {
+            Some(pointer)
+        }
+        _ => None,
+    }
+}
+
 #[must_use]
 #[derive(Debug)]
 pub struct FunctionConfigBuilder<'a> {
@@ -497,10 +754,20 @@ pub enum ExecutionMode {
     OriginUpperLeft,
     OriginLowerLeft,
     LocalSize(u32, u32, u32),
+    /// Workgroup size given by specialization constants, so that it can be changed when the
+    /// pipeline is created
+    LocalSizeId(SpecConstant, SpecConstant, SpecConstant),
     LocalSizeHint(u32, u32, u32),
     DepthReplacing,
 }
 
+/// Unsigned specialization constant, decorated with `SpecId`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+pub struct SpecConstant {
+    pub spec_id: u32,
+    pub default: u32,
+}
+
 #[must_use]
 pub struct ParameterBuilder<'a> {
     inner: Parameter,
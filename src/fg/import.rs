@@ -1,15 +1,28 @@
 use super::{
+    atomic::device_scope,
+    block::{BlockBuilder, StackValue},
     module::{GlobalVariable, ModuleBuilder},
+    subgroup::{check_platform, SubgroupArithmetic, SubgroupSource},
     Operation,
 };
 use crate::{
+    config::WorkgroupArray,
     decorator::VariableDecorator,
     error::{Error, Result},
-    fg::{module::CallableFunction, values::pointer::Pointer},
+    fg::{
+        module::CallableFunction,
+        values::{
+            bool::{Bool, BoolSource},
+            float::{Float, FloatSource},
+            integer::{ConversionSource, Integer, IntegerKind, IntegerSource},
+            pointer::Pointer,
+            Value,
+        },
+    },
     r#type::{CompositeType, PointerSize, ScalarType, Type},
 };
-use rspirv::spirv::{BuiltIn, StorageClass};
-use std::rc::Rc;
+use rspirv::spirv::{BuiltIn, Capability, GroupOperation, MemorySemantics, Scope, StorageClass};
+use std::sync::Arc;
 use wasmparser::TypeRef;
 
 pub enum ImportResult {
@@ -33,12 +46,275 @@ pub fn translate_spir_global<'a>(
         "gl_WorkGroupSize" => import_uint3_input(BuiltIn::WorkgroupSize, ty, module),
         "gl_LocalInvocationID" => import_uint3_input(BuiltIn::LocalInvocationId, ty, module),
         "gl_GlobalInvocationID" => import_uint3_input(BuiltIn::GlobalInvocationId, ty, module),
+
+        // Barriers
+        "barrier" => import_barrier(
+            Some(Scope::Workgroup),
+            Scope::Workgroup,
+            MemorySemantics::WORKGROUP_MEMORY,
+            ty,
+        ),
+        "memoryBarrier" => import_barrier(
+            None,
+            device_scope(module),
+            MemorySemantics::UNIFORM_MEMORY
+                | MemorySemantics::WORKGROUP_MEMORY
+                | MemorySemantics::IMAGE_MEMORY,
+            ty,
+        ),
+        "memoryBarrierBuffer" => import_barrier(
+            None,
+            device_scope(module),
+            MemorySemantics::UNIFORM_MEMORY,
+            ty,
+        ),
+        "memoryBarrierShared" => import_barrier(
+            None,
+            Scope::Workgroup,
+            MemorySemantics::WORKGROUP_MEMORY,
+            ty,
+        ),
+        "groupMemoryBarrier" => import_barrier(
+            None,
+            Scope::Workgroup,
+            MemorySemantics::UNIFORM_MEMORY
+                | MemorySemantics::WORKGROUP_MEMORY
+                | MemorySemantics::IMAGE_MEMORY,
+            ty,
+        ),
+
+        // Subgroups
+        "gl_SubgroupSize" => import_uint_input(BuiltIn::SubgroupSize, ty, module),
+        "gl_SubgroupInvocationID" => {
+            import_uint_input(BuiltIn::SubgroupLocalInvocationId, ty, module)
+        }
+        "subgroupElect"
+        | "subgroupAll"
+        | "subgroupAny"
+        | "subgroupBallot"
+        | "subgroupBroadcastFirst"
+        | "subgroupShuffle"
+        | "subgroupAdd"
+        | "subgroupMin"
+        | "subgroupMax"
+        | "subgroupUMin"
+        | "subgroupUMax"
+        | "subgroupInclusiveAdd"
+        | "subgroupExclusiveAdd" => import_subgroup(name, ty, module),
+
         _ => return Ok(None),
     };
 
     return result.map(Some);
 }
 
+/// Declares the configured workgroup array with the import's name, importing a pointer to it's
+/// first element.
+pub fn translate_workgroup_array<'a>(
+    name: &'a str,
+    ty: TypeRef,
+    arrays: &[WorkgroupArray],
+    module: &mut ModuleBuilder,
+) -> Result<ImportResult> {
+    let array = arrays
+        .iter()
+        .find(|x| &*x.name == name)
+        .ok_or_else(|| Error::msg(format!("Workgroup array '{name}' isn't configured")))?;
+
+    if array.ty.comptime_byte_size(module).is_none() {
+        return Err(Error::msg(format!(
+            "Elements of workgroup array '{name}' must have a known size"
+        )));
+    }
+
+    let var = Arc::new(Pointer::new_variable(
+        PointerSize::Skinny,
+        StorageClass::Workgroup,
+        CompositeType::array(array.ty.clone(), array.length),
+        None,
+        [],
+    ));
+    module.hidden_global_variables.push(var.clone());
+
+    let pointer = Arc::new(var.decay()?);
+    return Ok(match ty {
+        TypeRef::Global(global) if !global.mutable => {
+            ImportResult::Global(GlobalVariable::Constant(Value::Pointer(pointer)))
+        }
+        TypeRef::Func(_) => ImportResult::Func(CallableFunction::callback(
+            move |block, _function, _module| {
+                block.stack_push(pointer.clone());
+                Ok(())
+            },
+        )),
+        _ => return Err(Error::unexpected()),
+    });
+}
+
+/// Imports a function emitting a memory barrier, synchronizing the execution of every
+/// invocation within `execution` if present.
+fn import_barrier(
+    execution: Option<Scope>,
+    scope: Scope,
+    storage_semantics: MemorySemantics,
+    ty: TypeRef,
+) -> Result<ImportResult> {
+    let semantics = MemorySemantics::ACQUIRE_RELEASE | storage_semantics;
+    let barrier = match execution {
+        Some(execution) => Operation::ControlBarrier {
+            execution,
+            scope,
+            semantics,
+        },
+        None => Operation::MemoryBarrier { scope, semantics },
+    };
+
+    return Ok(match ty {
+        TypeRef::Func(_) => ImportResult::Func(CallableFunction::callback(
+            move |_block, function, _module| {
+                function.anchors.push(barrier.clone());
+                Ok(())
+            },
+        )),
+        _ => return Err(Error::unexpected()),
+    });
+}
+
+/// Imports a function performing a subgroup operation.
+///
+/// Since wasm functions return a single value, `subgroupBallot` takes the index of the 32-bit
+/// component of the ballot mask to return.
+fn import_subgroup(name: &str, ty: TypeRef, module: &mut ModuleBuilder) -> Result<ImportResult> {
+    if !matches!(ty, TypeRef::Func(_)) {
+        return Err(Error::unexpected());
+    }
+
+    check_platform(module.platform)?;
+    module
+        .capabilities
+        .require_mut(Capability::GroupNonUniform)?;
+
+    let f = match name {
+        "subgroupElect" => subgroup_callback(|_, _| Ok(SubgroupSource::Elect)),
+        "subgroupAll" => subgroup_callback(|block, module| {
+            Ok(SubgroupSource::All(
+                block.stack_pop(ScalarType::Bool, module)?.into_bool()?,
+            ))
+        }),
+        "subgroupAny" => subgroup_callback(|block, module| {
+            Ok(SubgroupSource::Any(
+                block.stack_pop(ScalarType::Bool, module)?.into_bool()?,
+            ))
+        }),
+        "subgroupBallot" => subgroup_callback(|block, module| {
+            let component = block.stack_pop(ScalarType::I32, module)?.into_integer()?;
+            let predicate = block.stack_pop(ScalarType::Bool, module)?.into_bool()?;
+            Ok(SubgroupSource::Ballot {
+                predicate,
+                component,
+            })
+        }),
+        "subgroupBroadcastFirst" => {
+            subgroup_callback(|block, _| Ok(SubgroupSource::BroadcastFirst(pop_scalar(block)?)))
+        }
+        "subgroupShuffle" => subgroup_callback(|block, module| {
+            let id = block.stack_pop(ScalarType::I32, module)?.into_integer()?;
+            let value = pop_scalar(block)?;
+            Ok(SubgroupSource::Shuffle { value, id })
+        }),
+        "subgroupAdd" => subgroup_arithmetic(SubgroupArithmetic::Add, GroupOperation::Reduce),
+        "subgroupInclusiveAdd" => {
+            subgroup_arithmetic(SubgroupArithmetic::Add, GroupOperation::InclusiveScan)
+        }
+        "subgroupExclusiveAdd" => {
+            subgroup_arithmetic(SubgroupArithmetic::Add, GroupOperation::ExclusiveScan)
+        }
+        "subgroupMin" => subgroup_arithmetic(
+            SubgroupArithmetic::Min { signed: true },
+            GroupOperation::Reduce,
+        ),
+        "subgroupMax" => subgroup_arithmetic(
+            SubgroupArithmetic::Max { signed: true },
+            GroupOperation::Reduce,
+        ),
+        "subgroupUMin" => subgroup_arithmetic(
+            SubgroupArithmetic::Min { signed: false },
+            GroupOperation::Reduce,
+        ),
+        "subgroupUMax" => subgroup_arithmetic(
+            SubgroupArithmetic::Max { signed: false },
+            GroupOperation::Reduce,
+        ),
+        _ => return Err(Error::msg(format!("Unknown subgroup operation '{name}'"))),
+    };
+
+    return Ok(ImportResult::Func(f));
+}
+
+/// Subgroup operations are convergent, so they are anchored where they are called instead of
+/// where their result is first used.
+fn subgroup_callback(
+    f: impl 'static
+        + Send
+        + Sync
+        + for<'a> Fn(&mut BlockBuilder<'a>, &ModuleBuilder) -> Result<SubgroupSource>,
+) -> CallableFunction {
+    CallableFunction::callback(move |block, function, module| {
+        let source = f(block, module)?;
+        module.capabilities.require(source.required_capability())?;
+
+        let anchor = match source.value() {
+            Some(Value::Integer(_)) => {
+                Value::Integer(Arc::new(Integer::new(IntegerSource::Subgroup(source))))
+            }
+            Some(Value::Float(_)) => {
+                Value::Float(Arc::new(Float::new(FloatSource::Subgroup(source))))
+            }
+            Some(_) => {
+                return Err(Error::msg(
+                    "Subgroup operations are only supported on scalar numbers",
+                ))
+            }
+            None if matches!(source, SubgroupSource::Ballot { .. }) => {
+                Value::Integer(Arc::new(Integer::new(IntegerSource::Subgroup(source))))
+            }
+            None => Value::Bool(Arc::new(Bool::new(BoolSource::Subgroup(source)))),
+        };
+
+        // Wasm has no booleans, so they are returned as an `i32`
+        let result = match anchor {
+            Value::Bool(ref value) => {
+                Value::Integer(Arc::new(Integer::new(IntegerSource::Conversion(
+                    ConversionSource::FromBool(value.clone(), IntegerKind::Short),
+                ))))
+            }
+            ref value => value.clone(),
+        };
+
+        function.anchors.push(Operation::Value(anchor));
+        block.stack_push(result);
+        Ok(())
+    })
+}
+
+fn subgroup_arithmetic(kind: SubgroupArithmetic, operation: GroupOperation) -> CallableFunction {
+    subgroup_callback(move |block, _| {
+        Ok(SubgroupSource::Arithmetic {
+            kind,
+            operation,
+            value: pop_scalar(block)?,
+        })
+    })
+}
+
+/// Pops a scalar operand, keeping whatever type it was pushed with.
+fn pop_scalar(block: &mut BlockBuilder) -> Result<Value> {
+    return Ok(match block.stack_pop_any()? {
+        StackValue::Value(value) => value,
+        StackValue::Schrodinger { loaded_integer, .. } => Value::Integer(loaded_integer),
+    });
+}
+
 fn import_output(
     builtin: BuiltIn,
     output_type: impl Into<Type>,
@@ -47,7 +323,7 @@ fn import_output(
 ) -> Result<ImportResult> {
     let output_type = output_type.into();
 
-    let var = Rc::new(Pointer::new_variable(
+    let var = Arc::new(Pointer::new_variable(
         PointerSize::Skinny,
         StorageClass::Output,
         output_type.clone(),
@@ -61,7 +337,7 @@ fn import_output(
             ImportResult::Func(CallableFunction::callback(
                 move |block, function, module| {
                     if let Some(ref mut entry_point) = function.entry_point {
-                        if !entry_point.interface.iter().any(|x| Rc::ptr_eq(x, &var)) {
+                        if !entry_point.interface.iter().any(|x| Arc::ptr_eq(x, &var)) {
                             entry_point.interface.push(var.clone());
                         }
                     }
@@ -86,7 +362,7 @@ fn import_uint3_input(
     ty: TypeRef,
     module: &mut ModuleBuilder,
 ) -> Result<ImportResult> {
-    let var = Rc::new(Pointer::new_variable(
+    let var = Arc::new(Pointer::new_variable(
         PointerSize::Skinny,
         StorageClass::Input,
         CompositeType::vector(ScalarType::I32, 3),
@@ -100,7 +376,7 @@ fn import_uint3_input(
             ImportResult::Func(CallableFunction::callback(
                 move |block, function, module| {
                     if let Some(ref mut entry_point) = function.entry_point {
-                        if !entry_point.interface.iter().any(|x| Rc::ptr_eq(x, &var)) {
+                        if !entry_point.interface.iter().any(|x| Arc::ptr_eq(x, &var)) {
                             entry_point.interface.push(var.clone());
                         }
                     }
@@ -115,3 +391,37 @@ fn import_uint3_input(
         _ => return Err(Error::unexpected()),
     });
 }
+
+fn import_uint_input(
+    builtin: BuiltIn,
+    ty: TypeRef,
+    module: &mut ModuleBuilder,
+) -> Result<ImportResult> {
+    let var = Arc::new(Pointer::new_variable(
+        PointerSize::Skinny,
+        StorageClass::Input,
+        ScalarType::I32,
+        None,
+        [VariableDecorator::BuiltIn(builtin)],
+    ));
+
+    return Ok(match ty {
+        TypeRef::Func(_) => {
+            module.hidden_global_variables.push(var.clone());
+            ImportResult::Func(CallableFunction::callback(
+                move |block, function, module| {
+                    if let Some(ref mut entry_point) = function.entry_point {
+                        if !entry_point.interface.iter().any(|x| Arc::ptr_eq(x, &var)) {
+                            entry_point.interface.push(var.clone());
+                        }
+                    }
+
+                    let value = var.clone().load(None, block, module)?;
+                    block.stack_push(value);
+                    Ok(())
+                },
+            ))
+        }
+        _ => return Err(Error::unexpected()),
+    });
+}
@@ -1,23 +1,83 @@
 use self::values::{bool::Bool, pointer::Pointer, Value};
 use crate::r#type::Type;
-use std::{cell::Cell, rc::Rc};
+use rspirv::spirv::{MemorySemantics, Scope};
+use std::{
+    fmt::Debug,
+    sync::{
+        atomic::{AtomicU32, Ordering},
+        Arc,
+    },
+};
 
+pub mod atomic;
 pub mod block;
+pub mod debug;
 pub mod extended_is;
 pub mod function;
 pub mod import;
 pub mod module;
+pub mod opt;
+pub mod subgroup;
 pub mod values;
+pub mod vectorize;
+
+/// Thread-safe slot holding the SPIR-V id a node has been translated to.
+///
+/// SPIR-V never assigns the id `0`, so it's used to represent a node that hasn't been translated yet.
+#[derive(Default)]
+pub struct IdCell(AtomicU32);
+
+impl IdCell {
+    pub const fn new(value: Option<rspirv::spirv::Word>) -> Self {
+        return Self(AtomicU32::new(match value {
+            Some(x) => x,
+            None => 0,
+        }));
+    }
+
+    #[inline]
+    pub fn get(&self) -> Option<rspirv::spirv::Word> {
+        match self.0.load(Ordering::Acquire) {
+            0 => None,
+            x => Some(x),
+        }
+    }
+
+    #[inline]
+    pub fn set(&self, value: Option<rspirv::spirv::Word>) {
+        self.0.store(value.unwrap_or_default(), Ordering::Release)
+    }
+}
+
+impl Clone for IdCell {
+    #[inline]
+    fn clone(&self) -> Self {
+        Self::new(self.get())
+    }
+}
+
+impl PartialEq for IdCell {
+    #[inline]
+    fn eq(&self, other: &Self) -> bool {
+        self.get() == other.get()
+    }
+}
+
+impl Debug for IdCell {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_tuple("IdCell").field(&self.get()).finish()
+    }
+}
 
 #[derive(Debug, PartialEq)]
 pub enum MergeBlock {
     This,
-    Label(Rc<Label>),
+    Label(Arc<Label>),
 }
 
 #[derive(Debug, PartialEq, Default)]
 pub struct Label {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
 }
 
 #[derive(Debug, Clone)]
@@ -29,31 +89,46 @@ pub enum End {
 #[derive(Debug, Clone)]
 pub enum Operation {
     Value(Value),
-    Label(Rc<Label>),
+    Label(Arc<Label>),
     Branch {
-        label: Rc<Label>,
+        label: Arc<Label>,
     },
     BranchConditional {
-        condition: Rc<Bool>,
-        true_label: Rc<Label>,
-        false_label: Rc<Label>,
+        condition: Arc<Bool>,
+        true_label: Arc<Label>,
+        false_label: Arc<Label>,
     },
     Store {
-        target: Rc<Pointer>,
+        target: Arc<Pointer>,
         value: Value,
         log2_alignment: Option<u32>,
     },
     Copy {
-        src: Rc<Pointer>,
+        src: Arc<Pointer>,
         src_log2_alignment: Option<u32>,
-        dst: Rc<Pointer>,
+        dst: Arc<Pointer>,
         dst_log2_alignment: Option<u32>,
     },
     FunctionCall {
-        function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+        function_id: Arc<IdCell>,
         args: Box<[Value]>,
     },
+    AtomicStore {
+        target: Arc<Pointer>,
+        value: Value,
+    },
+    MemoryBarrier {
+        scope: Scope,
+        semantics: MemorySemantics,
+    },
+    ControlBarrier {
+        execution: Scope,
+        scope: Scope,
+        semantics: MemorySemantics,
+    },
     Nop,
+    /// Offset into the code section of the operator the anchors that follow are translated from
+    Line(u32),
     Unreachable,
     Return {
         value: Option<Value>,
@@ -65,7 +140,7 @@ impl Operation {
         match (self, other) {
             (Operation::Value(x), Operation::Value(y)) => x.ptr_eq(y),
             (Operation::Label(x), Operation::Label(y))
-            | (Operation::Branch { label: x }, Operation::Branch { label: y }) => Rc::ptr_eq(x, y),
+            | (Operation::Branch { label: x }, Operation::Branch { label: y }) => Arc::ptr_eq(x, y),
             (
                 Operation::BranchConditional {
                     condition,
@@ -78,9 +153,9 @@ impl Operation {
                     false_label: other_false_label,
                 },
             ) => {
-                Rc::ptr_eq(condition, other_condition)
-                    && Rc::ptr_eq(true_label, other_true_label)
-                    && Rc::ptr_eq(false_label, other_false_label)
+                Arc::ptr_eq(condition, other_condition)
+                    && Arc::ptr_eq(true_label, other_true_label)
+                    && Arc::ptr_eq(false_label, other_false_label)
             }
             // TODO are ops without values equal?
             _ => false,
@@ -103,16 +178,16 @@ impl Operation {
     }
 }
 
-impl PartialEq<Rc<Label>> for Operation {
-    fn eq(&self, other: &Rc<Label>) -> bool {
+impl PartialEq<Arc<Label>> for Operation {
+    fn eq(&self, other: &Arc<Label>) -> bool {
         match self {
-            Operation::Label(x) => Rc::ptr_eq(x, other),
+            Operation::Label(x) => Arc::ptr_eq(x, other),
             _ => false,
         }
     }
 }
 
-impl PartialEq<Operation> for Rc<Label> {
+impl PartialEq<Operation> for Arc<Label> {
     #[inline]
     fn eq(&self, other: &Operation) -> bool {
         other == self
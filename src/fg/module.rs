@@ -1,42 +1,61 @@
 use super::{
     block::{mvp::translate_constants, translate_block, BlockBuilder, BlockReader},
+    debug::DebugInfo,
     extended_is::ExtendedIs,
     function::FunctionBuilder,
-    import::{translate_spir_global, ImportResult},
+    import::{translate_spir_global, translate_workgroup_array, ImportResult},
     values::{integer::IntegerKind, pointer::Pointer, Value},
-    End,
+    End, IdCell,
 };
 use crate::{
-    config::{CapabilityModel, Config, MemoryGrowErrorKind},
+    config::{BoundsCheckKind, CapabilityModel, Config, MemoryGrowErrorKind, OptimizationLevel},
     error::{Error, Result},
     r#type::{PointerSize, ScalarType, Type},
     version::{TargetPlatform, Version},
     Str,
 };
 use rspirv::spirv::{AddressingModel, MemoryModel, StorageClass};
-use std::{borrow::Cow, cell::Cell, collections::VecDeque, rc::Rc};
+use std::{
+    borrow::Cow,
+    collections::{HashMap, HashSet, VecDeque},
+    sync::Arc,
+};
 use tracing::warn;
-use wasmparser::{ExternalKind, FuncType, Payload, Validator};
+use wasmparser::{
+    types::TypesRef, Export, ExternalKind, FuncType, FuncValidatorAllocations, FunctionBody,
+    Global, Import, Payload, ValidPayload, Validator,
+};
+
+/// Function body waiting to be built, with everything it's builder requires.
+type FunctionJob<'a> = (
+    u32,
+    Arc<IdCell>,
+    Option<Export<'a>>,
+    FuncType,
+    FunctionBody<'a>,
+);
 
 #[derive(Debug, Clone)]
 pub enum GlobalVariable {
-    Variable(Rc<Pointer>),
+    Variable(Arc<Pointer>),
     Constant(Value),
 }
 
 #[derive(Clone)]
 pub enum CallableFunction {
     Callback(
-        Rc<
+        Arc<
             dyn for<'a> Fn(
-                &mut BlockBuilder<'a>,
-                &mut FunctionBuilder,
-                &mut ModuleBuilder,
-            ) -> Result<()>,
+                    &mut BlockBuilder<'a>,
+                    &mut FunctionBuilder,
+                    &ModuleBuilder,
+                ) -> Result<()>
+                + Send
+                + Sync,
         >,
     ),
     Defined {
-        function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+        function_id: Arc<IdCell>,
         ty: FuncType,
     },
 }
@@ -44,37 +63,245 @@ pub enum CallableFunction {
 impl CallableFunction {
     pub fn callback(
         f: impl 'static
-            + for<'a> Fn(
-                &mut BlockBuilder<'a>,
-                &mut FunctionBuilder,
-                &mut ModuleBuilder,
-            ) -> Result<()>,
+            + Send
+            + Sync
+            + for<'a> Fn(&mut BlockBuilder<'a>, &mut FunctionBuilder, &ModuleBuilder) -> Result<()>,
     ) -> Self {
-        Self::Callback(Rc::new(f))
+        Self::Callback(Arc::new(f))
     }
 }
 
 pub struct ModuleBuilder<'a> {
     pub platform: TargetPlatform,
     pub version: Version,
-    pub extended_is: Box<[Rc<ExtendedIs>]>,
+    pub extended_is: Box<[Arc<ExtendedIs>]>,
     pub capabilities: CapabilityModel,
     pub extensions: Box<[Str<'static>]>,
     pub addressing_model: AddressingModel,
     pub memory_model: MemoryModel,
     pub memory_grow_error: MemoryGrowErrorKind,
+    pub bounds_checks: BoundsCheckKind,
+    pub optimization: OptimizationLevel,
     pub wasm_memory64: bool,
     pub functions: Box<[CallableFunction]>,
     pub global_variables: Box<[GlobalVariable]>,
-    pub hidden_global_variables: Vec<Rc<Pointer>>,
+    pub hidden_global_variables: Vec<Arc<Pointer>>,
     pub built_functions: Box<[FunctionBuilder<'a>]>,
+    /// Defined functions (sorted by index) who's body isn't built, since their translation is
+    /// spliced in from an earlier compilation, with the indices of the functions they call
+    pub reused_functions: Box<[(u32, Box<[u32]>)]>,
+    /// Only collected when [`Config::debug_info`] is enabled
+    pub debug_info: Option<DebugInfo<'a>>,
 }
 
 impl<'a> ModuleBuilder<'a> {
     pub fn new(config: Config, bytes: &'a [u8]) -> Result<Self> {
+        return Self::new_reusing(config, bytes, Box::default());
+    }
+
+    /// Like [`new`](ModuleBuilder::new), but without building the bodies of `reused_functions`
+    /// (given with the indices of the functions they call).
+    ///
+    /// The module is validated and read in a single pass. Everything a function body may refer
+    /// to precedes the code section, so (unless they're built in parallel) functions are built as
+    /// soon as their code section entry is read.
+    pub fn new_reusing(
+        config: Config,
+        bytes: &'a [u8],
+        mut reused_functions: Box<[(u32, Box<[u32]>)]>,
+    ) -> Result<Self> {
+        reused_functions.sort_unstable_by_key(|(index, _)| *index);
+        let _span = tracing::info_span!("parse").entered();
         let mut validator = Validator::new_with_features(config.features.into());
-        let types = validator.validate_all(&bytes)?;
+        let mut allocations = FuncValidatorAllocations::default();
+
+        let mut result = None;
+        let mut next_function = 0u32;
+        let mut globals = Vec::new();
+        let mut imports = Vec::new();
+        let mut exports = Vec::new();
+        let mut jobs = Vec::new();
+        let mut built_functions = Vec::new();
+        let mut name_section = None;
+
+        for payload in wasmparser::Parser::new(0).parse_all(bytes) {
+            let payload = payload?;
+            match validator.payload(&payload)? {
+                ValidPayload::Func(func, body) => {
+                    let mut func = func.into_validator(std::mem::take(&mut allocations));
+                    func.validate(&body)?;
+                    allocations = func.into_allocations();
+                }
+                ValidPayload::End(types) if result.is_none() => {
+                    // Modules without a code section
+                    let (module, _) = Self::declare(
+                        &config,
+                        types.as_ref(),
+                        std::mem::take(&mut imports),
+                        &globals,
+                        std::mem::take(&mut reused_functions),
+                    )?;
+                    result = Some(module);
+                }
+                _ => {}
+            }
+
+            match payload {
+                Payload::ImportSection(imp) => {
+                    imports.reserve(imp.count() as usize);
+                    for import in imp.into_iter() {
+                        imports.push(import?);
+                    }
+                }
+                Payload::ExportSection(exp) => {
+                    exports.reserve(exp.count() as usize);
+                    for export in exp.into_iter() {
+                        exports.push(export?);
+                    }
+                }
+                Payload::GlobalSection(g) => {
+                    globals.reserve(g.count() as usize);
+                    for global in g.into_iter() {
+                        globals.push(global?);
+                    }
+                }
+                Payload::CustomSection(section)
+                    if config.debug_info && section.name() == "name" =>
+                {
+                    name_section = Some((section.data(), section.data_offset()));
+                }
+                Payload::CodeSectionStart { count, range, .. } => {
+                    let types = validator.types(0).ok_or_else(Error::unexpected)?;
+                    let (module, imported_function_count) = Self::declare(
+                        &config,
+                        types,
+                        std::mem::take(&mut imports),
+                        &globals,
+                        std::mem::take(&mut reused_functions),
+                    )?;
+
+                    result = Some(module);
+                    if let Some(debug_info) = result.as_mut().and_then(|x| x.debug_info.as_mut()) {
+                        debug_info.code_offset = range.start;
+                    }
+                    next_function = imported_function_count;
+                    match config.parallel {
+                        true => jobs.reserve(count as usize),
+                        false => built_functions.reserve(count as usize),
+                    }
+                }
+                Payload::CodeSectionEntry(body) => {
+                    let module = result.as_ref().ok_or_else(Error::unexpected)?;
+                    let i = next_function;
+                    next_function += 1;
+
+                    if module
+                        .reused_functions
+                        .binary_search_by_key(&i, |(index, _)| *index)
+                        .is_ok()
+                    {
+                        continue;
+                    }
+
+                    let job = module.function_job(i, body, &exports)?;
+                    match config.parallel {
+                        true => jobs.push(job),
+                        false => built_functions.push(module.build_function(&config, job)?),
+                    }
+                }
+                Payload::End(_) => break,
+                _ => continue,
+            }
+        }
+
+        let mut result = result.ok_or_else(Error::unexpected)?;
+        // The name section follows the code section, so names are only known once it's been read
+        if let (Some(debug_info), Some((data, offset))) = (&mut result.debug_info, name_section) {
+            debug_info.read_names(data, offset)?;
+        }
+
+        if config.parallel {
+            built_functions = crate::parallel::map(jobs, |job| result.build_function(&config, job))
+                .into_iter()
+                .collect::<Result<Vec<_>>>()?;
+        }
+
+        result.built_functions = built_functions.into_boxed_slice();
+        result.eliminate_dead_functions();
+        return Ok(result);
+    }
+
+    /// Drops the functions that can't be reached from any entry point, so that neither they nor
+    /// the globals and types only they use are ever translated (or spliced in).
+    ///
+    /// Modules without entry points are left as they are.
+    fn eliminate_dead_functions(&mut self) {
+        if !self.built_functions.iter().any(|x| x.entry_point.is_some()) {
+            return;
+        }
+
+        let indices = (0..self.functions.len() as u32)
+            .filter_map(|i| Some((Arc::as_ptr(self.function_id(i)?) as usize, i)))
+            .collect::<HashMap<_, _>>();
+        let index_of = |id: &Arc<IdCell>| indices.get(&(Arc::as_ptr(id) as usize)).copied();
+
+        let mut callees = HashMap::new();
+        for function in self.built_functions.iter() {
+            if let Some(i) = index_of(&function.function_id) {
+                let called = function
+                    .callees
+                    .iter()
+                    .filter_map(index_of)
+                    .collect::<Vec<_>>();
+                callees.insert(i, called);
+            }
+        }
+        for (i, called) in self.reused_functions.iter() {
+            callees.insert(*i, called.to_vec());
+        }
+
+        let mut reachable = HashSet::new();
+        let mut pending = self
+            .built_functions
+            .iter()
+            .filter(|x| x.entry_point.is_some())
+            .filter_map(|x| index_of(&x.function_id))
+            .collect::<Vec<_>>();
 
+        while let Some(i) = pending.pop() {
+            if reachable.insert(i) {
+                pending.extend(callees.get(&i).into_iter().flatten().copied());
+            }
+        }
+
+        if callees.keys().all(|i| reachable.contains(i)) {
+            return;
+        }
+
+        let built_functions = std::mem::take(&mut self.built_functions);
+        self.built_functions = built_functions
+            .into_vec()
+            .into_iter()
+            .filter(|x| index_of(&x.function_id).is_some_and(|i| reachable.contains(&i)))
+            .collect();
+
+        let reused_functions = std::mem::take(&mut self.reused_functions);
+        self.reused_functions = reused_functions
+            .into_vec()
+            .into_iter()
+            .filter(|(i, _)| reachable.contains(i))
+            .collect();
+    }
+
+    /// Creates the module with everything the function bodies may refer to (imports, function
+    /// declarations and global variables), returning it along with the number of imported functions.
+    fn declare(
+        config: &Config,
+        types: TypesRef,
+        imports: Vec<Import<'a>>,
+        globals: &[Global<'a>],
+        reused_functions: Box<[(u32, Box<[u32]>)]>,
+    ) -> Result<(Self, u32)> {
         let wasm_memory64 = match types.memory_count() {
             0 => false,
             _ => types.memory_at(0).memory64,
@@ -94,75 +321,53 @@ impl<'a> ModuleBuilder<'a> {
             extended_is: config
                 .platform
                 .extended_is()
-                .map_or_else(Default::default, |x| Box::from([Rc::new(x)])),
+                .map_or_else(Default::default, |x| Box::from([Arc::new(x)])),
             version: config.platform.spirv_version(),
-            capabilities: config.capabilities,
-            extensions: config.extensions,
+            capabilities: config.capabilities.clone(),
+            extensions: config.extensions.clone(),
             memory_model: config.memory_model,
             memory_grow_error: config.memory_grow_error,
+            bounds_checks: config.bounds_checks,
+            optimization: config.optimization,
             wasm_memory64,
             addressing_model,
             functions: Box::default(),
             global_variables: Box::default(),
             built_functions: Box::default(),
             hidden_global_variables: Vec::default(),
+            reused_functions,
+            debug_info: config.debug_info.then(DebugInfo::default),
         };
 
         let mut functions = Vec::with_capacity(types.function_count() as usize);
         let mut global_variables = Vec::with_capacity(types.global_count() as usize);
 
-        let mut globals = Vec::new();
-        let mut code_sections = Vec::new();
-        let mut imports = Vec::new();
-        let mut exports = Vec::new();
-
-        let mut reader = wasmparser::Parser::new(0).parse_all(&bytes);
-        while let Some(payload) = reader.next().transpose()? {
-            match payload {
-                Payload::ImportSection(imp) => {
-                    imports.reserve(imp.count() as usize);
-                    for import in imp.into_iter() {
-                        imports.push(import?);
-                    }
-                }
-                Payload::ExportSection(exp) => {
-                    exports.reserve(exp.count() as usize);
-                    for export in exp.into_iter() {
-                        exports.push(export?);
-                    }
-                }
-                Payload::GlobalSection(g) => {
-                    globals.reserve(g.count() as usize);
-                    for global in g.into_iter() {
-                        globals.push(global?);
-                    }
-                }
-                Payload::CodeSectionEntry(body) => code_sections.push(body),
-                Payload::End(_) => break,
-                _ => continue,
-            }
-        }
-
         // Imports
         let mut imported_function_count = 0u32;
         let mut imported_global_count = 0u32;
 
         for import in imports {
-            match import.module {
-                "spir_global" => {
-                    match translate_spir_global(import.name, import.ty, &mut result)? {
-                        Some(ImportResult::Global(var)) => {
-                            global_variables.push(var);
-                            imported_global_count += 1
-                        }
-                        Some(ImportResult::Func(f)) => {
-                            functions.push(f);
-                            imported_function_count += 1
-                        }
-                        None => todo!(),
-                    }
-                }
+            let import_result = match import.module {
+                "spir_global" => translate_spir_global(import.name, import.ty, &mut result)?,
+                "spir_workgroup" => Some(translate_workgroup_array(
+                    import.name,
+                    import.ty,
+                    &config.workgroup_arrays,
+                    &mut result,
+                )?),
                 _ => todo!(),
+            };
+
+            match import_result {
+                Some(ImportResult::Global(var)) => {
+                    global_variables.push(var);
+                    imported_global_count += 1
+                }
+                Some(ImportResult::Func(f)) => {
+                    functions.push(f);
+                    imported_function_count += 1
+                }
+                None => todo!(),
             }
         }
 
@@ -174,7 +379,7 @@ impl<'a> ModuleBuilder<'a> {
             {
                 wasmparser::types::Type::Sub(ty) => match &ty.structural_type {
                     wasmparser::StructuralType::Func(f) => CallableFunction::Defined {
-                        function_id: Rc::new(Cell::new(None)),
+                        function_id: Arc::new(IdCell::new(None)),
                         ty: f.clone(),
                     },
                     _ => return Err(Error::unexpected()),
@@ -194,7 +399,7 @@ impl<'a> ModuleBuilder<'a> {
                 .init_expr;
 
             let ty = Type::from(global.content_type);
-            let mut init_expr_reader = BlockReader::new(init_expr.get_operators_reader());
+            let mut init_expr_reader = BlockReader::new(init_expr.get_operators_reader())?;
 
             let op = init_expr_reader
                 .next()
@@ -207,18 +412,27 @@ impl<'a> ModuleBuilder<'a> {
                 VecDeque::new(),
                 End::Unreachable,
                 &mut f,
-                &mut result,
+                &result,
             )?;
             translate_constants(&op, &mut block)?;
 
-            let init_value = block.stack_pop(ty.clone(), &mut result)?;
+            let mut init_value = block.stack_pop(ty.clone(), &result)?;
+            if let Some(spec_id) = config.spec_constants.get(&i) {
+                if global.mutable {
+                    return Err(Error::msg(format!(
+                        "Global {i} is mutable, so it can't be a specialization constant"
+                    )));
+                }
+                init_value = init_value.specialize(*spec_id)?;
+            }
+
             global_variables.push(match global.mutable {
                 true => match result.platform {
                     TargetPlatform::Vulkan { .. } => {
                         warn!("Vulkan doesn't have mutable global variables. Using a constant instead.");
                         GlobalVariable::Constant(init_value)
                     }
-                    _ => GlobalVariable::Variable(Rc::new(Pointer::new_variable(
+                    _ => GlobalVariable::Variable(Arc::new(Pointer::new_variable(
                         PointerSize::Skinny,
                         StorageClass::CrossWorkgroup,
                         ty,
@@ -230,40 +444,61 @@ impl<'a> ModuleBuilder<'a> {
             })
         }
         result.global_variables = global_variables.into_boxed_slice();
+        return Ok((result, imported_function_count));
+    }
 
-        // Function bodies
-        let mut built_functions = Vec::with_capacity(code_sections.len());
-        for (i, body) in (imported_function_count..types.function_count()).zip(code_sections) {
-            let (function_id, ty) = match result
-                .functions
-                .get(i as usize)
-                .ok_or_else(Error::unexpected)?
-            {
-                CallableFunction::Defined { function_id, ty } => (function_id.clone(), ty.clone()),
-                _ => return Err(Error::unexpected()),
-            };
+    fn function_job(
+        &self,
+        i: u32,
+        body: FunctionBody<'a>,
+        exports: &[Export<'a>],
+    ) -> Result<FunctionJob<'a>> {
+        let (function_id, ty) = match self
+            .functions
+            .get(i as usize)
+            .ok_or_else(Error::unexpected)?
+        {
+            CallableFunction::Defined { function_id, ty } => (function_id.clone(), ty.clone()),
+            _ => return Err(Error::unexpected()),
+        };
 
-            let config = config
-                .functions
-                .get(&i)
-                .map_or_else(Cow::default, Cow::Borrowed);
-
-            let export = exports
-                .iter()
-                .find(|x| x.kind == ExternalKind::Func && x.index == i);
-
-            built_functions.push(FunctionBuilder::new(
-                function_id,
-                export.cloned(),
-                &config,
-                &ty,
-                body,
-                &mut result,
-            )?);
-        }
+        let export = exports
+            .iter()
+            .find(|x| x.kind == ExternalKind::Func && x.index == i)
+            .cloned();
 
-        result.built_functions = built_functions.into_boxed_slice();
-        return Ok(result);
+        return Ok((i, function_id, export, ty, body));
+    }
+
+    fn build_function(
+        &self,
+        config: &Config,
+        (i, function_id, export, ty, body): FunctionJob<'a>,
+    ) -> Result<FunctionBuilder<'a>> {
+        let function_config = config
+            .functions
+            .get(&i)
+            .map_or_else(Cow::default, Cow::Borrowed);
+
+        let span = tracing::info_span!(
+            "build_function",
+            function = i,
+            instructions = tracing::field::Empty
+        )
+        .entered();
+
+        let function =
+            FunctionBuilder::new(function_id, export, &function_config, &ty, body, self)?;
+        span.record("instructions", function.anchors.len() as u64);
+        return Ok(function);
+    }
+
+    /// Id cell of the defined function at `index`.
+    pub fn function_id(&self, index: u32) -> Option<&Arc<IdCell>> {
+        match self.functions.get(index as usize)? {
+            CallableFunction::Defined { function_id, .. } => Some(function_id),
+            CallableFunction::Callback(_) => None,
+        }
     }
 
     pub fn isize_type(&self) -> ScalarType {
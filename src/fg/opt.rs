@@ -0,0 +1,262 @@
+//! Control flow simplifications over the anchors of a function, run before it's translated.
+//!
+//! Basic blocks are the ranges of anchors between an [`Operation::Label`] and the next block
+//! terminating operation. The translation infers structured control flow from the shape of the
+//! blocks that are targeted by conditional branches, so those are never reshaped.
+
+use super::{
+    function::FunctionBuilder,
+    values::{
+        bool::{Bool, BoolSource, Comparison, Equality},
+        integer::{ConstantSource, Integer},
+    },
+    Label, Operation,
+};
+use std::{
+    collections::{HashMap, HashSet},
+    sync::Arc,
+};
+
+pub fn simplify_cfg(function: &mut FunctionBuilder) {
+    fold_constant_branches(function);
+    remove_unreachable_blocks(function);
+    merge_fallthrough_blocks(function);
+}
+
+/// Conditional branches on a known condition become unconditional.
+///
+/// Loops are only recognized from the conditional branches of their headers, so branches that
+/// take part in one (because one of their targets is at or before them, or because one of their
+/// targets branches back to the current block) are left as they are.
+fn fold_constant_branches(function: &mut FunctionBuilder) {
+    let positions = function
+        .anchors
+        .iter()
+        .enumerate()
+        .filter_map(|(i, x)| match x {
+            Operation::Label(label) => Some((label_key(label), i)),
+            _ => None,
+        })
+        .collect::<HashMap<_, _>>();
+
+    let mut header = None;
+    for i in 0..function.anchors.len() {
+        let (condition, true_label, false_label) = match &function.anchors[i] {
+            Operation::Label(label) => {
+                header = Some(label_key(label));
+                continue;
+            }
+            Operation::BranchConditional {
+                condition,
+                true_label,
+                false_label,
+            } => (condition, true_label, false_label),
+            _ => continue,
+        };
+
+        let is_loop_edge = |label: &Arc<Label>| -> bool {
+            let start = match positions.get(&label_key(label)) {
+                Some(start) if *start > i => *start,
+                _ => return true,
+            };
+
+            return match function.anchors[start + 1..]
+                .iter()
+                .find(|x| x.is_block_terminating())
+            {
+                Some(Operation::Branch { label }) => Some(label_key(label)) == header,
+                _ => false,
+            };
+        };
+
+        if is_loop_edge(true_label) || is_loop_edge(false_label) {
+            continue;
+        }
+
+        let label = match constant_condition(condition) {
+            Some(true) => true_label.clone(),
+            Some(false) => false_label.clone(),
+            None => continue,
+        };
+        function.anchors[i] = Operation::Branch { label };
+    }
+}
+
+/// Removes the blocks no branch points to, until there are none left.
+fn remove_unreachable_blocks(function: &mut FunctionBuilder) {
+    loop {
+        let references = label_references(&function.anchors);
+        let start = function.anchors.iter().position(|x| match x {
+            Operation::Label(label) => !references.contains_key(&label_key(label)),
+            _ => false,
+        });
+
+        let start = match start {
+            Some(start) => start,
+            None => return,
+        };
+
+        let end = function.anchors[start + 1..]
+            .iter()
+            .position(Operation::is_block_terminating)
+            .map_or(function.anchors.len(), |x| start + x + 2);
+
+        function.anchors.drain(start..end);
+    }
+}
+
+/// Merges a block into it's predecessor when the latter unconditionally falls through into it
+/// and nothing else branches to either of them. Merge blocks and continue targets of the
+/// structured control flow are never merged, neither into nor away.
+fn merge_fallthrough_blocks(function: &mut FunctionBuilder) {
+    let structured = structured_labels(function);
+    let mut references = label_references(&function.anchors);
+    let is_fallthrough_only = |anchors: &[Operation],
+                               i: usize,
+                               references: &HashMap<usize, usize>| {
+        match (i.checked_sub(1).map(|x| &anchors[x]), &anchors[i]) {
+            (Some(Operation::Branch { label: target }), Operation::Label(label)) => {
+                Arc::ptr_eq(target, label)
+                    && references.get(&label_key(label)) == Some(&1)
+                    && !structured.contains(&label_key(label))
+            }
+            _ => false,
+        }
+    };
+
+    let mut i = 1;
+    while i < function.anchors.len() {
+        if !is_fallthrough_only(&function.anchors, i, &references) {
+            i += 1;
+            continue;
+        }
+
+        // Start of the block the fallthrough branch belongs to. Blocks with code after their
+        // terminator, and the entry block (which has no label), are left as they are.
+        let predecessor = function.anchors[..i - 1]
+            .iter()
+            .rposition(|x| matches!(x, Operation::Label(_)) || x.is_block_terminating());
+
+        match predecessor {
+            Some(start)
+                if matches!(function.anchors[start], Operation::Label(_))
+                    && is_fallthrough_only(&function.anchors, start, &references) =>
+            {
+                if let Operation::Label(label) = &function.anchors[i] {
+                    references.remove(&label_key(label));
+                }
+                function.anchors.drain(i - 1..=i);
+            }
+            _ => i += 1,
+        }
+    }
+}
+
+/// Merge blocks and continue targets the conditional branches of the function will be translated
+/// with.
+fn structured_labels(function: &FunctionBuilder) -> HashSet<usize> {
+    let mut labels = HashSet::new();
+    for anchor in function.anchors.iter() {
+        if !matches!(anchor, Operation::BranchConditional { .. }) {
+            continue;
+        }
+
+        if let Ok((merge_block, continue_target)) = function.structure_of(anchor) {
+            labels.extend(
+                merge_block
+                    .iter()
+                    .chain(continue_target.iter())
+                    .map(label_key),
+            );
+        }
+    }
+    return labels;
+}
+
+fn label_references(anchors: &[Operation]) -> HashMap<usize, usize> {
+    let mut references = HashMap::new();
+    for anchor in anchors {
+        let labels = match anchor {
+            Operation::Branch { label } => [Some(label), None],
+            Operation::BranchConditional {
+                true_label,
+                false_label,
+                ..
+            } => [Some(true_label), Some(false_label)],
+            _ => continue,
+        };
+
+        for label in labels.into_iter().flatten() {
+            *references.entry(label_key(label)).or_default() += 1;
+        }
+    }
+    return references;
+}
+
+#[inline]
+fn label_key(label: &Arc<Label>) -> usize {
+    Arc::as_ptr(label) as usize
+}
+
+/// Value of the condition, if it can be evaluated at compile time.
+pub fn constant_condition(condition: &Bool) -> Option<bool> {
+    if let Ok(Some(x)) = condition.get_constant_value() {
+        return Some(x);
+    }
+
+    return match &condition.source {
+        BoolSource::Negated(x) => constant_condition(x).map(|x| !x),
+
+        BoolSource::Select {
+            selector,
+            true_value,
+            false_value,
+        } => match constant_condition(selector)? {
+            true => constant_condition(true_value),
+            false => constant_condition(false_value),
+        },
+
+        BoolSource::IntEquality { kind, op1, op2 } => {
+            let (op1, op2) = constant_operands(op1, op2, false)?;
+            Some(match kind {
+                Equality::Eq => op1 == op2,
+                Equality::Ne => op1 != op2,
+            })
+        }
+
+        BoolSource::IntComparison {
+            kind,
+            signed,
+            op1,
+            op2,
+        } => {
+            let (op1, op2) = constant_operands(op1, op2, *signed)?;
+            Some(match kind {
+                Comparison::Le => op1 <= op2,
+                Comparison::Lt => op1 < op2,
+                Comparison::Gt => op1 > op2,
+                Comparison::Ge => op1 >= op2,
+            })
+        }
+
+        _ => None,
+    };
+}
+
+fn constant_operands(op1: &Integer, op2: &Integer, signed: bool) -> Option<(i128, i128)> {
+    let widen = |x: ConstantSource| match (x, signed) {
+        (ConstantSource::Short(x), true) => x as i32 as i128,
+        (ConstantSource::Short(x), false) => x as i128,
+        (ConstantSource::Long(x), true) => x as i64 as i128,
+        (ConstantSource::Long(x), false) => x as i128,
+    };
+
+    match (
+        op1.get_constant_value().ok()??,
+        op2.get_constant_value().ok()??,
+    ) {
+        (x @ ConstantSource::Short(_), y @ ConstantSource::Short(_))
+        | (x @ ConstantSource::Long(_), y @ ConstantSource::Long(_)) => Some((widen(x), widen(y))),
+        _ => None,
+    }
+}
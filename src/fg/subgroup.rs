@@ -0,0 +1,73 @@
+//! Subgroup operations, lowered to `OpGroupNonUniform*` instructions.
+
+use super::values::{bool::Bool, integer::Integer, Value};
+use crate::{
+    error::{Error, Result},
+    version::{TargetPlatform, Version},
+};
+use rspirv::spirv::{Capability, GroupOperation};
+use std::sync::Arc;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum SubgroupArithmetic {
+    Add,
+    Min { signed: bool },
+    Max { signed: bool },
+}
+
+#[derive(Debug, Clone)]
+pub enum SubgroupSource {
+    Elect,
+    All(Arc<Bool>),
+    Any(Arc<Bool>),
+    /// Component of the mask of invocations for which `predicate` is true
+    Ballot {
+        predicate: Arc<Bool>,
+        component: Arc<Integer>,
+    },
+    BroadcastFirst(Value),
+    Shuffle {
+        value: Value,
+        id: Arc<Integer>,
+    },
+    Arithmetic {
+        kind: SubgroupArithmetic,
+        operation: GroupOperation,
+        value: Value,
+    },
+}
+
+impl SubgroupSource {
+    /// Operand the result takes it's type from, if any.
+    pub fn value(&self) -> Option<&Value> {
+        match self {
+            SubgroupSource::BroadcastFirst(value)
+            | SubgroupSource::Shuffle { value, .. }
+            | SubgroupSource::Arithmetic { value, .. } => Some(value),
+            _ => None,
+        }
+    }
+
+    pub fn required_capability(&self) -> Capability {
+        match self {
+            SubgroupSource::Elect => Capability::GroupNonUniform,
+            SubgroupSource::All(_) | SubgroupSource::Any(_) => Capability::GroupNonUniformVote,
+            SubgroupSource::Ballot { .. } | SubgroupSource::BroadcastFirst(_) => {
+                Capability::GroupNonUniformBallot
+            }
+            SubgroupSource::Shuffle { .. } => Capability::GroupNonUniformShuffle,
+            SubgroupSource::Arithmetic { .. } => Capability::GroupNonUniformArithmetic,
+        }
+    }
+}
+
+/// Subgroup operations were introduced on SPIR-V 1.3 (Vulkan 1.1).
+pub fn check_platform(platform: TargetPlatform) -> Result<()> {
+    if platform.spirv_version() < Version::V1_3 {
+        return Err(Error::msg(format!(
+            "Subgroup operations require SPIR-V 1.3 or higher, but {platform:?} targets SPIR-V {}",
+            platform.spirv_version()
+        )));
+    }
+    return Ok(());
+}
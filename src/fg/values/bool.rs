@@ -6,49 +6,51 @@ use super::{
     pointer::Pointer,
 };
 use crate::error::Result;
-use std::{cell::Cell, rc::Rc};
+use crate::fg::{subgroup::SubgroupSource, IdCell};
+use std::sync::Arc;
 
 #[derive(Debug, Clone)]
 pub struct Bool {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub source: BoolSource,
 }
 
 #[derive(Debug, Clone)]
 pub enum BoolSource {
     Constant(bool),
-    FromInteger(Rc<Integer>),
-    Negated(Rc<Bool>),
+    FromInteger(Arc<Integer>),
+    Negated(Arc<Bool>),
     Select {
-        selector: Rc<Bool>,
-        true_value: Rc<Bool>,
-        false_value: Rc<Bool>,
+        selector: Arc<Bool>,
+        true_value: Arc<Bool>,
+        false_value: Arc<Bool>,
     },
     IntEquality {
         kind: Equality,
-        op1: Rc<Integer>,
-        op2: Rc<Integer>,
+        op1: Arc<Integer>,
+        op2: Arc<Integer>,
     },
     FloatEquality {
         kind: Equality,
-        op1: Rc<Float>,
-        op2: Rc<Float>,
+        op1: Arc<Float>,
+        op2: Arc<Float>,
     },
     IntComparison {
         kind: Comparison,
         signed: bool,
-        op1: Rc<Integer>,
-        op2: Rc<Integer>,
+        op1: Arc<Integer>,
+        op2: Arc<Integer>,
     },
     FloatComparison {
         kind: Comparison,
-        op1: Rc<Float>,
-        op2: Rc<Float>,
+        op1: Arc<Float>,
+        op2: Arc<Float>,
     },
     Loaded {
-        pointer: Rc<Pointer>,
+        pointer: Arc<Pointer>,
         log2_alignment: Option<u32>,
     },
+    Subgroup(SubgroupSource),
 }
 
 #[derive(Debug, Clone, Copy, PartialEq)]
@@ -68,12 +70,12 @@ pub enum Equality {
 impl Bool {
     pub fn new(source: BoolSource) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         };
     }
 
-    pub fn to_integer(self: Rc<Self>, kind: IntegerKind) -> Result<Rc<Integer>> {
+    pub fn to_integer(self: Arc<Self>, kind: IntegerKind) -> Result<Arc<Integer>> {
         return Ok(match (kind, self.get_constant_value()?) {
             (IntegerKind::Long, Some(true)) => Integer::new_constant_u64(1),
             (IntegerKind::Short, Some(true)) => Integer::new_constant_u32(1),
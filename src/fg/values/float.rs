@@ -1,16 +1,17 @@
 #![allow(clippy::should_implement_trait)]
 
 use super::{bool::Bool, integer::Integer, pointer::Pointer, vector::Vector, Value};
+use crate::fg::{subgroup::SubgroupSource, IdCell};
 use crate::{
     error::{Error, Result},
     r#type::{ScalarType, Type},
     wasm_max_f32, wasm_max_f64, wasm_min_f32, wasm_min_f64,
 };
-use std::{cell::Cell, rc::Rc};
+use std::sync::Arc;
 
 #[derive(Debug, Clone)]
 pub struct Float {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub source: FloatSource,
 }
 
@@ -26,33 +27,39 @@ pub enum FloatKind {
 pub enum FloatSource {
     FunctionParam(FloatKind),
     Constant(ConstantSource),
+    /// Specialization constant with the given `SpecId`
+    SpecConstant {
+        spec_id: u32,
+        default: ConstantSource,
+    },
     Conversion(ConversionSource),
     Loaded {
-        pointer: Rc<Pointer>,
+        pointer: Arc<Pointer>,
         log2_alignment: Option<u32>,
     },
     Extracted {
-        vector: Rc<Vector>,
-        index: Rc<Integer>,
+        vector: Arc<Vector>,
+        index: Arc<Integer>,
     },
     Select {
-        selector: Rc<Bool>,
-        true_value: Rc<Float>,
-        false_value: Rc<Float>,
+        selector: Arc<Bool>,
+        true_value: Arc<Float>,
+        false_value: Arc<Float>,
     },
     FunctionCall {
-        function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+        function_id: Arc<IdCell>,
         args: Box<[Value]>,
         kind: FloatKind,
     },
+    Subgroup(SubgroupSource),
     Unary {
         source: UnarySource,
-        op1: Rc<Float>,
+        op1: Arc<Float>,
     },
     Binary {
         source: BinarySource,
-        op1: Rc<Float>,
-        op2: Rc<Float>,
+        op1: Arc<Float>,
+        op2: Arc<Float>,
     },
 }
 
@@ -92,33 +99,33 @@ pub enum ConversionSource {
         kind: FloatKind,
         value: Value,
     },
-    FromSingle(Rc<Float>),
-    FromDouble(Rc<Float>),
+    FromSingle(Arc<Float>),
+    FromDouble(Arc<Float>),
     FromInteger {
         kind: FloatKind,
         signed: bool,
-        value: Rc<Integer>,
+        value: Arc<Integer>,
     },
 }
 
 impl Float {
     pub fn new(source: FloatSource) -> Float {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         };
     }
 
     pub fn new_constant_f32(value: f32) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: FloatSource::Constant(ConstantSource::Single(value)),
         };
     }
 
     pub fn new_constant_f64(value: f64) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: FloatSource::Constant(ConstantSource::Double(value)),
         };
     }
@@ -144,8 +151,20 @@ impl Float {
                 _ => return Err(Error::unexpected()),
             },
             FloatSource::FunctionParam(kind) | FloatSource::FunctionCall { kind, .. } => *kind,
-            FloatSource::Constant(ConstantSource::Double(_)) => FloatKind::Double,
-            FloatSource::Constant(ConstantSource::Single(_)) => FloatKind::Single,
+            FloatSource::Subgroup(source) => match source.value() {
+                Some(Value::Float(x)) => x.kind()?,
+                _ => return Err(Error::unexpected()),
+            },
+            FloatSource::Constant(ConstantSource::Double(_))
+            | FloatSource::SpecConstant {
+                default: ConstantSource::Double(_),
+                ..
+            } => FloatKind::Double,
+            FloatSource::Constant(ConstantSource::Single(_))
+            | FloatSource::SpecConstant {
+                default: ConstantSource::Single(_),
+                ..
+            } => FloatKind::Single,
             FloatSource::Conversion(ConversionSource::FromDouble(x)) => {
                 debug_assert_eq!(x.kind()?, FloatKind::Double);
                 FloatKind::Single
@@ -184,12 +203,12 @@ impl Float {
         }));
     }
 
-    pub fn abs(self: Rc<Self>) -> Result<Self> {
+    pub fn abs(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(f32::abs(x)),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(f64::abs(x)),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Abs,
                     op1: self,
@@ -198,12 +217,12 @@ impl Float {
         });
     }
 
-    pub fn neg(self: Rc<Self>) -> Result<Self> {
+    pub fn neg(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(-x),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(-x),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Neg,
                     op1: self,
@@ -212,12 +231,12 @@ impl Float {
         });
     }
 
-    pub fn ceil(self: Rc<Self>) -> Result<Self> {
+    pub fn ceil(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(f32::ceil(x)),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(f64::ceil(x)),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Ceil,
                     op1: self,
@@ -226,12 +245,12 @@ impl Float {
         });
     }
 
-    pub fn floor(self: Rc<Self>) -> Result<Self> {
+    pub fn floor(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(f32::floor(x)),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(f64::floor(x)),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Ceil,
                     op1: self,
@@ -240,12 +259,12 @@ impl Float {
         });
     }
 
-    pub fn trunc(self: Rc<Self>) -> Result<Self> {
+    pub fn trunc(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(f32::trunc(x)),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(f64::trunc(x)),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Ceil,
                     op1: self,
@@ -255,10 +274,10 @@ impl Float {
     }
 
     // Waiting for [`round_ties_even`](https://github.com/rust-lang/rust/issues/96710) to stabilize
-    pub fn nearest(self: Rc<Self>) -> Result<Self> {
+    pub fn nearest(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Nearest,
                     op1: self,
@@ -267,12 +286,12 @@ impl Float {
         });
     }
 
-    pub fn sqrt(self: Rc<Self>) -> Result<Self> {
+    pub fn sqrt(self: Arc<Self>) -> Result<Self> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Single(x)) => Float::new_constant_f32(f32::sqrt(x)),
             Some(ConstantSource::Double(x)) => Float::new_constant_f64(f64::sqrt(x)),
             _ => Self {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 source: FloatSource::Unary {
                     source: UnarySource::Sqrt,
                     op1: self,
@@ -281,7 +300,7 @@ impl Float {
         });
     }
 
-    pub fn add(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn add(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -302,12 +321,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn sub(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn sub(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -328,12 +347,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn mul(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn mul(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -354,12 +373,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn div(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn div(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -380,12 +399,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn copysign(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn copysign(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -406,12 +425,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn min(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn min(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -432,12 +451,12 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn max(self: Rc<Self>, rhs: Rc<Float>) -> Result<Self> {
+    pub fn max(self: Arc<Self>, rhs: Arc<Float>) -> Result<Self> {
         match (self.kind()?, rhs.kind()?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -458,7 +477,7 @@ impl Float {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
@@ -9,15 +9,15 @@ use super::{
 };
 use crate::{
     error::{Error, Result},
-    fg::module::ModuleBuilder,
+    fg::{module::ModuleBuilder, subgroup::SubgroupSource, IdCell},
     r#type::{PointerSize, ScalarType, Type},
 };
 use rspirv::spirv::{Capability, StorageClass};
-use std::{cell::Cell, mem::transmute, rc::Rc};
+use std::{mem::transmute, sync::Arc};
 
 #[derive(Debug, Clone)]
 pub struct Integer {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub source: IntegerSource,
 }
 
@@ -33,36 +33,47 @@ pub enum IntegerKind {
 pub enum IntegerSource {
     FunctionParam(IntegerKind),
     Constant(ConstantSource),
+    /// Specialization constant with the given `SpecId`
+    SpecConstant {
+        spec_id: u32,
+        default: ConstantSource,
+    },
     Conversion(ConversionSource),
     ArrayLength {
-        structured_array: Rc<Pointer>,
+        structured_array: Arc<Pointer>,
     },
     Loaded {
-        pointer: Rc<Pointer>,
+        pointer: Arc<Pointer>,
         log2_alignment: Option<u32>,
     },
     Select {
-        selector: Rc<Bool>,
-        true_value: Rc<Integer>,
-        false_value: Rc<Integer>,
+        selector: Arc<Bool>,
+        true_value: Arc<Integer>,
+        false_value: Arc<Integer>,
     },
     Extracted {
-        vector: Rc<Vector>,
-        index: Rc<Integer>,
+        vector: Arc<Vector>,
+        index: Arc<Integer>,
     },
     FunctionCall {
-        function_id: Rc<Cell<Option<rspirv::spirv::Word>>>,
+        function_id: Arc<IdCell>,
         args: Box<[Value]>,
         kind: IntegerKind,
     },
+    /// Atomic operation on the pointee, resulting in it's original value
+    Atomic {
+        pointer: Arc<Pointer>,
+        source: AtomicSource,
+    },
+    Subgroup(SubgroupSource),
     Unary {
         source: UnarySource,
-        op1: Rc<Integer>,
+        op1: Arc<Integer>,
     },
     Binary {
         source: BinarySource,
-        op1: Rc<Integer>,
-        op2: Rc<Integer>,
+        op1: Arc<Integer>,
+        op2: Arc<Integer>,
     },
 }
 
@@ -72,6 +83,21 @@ pub enum ConstantSource {
     Long(u64),
 }
 
+#[derive(Debug, Clone)]
+pub enum AtomicSource {
+    Load,
+    Exchange(Arc<Integer>),
+    CompareExchange {
+        expected: Arc<Integer>,
+        replacement: Arc<Integer>,
+    },
+    Add(Arc<Integer>),
+    Sub(Arc<Integer>),
+    And(Arc<Integer>),
+    Or(Arc<Integer>),
+    Xor(Arc<Integer>),
+}
+
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum UnarySource {
     Not,
@@ -108,30 +134,30 @@ pub enum ConversionSource {
     },
     FromShort {
         signed: bool,
-        value: Rc<Integer>,
+        value: Arc<Integer>,
     },
-    FromLong(Rc<Integer>),
-    FromPointer(Rc<Pointer>),
-    FromBool(Rc<Bool>, IntegerKind),
+    FromLong(Arc<Integer>),
+    FromPointer(Arc<Pointer>),
+    FromBool(Arc<Bool>, IntegerKind),
     FromFloat {
         kind: IntegerKind,
         signed: bool,
         saturating: bool,
-        value: Rc<Float>,
+        value: Arc<Float>,
     },
 }
 
 impl Integer {
     pub fn new(source: IntegerSource) -> Integer {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         };
     }
 
     pub fn new_constant_u32(value: u32) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: IntegerSource::Constant(ConstantSource::Short(value)),
         };
     }
@@ -142,7 +168,7 @@ impl Integer {
 
     pub fn new_constant_u64(value: u64) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: IntegerSource::Constant(ConstantSource::Long(value)),
         };
     }
@@ -167,11 +193,13 @@ impl Integer {
 
     pub fn kind(&self, module: &ModuleBuilder) -> Result<IntegerKind> {
         return Ok(match &self.source {
-            IntegerSource::Loaded { pointer, .. } => match &pointer.pointee {
-                Type::Scalar(ScalarType::I32) => IntegerKind::Short,
-                Type::Scalar(ScalarType::I64) => IntegerKind::Long,
-                _ => return Err(Error::unexpected()),
-            },
+            IntegerSource::Loaded { pointer, .. } | IntegerSource::Atomic { pointer, .. } => {
+                match &pointer.pointee {
+                    Type::Scalar(ScalarType::I32) => IntegerKind::Short,
+                    Type::Scalar(ScalarType::I64) => IntegerKind::Long,
+                    _ => return Err(Error::unexpected()),
+                }
+            }
             IntegerSource::Select {
                 true_value,
                 false_value,
@@ -186,11 +214,24 @@ impl Integer {
                 _ => return Err(Error::unexpected()),
             },
             IntegerSource::ArrayLength { .. } => IntegerKind::Short,
+            IntegerSource::Subgroup(SubgroupSource::Ballot { .. }) => IntegerKind::Short,
+            IntegerSource::Subgroup(source) => match source.value() {
+                Some(Value::Integer(x)) => x.kind(module)?,
+                _ => return Err(Error::unexpected()),
+            },
             IntegerSource::FunctionParam(kind)
             | IntegerSource::FunctionCall { kind, .. }
             | IntegerSource::Conversion(ConversionSource::FromBool(_, kind)) => *kind,
-            IntegerSource::Constant(ConstantSource::Long(_)) => IntegerKind::Long,
-            IntegerSource::Constant(ConstantSource::Short(_)) => IntegerKind::Short,
+            IntegerSource::Constant(ConstantSource::Long(_))
+            | IntegerSource::SpecConstant {
+                default: ConstantSource::Long(_),
+                ..
+            } => IntegerKind::Long,
+            IntegerSource::Constant(ConstantSource::Short(_))
+            | IntegerSource::SpecConstant {
+                default: ConstantSource::Short(_),
+                ..
+            } => IntegerKind::Short,
             IntegerSource::Conversion(ConversionSource::FromLong(x)) => {
                 debug_assert_eq!(x.kind(module)?, IntegerKind::Long);
                 IntegerKind::Short
@@ -255,19 +296,11 @@ impl Integer {
         }));
     }
 
-    pub fn is_isize(
-        &self,
-        storage_class: StorageClass,
-        module: &mut ModuleBuilder,
-    ) -> Result<bool> {
+    pub fn is_isize(&self, storage_class: StorageClass, module: &ModuleBuilder) -> Result<bool> {
         return Ok(self.kind(module)? == IntegerKind::isize(storage_class, module)?);
     }
 
-    pub fn assert_isize(
-        &self,
-        storage_class: StorageClass,
-        module: &mut ModuleBuilder,
-    ) -> Result<()> {
+    pub fn assert_isize(&self, storage_class: StorageClass, module: &ModuleBuilder) -> Result<()> {
         if !self.is_isize(storage_class, module)? {
             return Err(Error::msg(
                 "Integer doesn't have the same size as the pointer",
@@ -276,7 +309,7 @@ impl Integer {
         return Ok(());
     }
 
-    pub fn to_bool(self: Rc<Self>) -> Result<Bool> {
+    pub fn to_bool(self: Arc<Self>) -> Result<Bool> {
         return Ok(match self.get_constant_value()? {
             Some(ConstantSource::Long(0) | ConstantSource::Short(0)) => {
                 Bool::new(BoolSource::Constant(false))
@@ -287,16 +320,14 @@ impl Integer {
     }
 
     pub fn to_pointer(
-        self: Rc<Self>,
+        self: Arc<Self>,
         size: PointerSize,
         storage_class: StorageClass,
         pointee: Type,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Pointer> {
         match storage_class {
-            StorageClass::Generic => module
-                .capabilities
-                .require_mut(Capability::GenericPointer)?,
+            StorageClass::Generic => module.capabilities.require(Capability::GenericPointer)?,
             _ => {}
         }
 
@@ -310,9 +341,9 @@ impl Integer {
         return Ok(ptr);
     }
 
-    pub fn negate(self: Rc<Self>) -> Self {
+    pub fn negate(self: Arc<Self>) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: IntegerSource::Unary {
                 source: UnarySource::Negate,
                 op1: self,
@@ -320,7 +351,7 @@ impl Integer {
         };
     }
 
-    pub fn add(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn add(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -344,13 +375,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn sub(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Self> {
+    pub fn sub(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Self> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -373,12 +404,12 @@ impl Integer {
         };
 
         return Ok(Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
         });
     }
 
-    pub fn mul(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn mul(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -406,13 +437,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn s_div(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn s_div(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -444,18 +475,18 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
     pub fn u_div(
-        self: Rc<Self>,
-        rhs: Rc<Integer>,
+        self: Arc<Self>,
+        rhs: Arc<Integer>,
         optimize_away: bool,
         module: &ModuleBuilder,
-    ) -> Result<Rc<Self>> {
+    ) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -478,7 +509,7 @@ impl Integer {
 
             (_, Some(ConstantSource::Short(x))) if x.is_power_of_two() => {
                 return self.u_shr(
-                    Rc::new(Integer::new_constant_u32(x.ilog2())),
+                    Arc::new(Integer::new_constant_u32(x.ilog2())),
                     optimize_away,
                     module,
                 )
@@ -486,7 +517,7 @@ impl Integer {
 
             (_, Some(ConstantSource::Long(x))) if x.is_power_of_two() => {
                 return self.u_shr(
-                    Rc::new(Integer::new_constant_u64(x.ilog2() as u64)),
+                    Arc::new(Integer::new_constant_u64(x.ilog2() as u64)),
                     optimize_away,
                     module,
                 )
@@ -499,13 +530,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn s_rem(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn s_rem(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -537,13 +568,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn u_rem(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn u_rem(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -571,13 +602,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn and(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn and(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -601,13 +632,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn or(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn or(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -632,13 +663,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn xor(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn xor(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -663,13 +694,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn shl(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn shl(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -694,13 +725,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn s_shr(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn s_shr(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -729,18 +760,18 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
     pub fn u_shr(
-        self: Rc<Self>,
-        rhs: Rc<Integer>,
+        self: Arc<Self>,
+        rhs: Arc<Integer>,
         optimize_away: bool,
         module: &ModuleBuilder,
-    ) -> Result<Rc<Self>> {
+    ) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -778,13 +809,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn clz(self: Rc<Self>) -> Result<Rc<Self>> {
+    pub fn clz(self: Arc<Self>) -> Result<Arc<Self>> {
         let source = match self.get_constant_value()? {
             Some(ConstantSource::Short(x)) => {
                 IntegerSource::Constant(ConstantSource::Short(u32::leading_zeros(x)))
@@ -800,13 +831,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn ctz(self: Rc<Self>) -> Result<Rc<Self>> {
+    pub fn ctz(self: Arc<Self>) -> Result<Arc<Self>> {
         let source = match self.get_constant_value()? {
             Some(ConstantSource::Short(x)) => {
                 IntegerSource::Constant(ConstantSource::Short(u32::trailing_zeros(x)))
@@ -822,13 +853,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn popcnt(self: Rc<Self>) -> Result<Rc<Self>> {
+    pub fn popcnt(self: Arc<Self>) -> Result<Arc<Self>> {
         let source = match self.get_constant_value()? {
             Some(ConstantSource::Short(x)) => {
                 IntegerSource::Constant(ConstantSource::Short(u32::count_ones(x)))
@@ -844,13 +875,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn rotl(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn rotl(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -875,13 +906,13 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
 
-    pub fn rotr(self: Rc<Self>, rhs: Rc<Integer>, module: &ModuleBuilder) -> Result<Rc<Self>> {
+    pub fn rotr(self: Arc<Self>, rhs: Arc<Integer>, module: &ModuleBuilder) -> Result<Arc<Self>> {
         match (self.kind(module)?, rhs.kind(module)?) {
             (x, y) if x != y => return Err(Error::mismatch(x, y)),
             _ => {}
@@ -906,8 +937,8 @@ impl Integer {
             },
         };
 
-        return Ok(Rc::new(Self {
-            translation: Cell::new(None),
+        return Ok(Arc::new(Self {
+            translation: IdCell::new(None),
             source,
         }));
     }
@@ -3,7 +3,7 @@ use self::{
     float::{Float, FloatKind, FloatSource},
     integer::{Integer, IntegerKind, IntegerSource},
     pointer::{Pointer, PointerSource},
-    vector::Vector,
+    vector::{Vector, VectorSource},
 };
 use super::module::ModuleBuilder;
 use crate::{
@@ -11,7 +11,7 @@ use crate::{
     r#type::{CompositeType, PointerSize, ScalarType, Type},
 };
 use rspirv::spirv::StorageClass;
-use std::rc::Rc;
+use std::sync::Arc;
 
 pub mod bool;
 pub mod float;
@@ -21,21 +21,21 @@ pub mod vector;
 
 #[derive(Debug, Clone)]
 pub enum Value {
-    Integer(Rc<Integer>),
-    Float(Rc<Float>),
-    Pointer(Rc<Pointer>),
-    Vector(Rc<Vector>),
-    Bool(Rc<Bool>),
+    Integer(Arc<Integer>),
+    Float(Arc<Float>),
+    Pointer(Arc<Pointer>),
+    Vector(Arc<Vector>),
+    Bool(Arc<Bool>),
 }
 
 impl Value {
     pub fn ptr_eq(&self, other: &Self) -> bool {
         match (self, other) {
-            (Value::Integer(x), Value::Integer(y)) => Rc::ptr_eq(x, y),
-            (Value::Float(x), Value::Float(y)) => Rc::ptr_eq(x, y),
-            (Value::Pointer(x), Value::Pointer(y)) => Rc::ptr_eq(x, y),
-            (Value::Vector(x), Value::Vector(y)) => Rc::ptr_eq(x, y),
-            (Value::Bool(x), Value::Bool(y)) => Rc::ptr_eq(x, y),
+            (Value::Integer(x), Value::Integer(y)) => Arc::ptr_eq(x, y),
+            (Value::Float(x), Value::Float(y)) => Arc::ptr_eq(x, y),
+            (Value::Pointer(x), Value::Pointer(y)) => Arc::ptr_eq(x, y),
+            (Value::Vector(x), Value::Vector(y)) => Arc::ptr_eq(x, y),
+            (Value::Bool(x), Value::Bool(y)) => Arc::ptr_eq(x, y),
             _ => false,
         }
     }
@@ -79,11 +79,35 @@ impl Value {
                 PointerSource::FunctionParam,
             )
             .into(),
+            Type::Composite(CompositeType::Vector(elem, count)) => {
+                Vector::new(VectorSource::FunctionParam, elem, count).into()
+            }
             _ => todo!(),
         }
     }
 
-    pub fn i_add(self, rhs: impl Into<Value>, module: &mut ModuleBuilder) -> Result<Value> {
+    /// Specialization constant with the given `SpecId`, defaulting to this (constant) value.
+    pub fn specialize(self, spec_id: u32) -> Result<Value> {
+        return Ok(match self {
+            Value::Integer(x) => match x.get_constant_value()? {
+                Some(default) => {
+                    Integer::new(IntegerSource::SpecConstant { spec_id, default }).into()
+                }
+                None => return Err(Error::msg("Specialization constants must be constant")),
+            },
+            Value::Float(x) => match x.get_constant_value()? {
+                Some(default) => Float::new(FloatSource::SpecConstant { spec_id, default }).into(),
+                None => return Err(Error::msg("Specialization constants must be constant")),
+            },
+            other => {
+                return Err(Error::msg(format!(
+                    "Specialization constants must be scalars, found {other:?}"
+                )))
+            }
+        });
+    }
+
+    pub fn i_add(self, rhs: impl Into<Value>, module: &ModuleBuilder) -> Result<Value> {
         return match (self, rhs.into()) {
             (Value::Integer(x), Value::Integer(y)) => x.add(y, module).map(Into::into),
             (Value::Pointer(x), Value::Integer(y)) => x.access(y, module).map(Into::into),
@@ -92,66 +116,66 @@ impl Value {
         };
     }
 
-    pub fn i_sub(self, rhs: impl Into<Rc<Integer>>, module: &mut ModuleBuilder) -> Result<Value> {
+    pub fn i_sub(self, rhs: impl Into<Arc<Integer>>, module: &ModuleBuilder) -> Result<Value> {
         let rhs = rhs.into();
         return Ok(match self {
-            Value::Integer(int) => Value::Integer(Rc::new(int.sub(rhs, module)?)),
+            Value::Integer(int) => Value::Integer(Arc::new(int.sub(rhs, module)?)),
             Value::Pointer(ptr) => {
-                Value::Pointer(Rc::new(ptr.access(Rc::new(rhs.negate()), module)?))
+                Value::Pointer(Arc::new(ptr.access(Arc::new(rhs.negate()), module)?))
             }
             _ => return Err(Error::invalid_operand()),
         });
     }
 
-    pub fn into_integer(self) -> Result<Rc<Integer>> {
+    pub fn into_integer(self) -> Result<Arc<Integer>> {
         match self {
             Value::Integer(x) => Ok(x),
             other => Err(Error::msg(format!("Expected an integer, found {other:?}"))),
         }
     }
 
-    pub fn into_float(self) -> Result<Rc<Float>> {
+    pub fn into_float(self) -> Result<Arc<Float>> {
         match self {
             Value::Float(x) => Ok(x),
             other => Err(Error::msg(format!("Expected a float, found {other:?}"))),
         }
     }
 
-    pub fn into_pointer(self) -> Result<Rc<Pointer>> {
+    pub fn into_pointer(self) -> Result<Arc<Pointer>> {
         match self {
             Value::Pointer(x) => Ok(x),
             other => Err(Error::msg(format!("Expected a pointer, found {other:?}"))),
         }
     }
 
-    pub fn into_vector(self) -> Result<Rc<Vector>> {
+    pub fn into_vector(self) -> Result<Arc<Vector>> {
         match self {
             Value::Vector(x) => Ok(x),
             other => Err(Error::msg(format!("Expected a vector, found {other:?}"))),
         }
     }
 
-    pub fn into_bool(self) -> Result<Rc<Bool>> {
+    pub fn into_bool(self) -> Result<Arc<Bool>> {
         match self {
             Value::Bool(x) => Ok(x),
             other => Err(Error::msg(format!("Expected a boolean, found {other:?}"))),
         }
     }
 
-    pub fn to_bool(self, module: &mut ModuleBuilder) -> Result<Rc<Bool>> {
+    pub fn to_bool(self, module: &ModuleBuilder) -> Result<Arc<Bool>> {
         return match self {
             Value::Bool(x) => Ok(x),
-            Value::Integer(x) => x.to_bool().map(Rc::new),
-            Value::Pointer(x) => x.to_integer(module).map(Rc::new)?.to_bool().map(Rc::new),
+            Value::Integer(x) => x.to_bool().map(Arc::new),
+            Value::Pointer(x) => x.to_integer(module).map(Arc::new)?.to_bool().map(Arc::new),
             _ => return Err(Error::invalid_operand()),
         };
     }
 
-    pub fn to_integer(self, kind: IntegerKind, module: &mut ModuleBuilder) -> Result<Rc<Integer>> {
+    pub fn to_integer(self, kind: IntegerKind, module: &ModuleBuilder) -> Result<Arc<Integer>> {
         return match self {
             Value::Integer(x) if kind == x.kind(module)? => Ok(x),
             Value::Pointer(x) if kind == module.isize_integer_kind() => {
-                x.to_integer(module).map(Rc::new)
+                x.to_integer(module).map(Arc::new)
             }
             Value::Bool(x) => x.to_integer(kind),
             _ => return Err(Error::invalid_operand()),
@@ -162,75 +186,75 @@ impl Value {
         self,
         size_hint: PointerSize,
         pointee: impl Into<Type>,
-        module: &mut ModuleBuilder,
-    ) -> Result<Rc<Pointer>> {
+        module: &ModuleBuilder,
+    ) -> Result<Arc<Pointer>> {
         let pointee = pointee.into();
         return match self {
             Value::Integer(x) => x
                 .to_pointer(size_hint, StorageClass::Generic, pointee.into(), module)
-                .map(Rc::new),
+                .map(Arc::new),
             Value::Pointer(x) => Ok(x.cast(pointee)),
             _ => return Err(Error::invalid_operand()),
         };
     }
 }
 
-impl From<Rc<Integer>> for Value {
-    fn from(value: Rc<Integer>) -> Self {
+impl From<Arc<Integer>> for Value {
+    fn from(value: Arc<Integer>) -> Self {
         Value::Integer(value)
     }
 }
 
-impl From<Rc<Float>> for Value {
-    fn from(value: Rc<Float>) -> Self {
+impl From<Arc<Float>> for Value {
+    fn from(value: Arc<Float>) -> Self {
         Value::Float(value)
     }
 }
 
-impl From<Rc<Pointer>> for Value {
-    fn from(value: Rc<Pointer>) -> Self {
+impl From<Arc<Pointer>> for Value {
+    fn from(value: Arc<Pointer>) -> Self {
         Value::Pointer(value)
     }
 }
 
-impl From<Rc<Vector>> for Value {
-    fn from(value: Rc<Vector>) -> Self {
+impl From<Arc<Vector>> for Value {
+    fn from(value: Arc<Vector>) -> Self {
         Value::Vector(value)
     }
 }
 
-impl From<Rc<Bool>> for Value {
-    fn from(value: Rc<Bool>) -> Self {
+impl From<Arc<Bool>> for Value {
+    fn from(value: Arc<Bool>) -> Self {
         Value::Bool(value)
     }
 }
 
 impl From<Integer> for Value {
     fn from(value: Integer) -> Self {
-        Value::Integer(Rc::new(value))
+        Value::Integer(Arc::new(value))
     }
 }
 
 impl From<Float> for Value {
     fn from(value: Float) -> Self {
-        Value::Float(Rc::new(value))
+        Value::Float(Arc::new(value))
     }
 }
 
 impl From<Pointer> for Value {
     fn from(value: Pointer) -> Self {
-        Value::Pointer(Rc::new(value))
+        Value::Pointer(Arc::new(value))
     }
 }
 
 impl From<Vector> for Value {
     fn from(value: Vector) -> Self {
-        Value::Vector(Rc::new(value))
+        Value::Vector(Arc::new(value))
     }
 }
 
 impl From<Bool> for Value {
     fn from(value: Bool) -> Self {
-        Value::Bool(Rc::new(value))
+        Value::Bool(Arc::new(value))
     }
 }
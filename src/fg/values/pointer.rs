@@ -1,23 +1,23 @@
 use super::{
     bool::{Bool, BoolSource},
     float::{Float, FloatSource},
-    integer::{Integer, IntegerSource},
+    integer::{AtomicSource, Integer, IntegerSource},
     vector::{Vector, VectorSource},
     Value,
 };
 use crate::{
     decorator::VariableDecorator,
     error::{Error, Result},
-    fg::{block::BlockBuilder, module::ModuleBuilder, Operation},
+    fg::{block::BlockBuilder, module::ModuleBuilder, IdCell, Operation},
     r#type::{CompositeType, PointerSize, ScalarType, Type},
 };
 use spirv::StorageClass;
-use std::{cell::Cell, rc::Rc};
+use std::sync::Arc;
 
 #[derive(Debug, Clone)]
 pub enum PointerKind {
     Skinny,
-    Fat { byte_offset: Option<Rc<Integer>> },
+    Fat { byte_offset: Option<Arc<Integer>> },
 }
 
 impl PointerKind {
@@ -39,7 +39,7 @@ impl PointerKind {
 
 #[derive(Debug)]
 pub struct Pointer {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub kind: PointerKind,
     pub storage_class: StorageClass,
     pub pointee: Type,
@@ -54,7 +54,7 @@ impl Pointer {
         source: PointerSource,
     ) -> Self {
         return Self {
-            translation: Cell::default(),
+            translation: IdCell::default(),
             kind,
             source,
             storage_class,
@@ -97,13 +97,13 @@ impl Pointer {
         matches!(self.kind, PointerKind::Skinny { .. })
     }
 
-    pub fn take_byte_offset(self: Rc<Self>) -> (Rc<Self>, Option<Rc<Integer>>) {
+    pub fn take_byte_offset(self: Arc<Self>) -> (Arc<Self>, Option<Arc<Integer>>) {
         match &self.kind {
             PointerKind::Skinny => (self, None),
             PointerKind::Fat { byte_offset } => {
                 let kind = PointerKind::Fat { byte_offset: None };
                 (
-                    Rc::new(Pointer::new(
+                    Arc::new(Pointer::new(
                         kind,
                         self.storage_class,
                         self.pointee.clone(),
@@ -115,14 +115,14 @@ impl Pointer {
         }
     }
 
-    pub fn byte_offset(&self) -> Option<Rc<Integer>> {
+    pub fn byte_offset(&self) -> Option<Arc<Integer>> {
         match &self.kind {
             PointerKind::Skinny { .. } => None,
             PointerKind::Fat { byte_offset, .. } => byte_offset.clone(),
         }
     }
 
-    pub fn cast(self: Rc<Self>, new_pointee: impl Into<Type>) -> Rc<Pointer> {
+    pub fn cast(self: Arc<Self>, new_pointee: impl Into<Type>) -> Arc<Pointer> {
         let new_pointee = new_pointee.into();
         if self.pointee == new_pointee {
             return self;
@@ -133,7 +133,7 @@ impl Pointer {
             PointerKind::Fat { .. } => self.kind.clone(),
         };
 
-        return Rc::new(Pointer::new(
+        return Arc::new(Pointer::new(
             kind,
             self.storage_class,
             new_pointee,
@@ -141,19 +141,19 @@ impl Pointer {
         ));
     }
 
-    pub fn to_integer(self: Rc<Self>, module: &mut ModuleBuilder) -> Result<Integer> {
+    pub fn to_integer(self: Arc<Self>, module: &ModuleBuilder) -> Result<Integer> {
         return Ok(Integer {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source: IntegerSource::Conversion(super::integer::ConversionSource::FromPointer(self)),
         });
     }
 
     pub fn store(
-        self: Rc<Self>,
+        self: Arc<Self>,
         value: impl Into<Value>,
         log2_alignment: Option<u32>,
         _block: &mut BlockBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Operation> {
         let value: Value = value.into();
         let value_type = value.ty(module)?;
@@ -171,18 +171,75 @@ impl Pointer {
         });
     }
 
+    /// Pointer to the first element of the pointed-to array.
+    pub fn decay(self: Arc<Self>) -> Result<Pointer> {
+        let elem = match &self.pointee {
+            Type::Composite(CompositeType::Array(elem, _)) => Type::clone(elem),
+            other => return Err(Error::mismatch("array", other)),
+        };
+
+        return Ok(Pointer::new(
+            PointerKind::fat(),
+            self.storage_class,
+            elem,
+            PointerSource::Decayed { array: self },
+        ));
+    }
+
+    /// Atomically applies `source` to the pointee, resulting in it's original value.
+    pub fn atomic(
+        self: Arc<Self>,
+        source: AtomicSource,
+        _block: &mut BlockBuilder,
+        _module: &ModuleBuilder,
+    ) -> Result<Integer> {
+        if !matches!(
+            self.pointee,
+            Type::Scalar(ScalarType::I32 | ScalarType::I64)
+        ) {
+            return Err(Error::msg(format!(
+                "Atomic operations are only supported on integers, found {:?}",
+                self.pointee
+            )));
+        }
+
+        return Ok(Integer::new(IntegerSource::Atomic {
+            pointer: self,
+            source,
+        }));
+    }
+
+    pub fn atomic_store(
+        self: Arc<Self>,
+        value: impl Into<Value>,
+        _block: &mut BlockBuilder,
+        module: &ModuleBuilder,
+    ) -> Result<Operation> {
+        let value: Value = value.into();
+        let value_type = value.ty(module)?;
+
+        if value_type != self.pointee {
+            return Err(Error::mismatch(self.pointee.clone(), value_type));
+        }
+
+        return Ok(Operation::AtomicStore {
+            target: self,
+            value,
+        });
+    }
+
     pub fn load(
-        self: Rc<Self>,
+        self: Arc<Self>,
         log2_alignment: Option<u32>,
         _block: &mut BlockBuilder,
-        module: &mut ModuleBuilder,
+        module: &ModuleBuilder,
     ) -> Result<Value> {
         let result = match &self.pointee {
             Type::Pointer {
                 size,
                 storage_class,
                 pointee,
-            } => Value::Pointer(Rc::new(Pointer::new(
+            } => Value::Pointer(Arc::new(Pointer::new(
                 size.to_pointer_kind(),
                 *storage_class,
                 Type::clone(pointee),
@@ -192,16 +249,16 @@ impl Pointer {
                 },
             ))),
 
-            Type::Scalar(ScalarType::I32 | ScalarType::I64) => Value::Integer(Rc::new(Integer {
-                translation: Cell::new(None),
+            Type::Scalar(ScalarType::I32 | ScalarType::I64) => Value::Integer(Arc::new(Integer {
+                translation: IdCell::new(None),
                 source: IntegerSource::Loaded {
                     pointer: self,
                     log2_alignment,
                 },
             })),
 
-            Type::Scalar(ScalarType::F32 | ScalarType::F64) => Value::Float(Rc::new(Float {
-                translation: Cell::new(None),
+            Type::Scalar(ScalarType::F32 | ScalarType::F64) => Value::Float(Arc::new(Float {
+                translation: IdCell::new(None),
                 source: FloatSource::Loaded {
                     pointer: self,
                     log2_alignment,
@@ -215,7 +272,7 @@ impl Pointer {
             .into(),
 
             Type::Composite(CompositeType::Vector(elem, count)) => Vector {
-                translation: Cell::new(None),
+                translation: IdCell::new(None),
                 element_type: *elem,
                 element_count: *count,
                 source: VectorSource::Loaded {
@@ -224,14 +281,18 @@ impl Pointer {
                 },
             }
             .into(),
+
+            Type::Composite(CompositeType::Array(..)) => {
+                return Err(Error::msg("Arrays can't be loaded as a single value"))
+            }
         };
 
         return Ok(result);
     }
 
     pub fn access(
-        self: Rc<Self>,
-        byte_offset: impl Into<Rc<Integer>>,
+        self: Arc<Self>,
+        byte_offset: impl Into<Arc<Integer>>,
         module: &ModuleBuilder,
     ) -> Result<Self> {
         let byte_offset = byte_offset.into();
@@ -265,17 +326,21 @@ impl Pointer {
 #[derive(Debug, Clone)]
 pub enum PointerSource {
     FunctionParam,
-    FromInteger(Rc<Integer>),
+    FromInteger(Arc<Integer>),
     Select {
-        selector: Rc<Bool>,
-        true_value: Rc<Pointer>,
-        false_value: Rc<Pointer>,
+        selector: Arc<Bool>,
+        true_value: Arc<Pointer>,
+        false_value: Arc<Pointer>,
     },
     Casted {
-        prev: Rc<Pointer>,
+        prev: Arc<Pointer>,
+    },
+    /// Pointer to the elements of a fixed-size array
+    Decayed {
+        array: Arc<Pointer>,
     },
     Loaded {
-        pointer: Rc<Pointer>,
+        pointer: Arc<Pointer>,
         log2_alignment: Option<u32>,
     },
     Variable {
@@ -7,12 +7,14 @@ use super::{
     pointer::Pointer,
     Value,
 };
+use crate::error::{Error, Result};
+use crate::fg::IdCell;
 use crate::r#type::{CompositeType, ScalarType};
-use std::{cell::Cell, rc::Rc};
+use std::sync::Arc;
 
 #[derive(Debug, Clone)]
 pub struct Vector {
-    pub(crate) translation: Cell<Option<rspirv::spirv::Word>>,
+    pub(crate) translation: IdCell,
     pub source: VectorSource,
     pub element_type: ScalarType,
     pub element_count: u32,
@@ -20,32 +22,250 @@ pub struct Vector {
 
 #[derive(Debug, Clone)]
 pub enum VectorSource {
+    FunctionParam,
     Loaded {
-        pointer: Rc<Pointer>,
+        pointer: Arc<Pointer>,
         log2_alignment: Option<u32>,
     },
     Select {
-        selector: Rc<Bool>,
-        true_value: Rc<Vector>,
-        false_value: Rc<Vector>,
+        selector: Arc<Bool>,
+        true_value: Arc<Vector>,
+        false_value: Arc<Vector>,
+    },
+    FunctionCall {
+        function_id: Arc<IdCell>,
+        args: Box<[Value]>,
+    },
+    /// Vector with all of it's components set to the same value
+    Splat(Value),
+    Construct(Box<[Value]>),
+    /// Reinterpretation of a vector with the same bit width, but a different lane shape
+    Bitcast(Arc<Vector>),
+    Shuffle {
+        vector_1: Arc<Vector>,
+        vector_2: Arc<Vector>,
+        components: Box<[u32]>,
+    },
+    Inserted {
+        vector: Arc<Vector>,
+        value: Value,
+        index: u32,
+    },
+    Unary {
+        source: UnarySource,
+        op1: Arc<Vector>,
+    },
+    Binary {
+        source: BinarySource,
+        op1: Arc<Vector>,
+        op2: Arc<Vector>,
     },
 }
 
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum UnarySource {
+    Not,
+    Negate,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BinarySource {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    And,
+    Or,
+    Xor,
+}
+
 impl Vector {
     pub fn new(source: VectorSource, element_type: ScalarType, element_count: u32) -> Self {
         return Self {
-            translation: Cell::new(None),
+            translation: IdCell::new(None),
             source,
             element_type,
             element_count,
         };
     }
 
+    /// Creates a vector with the lane shape of [`CompositeType::V128`].
+    pub fn v128(source: VectorSource) -> Self {
+        return Self::new(source, ScalarType::I32, 4);
+    }
+
     pub fn vector_type(&self) -> CompositeType {
         CompositeType::Vector(self.element_type, self.element_count)
     }
 
-    pub fn extract(self: Rc<Self>, index: impl Into<Rc<Integer>>) -> Value {
+    pub fn is_float(&self) -> bool {
+        matches!(self.element_type, ScalarType::F32 | ScalarType::F64)
+    }
+
+    pub fn splat(value: impl Into<Value>, element_type: ScalarType, element_count: u32) -> Self {
+        return Self::new(
+            VectorSource::Splat(value.into()),
+            element_type,
+            element_count,
+        );
+    }
+
+    /// Reinterprets the vector's bits with a different lane shape.
+    pub fn reinterpret(
+        self: Arc<Self>,
+        element_type: ScalarType,
+        element_count: u32,
+    ) -> Result<Arc<Self>> {
+        let shape = CompositeType::Vector(element_type, element_count);
+        if self.vector_type() == shape {
+            return Ok(self);
+        }
+
+        let byte_size = |ty: ScalarType, count: u32| ty.byte_size().map(|x| x * count);
+        if byte_size(self.element_type, self.element_count)
+            != byte_size(element_type, element_count)
+        {
+            return Err(Error::mismatch(shape, self.vector_type()));
+        }
+
+        // Avoid chaining bitcasts when going back to the original shape
+        if let VectorSource::Bitcast(inner) = &self.source {
+            if inner.vector_type() == shape {
+                return Ok(inner.clone());
+            }
+        }
+
+        return Ok(Arc::new(Self::new(
+            VectorSource::Bitcast(self),
+            element_type,
+            element_count,
+        )));
+    }
+
+    pub fn insert(self: Arc<Self>, value: impl Into<Value>, index: u32) -> Result<Self> {
+        if index >= self.element_count {
+            return Err(Error::msg(format!(
+                "Lane {index} is out of bounds for a vector of {} lanes",
+                self.element_count
+            )));
+        }
+
+        let (element_type, element_count) = (self.element_type, self.element_count);
+        return Ok(Self::new(
+            VectorSource::Inserted {
+                vector: self,
+                value: value.into(),
+                index,
+            },
+            element_type,
+            element_count,
+        ));
+    }
+
+    /// Selects the components of the result from the concatenation of both vectors.
+    pub fn shuffle(
+        self: Arc<Self>,
+        rhs: Arc<Vector>,
+        components: impl Into<Box<[u32]>>,
+    ) -> Result<Self> {
+        if self.vector_type() != rhs.vector_type() {
+            return Err(Error::mismatch(self.vector_type(), rhs.vector_type()));
+        }
+
+        let components = components.into();
+        if components.iter().any(|x| *x >= 2 * self.element_count) {
+            return Err(Error::msg("Shuffle component is out of bounds"));
+        }
+
+        let element_type = self.element_type;
+        let element_count = components.len() as u32;
+        return Ok(Self::new(
+            VectorSource::Shuffle {
+                vector_1: self,
+                vector_2: rhs,
+                components,
+            },
+            element_type,
+            element_count,
+        ));
+    }
+
+    pub fn not(self: Arc<Self>) -> Result<Self> {
+        if self.is_float() {
+            return Err(Error::invalid_operand());
+        }
+        return Ok(self.unary(UnarySource::Not));
+    }
+
+    pub fn negate(self: Arc<Self>) -> Self {
+        self.unary(UnarySource::Negate)
+    }
+
+    pub fn add(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.binary(BinarySource::Add, rhs)
+    }
+
+    pub fn sub(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.binary(BinarySource::Sub, rhs)
+    }
+
+    pub fn mul(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.binary(BinarySource::Mul, rhs)
+    }
+
+    pub fn div(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        if !self.is_float() {
+            return Err(Error::invalid_operand());
+        }
+        self.binary(BinarySource::Div, rhs)
+    }
+
+    pub fn and(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.bitwise(BinarySource::And, rhs)
+    }
+
+    pub fn or(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.bitwise(BinarySource::Or, rhs)
+    }
+
+    pub fn xor(self: Arc<Self>, rhs: Arc<Vector>) -> Result<Self> {
+        self.bitwise(BinarySource::Xor, rhs)
+    }
+
+    fn unary(self: Arc<Self>, source: UnarySource) -> Self {
+        let (element_type, element_count) = (self.element_type, self.element_count);
+        return Self::new(
+            VectorSource::Unary { source, op1: self },
+            element_type,
+            element_count,
+        );
+    }
+
+    fn bitwise(self: Arc<Self>, source: BinarySource, rhs: Arc<Vector>) -> Result<Self> {
+        if self.is_float() {
+            return Err(Error::invalid_operand());
+        }
+        self.binary(source, rhs)
+    }
+
+    fn binary(self: Arc<Self>, source: BinarySource, rhs: Arc<Vector>) -> Result<Self> {
+        if self.vector_type() != rhs.vector_type() {
+            return Err(Error::mismatch(self.vector_type(), rhs.vector_type()));
+        }
+
+        let (element_type, element_count) = (self.element_type, self.element_count);
+        return Ok(Self::new(
+            VectorSource::Binary {
+                source,
+                op1: self,
+                op2: rhs,
+            },
+            element_type,
+            element_count,
+        ));
+    }
+
+    pub fn extract(self: Arc<Self>, index: impl Into<Arc<Integer>>) -> Value {
         match self.element_type {
             ScalarType::I32 | ScalarType::I64 => Integer::new(IntegerSource::Extracted {
                 vector: self,
@@ -0,0 +1,560 @@
+//! Merging of contiguous memory accesses into vector ones, run before a function is translated.
+//!
+//! Runs of consecutive [`Operation::Store`]s of scalars into the same buffer, at byte offsets that
+//! only differ by a constant and follow each other without gaps, become a single store of a two
+//! or four component vector built from the stored values. Fat pointers are lowered into an index
+//! of the buffer's elements, so a run is only merged when the offset of it's first access is known
+//! to be a multiple of the vector's size. WebAssembly alignment hints never go over the natural
+//! alignment of a scalar, so that's inferred from the shape of the offset instead.
+//!
+//! Debug lines between the stores of a run are dropped, so the merged store keeps the line of it's
+//! first store.
+//!
+//! Stored values are only lowered once their store is reached, so merging a run lowers every one
+//! of it's values before the first store. Runs with a value that may read memory the run could
+//! write to are thus left alone. Merged stores reinterpret the buffer through a pointer cast,
+//! which is only legal with physical addressing. With logical addressing, pointers can't be cast,
+//! so only runs that store every component of an element of a buffer of vectors are merged, into
+//! a store of that element.
+//!
+//! Loads aren't merged, since loaded values are graph nodes that any number of operations may
+//! share, and they're only lowered when first used. With logical addressing, scalar loads from a
+//! buffer of vectors go through an access chain into the vector's component instead.
+
+use super::{
+    function::FunctionBuilder,
+    module::ModuleBuilder,
+    subgroup::SubgroupSource,
+    values::{
+        bool::{Bool, BoolSource},
+        float::{ConversionSource as FloatConversion, Float, FloatSource},
+        integer::{
+            BinarySource, ConstantSource, ConversionSource as IntegerConversion, Integer,
+            IntegerSource,
+        },
+        pointer::{Pointer, PointerKind, PointerSource},
+        vector::{Vector, VectorSource},
+        Value,
+    },
+    Operation,
+};
+use crate::r#type::{CompositeType, ScalarType, Type};
+use rspirv::spirv::{AddressingModel, StorageClass};
+use std::sync::Arc;
+
+/// Component counts stores are merged into, from widest to narrowest
+const WIDTHS: [usize; 2] = [4, 2];
+
+/// Nodes of the stored values that are looked at before giving up on merging a run
+const READ_BUDGET: usize = 256;
+
+pub fn vectorize_stores(function: &mut FunctionBuilder, module: &ModuleBuilder) {
+    let logical = match module.addressing_model {
+        AddressingModel::Physical32 | AddressingModel::Physical64 => false,
+        AddressingModel::Logical => true,
+        _ => return,
+    };
+
+    let anchors = std::mem::take(&mut function.anchors);
+    let mut result = Vec::with_capacity(anchors.len());
+
+    let mut i = 0;
+    while i < anchors.len() {
+        match merge_width(&anchors[i..], logical) {
+            Some(length) => {
+                result.push(merge(&anchors[i..i + length], logical));
+                i += length;
+            }
+            _ => {
+                result.push(anchors[i].clone());
+                i += 1;
+            }
+        }
+    }
+
+    function.anchors = result;
+}
+
+/// Number of anchors, from the start of `anchors`, that can be merged into a single store. With
+/// `logical` addressing, only stores of every component of a buffer's vector are merged.
+fn merge_width(anchors: &[Operation], logical: bool) -> Option<usize> {
+    let first = StoreAccess::new(anchors.first()?)?;
+    let vector_width = match logical {
+        true => Some(buffer_vector(first.target)?.1 as usize),
+        false => None,
+    };
+
+    // Position of every store of the run, after the first one
+    let run = anchors
+        .iter()
+        .enumerate()
+        .skip(1)
+        .filter(|(_, x)| !matches!(x, Operation::Line(_)))
+        .take(WIDTHS[0] - 1)
+        .map_while(|(i, x)| Some((i, StoreAccess::new(x)?)))
+        .zip(1..)
+        .take_while(|((_, next), j)| first.is_followed_by(next, *j))
+        .map(|((i, _), _)| i)
+        .collect::<Vec<_>>();
+
+    let alignment = known_alignment(first.offset);
+    let width = WIDTHS.into_iter().find(|width| {
+        run.len() + 1 >= *width
+            && alignment >= (*width as u32 * first.size).trailing_zeros()
+            && vector_width.map_or(true, |x| x == *width)
+    })?;
+
+    let length = run[width - 2] + 1;
+    let mut reads = Reads {
+        storage_class: first.target.storage_class,
+        budget: READ_BUDGET,
+    };
+
+    for anchor in &anchors[..length] {
+        if let Operation::Store { value, .. } = anchor {
+            if reads.value(value) {
+                return None;
+            }
+        }
+    }
+
+    return Some(length);
+}
+
+/// Single store of the vector of every value stored by `run`. With `logical` addressing, it's
+/// stored into the buffer's vector instead of through a pointer cast.
+fn merge(run: &[Operation], logical: bool) -> Operation {
+    let mut values = Vec::with_capacity(run.len());
+    let mut first = None;
+    for anchor in run {
+        if let Operation::Store { target, value, .. } = anchor {
+            first.get_or_insert(target);
+            values.push(value.clone());
+        }
+    }
+
+    let (target, elem) = match first {
+        Some(target) => match target.pointee {
+            Type::Scalar(elem) => (target.clone(), elem),
+            _ => unreachable!(),
+        },
+        None => unreachable!(),
+    };
+
+    let count = values.len() as u32;
+    let size = elem.byte_size().unwrap_or_default() * count;
+    let vector = Vector::new(
+        VectorSource::Construct(values.into_boxed_slice()),
+        elem,
+        count,
+    );
+
+    // Casts into the buffer's own pointee only change the offset
+    let target = match (logical, buffer_vector(&target)) {
+        (true, Some((buffer, _))) => Arc::new(Pointer::new(
+            target.kind.clone(),
+            buffer.storage_class,
+            buffer.pointee.clone(),
+            PointerSource::Casted {
+                prev: buffer.clone(),
+            },
+        )),
+        _ => target.cast(CompositeType::Vector(elem, count)),
+    };
+
+    return Operation::Store {
+        target,
+        value: Value::Vector(Arc::new(vector)),
+        log2_alignment: Some(size.trailing_zeros()),
+    };
+}
+
+/// Structured buffer of vectors (and their component count) a scalar pointer has been cast from.
+fn buffer_vector(pointer: &Pointer) -> Option<(&Arc<Pointer>, u32)> {
+    let buffer = match &pointer.source {
+        PointerSource::Casted { prev } if prev.is_structured() => prev,
+        _ => return None,
+    };
+
+    return match (&pointer.pointee, &buffer.pointee) {
+        (Type::Scalar(elem), Type::Composite(CompositeType::Vector(vector_elem, count)))
+            if elem == vector_elem =>
+        {
+            Some((buffer, *count))
+        }
+        _ => None,
+    };
+}
+
+/// Whether lowering a value may read memory of `storage_class`. Anything that can't be proven not
+/// to (like function calls, atomics, or values too large to look through) is assumed to.
+struct Reads {
+    storage_class: StorageClass,
+    budget: usize,
+}
+
+impl Reads {
+    fn visit(&mut self) -> bool {
+        match self.budget.checked_sub(1) {
+            Some(budget) => {
+                self.budget = budget;
+                true
+            }
+            None => false,
+        }
+    }
+
+    fn value(&mut self, value: &Value) -> bool {
+        return match value {
+            Value::Integer(x) => self.integer(x),
+            Value::Float(x) => self.float(x),
+            Value::Bool(x) => self.bool(x),
+            Value::Vector(x) => self.vector(x),
+            Value::Pointer(x) => self.pointer(x),
+        };
+    }
+
+    fn loaded(&mut self, pointer: &Pointer) -> bool {
+        return pointer.storage_class == self.storage_class
+            || pointer.storage_class == StorageClass::Generic
+            || self.pointer(pointer);
+    }
+
+    fn integer(&mut self, value: &Integer) -> bool {
+        if !self.visit() {
+            return true;
+        }
+
+        return match &value.source {
+            IntegerSource::FunctionParam(_)
+            | IntegerSource::Constant(_)
+            | IntegerSource::SpecConstant { .. } => false,
+            IntegerSource::Conversion(x) => match x {
+                IntegerConversion::Bitcast { value, .. } => self.value(value),
+                IntegerConversion::FromShort { value, .. } | IntegerConversion::FromLong(value) => {
+                    self.integer(value)
+                }
+                IntegerConversion::FromPointer(x) => self.pointer(x),
+                IntegerConversion::FromBool(x, _) => self.bool(x),
+                IntegerConversion::FromFloat { value, .. } => self.float(value),
+            },
+            IntegerSource::ArrayLength { structured_array } => self.pointer(structured_array),
+            IntegerSource::Loaded { pointer, .. } => self.loaded(pointer),
+            IntegerSource::Select {
+                selector,
+                true_value,
+                false_value,
+            } => self.bool(selector) || self.integer(true_value) || self.integer(false_value),
+            IntegerSource::Extracted { vector, index } => {
+                self.vector(vector) || self.integer(index)
+            }
+            IntegerSource::FunctionCall { .. } | IntegerSource::Atomic { .. } => true,
+            IntegerSource::Subgroup(x) => self.subgroup(x),
+            IntegerSource::Unary { op1, .. } => self.integer(op1),
+            IntegerSource::Binary { op1, op2, .. } => self.integer(op1) || self.integer(op2),
+        };
+    }
+
+    fn float(&mut self, value: &Float) -> bool {
+        if !self.visit() {
+            return true;
+        }
+
+        return match &value.source {
+            FloatSource::FunctionParam(_)
+            | FloatSource::Constant(_)
+            | FloatSource::SpecConstant { .. } => false,
+            FloatSource::Conversion(x) => match x {
+                FloatConversion::Bitcast { value, .. } => self.value(value),
+                FloatConversion::FromSingle(x) | FloatConversion::FromDouble(x) => self.float(x),
+                FloatConversion::FromInteger { value, .. } => self.integer(value),
+            },
+            FloatSource::Loaded { pointer, .. } => self.loaded(pointer),
+            FloatSource::Extracted { vector, index } => self.vector(vector) || self.integer(index),
+            FloatSource::Select {
+                selector,
+                true_value,
+                false_value,
+            } => self.bool(selector) || self.float(true_value) || self.float(false_value),
+            FloatSource::FunctionCall { .. } => true,
+            FloatSource::Subgroup(x) => self.subgroup(x),
+            FloatSource::Unary { op1, .. } => self.float(op1),
+            FloatSource::Binary { op1, op2, .. } => self.float(op1) || self.float(op2),
+        };
+    }
+
+    fn bool(&mut self, value: &Bool) -> bool {
+        if !self.visit() {
+            return true;
+        }
+
+        return match &value.source {
+            BoolSource::Constant(_) => false,
+            BoolSource::FromInteger(x) => self.integer(x),
+            BoolSource::Negated(x) => self.bool(x),
+            BoolSource::Select {
+                selector,
+                true_value,
+                false_value,
+            } => self.bool(selector) || self.bool(true_value) || self.bool(false_value),
+            BoolSource::IntEquality { op1, op2, .. }
+            | BoolSource::IntComparison { op1, op2, .. } => self.integer(op1) || self.integer(op2),
+            BoolSource::FloatEquality { op1, op2, .. }
+            | BoolSource::FloatComparison { op1, op2, .. } => self.float(op1) || self.float(op2),
+            BoolSource::Loaded { pointer, .. } => self.loaded(pointer),
+            BoolSource::Subgroup(x) => self.subgroup(x),
+        };
+    }
+
+    fn vector(&mut self, value: &Vector) -> bool {
+        if !self.visit() {
+            return true;
+        }
+
+        return match &value.source {
+            VectorSource::FunctionParam => false,
+            VectorSource::Loaded { pointer, .. } => self.loaded(pointer),
+            VectorSource::Select {
+                selector,
+                true_value,
+                false_value,
+            } => self.bool(selector) || self.vector(true_value) || self.vector(false_value),
+            VectorSource::FunctionCall { .. } => true,
+            VectorSource::Splat(x) => self.value(x),
+            VectorSource::Construct(values) => values.iter().any(|x| self.value(x)),
+            VectorSource::Bitcast(x) | VectorSource::Unary { op1: x, .. } => self.vector(x),
+            VectorSource::Shuffle {
+                vector_1, vector_2, ..
+            } => self.vector(vector_1) || self.vector(vector_2),
+            VectorSource::Inserted { vector, value, .. } => {
+                self.vector(vector) || self.value(value)
+            }
+            VectorSource::Binary { op1, op2, .. } => self.vector(op1) || self.vector(op2),
+        };
+    }
+
+    /// Whether computing the pointer (not reading it's pointee) may read memory.
+    fn pointer(&mut self, value: &Pointer) -> bool {
+        if !self.visit() {
+            return true;
+        }
+
+        if let PointerKind::Fat {
+            byte_offset: Some(offset),
+        } = &value.kind
+        {
+            if self.integer(offset) {
+                return true;
+            }
+        }
+
+        return match &value.source {
+            PointerSource::FunctionParam => false,
+            PointerSource::FromInteger(x) => self.integer(x),
+            PointerSource::Select {
+                selector,
+                true_value,
+                false_value,
+            } => self.bool(selector) || self.pointer(true_value) || self.pointer(false_value),
+            PointerSource::Casted { prev } => self.pointer(prev),
+            PointerSource::Decayed { array } => self.pointer(array),
+            PointerSource::Loaded { pointer, .. } => self.loaded(pointer),
+            PointerSource::Variable { init, .. } => init.as_ref().map_or(false, |x| self.value(x)),
+        };
+    }
+
+    fn subgroup(&mut self, value: &SubgroupSource) -> bool {
+        return match value {
+            SubgroupSource::Elect => false,
+            SubgroupSource::All(x) | SubgroupSource::Any(x) => self.bool(x),
+            SubgroupSource::Ballot {
+                predicate,
+                component,
+            } => self.bool(predicate) || self.integer(component),
+            SubgroupSource::BroadcastFirst(value) | SubgroupSource::Arithmetic { value, .. } => {
+                self.value(value)
+            }
+            SubgroupSource::Shuffle { value, id } => self.value(value) || self.integer(id),
+        };
+    }
+}
+
+struct StoreAccess<'a> {
+    target: &'a Pointer,
+    size: u32,
+    offset: &'a Arc<Integer>,
+    /// Part of the offset that isn't constant, if any
+    base: Option<&'a Arc<Integer>>,
+    constant: i64,
+}
+
+impl<'a> StoreAccess<'a> {
+    fn new(anchor: &'a Operation) -> Option<Self> {
+        let (target, value) = match anchor {
+            Operation::Store { target, value, .. } => (target, value),
+            _ => return None,
+        };
+
+        let size = match (&target.pointee, value) {
+            (Type::Scalar(ScalarType::I32 | ScalarType::I64), Value::Integer(_))
+            | (Type::Scalar(ScalarType::F32 | ScalarType::F64), Value::Float(_)) => {
+                match &target.pointee {
+                    Type::Scalar(x) => x.byte_size()?,
+                    _ => return None,
+                }
+            }
+            _ => return None,
+        };
+
+        if target.storage_class == StorageClass::Function {
+            return None;
+        }
+
+        let offset = match &target.kind {
+            PointerKind::Fat {
+                byte_offset: Some(offset),
+            } => offset,
+            _ => return None,
+        };
+
+        let (base, constant) = split_offset(offset)?;
+        return Some(Self {
+            target,
+            size,
+            offset,
+            base,
+            constant,
+        });
+    }
+
+    /// Whether `next` stores the `index`-th element after this one, in the same buffer.
+    fn is_followed_by(&self, next: &StoreAccess, index: i64) -> bool {
+        return self.target.pointee == next.target.pointee
+            && self.target.storage_class == next.target.storage_class
+            && same_source(&self.target.source, &next.target.source)
+            && match (self.base, next.base) {
+                (Some(x), Some(y)) => same_integer(x, y),
+                (None, None) => true,
+                _ => false,
+            }
+            && next.constant == self.constant + index * self.size as i64;
+    }
+}
+
+/// Splits an offset into it's non-constant part and a constant one.
+fn split_offset(offset: &Arc<Integer>) -> Option<(Option<&Arc<Integer>>, i64)> {
+    if let Some(value) = constant(offset) {
+        return Some((None, value));
+    }
+
+    if let IntegerSource::Binary {
+        source: BinarySource::Add,
+        op1,
+        op2,
+    } = &offset.source
+    {
+        let (base, value) = match (constant(op1), constant(op2)) {
+            (None, Some(value)) => (op1, value),
+            (Some(value), None) => (op2, value),
+            _ => return Some((Some(offset), 0)),
+        };
+
+        let (base, inner) = split_offset(base)?;
+        return Some((base, inner.checked_add(value)?));
+    }
+
+    return Some((Some(offset), 0));
+}
+
+fn constant(value: &Integer) -> Option<i64> {
+    return match value.get_constant_value().ok()?? {
+        ConstantSource::Short(x) => Some(x as i32 as i64),
+        ConstantSource::Long(x) => Some(x as i64),
+    };
+}
+
+/// Log2 of the largest power of two `value` is known to be a multiple of.
+fn known_alignment(value: &Integer) -> u32 {
+    if let Some(value) = constant(value) {
+        return match value {
+            0 => u32::MAX,
+            x => x.trailing_zeros(),
+        };
+    }
+
+    return match &value.source {
+        IntegerSource::Binary { source, op1, op2 } => match source {
+            BinarySource::Add | BinarySource::Sub => {
+                u32::min(known_alignment(op1), known_alignment(op2))
+            }
+            BinarySource::Mul => known_alignment(op1).saturating_add(known_alignment(op2)),
+            BinarySource::And => u32::max(known_alignment(op1), known_alignment(op2)),
+            BinarySource::Shl => match constant(op2) {
+                Some(shift @ 0..=63) => known_alignment(op1).saturating_add(shift as u32),
+                _ => 0,
+            },
+            _ => 0,
+        },
+        _ => 0,
+    };
+}
+
+/// Whether both pointers are derived from the same pointer, without looking at their offsets.
+fn same_source(x: &PointerSource, y: &PointerSource) -> bool {
+    return match (x, y) {
+        (
+            PointerSource::Loaded {
+                pointer: x,
+                log2_alignment: x_align,
+            },
+            PointerSource::Loaded {
+                pointer: y,
+                log2_alignment: y_align,
+            },
+        ) => Arc::ptr_eq(x, y) && x_align == y_align,
+        // Casts keep the offset of the pointer they're cast from, so only their sources are
+        // looked at
+        (PointerSource::Casted { prev: x }, PointerSource::Casted { prev: y }) => {
+            Arc::ptr_eq(x, y)
+                || (x.pointee == y.pointee
+                    && x.storage_class == y.storage_class
+                    && same_source(&x.source, &y.source))
+        }
+        (PointerSource::Decayed { array: x }, PointerSource::Decayed { array: y }) => {
+            Arc::ptr_eq(x, y)
+        }
+        (PointerSource::FromInteger(x), PointerSource::FromInteger(y)) => same_integer(x, y),
+        // Variables and parameters are declared anew by every copy of their source
+        _ => false,
+    };
+}
+
+/// Whether both integers are known to evaluate to the same value. Values that may read memory
+/// (or anything else that may change between evaluations) are only the same if they're the same
+/// node, since every node is only lowered once.
+fn same_integer(x: &Arc<Integer>, y: &Arc<Integer>) -> bool {
+    if Arc::ptr_eq(x, y) {
+        return true;
+    }
+
+    return match (&x.source, &y.source) {
+        (IntegerSource::Constant(x), IntegerSource::Constant(y)) => x == y,
+        (
+            IntegerSource::Binary {
+                source: x_source,
+                op1: x1,
+                op2: x2,
+            },
+            IntegerSource::Binary {
+                source: y_source,
+                op1: y1,
+                op2: y2,
+            },
+        ) => {
+            std::mem::discriminant(x_source) == std::mem::discriminant(y_source)
+                && same_integer(x1, y1)
+                && same_integer(x2, y2)
+        }
+        _ => false,
+    };
+}
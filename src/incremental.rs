@@ -0,0 +1,369 @@
+//! Incremental recompilation, at function granularity.
+//!
+//! Every defined function is fingerprinted with it's body, the parts of the [`Config`] that change
+//! the output and the sections of the module that precede the code section (types, imports,
+//! globals, exports, ...), and the name section when debug information is emitted. Functions
+//! who's fingerprint hasn't changed since the last compilation aren't built nor translated again.
+//! Instead, their SPIR-V is spliced back in, with it's ids remapped into the new module.
+//!
+//! Only functions that don't refer to global variables, and that aren't entry points, are reused,
+//! since those are the only ones who's translation doesn't depend on the rest of the module.
+
+use crate::{
+    cache::Fnv1a,
+    config::Config,
+    emitter::{EmittedFunction, Emitter, Section, Words},
+    error::{Error, Result},
+    fg::module::ModuleBuilder,
+    translation::Builder,
+};
+use rspirv::spirv::{Capability, Op, Word};
+use std::collections::{HashMap, HashSet};
+use wasmparser::{Payload, TypeRef};
+
+/// Translated functions of earlier compilations, keyed by their index.
+#[derive(Debug, Clone, Default)]
+pub struct IncrementalCache {
+    fragments: HashMap<u32, Fragment>,
+}
+
+/// SPIR-V of a single function, together with the global instructions it depends on.
+#[derive(Debug, Clone)]
+struct Fragment {
+    fingerprint: u128,
+    /// Types and constants, in definition order
+    globals: Vec<Words>,
+    ext_inst_imports: Vec<(Word, String)>,
+    /// Ids of the called functions, with their index
+    callees: Vec<(Word, u32)>,
+    annotations: Words,
+    debug_names: Words,
+    /// Id the function had in it's module
+    id: Word,
+    function: Words,
+    capabilities: Vec<Capability>,
+}
+
+impl IncrementalCache {
+    pub fn new() -> Self {
+        return Self::default();
+    }
+
+    /// Number of functions that can be reused.
+    pub fn len(&self) -> usize {
+        self.fragments.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.fragments.is_empty()
+    }
+
+    pub fn clear(&mut self) {
+        self.fragments.clear()
+    }
+
+    /// Compiles the module into SPIR-V words, reusing (and then updating) the cached functions.
+    pub fn compile(&mut self, config: Config, bytes: &[u8]) -> Result<Vec<u32>> {
+        let fingerprints = fingerprints(&config, bytes)?;
+        self.fragments
+            .retain(|i, fragment| fingerprints.get(i) == Some(&fragment.fingerprint));
+
+        let reused = self
+            .fragments
+            .iter()
+            .map(|(i, fragment)| (*i, fragment.callees.iter().map(|(_, x)| *x).collect()))
+            .collect::<Box<[_]>>();
+        let builder = ModuleBuilder::new_reusing(config, bytes, reused)?;
+
+        // Ids are tracked, so that the translated functions can be moved into later compilations
+        let builder =
+            builder.translate_into(Builder::with_tracked_ids(), |module, builder, built| {
+                // Fragments are extracted before anything is spliced into the module
+                let function_indices = module
+                    .functions
+                    .iter()
+                    .enumerate()
+                    .filter_map(|(i, _)| {
+                        let id = module.function_id(i as u32)?.get()?;
+                        Some((id, i as u32))
+                    })
+                    .collect::<HashMap<_, _>>();
+
+                let mut extracted = Vec::new();
+                for (index, function) in built.iter().zip(builder.functions()) {
+                    let fingerprint = match fingerprints.get(index) {
+                        Some(fingerprint) => *fingerprint,
+                        None => continue,
+                    };
+
+                    if let Some(fragment) =
+                        extract(function, fingerprint, builder, &function_indices)
+                    {
+                        extracted.push((*index, fragment));
+                    }
+                }
+
+                // Sorted by index, and without the reused functions that aren't reachable anymore
+                for (index, _) in module.reused_functions.iter() {
+                    let fragment = self.fragments.get(index).ok_or_else(Error::unexpected)?;
+                    let function_id = module
+                        .function_id(*index)
+                        .and_then(|x| x.get())
+                        .ok_or_else(Error::unexpected)?;
+                    splice(fragment, function_id, module, builder)?;
+                }
+
+                self.fragments.extend(extracted);
+                Ok(())
+            });
+
+        return match builder {
+            Ok(builder) => Ok(builder.assemble()),
+            Err(e) => {
+                // A failed compilation may have left the cache halfway updated
+                self.fragments.clear();
+                Err(e)
+            }
+        };
+    }
+}
+
+/// Fingerprint of every defined function, keyed by it's index.
+fn fingerprints(config: &Config, bytes: &[u8]) -> Result<HashMap<u32, u128>> {
+    let mut environment = Fnv1a::new();
+    environment.write(env!("CARGO_PKG_VERSION").as_bytes());
+    environment.write_config(config)?;
+
+    let mut imported_function_count = 0;
+    let mut result = HashMap::new();
+    let mut names = None;
+
+    for payload in wasmparser::Parser::new(0).parse_all(bytes) {
+        match payload? {
+            Payload::ImportSection(imports) => {
+                for import in imports {
+                    if let TypeRef::Func(_) = import?.ty {
+                        imported_function_count += 1;
+                    }
+                }
+            }
+            Payload::CodeSectionStart { range, .. } => {
+                environment.write(bytes.get(..range.start).ok_or_else(Error::unexpected)?);
+            }
+            Payload::CodeSectionEntry(body) => {
+                let index = imported_function_count + result.len() as u32;
+                let mut hasher = Fnv1a::new();
+                hasher.write(&environment.finish().to_le_bytes());
+                hasher.write(&index.to_le_bytes());
+                hasher.write(bytes.get(body.range()).ok_or_else(Error::unexpected)?);
+                result.insert(index, hasher.finish());
+            }
+            // Functions are named after the name section, which follows the code section
+            Payload::CustomSection(section) if config.debug_info && section.name() == "name" => {
+                names = Some(section.data());
+            }
+            Payload::End(_) => break,
+            _ => continue,
+        }
+    }
+
+    if let Some(names) = names {
+        for fingerprint in result.values_mut() {
+            let mut hasher = Fnv1a::new();
+            hasher.write(&fingerprint.to_le_bytes());
+            hasher.write(names);
+            *fingerprint = hasher.finish();
+        }
+    }
+
+    return Ok(result);
+}
+
+/// Takes the translated `function` out of it's module, if it can be reused by later compilations.
+fn extract(
+    function: &EmittedFunction,
+    fingerprint: u128,
+    module: &Emitter,
+    function_indices: &HashMap<Word, u32>,
+) -> Option<Fragment> {
+    let function_id = function.id;
+    let is_entry_point = module
+        .section(Section::EntryPoints)
+        .iter()
+        .any(|x| x.referenced_ids().any(|id| id == function_id));
+
+    if is_entry_point {
+        return None;
+    }
+
+    let words = module
+        .section(Section::Functions)
+        .slice(function.words.clone(), function.ids.clone());
+
+    let defined = words
+        .iter()
+        .filter_map(|x| x.result_id())
+        .collect::<HashSet<_>>();
+
+    let globals = module
+        .section(Section::Globals)
+        .iter()
+        .filter_map(|x| Some((x.result_id()?, x)))
+        .collect::<HashMap<_, _>>();
+
+    let ext_inst_imports = module
+        .section(Section::ExtInstImports)
+        .iter()
+        .filter_map(|x| Some((x.result_id()?, x.literal_string(2)?)))
+        .collect::<HashMap<_, _>>();
+
+    // Global instructions the function depends on, transitively
+    let mut dependencies = HashSet::new();
+    let mut used_ext_inst_imports = Vec::new();
+    let mut callees = Vec::new();
+    let mut pending = words
+        .iter()
+        .flat_map(|x| x.referenced_ids())
+        .filter(|x| !defined.contains(x))
+        .collect::<Vec<_>>();
+
+    while let Some(id) = pending.pop() {
+        if let Some(global) = globals.get(&id) {
+            if global.opcode() == Op::Variable as u32 {
+                return None;
+            }
+            if dependencies.insert(id) {
+                pending.extend(global.referenced_ids());
+            }
+        } else if let Some(name) = ext_inst_imports.get(&id) {
+            if !used_ext_inst_imports.iter().any(|(x, _)| *x == id) {
+                used_ext_inst_imports.push((id, name.clone()));
+            }
+        } else if let Some(index) = function_indices.get(&id) {
+            if id != function_id && !callees.iter().any(|(x, _)| *x == id) {
+                callees.push((id, *index));
+            }
+        } else if id != function_id {
+            return None;
+        }
+    }
+
+    // Decorated types can't be merged with the types of other modules
+    let mut annotations = Words::default();
+    for annotation in module.section(Section::Annotations).iter() {
+        match annotation.referenced_ids().next() {
+            Some(target) if defined.contains(&target) => annotations.append(&annotation.to_words()),
+            Some(target) if dependencies.contains(&target) => return None,
+            _ => {}
+        }
+    }
+
+    let mut debug_names = Words::default();
+    for name in module.section(Section::DebugNames).iter() {
+        if name
+            .referenced_ids()
+            .next()
+            .is_some_and(|x| defined.contains(&x))
+        {
+            debug_names.append(&name.to_words())
+        }
+    }
+
+    return Some(Fragment {
+        fingerprint,
+        globals: module
+            .section(Section::Globals)
+            .iter()
+            .filter(|x| x.result_id().is_some_and(|id| dependencies.contains(&id)))
+            .map(|x| x.to_words())
+            .collect(),
+        ext_inst_imports: used_ext_inst_imports,
+        callees,
+        annotations,
+        debug_names,
+        id: function_id,
+        function: words,
+        capabilities: function.capabilities.clone(),
+    });
+}
+
+/// Adds the function of `fragment` to the module, as `function_id`.
+fn splice(
+    fragment: &Fragment,
+    function_id: Word,
+    module: &ModuleBuilder,
+    builder: &mut Builder,
+) -> Result<()> {
+    let mut ids = HashMap::new();
+    ids.insert(fragment.id, function_id);
+
+    for (id, index) in fragment.callees.iter() {
+        let callee = module
+            .function_id(*index)
+            .and_then(|x| x.get())
+            .ok_or_else(Error::unexpected)?;
+        ids.insert(*id, callee);
+    }
+
+    for (id, name) in fragment.ext_inst_imports.iter() {
+        let existing = builder
+            .section(Section::ExtInstImports)
+            .iter()
+            .find(|x| x.literal_string(2).as_ref() == Some(name))
+            .and_then(|x| x.result_id());
+
+        let new_id = match existing {
+            Some(existing) => existing,
+            None => builder.ext_inst_import(name.clone()),
+        };
+        ids.insert(*id, new_id);
+    }
+
+    // Types and constants are interned, so they're merged with the equivalent ones of the module
+    for global in fragment.globals.iter() {
+        let old_id = global
+            .iter()
+            .next()
+            .and_then(|x| x.result_id())
+            .ok_or_else(Error::unexpected)?;
+
+        let mut remapped = global.clone();
+        remapped.remap(&ids)?;
+        let declaration = remapped.iter().next().ok_or_else(Error::unexpected)?;
+
+        let new_id = match builder.intern_declaration(&declaration)? {
+            Some(new_id) => new_id,
+            None => {
+                let new_id = builder.id();
+                ids.insert(old_id, new_id);
+                let mut global = global.clone();
+                global.remap(&ids)?;
+                builder.append(Section::Globals, &global, &[]);
+                new_id
+            }
+        };
+        ids.insert(old_id, new_id);
+    }
+
+    // Every id defined by the function is replaced by a fresh one
+    for instruction in fragment.function.iter() {
+        if let Some(id) = instruction.result_id() {
+            if !ids.contains_key(&id) {
+                let new_id = builder.id();
+                ids.insert(id, new_id);
+            }
+        }
+    }
+
+    let mut function = fragment.function.clone();
+    let mut annotations = fragment.annotations.clone();
+    let mut debug_names = fragment.debug_names.clone();
+    for words in [&mut function, &mut annotations, &mut debug_names] {
+        words.remap(&ids)?;
+    }
+
+    builder.append(Section::Annotations, &annotations, &[]);
+    builder.append(Section::DebugNames, &debug_names, &[]);
+    builder.append(Section::Functions, &function, &fragment.capabilities);
+    return Ok(());
+}
@@ -7,7 +7,7 @@ use error::{Error, Result};
 use fg::module::ModuleBuilder;
 use once_cell::unsync::OnceCell;
 use rspirv::{
-    binary::{Assemble, Disassemble, ParseState},
+    binary::{Disassemble, ParseState},
     dr::Module,
 };
 use serde::{Deserialize, Serialize};
@@ -19,12 +19,19 @@ use std::{
 use version::TargetPlatform;
 
 // pub mod binary;
+#[docfg(feature = "cache")]
+pub mod cache;
 pub mod capabilities;
 pub mod compilers;
 pub mod config;
 pub mod decorator;
+pub mod emitter;
 pub mod error;
 pub mod fg;
+#[docfg(feature = "cache")]
+pub mod incremental;
+mod parallel;
+pub mod timings;
 pub mod translation;
 pub mod r#type;
 pub mod version;
@@ -37,38 +44,89 @@ pub struct Compilation {
         OnceCell<Result<(naga::Module, naga::valid::ModuleInfo), compilers::CompilerError>>,
     #[cfg(feature = "spirvcross")]
     spvc_context: OnceCell<Result<UnsafeCell<spirvcross::Context>, spirvcross::Error>>,
-    #[cfg(feature = "spirv-tools")]
-    target_env: spirv_tools::TargetEnv,
     assembly: OnceCell<Box<str>>,
-    words: OnceCell<Box<[u32]>>,
+    /// The [`Module`] is only built on demand, from the assembled words.
+    words: Box<[u32]>,
     #[cfg(feature = "spvt-validate")]
     validate: OnceCell<Option<spirv_tools::error::Error>>,
 }
 
 impl Compilation {
     pub fn new(config: Config, bytes: &[u8]) -> Result<Self> {
+        let _span = tracing::info_span!("compile").entered();
         let platform = config.platform;
-        #[cfg(feature = "spirv-tools")]
-        let target_env = spirv_tools::TargetEnv::from(&config.platform);
         let builder = ModuleBuilder::new(config, bytes)?;
-        let module = builder.translate()?.module();
+        let words = builder.translate()?.assemble();
 
         return Ok(Self {
             platform,
-            module: OnceCell::with_value(Ok(module)),
+            module: OnceCell::new(),
             #[cfg(feature = "naga")]
             naga_module: OnceCell::new(),
             #[cfg(feature = "spirvcross")]
             spvc_context: OnceCell::new(),
-            #[cfg(feature = "spirv-tools")]
-            target_env,
             assembly: OnceCell::new(),
-            words: OnceCell::new(),
+            words: words.into_boxed_slice(),
             #[cfg(feature = "spirv-tools")]
             validate: OnceCell::new(),
         });
     }
 
+    /// Like [`new`](Compilation::new), but only builds and translates the functions that changed
+    /// since the last compilation recorded on `cache`, splicing the translation of the rest back in.
+    #[docfg(feature = "cache")]
+    pub fn new_incremental(
+        config: Config,
+        bytes: &[u8],
+        cache: &mut incremental::IncrementalCache,
+    ) -> Result<Self> {
+        let _span = tracing::info_span!("compile").entered();
+        let platform = config.platform;
+        let words = cache.compile(config, bytes)?;
+        return Ok(Self::from_words(platform, words));
+    }
+
+    /// Compiles every `(config, bytes)` pair on a pool of worker threads, returning one result per item.
+    pub fn batch<'a>(items: impl IntoIterator<Item = (Config, &'a [u8])>) -> Vec<Result<Self>> {
+        return Self::batch_with(items, || (), |_, compilation| Ok(compilation));
+    }
+
+    /// Like [`batch`](Compilation::batch), but runs `f` on every compilation before returning it (e.g. to validate
+    /// or optimize it). Every worker thread creates its own state with `init`, and reuses it for all of its items.
+    pub fn batch_with<'a, S>(
+        items: impl IntoIterator<Item = (Config, &'a [u8])>,
+        init: impl Sync + Fn() -> S,
+        f: impl Sync + Fn(&mut S, Self) -> Result<Self>,
+    ) -> Vec<Result<Self>> {
+        let items = items.into_iter().collect::<Vec<_>>();
+
+        // Compilations can't be sent between threads, so they're rebuilt from their words.
+        return parallel::map_with(items, init, |state, (config, bytes)| {
+            let platform = config.platform;
+            let compilation = f(state, Self::new(config, bytes)?)?;
+            Ok::<_, Error>((platform, compilation.into_words()?))
+        })
+        .into_iter()
+        .map(|result| result.map(|(platform, words)| Self::from_words(platform, words)))
+        .collect();
+    }
+
+    /// Creates a compilation from an already assembled SPIR-V binary.
+    pub fn from_words(platform: TargetPlatform, words: impl Into<Box<[u32]>>) -> Self {
+        return Self {
+            platform,
+            module: OnceCell::new(),
+            #[cfg(feature = "naga")]
+            naga_module: OnceCell::new(),
+            #[cfg(feature = "spirvcross")]
+            spvc_context: OnceCell::new(),
+            assembly: OnceCell::new(),
+            words: words.into(),
+            #[cfg(feature = "spirv-tools")]
+            validate: OnceCell::new(),
+        };
+    }
+
     pub fn module(&self) -> Result<&Module> {
         match self.module.get_or_try_init(|| {
             let mut loader = rspirv::dr::Loader::new();
@@ -89,9 +147,7 @@ impl Compilation {
     }
 
     pub fn words(&self) -> Result<&[u32]> {
-        self.words
-            .get_or_try_init(|| Ok(self.module()?.assemble().into_boxed_slice()))
-            .map(Deref::deref)
+        Ok(&self.words)
     }
 
     pub fn bytes(&self) -> Result<&[u8]> {
@@ -104,6 +160,7 @@ impl Compilation {
     #[docfg(any(feature = "spvt-validate", feature = "naga-validate"))]
     #[inline]
     pub fn validate(&self) -> Result<()> {
+        let _span = tracing::info_span!("validate").entered();
         cfg_if::cfg_if! {
             if #[cfg(feature = "spvt-validate")] {
                 return self.spvt_validate()
@@ -116,6 +173,7 @@ impl Compilation {
     #[docfg(any(feature = "spvc-glsl", feature = "naga-glsl"))]
     #[inline]
     pub fn glsl(&self) -> Result<String> {
+        let _span = tracing::info_span!("glsl").entered();
         cfg_if::cfg_if! {
             if #[cfg(feature = "spvc-glsl")] {
                 return self.spvc_glsl()
@@ -128,6 +186,7 @@ impl Compilation {
     #[docfg(any(feature = "spvc-hlsl", feature = "naga-hlsl"))]
     #[inline]
     pub fn hlsl(&self) -> Result<String> {
+        let _span = tracing::info_span!("hlsl").entered();
         cfg_if::cfg_if! {
             if #[cfg(feature = "spvc-hlsl")] {
                 return self.spvc_hlsl()
@@ -140,6 +199,7 @@ impl Compilation {
     #[docfg(any(feature = "spvc-msl", feature = "naga-msl"))]
     #[inline]
     pub fn msl(&self) -> Result<String> {
+        let _span = tracing::info_span!("msl").entered();
         cfg_if::cfg_if! {
             if #[cfg(feature = "spvc-msl")] {
                 return self.spvc_msl()
@@ -152,6 +212,7 @@ impl Compilation {
     #[docfg(feature = "naga-wgsl")]
     #[inline]
     pub fn wgsl(&self) -> Result<String> {
+        let _span = tracing::info_span!("wgsl").entered();
         return self.naga_wgsl();
     }
 
@@ -165,12 +226,7 @@ impl Compilation {
     }
 
     pub fn into_words(self) -> Result<Vec<u32>> {
-        if self.words.get().is_some() {
-            let str = unsafe { self.words.into_inner().unwrap_unchecked() };
-            Ok(str.into_vec())
-        } else {
-            Ok(self.module()?.assemble())
-        }
+        Ok(self.words.into_vec())
     }
 
     pub fn into_bytes(self) -> Result<Vec<u8>> {
@@ -0,0 +1,67 @@
+use std::{
+    num::NonZeroUsize,
+    sync::{Mutex, PoisonError},
+    thread::available_parallelism,
+};
+use tracing::Dispatch;
+
+/// Maps `jobs` on a scoped pool of worker threads, returning the results in the same order as the jobs.
+///
+/// Every worker creates its own state with `init`, which is then reused for all the jobs it runs.
+pub(crate) fn map_with<T: Send, U: Send, S>(
+    jobs: Vec<T>,
+    init: impl Sync + Fn() -> S,
+    f: impl Sync + Fn(&mut S, T) -> U,
+) -> Vec<U> {
+    let threads = available_parallelism()
+        .map_or(1, NonZeroUsize::get)
+        .min(jobs.len());
+
+    if threads <= 1 {
+        let mut state = init();
+        return jobs.into_iter().map(|job| f(&mut state, job)).collect();
+    }
+
+    let len = jobs.len();
+    let queue = Mutex::new(jobs.into_iter().enumerate());
+    let next_job = || queue.lock().unwrap_or_else(PoisonError::into_inner).next();
+
+    // Workers report to the caller's subscriber, under it's current span.
+    let dispatch = tracing::dispatcher::get_default(Dispatch::clone);
+    let parent = tracing::Span::current();
+
+    let mut results = std::thread::scope(|s| {
+        let workers = (0..threads)
+            .map(|_| {
+                s.spawn(|| {
+                    let _dispatch = tracing::dispatcher::set_default(&dispatch);
+                    let _parent = parent.enter();
+                    let mut state = init();
+                    let mut results = Vec::new();
+                    while let Some((i, job)) = next_job() {
+                        results.push((i, f(&mut state, job)));
+                    }
+                    results
+                })
+            })
+            .collect::<Vec<_>>();
+
+        let mut results = Vec::with_capacity(len);
+        for worker in workers {
+            match worker.join() {
+                Ok(worker_results) => results.extend(worker_results),
+                Err(e) => std::panic::resume_unwind(e),
+            }
+        }
+        results
+    });
+
+    results.sort_unstable_by_key(|(i, _)| *i);
+    return results.into_iter().map(|(_, x)| x).collect();
+}
+
+/// Maps `jobs` on a scoped pool of worker threads, returning the results in the same order as the jobs.
+#[inline]
+pub(crate) fn map<T: Send, U: Send>(jobs: Vec<T>, f: impl Sync + Fn(T) -> U) -> Vec<U> {
+    return map_with(jobs, || (), |_, job| f(job));
+}
@@ -0,0 +1,326 @@
+//! Per-phase timings of a compilation, collected from it's [`tracing`] spans.
+//!
+//! Every phase of the compiler runs inside a span (`compile`, `parse`, `build_function`, `translate`,
+//! `translate_function`, `assemble`, `validate`, `optimize` and one per backend), and [`Timings::layer`]
+//! turns each of them into a [`PhaseTiming`] once it closes. Allocations (and the peak of heap
+//! memory, see [`peak_memory`]) are only counted when [`CountingAllocator`] is installed as the
+//! global allocator.
+//!
+//! Any other integer field of a span is kept as a counter of it's phase (e.g. the hits and misses
+//! of the type and constant interning tables, recorded by `translate`).
+
+use serde::{Serialize, Serializer};
+use std::{
+    alloc::{GlobalAlloc, Layout, System},
+    cell::Cell,
+    collections::BTreeMap,
+    fmt::Display,
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        Arc, Mutex, PoisonError,
+    },
+    time::{Duration, Instant},
+};
+use tracing::{
+    field::{Field, Visit},
+    span, Subscriber,
+};
+use tracing_subscriber::{layer::Context, prelude::*, registry::LookupSpan, Layer};
+
+thread_local! {
+    static ALLOCATIONS: Cell<u64> = const { Cell::new(0) };
+}
+
+/// Bytes currently allocated by every thread, and the most there's been since the last reset
+static LIVE_BYTES: AtomicUsize = AtomicUsize::new(0);
+static PEAK_BYTES: AtomicUsize = AtomicUsize::new(0);
+
+/// Global allocator that counts the allocations made by every thread, and the bytes they hold.
+///
+/// ```ignore
+/// #[global_allocator]
+/// static ALLOCATOR: wasm2spirv::timings::CountingAllocator = wasm2spirv::timings::CountingAllocator;
+/// ```
+pub struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    #[inline]
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count_allocation();
+        let ptr = System.alloc(layout);
+        if !ptr.is_null() {
+            grow_live_bytes(layout.size());
+        }
+        ptr
+    }
+
+    #[inline]
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        count_allocation();
+        let ptr = System.alloc_zeroed(layout);
+        if !ptr.is_null() {
+            grow_live_bytes(layout.size());
+        }
+        ptr
+    }
+
+    #[inline]
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count_allocation();
+        let new_ptr = System.realloc(ptr, layout, new_size);
+        if !new_ptr.is_null() {
+            match new_size.checked_sub(layout.size()) {
+                Some(grown) => grow_live_bytes(grown),
+                None => shrink_live_bytes(layout.size() - new_size),
+            }
+        }
+        new_ptr
+    }
+
+    #[inline]
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout);
+        shrink_live_bytes(layout.size());
+    }
+}
+
+#[inline]
+fn count_allocation() {
+    // The thread local may already have been destroyed while the thread is exiting
+    let _ = ALLOCATIONS.try_with(|x| x.set(x.get() + 1));
+}
+
+/// Number of allocations made by the current thread through [`CountingAllocator`].
+#[inline]
+pub fn allocation_count() -> u64 {
+    ALLOCATIONS.try_with(Cell::get).unwrap_or_default()
+}
+
+#[inline]
+fn grow_live_bytes(size: usize) {
+    let live = LIVE_BYTES.fetch_add(size, Ordering::Relaxed) + size;
+    PEAK_BYTES.fetch_max(live, Ordering::Relaxed);
+}
+
+#[inline]
+fn shrink_live_bytes(size: usize) {
+    LIVE_BYTES.fetch_sub(size, Ordering::Relaxed);
+}
+
+/// Most bytes held at once through [`CountingAllocator`] since the last call to
+/// [`reset_peak_memory`], by all threads together.
+#[inline]
+pub fn peak_memory() -> usize {
+    PEAK_BYTES.load(Ordering::Relaxed)
+}
+
+/// Bytes currently held through [`CountingAllocator`], by all threads together.
+#[inline]
+pub fn live_memory() -> usize {
+    LIVE_BYTES.load(Ordering::Relaxed)
+}
+
+/// Restarts [`peak_memory`] from the bytes currently held, so that it only measures what's
+/// allocated from now on.
+#[inline]
+pub fn reset_peak_memory() {
+    PEAK_BYTES.store(LIVE_BYTES.load(Ordering::Relaxed), Ordering::Relaxed);
+}
+
+#[derive(Debug, Clone, PartialEq, Serialize)]
+pub struct PhaseTiming {
+    pub phase: &'static str,
+    /// Index of the function the phase ran for, if any
+    pub function: Option<u32>,
+    #[serde(rename = "wall_ns", serialize_with = "serialize_nanos")]
+    pub wall: Duration,
+    /// Graph operations for `build_function`, and SPIR-V instructions for `translate` and
+    /// `translate_function`
+    pub instructions: Option<u64>,
+    /// Allocations made by the thread that ran the phase, excluding the ones of worker threads
+    pub allocations: u64,
+    #[serde(skip_serializing_if = "BTreeMap::is_empty")]
+    pub counters: BTreeMap<&'static str, u64>,
+    #[serde(skip)]
+    start: Instant,
+}
+
+/// Shared list of the phases that have been recorded.
+#[derive(Debug, Clone, Default)]
+pub struct Timings {
+    phases: Arc<Mutex<Vec<PhaseTiming>>>,
+}
+
+impl Timings {
+    pub fn new() -> Self {
+        return Self::default();
+    }
+
+    /// Runs `f` with a subscriber that records it's phases on the current thread (and on the
+    /// worker threads it spawns), regardless of the global subscriber.
+    pub fn record<T>(f: impl FnOnce() -> T) -> (T, Self) {
+        let timings = Self::new();
+        let subscriber = tracing_subscriber::registry().with(timings.layer());
+        let result = tracing::subscriber::with_default(subscriber, f);
+        return (result, timings);
+    }
+
+    pub fn layer(&self) -> TimingLayer {
+        return TimingLayer {
+            phases: self.phases.clone(),
+        };
+    }
+
+    /// Recorded phases, in the order they were started.
+    pub fn phases(&self) -> Vec<PhaseTiming> {
+        let mut phases = self
+            .phases
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .clone();
+
+        phases.sort_by_key(|x| x.start);
+        return phases;
+    }
+}
+
+impl Serialize for Timings {
+    fn serialize<S>(&self, serializer: S) -> Result<S::Ok, S::Error>
+    where
+        S: Serializer,
+    {
+        self.phases().serialize(serializer)
+    }
+}
+
+impl Display for Timings {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        writeln!(
+            f,
+            "{:<20} {:>8} {:>12} {:>12} {:>12}  {}",
+            "phase", "function", "wall (ms)", "instructions", "allocations", "counters"
+        )?;
+
+        for phase in self.phases() {
+            let function = phase.function.map(|x| x.to_string()).unwrap_or_default();
+            let instructions = phase
+                .instructions
+                .map(|x| x.to_string())
+                .unwrap_or_default();
+            let counters = phase
+                .counters
+                .iter()
+                .map(|(name, value)| format!("{name}={value}"))
+                .collect::<Vec<_>>()
+                .join(" ");
+            writeln!(
+                f,
+                "{:<20} {:>8} {:>12.3} {:>12} {:>12}  {}",
+                phase.phase,
+                function,
+                phase.wall.as_secs_f64() * 1000.0,
+                instructions,
+                phase.allocations,
+                counters
+            )?;
+        }
+
+        return Ok(());
+    }
+}
+
+/// Layer that records the spans of this crate into [`Timings`].
+#[derive(Debug, Clone)]
+pub struct TimingLayer {
+    phases: Arc<Mutex<Vec<PhaseTiming>>>,
+}
+
+struct SpanTiming {
+    start: Instant,
+    allocations: u64,
+    function: Option<u32>,
+    instructions: Option<u64>,
+    counters: BTreeMap<&'static str, u64>,
+}
+
+impl Visit for SpanTiming {
+    fn record_u64(&mut self, field: &Field, value: u64) {
+        match field.name() {
+            "function" => self.function = u32::try_from(value).ok(),
+            "instructions" => self.instructions = Some(value),
+            name => {
+                self.counters.insert(name, value);
+            }
+        }
+    }
+
+    fn record_i64(&mut self, field: &Field, value: i64) {
+        if let Ok(value) = u64::try_from(value) {
+            self.record_u64(field, value)
+        }
+    }
+
+    fn record_debug(&mut self, _field: &Field, _value: &dyn std::fmt::Debug) {}
+}
+
+impl<S: Subscriber + for<'a> LookupSpan<'a>> Layer<S> for TimingLayer {
+    fn on_new_span(&self, attrs: &span::Attributes<'_>, id: &span::Id, ctx: Context<'_, S>) {
+        if !attrs
+            .metadata()
+            .target()
+            .starts_with(env!("CARGO_CRATE_NAME"))
+        {
+            return;
+        }
+
+        if let Some(span) = ctx.span(id) {
+            let mut timing = SpanTiming {
+                start: Instant::now(),
+                allocations: allocation_count(),
+                function: None,
+                instructions: None,
+                counters: BTreeMap::new(),
+            };
+
+            attrs.record(&mut timing);
+            span.extensions_mut().insert(timing);
+        }
+    }
+
+    fn on_record(&self, id: &span::Id, values: &span::Record<'_>, ctx: Context<'_, S>) {
+        if let Some(span) = ctx.span(id) {
+            if let Some(timing) = span.extensions_mut().get_mut::<SpanTiming>() {
+                values.record(timing);
+            }
+        }
+    }
+
+    fn on_close(&self, id: span::Id, ctx: Context<'_, S>) {
+        let span = match ctx.span(&id) {
+            Some(span) => span,
+            None => return,
+        };
+
+        let timing = match span.extensions_mut().remove::<SpanTiming>() {
+            Some(timing) => timing,
+            None => return,
+        };
+
+        self.phases
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .push(PhaseTiming {
+                phase: span.name(),
+                function: timing.function,
+                wall: timing.start.elapsed(),
+                instructions: timing.instructions,
+                allocations: allocation_count().saturating_sub(timing.allocations),
+                counters: timing.counters,
+                start: timing.start,
+            });
+    }
+}
+
+fn serialize_nanos<S: Serializer>(duration: &Duration, serializer: S) -> Result<S::Ok, S::Error> {
+    serializer.serialize_u64(u64::try_from(duration.as_nanos()).unwrap_or(u64::MAX))
+}
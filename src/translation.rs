@@ -1,10 +1,14 @@
 use crate::{
-    capabilities::instruction_capabilities,
+    config::BoundsCheckKind,
+    decorator::VariableDecorator,
+    emitter::{Emitter, InstructionWords},
     error::{Error, Result},
     fg::{
+        atomic::{self, AtomicAccess},
         extended_is::{ExtendedSet, GLSLInstr, OpenCLInstr},
-        function::{ExecutionMode, FunctionBuilder, Schrodinger},
+        function::{ExecutionMode, FunctionBuilder, Schrodinger, SpecConstant},
         module::{GlobalVariable, ModuleBuilder},
+        subgroup::{SubgroupArithmetic, SubgroupSource},
         values::{
             bool::{Bool, BoolSource, Comparison, Equality},
             float::{
@@ -13,12 +17,15 @@ use crate::{
                 UnarySource as FloatUnarySource,
             },
             integer::{
-                BinarySource as IntBinarySource, ConstantSource as IntConstantSource,
+                AtomicSource, BinarySource as IntBinarySource, ConstantSource as IntConstantSource,
                 ConversionSource as IntConversionSource, Integer, IntegerKind, IntegerSource,
                 UnarySource as IntUnarySource,
             },
             pointer::{Pointer, PointerKind, PointerSource},
-            vector::{Vector, VectorSource},
+            vector::{
+                BinarySource as VectorBinarySource, UnarySource as VectorUnarySource, Vector,
+                VectorSource,
+            },
             Value,
         },
         Label, Operation,
@@ -27,18 +34,19 @@ use crate::{
     version::Version,
 };
 use rspirv::{
-    dr::{Instruction, Module, Operand},
+    dr::Operand,
     spirv::{
-        Decoration, ExecutionMode as SpirvExecutionMode, FunctionControl, LoopControl,
-        MemoryAccess, Op, SelectionControl,
+        BuiltIn, Decoration, ExecutionMode as SpirvExecutionMode, FunctionControl, LoopControl,
+        MemoryAccess, Op, SelectionControl, SourceLanguage,
     },
 };
-use spirv::{Capability, StorageClass};
+use spirv::{AddressingModel, Capability, StorageClass};
 use std::{
     cmp::Ordering,
-    collections::HashMap,
+    collections::{HashMap, HashSet},
+    io::Write,
     ops::{Deref, DerefMut},
-    rc::Rc,
+    sync::Arc,
 };
 
 #[derive(Debug, Clone, PartialEq, Eq, Hash)]
@@ -48,37 +56,320 @@ enum Constant {
     F32(u32),
     F64(u64),
     Bool(bool),
+    Null,
+    Composite(Box<[rspirv::spirv::Word]>),
+}
+
+/// Type declaration, with it's operands already translated.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+enum TypeKey {
+    Void,
+    Bool,
+    Int(u32, u32),
+    Float(u32),
+    Vector(rspirv::spirv::Word, u32),
+    Array(rspirv::spirv::Word, rspirv::spirv::Word),
+    RuntimeArray(rspirv::spirv::Word),
+    /// Runtime array, decorated with it's stride
+    StridedRuntimeArray(rspirv::spirv::Word, u32),
+    Struct(Box<[rspirv::spirv::Word]>),
+    /// Single member structure, decorated as a block (or buffer block)
+    Block(rspirv::spirv::Word, Decoration),
+    Pointer(StorageClass, rspirv::spirv::Word),
+    Function(rspirv::spirv::Word, Box<[rspirv::spirv::Word]>),
 }
 
+/// Lookups into the interning tables of a [`Builder`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct InternStats {
+    pub type_hits: u64,
+    pub type_misses: u64,
+    pub constant_hits: u64,
+    pub constant_misses: u64,
+}
+
+/// Guards of accesses through fat pointers emitted by a [`Builder`], as configured by
+/// [`BoundsCheckKind`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct BoundsCheckStats {
+    pub emitted: u64,
+    /// Accesses guarded by a check already emitted in the same block
+    pub reused: u64,
+    /// Accesses known to always be in bounds
+    pub elided: u64,
+}
+
+/// Condition under which an index is in bounds, and the index clamped to the array's bounds.
+#[derive(Debug, Clone, Copy)]
+struct BoundsCheck {
+    in_bounds: rspirv::spirv::Word,
+    clamped: rspirv::spirv::Word,
+}
+
+/// SPIR-V module builder that declares every type and constant (with the decorations that belong
+/// to them) only once, looking them up in hash tables instead of scanning the module.
 pub struct Builder {
-    inner: rspirv::dr::Builder,
+    inner: Emitter,
     constants: HashMap<(rspirv::spirv::Word, Constant), rspirv::spirv::Word>,
+    constant_ids: HashSet<rspirv::spirv::Word>,
+    types: HashMap<TypeKey, rspirv::spirv::Word>,
+    /// Translations of [`Type`]s, so that nested types aren't looked up again
+    translated_types: HashMap<Type, rspirv::spirv::Word>,
+    stats: InternStats,
+    /// Bounds checks of the current block, by the ids of the array and index they guard
+    bounds_checks: HashMap<(rspirv::spirv::Word, rspirv::spirv::Word), BoundsCheck>,
+    bounds_stats: BoundsCheckStats,
+    /// `WorkgroupSize` built-in, which there can only be one of in a module, and the workgroup size
+    /// it declares
+    workgroup_size: Option<([SpecConstant; 3], rspirv::spirv::Word)>,
 }
 
 impl Builder {
     pub fn new() -> Self {
+        return Self::with_emitter(Emitter::new());
+    }
+
+    /// Builder that keeps track of where every id is, so that the instructions it emits can be
+    /// moved into other modules.
+    pub fn with_tracked_ids() -> Self {
+        return Self::with_emitter(Emitter::with_tracked_ids());
+    }
+
+    fn with_emitter(inner: Emitter) -> Self {
         return Self {
-            inner: rspirv::dr::Builder::new(),
+            inner,
             constants: HashMap::new(),
+            constant_ids: HashSet::new(),
+            types: HashMap::new(),
+            translated_types: HashMap::new(),
+            stats: InternStats::default(),
+            bounds_checks: HashMap::new(),
+            bounds_stats: BoundsCheckStats::default(),
+            workgroup_size: None,
         };
     }
 
-    pub fn module(self) -> Module {
-        self.inner.module()
+    pub fn intern_stats(&self) -> InternStats {
+        return self.stats;
+    }
+
+    pub fn bounds_check_stats(&self) -> BoundsCheckStats {
+        return self.bounds_stats;
+    }
+
+    /// Begins a new basic block. The bounds checks of earlier blocks are forgotten, since they
+    /// may not dominate it.
+    pub fn begin_block(
+        &mut self,
+        label: Option<rspirv::spirv::Word>,
+    ) -> Result<rspirv::spirv::Word> {
+        self.bounds_checks.clear();
+        return self.inner.begin_block(label);
+    }
+
+    /// Assembles the module into a SPIR-V binary, concatenating the words of every section.
+    pub fn assemble(self) -> Vec<u32> {
+        let _span = tracing::info_span!("assemble").entered();
+        return self.inner.assemble();
+    }
+
+    /// Writes the module into `writer` one section at a time, without assembling it in memory.
+    pub fn assemble_to(self, writer: impl Write) -> Result<()> {
+        let _span = tracing::info_span!("assemble").entered();
+        return Ok(self.inner.assemble_to(writer)?);
+    }
+
+    fn intern_type(
+        &mut self,
+        key: TypeKey,
+        declare: impl FnOnce(&mut Emitter) -> rspirv::spirv::Word,
+    ) -> rspirv::spirv::Word {
+        if let Some(id) = self.types.get(&key) {
+            self.stats.type_hits += 1;
+            return *id;
+        }
+
+        self.stats.type_misses += 1;
+        let id = declare(&mut self.inner);
+        self.types.insert(key, id);
+        return id;
+    }
+
+    fn intern_constant(
+        &mut self,
+        result_type: rspirv::spirv::Word,
+        key: Constant,
+        declare: impl FnOnce(&mut Emitter) -> rspirv::spirv::Word,
+    ) -> rspirv::spirv::Word {
+        if let Some(id) = self.constants.get(&(result_type, key.clone())) {
+            self.stats.constant_hits += 1;
+            return *id;
+        }
+
+        self.stats.constant_misses += 1;
+        let id = declare(&mut self.inner);
+        self.constants.insert((result_type, key), id);
+        self.constant_ids.insert(id);
+        return id;
+    }
+
+    pub fn type_void(&mut self) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Void, |x| x.global(Op::TypeVoid, None, []))
+    }
+
+    pub fn type_bool(&mut self) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Bool, |x| x.global(Op::TypeBool, None, []))
+    }
+
+    pub fn type_int(&mut self, width: u32, signedness: u32) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Int(width, signedness), |x| {
+            x.global(
+                Op::TypeInt,
+                None,
+                [
+                    Operand::LiteralInt32(width),
+                    Operand::LiteralInt32(signedness),
+                ],
+            )
+        })
+    }
+
+    pub fn type_float(&mut self, width: u32) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Float(width), |x| {
+            x.global(Op::TypeFloat, None, [Operand::LiteralInt32(width)])
+        })
+    }
+
+    pub fn type_vector(
+        &mut self,
+        component_type: rspirv::spirv::Word,
+        component_count: u32,
+    ) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Vector(component_type, component_count), |x| {
+            x.global(
+                Op::TypeVector,
+                None,
+                [
+                    Operand::IdRef(component_type),
+                    Operand::LiteralInt32(component_count),
+                ],
+            )
+        })
+    }
+
+    pub fn type_array(
+        &mut self,
+        element_type: rspirv::spirv::Word,
+        length: rspirv::spirv::Word,
+    ) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Array(element_type, length), |x| {
+            x.global(
+                Op::TypeArray,
+                None,
+                [Operand::IdRef(element_type), Operand::IdRef(length)],
+            )
+        })
+    }
+
+    pub fn type_runtime_array(&mut self, element_type: rspirv::spirv::Word) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::RuntimeArray(element_type), |x| {
+            x.global(Op::TypeRuntimeArray, None, [Operand::IdRef(element_type)])
+        })
+    }
+
+    /// Runtime array of `element_type`, decorated with an `ArrayStride` of `stride` bytes.
+    pub fn type_strided_runtime_array(
+        &mut self,
+        element_type: rspirv::spirv::Word,
+        stride: u32,
+    ) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::StridedRuntimeArray(element_type, stride), |x| {
+            let id = x.global(Op::TypeRuntimeArray, None, [Operand::IdRef(element_type)]);
+            x.decorate(
+                id,
+                Decoration::ArrayStride,
+                Some(Operand::LiteralInt32(stride)),
+            );
+            id
+        })
+    }
+
+    pub fn type_struct(
+        &mut self,
+        member_types: impl IntoIterator<Item = rspirv::spirv::Word>,
+    ) -> rspirv::spirv::Word {
+        let member_types = member_types.into_iter().collect::<Box<[_]>>();
+        self.intern_type(TypeKey::Struct(member_types.clone()), |x| {
+            let operands = member_types.iter().copied().map(Operand::IdRef);
+            x.global(Op::TypeStruct, None, operands)
+        })
+    }
+
+    /// Structure with `member_type` as it's only member (at offset zero), decorated with `block`
+    /// (either `Block` or `BufferBlock`).
+    pub fn type_block(
+        &mut self,
+        member_type: rspirv::spirv::Word,
+        block: Decoration,
+    ) -> rspirv::spirv::Word {
+        self.intern_type(TypeKey::Block(member_type, block), |x| {
+            let id = x.global(Op::TypeStruct, None, [Operand::IdRef(member_type)]);
+            x.member_decorate(id, 0, Decoration::Offset, Some(Operand::LiteralInt32(0)));
+            x.decorate(id, block, None);
+            id
+        })
+    }
+
+    /// Pointer types with an explicit `return_id` are always declared.
+    pub fn type_pointer(
+        &mut self,
+        return_id: Option<rspirv::spirv::Word>,
+        storage_class: StorageClass,
+        pointee_type: rspirv::spirv::Word,
+    ) -> rspirv::spirv::Word {
+        let operands = [
+            Operand::StorageClass(storage_class),
+            Operand::IdRef(pointee_type),
+        ];
+
+        match return_id {
+            Some(id) => {
+                self.inner.declare(Op::TypePointer, None, id, operands);
+                id
+            }
+            None => self.intern_type(TypeKey::Pointer(storage_class, pointee_type), |x| {
+                x.global(Op::TypePointer, None, operands)
+            }),
+        }
+    }
+
+    pub fn type_function(
+        &mut self,
+        return_type: rspirv::spirv::Word,
+        parameter_types: impl IntoIterator<Item = rspirv::spirv::Word>,
+    ) -> rspirv::spirv::Word {
+        let parameter_types = parameter_types.into_iter().collect::<Box<[_]>>();
+        self.intern_type(
+            TypeKey::Function(return_type, parameter_types.clone()),
+            |x| {
+                let operands = std::iter::once(return_type)
+                    .chain(parameter_types.iter().copied())
+                    .map(Operand::IdRef);
+                x.global(Op::TypeFunction, None, operands)
+            },
+        )
     }
 
     pub fn constant_true(&mut self, result_type: rspirv::spirv::Word) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::Bool(true)))
-            .or_insert_with(|| self.inner.constant_true(result_type))
+        self.intern_constant(result_type, Constant::Bool(true), |x| {
+            x.global(Op::ConstantTrue, Some(result_type), [])
+        })
     }
 
     pub fn constant_false(&mut self, result_type: rspirv::spirv::Word) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::Bool(false)))
-            .or_insert_with(|| self.inner.constant_false(result_type))
+        self.intern_constant(result_type, Constant::Bool(false), |x| {
+            x.global(Op::ConstantFalse, Some(result_type), [])
+        })
     }
 
     pub fn constant_u32(
@@ -86,10 +377,13 @@ impl Builder {
         result_type: rspirv::spirv::Word,
         value: u32,
     ) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::U32(value)))
-            .or_insert_with(|| self.inner.constant_u32(result_type, value))
+        self.intern_constant(result_type, Constant::U32(value), |x| {
+            x.global(
+                Op::Constant,
+                Some(result_type),
+                [Operand::LiteralInt32(value)],
+            )
+        })
     }
 
     pub fn constant_u64(
@@ -97,10 +391,13 @@ impl Builder {
         result_type: rspirv::spirv::Word,
         value: u64,
     ) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::U64(value)))
-            .or_insert_with(|| self.inner.constant_u64(result_type, value))
+        self.intern_constant(result_type, Constant::U64(value), |x| {
+            x.global(
+                Op::Constant,
+                Some(result_type),
+                [Operand::LiteralInt64(value)],
+            )
+        })
     }
 
     pub fn constant_f32(
@@ -108,10 +405,13 @@ impl Builder {
         result_type: rspirv::spirv::Word,
         value: f32,
     ) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::F32(f32::to_bits(value))))
-            .or_insert_with(|| self.inner.constant_f32(result_type, value))
+        self.intern_constant(result_type, Constant::F32(f32::to_bits(value)), |x| {
+            x.global(
+                Op::Constant,
+                Some(result_type),
+                [Operand::LiteralFloat32(value)],
+            )
+        })
     }
 
     pub fn constant_f64(
@@ -119,16 +419,172 @@ impl Builder {
         result_type: rspirv::spirv::Word,
         value: f64,
     ) -> rspirv::spirv::Word {
-        *self
-            .constants
-            .entry((result_type, Constant::F64(f64::to_bits(value))))
-            .or_insert_with(|| self.inner.constant_f64(result_type, value))
+        self.intern_constant(result_type, Constant::F64(f64::to_bits(value)), |x| {
+            x.global(
+                Op::Constant,
+                Some(result_type),
+                [Operand::LiteralFloat64(value)],
+            )
+        })
+    }
+
+    pub fn constant_null(&mut self, result_type: rspirv::spirv::Word) -> rspirv::spirv::Word {
+        self.intern_constant(result_type, Constant::Null, |x| {
+            x.global(Op::ConstantNull, Some(result_type), [])
+        })
+    }
+
+    /// `loaded`, or zero if the load it results from was out of bounds. Vectors are selected by a
+    /// vector of `component_count` conditions, since older versions require one per component.
+    fn guard_load(
+        &mut self,
+        result_type: rspirv::spirv::Word,
+        loaded: rspirv::spirv::Word,
+        in_bounds: Option<rspirv::spirv::Word>,
+        component_count: Option<u32>,
+    ) -> Result<rspirv::spirv::Word> {
+        let mut condition = match in_bounds {
+            Some(x) => x,
+            None => return Ok(loaded),
+        };
+
+        if let Some(count) = component_count {
+            let boolean = self.type_bool();
+            let condition_type = self.type_vector(boolean, count);
+            condition = self.composite(condition_type, vec![condition; count as usize])?;
+        }
+
+        let zero = self.constant_null(result_type);
+        return self
+            .inner
+            .select(result_type, None, condition, loaded, zero);
+    }
+
+    /// Composite of `constituents`, declared as a constant when all of them are constants.
+    pub fn composite(
+        &mut self,
+        result_type: rspirv::spirv::Word,
+        constituents: Vec<rspirv::spirv::Word>,
+    ) -> Result<rspirv::spirv::Word> {
+        if !constituents.iter().all(|x| self.constant_ids.contains(x)) {
+            return self
+                .inner
+                .composite_construct(result_type, None, constituents);
+        }
+
+        let key = Constant::Composite(constituents.clone().into_boxed_slice());
+        return Ok(self.intern_constant(result_type, key, |x| {
+            let operands = constituents.into_iter().map(Operand::IdRef);
+            x.global(Op::ConstantComposite, Some(result_type), operands)
+        }));
+    }
+
+    /// Declares the type or constant of `declaration` (which must already refer to the ids of
+    /// this module) through the interning tables, returning it's id. Declarations the tables
+    /// don't know about aren't declared.
+    pub fn intern_declaration(
+        &mut self,
+        declaration: &InstructionWords,
+    ) -> Result<Option<rspirv::spirv::Word>> {
+        let words = declaration.words;
+        let word = |i: usize| words.get(i).copied().ok_or_else(Error::unexpected);
+
+        // Types have no result type, so their operands start one word earlier than constants'
+        let opcode = declaration.opcode();
+        let id = if opcode == Op::TypeVoid as u32 {
+            self.type_void()
+        } else if opcode == Op::TypeBool as u32 {
+            self.type_bool()
+        } else if opcode == Op::TypeInt as u32 {
+            self.type_int(word(2)?, word(3)?)
+        } else if opcode == Op::TypeFloat as u32 {
+            self.type_float(word(2)?)
+        } else if opcode == Op::TypeVector as u32 {
+            self.type_vector(word(2)?, word(3)?)
+        } else if opcode == Op::TypeArray as u32 {
+            self.type_array(word(2)?, word(3)?)
+        } else if opcode == Op::TypeRuntimeArray as u32 {
+            self.type_runtime_array(word(2)?)
+        } else if opcode == Op::TypeStruct as u32 {
+            self.type_struct(words.get(2..).unwrap_or_default().iter().copied())
+        } else if opcode == Op::TypePointer as u32 {
+            let storage_class = StorageClass::from_u32(word(2)?).ok_or_else(Error::unexpected)?;
+            self.type_pointer(None, storage_class, word(3)?)
+        } else if opcode == Op::TypeFunction as u32 {
+            self.type_function(word(2)?, words.get(3..).unwrap_or_default().iter().copied())
+        } else if opcode == Op::ConstantTrue as u32 {
+            self.constant_true(word(1)?)
+        } else if opcode == Op::ConstantFalse as u32 {
+            self.constant_false(word(1)?)
+        } else if opcode == Op::ConstantNull as u32 {
+            self.constant_null(word(1)?)
+        } else if opcode == Op::Constant as u32 {
+            let result_type = word(1)?;
+            let is_float = [32, 64]
+                .into_iter()
+                .any(|width| self.types.get(&TypeKey::Float(width)) == Some(&result_type));
+
+            match (words.len(), is_float) {
+                (4, false) => self.constant_u32(result_type, word(3)?),
+                (4, true) => self.constant_f32(result_type, f32::from_bits(word(3)?)),
+                (5, false) => {
+                    self.constant_u64(result_type, word(3)? as u64 | (word(4)? as u64) << 32)
+                }
+                (5, true) => self.constant_f64(
+                    result_type,
+                    f64::from_bits(word(3)? as u64 | (word(4)? as u64) << 32),
+                ),
+                _ => return Err(Error::unexpected()),
+            }
+        } else if opcode == Op::ConstantComposite as u32 {
+            let result_type = word(1)?;
+            let constituents = words.get(3..).unwrap_or_default().to_vec();
+            if !constituents.iter().all(|x| self.constant_ids.contains(x)) {
+                return Ok(None);
+            }
+            self.composite(result_type, constituents)?
+        } else {
+            return Ok(None);
+        };
+
+        return Ok(Some(id));
     }
 }
 
 impl<'a> ModuleBuilder<'a> {
-    pub fn translate(mut self) -> Result<Builder> {
-        let mut builder = Builder::new();
+    pub fn translate(self) -> Result<Builder> {
+        return self.translate_with(|_, _, _| Ok(()));
+    }
+
+    /// Like [`translate`](ModuleBuilder::translate), but calls `after_functions` once every
+    /// function body has been lowered, with the indices of the functions that have been built
+    /// (in the order they were added to the module). That's where the bodies of the
+    /// [`reused_functions`](ModuleBuilder::reused_functions) are expected to be added.
+    pub fn translate_with(
+        self,
+        after_functions: impl FnOnce(&Self, &mut Builder, &[u32]) -> Result<()>,
+    ) -> Result<Builder> {
+        return self.translate_into(Builder::new(), after_functions);
+    }
+
+    /// Like [`translate_with`](ModuleBuilder::translate_with), but emits the module into `builder`.
+    pub fn translate_into(
+        mut self,
+        mut builder: Builder,
+        after_functions: impl FnOnce(&Self, &mut Builder, &[u32]) -> Result<()>,
+    ) -> Result<Builder> {
+        let span = tracing::info_span!(
+            "translate",
+            instructions = tracing::field::Empty,
+            type_hits = tracing::field::Empty,
+            type_misses = tracing::field::Empty,
+            constant_hits = tracing::field::Empty,
+            constant_misses = tracing::field::Empty,
+            bounds_checks = tracing::field::Empty,
+            reused_bounds_checks = tracing::field::Empty,
+            elided_bounds_checks = tracing::field::Empty
+        )
+        .entered();
         builder.set_version(self.version.major, self.version.minor);
 
         // Memory model
@@ -136,41 +592,70 @@ impl<'a> ModuleBuilder<'a> {
 
         // TODO entry points
 
-        // TODO debug info
+        // Debug info
+        if let Some(debug_info) = &self.debug_info {
+            let file = builder.string(debug_info.file_name());
+            builder.source(SourceLanguage::Unknown, 0, Some(file), None::<String>);
+            debug_info.file.set(Some(file));
+        }
 
         // TODO anotations
 
-        // Globals
-        for global in self.global_variables.iter() {
-            let _ = global.translate(&self, None, &mut builder)?;
-        }
+        // Globals (and hidden globals) are translated the first time they're used, so the ones
+        // only used by eliminated functions never make it into the module.
 
         // Function declarations
         for function in self.built_functions.iter() {
             function.function_id.set(Some(builder.id()));
         }
-
-        // Hidden globals
-        for global in self.hidden_global_variables.iter() {
-            let _ = global.translate(&self, None, &mut builder)?;
+        for (index, _) in self.reused_functions.iter() {
+            self.function_id(*index)
+                .ok_or_else(Error::unexpected)?
+                .set(Some(builder.id()));
         }
 
-        // Function bodies
-        for function in self.built_functions.iter() {
+        // Function bodies. Graphs are still made of `Arc` nodes (see TODO.md), but each one is
+        // released as soon as it's function has been lowered.
+        let built_functions = std::mem::take(&mut self.built_functions);
+        let function_indices = (0..self.functions.len() as u32)
+            .filter_map(|i| Some((Arc::as_ptr(self.function_id(i)?) as usize, i)))
+            .collect::<HashMap<_, _>>();
+        let built_indices = built_functions
+            .iter()
+            .map(|x| function_indices.get(&(Arc::as_ptr(&x.function_id) as usize)))
+            .map(|x| x.copied().ok_or_else(Error::unexpected))
+            .collect::<Result<Vec<_>>>()?;
+
+        for (function, i) in built_functions.into_vec().into_iter().zip(&built_indices) {
+            let span = tracing::info_span!(
+                "translate_function",
+                function = *i,
+                instructions = tracing::field::Empty
+            )
+            .entered();
+
             function.translate(&self, &mut builder)?;
+            if let Some(debug_info) = &self.debug_info {
+                debug_info.name_function(*i, &function, &mut builder);
+            }
+            if let Some(function) = builder.functions().last() {
+                span.record("instructions", function.instructions);
+            }
         }
 
+        after_functions(&self, &mut builder, &built_indices)?;
+
         // Capabilities
-        for capability in builder
-            .module_ref()
-            .all_inst_iter()
-            .flat_map(instruction_capabilities)
-        {
-            self.capabilities.require_mut(capability)?;
+        for capability in builder.capabilities().iter() {
+            self.capabilities.require_mut(*capability)?;
         }
 
-        for capability in self.capabilities.iter() {
-            builder.capability(*capability)
+        // Functions built in parallel require capabilities in whatever order their threads are
+        // scheduled, so they're declared in a fixed order instead
+        let mut capabilities = self.capabilities.iter().copied().collect::<Vec<_>>();
+        capabilities.sort_unstable_by_key(|x| *x as u32);
+        for capability in capabilities {
+            builder.capability(capability)
         }
 
         // Extensions
@@ -178,6 +663,17 @@ impl<'a> ModuleBuilder<'a> {
             builder.extension(extension.to_string())
         }
 
+        let stats = builder.intern_stats();
+        span.record("instructions", builder.instruction_count());
+        span.record("type_hits", stats.type_hits);
+        span.record("type_misses", stats.type_misses);
+        span.record("constant_hits", stats.constant_hits);
+        span.record("constant_misses", stats.constant_misses);
+
+        let stats = builder.bounds_check_stats();
+        span.record("bounds_checks", stats.emitted);
+        span.record("reused_bounds_checks", stats.reused);
+        span.record("elided_bounds_checks", stats.elided);
         return Ok(builder);
     }
 }
@@ -203,9 +699,18 @@ impl<'a> FunctionBuilder<'a> {
         // Create entry point
         if let Some(ref entry_point) = self.entry_point {
             let function_id = self.function_id.get().ok_or_else(Error::unexpected)?;
+            // Since SPIR-V 1.4, the interface lists every global variable, including workgroup arrays
+            let workgroup_arrays = module
+                .hidden_global_variables
+                .iter()
+                .filter(|_| module.version >= Version::V1_4)
+                .filter(|x| x.storage_class == StorageClass::Workgroup)
+                .filter(|x| !entry_point.interface.iter().any(|y| Arc::ptr_eq(*x, y)));
+
             let interface = entry_point
                 .interface
                 .iter()
+                .chain(workgroup_arrays)
                 .map(|x| x.translate(module, Some(self), builder))
                 .collect::<Result<Vec<_>>>()?;
 
@@ -232,6 +737,10 @@ impl<'a> FunctionBuilder<'a> {
                     ExecutionMode::LocalSize(x, y, z) => {
                         (SpirvExecutionMode::LocalSize, vec![*x, *y, *z])
                     }
+                    ExecutionMode::LocalSizeId(x, y, z) => {
+                        translate_local_size_id([*x, *y, *z], function_id, module, builder)?;
+                        continue;
+                    }
                     ExecutionMode::LocalSizeHint(x, y, z) => {
                         (SpirvExecutionMode::LocalSizeHint, vec![*x, *y, *z])
                     }
@@ -268,7 +777,6 @@ impl<'a> FunctionBuilder<'a> {
         }
 
         builder.end_function()?;
-        builder.select_block(None)?;
 
         return Ok(());
     }
@@ -313,6 +821,11 @@ impl Translation for CompositeType {
                 let component_type = elem.translate(module, function, builder)?;
                 Ok(builder.type_vector(component_type, component_count))
             }
+            CompositeType::Array(elem, length) => {
+                let element_type = elem.translate(module, function, builder)?;
+                let length = translate_constant_u32(length, module, function, builder)?;
+                Ok(builder.type_array(element_type, length))
+            }
         }
     }
 }
@@ -324,7 +837,13 @@ impl Translation for Type {
         function: Option<&FunctionBuilder>,
         builder: &mut Builder,
     ) -> Result<rspirv::spirv::Word> {
-        match self {
+        if let Some(id) = builder.translated_types.get(&self) {
+            builder.stats.type_hits += 1;
+            return Ok(*id);
+        }
+
+        let key = self.clone();
+        let id = match self {
             Type::Pointer {
                 size,
                 storage_class,
@@ -345,19 +864,7 @@ impl Translation for Type {
                         let align = pointee
                             .comptime_byte_size(module)
                             .ok_or_else(Error::unexpected)?;
-
-                        let n = builder.module_ref().types_global_values.len();
-                        let runtime_array_type = builder.type_runtime_array(pointee_type);
-
-                        if n != builder.module_ref().types_global_values.len() {
-                            builder.decorate(
-                                runtime_array_type,
-                                Decoration::ArrayStride,
-                                Some(Operand::LiteralInt32(align)),
-                            );
-                        }
-
-                        runtime_array_type
+                        builder.type_strided_runtime_array(pointee_type, align)
                     }
                 };
 
@@ -365,33 +872,22 @@ impl Translation for Type {
                 let pointee_type = match is_structured {
                     false => pointee_type,
                     true => {
-                        let n = builder.module_ref().types_global_values.len();
-                        let structure_type = builder.type_struct([pointee_type]);
-
-                        if n != builder.module_ref().types_global_values.len() {
-                            builder.member_decorate(
-                                structure_type,
-                                0,
-                                Decoration::Offset,
-                                Some(Operand::LiteralInt32(0)),
-                            );
-
-                            let block = match module.version.cmp(&Version::V1_3) {
-                                Ordering::Greater | Ordering::Equal => Decoration::Block,
-                                _ => Decoration::BufferBlock,
-                            };
-                            builder.decorate(structure_type, block, None);
-                        }
-
-                        structure_type
+                        let block = match module.version.cmp(&Version::V1_3) {
+                            Ordering::Greater | Ordering::Equal => Decoration::Block,
+                            _ => Decoration::BufferBlock,
+                        };
+                        builder.type_block(pointee_type, block)
                     }
                 };
 
-                Ok(builder.type_pointer(None, storage_class, pointee_type))
+                builder.type_pointer(None, storage_class, pointee_type)
             }
-            Type::Scalar(x) => x.translate(module, function, builder),
-            Type::Composite(x) => x.translate(module, function, builder),
-        }
+            Type::Scalar(x) => x.translate(module, function, builder)?,
+            Type::Composite(x) => x.translate(module, function, builder)?,
+        };
+
+        builder.translated_types.insert(key, id);
+        return Ok(id);
     }
 }
 
@@ -546,16 +1042,26 @@ impl Translation for &Bool {
                 builder.logical_not(result_type, None, operand)
             }
 
+            BoolSource::Subgroup(source) => Ok(translate_subgroup(
+                source,
+                result_type,
+                module,
+                function,
+                builder,
+            )?),
+
             BoolSource::Loaded {
                 pointer,
                 log2_alignment,
             } => {
                 let pointee = &pointer.pointee;
                 let storage_class = pointer.storage_class;
-                let pointer = translate_to_skinny(pointer, module, function, builder)?;
+                let (pointer, in_bounds) = translate_guarded(pointer, module, function, builder)?;
 
                 let (memory_access, additional_params) = additional_access_info(*log2_alignment);
-                builder.load(result_type, None, pointer, memory_access, additional_params)
+                let loaded =
+                    builder.load(result_type, None, pointer, memory_access, additional_params)?;
+                builder.guard_load(result_type, loaded, in_bounds, None)
             }
         }?;
 
@@ -599,6 +1105,20 @@ impl Translation for &Integer {
                 Ok(builder.constant_u64(result_type, *x))
             }
 
+            // Specialization constants are never shared, since each one has it's own id
+            IntegerSource::SpecConstant { spec_id, default } => {
+                let res = match default {
+                    IntConstantSource::Short(x) => builder.spec_constant_u32(result_type, *x),
+                    IntConstantSource::Long(x) => builder.spec_constant_u64(result_type, *x),
+                };
+                builder.decorate(
+                    res,
+                    Decoration::SpecId,
+                    Some(Operand::LiteralInt32(*spec_id)),
+                );
+                Ok(res)
+            }
+
             IntegerSource::Select {
                 selector,
                 true_value,
@@ -641,8 +1161,8 @@ impl Translation for &Integer {
                 ..
             }) => {
                 let convert_f_to_i = match signed {
-                    true => rspirv::dr::Builder::convert_f_to_s,
-                    false => rspirv::dr::Builder::convert_f_to_u,
+                    true => Emitter::convert_f_to_s,
+                    false => Emitter::convert_f_to_u,
                 };
                 let float_value = value.translate(module, function, builder)?;
                 convert_f_to_i(builder, result_type, None, float_value)
@@ -684,10 +1204,90 @@ impl Translation for &Integer {
             } => {
                 let pointee = &pointer.pointee;
                 let storage_class = pointer.storage_class;
-                let pointer = translate_to_skinny(pointer, module, function, builder)?;
+                let (pointer, in_bounds) = translate_guarded(pointer, module, function, builder)?;
 
                 let (memory_access, additional_params) = additional_access_info(*log2_alignment);
-                builder.load(result_type, None, pointer, memory_access, additional_params)
+                let loaded =
+                    builder.load(result_type, None, pointer, memory_access, additional_params)?;
+                builder.guard_load(result_type, loaded, in_bounds, None)
+            }
+
+            IntegerSource::Subgroup(source) => Ok(translate_subgroup(
+                source,
+                result_type,
+                module,
+                function,
+                builder,
+            )?),
+
+            IntegerSource::Atomic { pointer, source } => {
+                if self.kind(module)? == IntegerKind::Long {
+                    builder.require(Capability::Int64Atomics);
+                }
+
+                let storage_class = pointer.storage_class;
+                let access = match source {
+                    AtomicSource::Load => AtomicAccess::Read,
+                    _ => AtomicAccess::ReadWrite,
+                };
+
+                let pointer = translate_to_skinny(pointer, module, function, builder)?;
+                let scope = atomic::memory_scope(storage_class, module) as u32;
+                let scope = translate_constant_u32(scope, module, function, builder)?;
+                let semantics = atomic::semantics(storage_class, access, module).bits();
+                let semantics = translate_constant_u32(semantics, module, function, builder)?;
+
+                match source {
+                    AtomicSource::Load => {
+                        builder.atomic_load(result_type, None, pointer, scope, semantics)
+                    }
+                    AtomicSource::Exchange(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_exchange(result_type, None, pointer, scope, semantics, value)
+                    }
+                    AtomicSource::CompareExchange {
+                        expected,
+                        replacement,
+                    } => {
+                        // The unequal semantics can't have release semantics
+                        let unequal =
+                            atomic::semantics(storage_class, AtomicAccess::Read, module).bits();
+                        let unequal = translate_constant_u32(unequal, module, function, builder)?;
+                        let value = replacement.translate(module, function, builder)?;
+                        let comparator = expected.translate(module, function, builder)?;
+
+                        builder.atomic_compare_exchange(
+                            result_type,
+                            None,
+                            pointer,
+                            scope,
+                            semantics,
+                            unequal,
+                            value,
+                            comparator,
+                        )
+                    }
+                    AtomicSource::Add(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_i_add(result_type, None, pointer, scope, semantics, value)
+                    }
+                    AtomicSource::Sub(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_i_sub(result_type, None, pointer, scope, semantics, value)
+                    }
+                    AtomicSource::And(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_and(result_type, None, pointer, scope, semantics, value)
+                    }
+                    AtomicSource::Or(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_or(result_type, None, pointer, scope, semantics, value)
+                    }
+                    AtomicSource::Xor(value) => {
+                        let value = value.translate(module, function, builder)?;
+                        builder.atomic_xor(result_type, None, pointer, scope, semantics, value)
+                    }
+                }
             }
 
             IntegerSource::Extracted { vector, index } => {
@@ -739,9 +1339,7 @@ impl Translation for &Integer {
                             }
                         }
 
-                        module
-                            .capabilities
-                            .require(Capability::IntegerFunctions2INTEL)?;
+                        builder.require(Capability::IntegerFunctions2INTEL);
                         builder.u_count_leading_zeros_intel(result_type, None, operand)
                     }
 
@@ -762,9 +1360,7 @@ impl Translation for &Integer {
                             }
                         }
 
-                        module
-                            .capabilities
-                            .require(Capability::IntegerFunctions2INTEL)?;
+                        builder.require(Capability::IntegerFunctions2INTEL);
                         builder.u_count_trailing_zeros_intel(result_type, None, operand)
                     }
                 }
@@ -851,6 +1447,14 @@ impl Translation for &Float {
         let res = match &self.source {
             FloatSource::FunctionParam(_) => builder.function_parameter(result_type),
 
+            FloatSource::Subgroup(source) => Ok(translate_subgroup(
+                source,
+                result_type,
+                module,
+                function,
+                builder,
+            )?),
+
             FloatSource::Constant(FloatConstantSource::Single(x)) => {
                 Ok(builder.constant_f32(result_type, *x))
             }
@@ -859,6 +1463,19 @@ impl Translation for &Float {
                 Ok(builder.constant_f64(result_type, *x))
             }
 
+            FloatSource::SpecConstant { spec_id, default } => {
+                let res = match default {
+                    FloatConstantSource::Single(x) => builder.spec_constant_f32(result_type, *x),
+                    FloatConstantSource::Double(x) => builder.spec_constant_f64(result_type, *x),
+                };
+                builder.decorate(
+                    res,
+                    Decoration::SpecId,
+                    Some(Operand::LiteralInt32(*spec_id)),
+                );
+                Ok(res)
+            }
+
             FloatSource::Conversion(FloatConversionSource::Bitcast { value, .. }) => {
                 let value = value.translate(module, function, builder)?;
                 builder.bitcast(result_type, None, value)
@@ -875,8 +1492,8 @@ impl Translation for &Float {
                 signed, value, ..
             }) => {
                 let convert_i_to_f = match signed {
-                    true => rspirv::dr::Builder::convert_s_to_f,
-                    false => rspirv::dr::Builder::convert_u_to_f,
+                    true => Emitter::convert_s_to_f,
+                    false => Emitter::convert_u_to_f,
                 };
 
                 let value = value.translate(module, function, builder)?;
@@ -900,10 +1517,12 @@ impl Translation for &Float {
             } => {
                 let pointee = &pointer.pointee;
                 let storage_class = pointer.storage_class;
-                let pointer = translate_to_skinny(pointer, module, function, builder)?;
+                let (pointer, in_bounds) = translate_guarded(pointer, module, function, builder)?;
 
                 let (memory_access, additional_params) = additional_access_info(*log2_alignment);
-                builder.load(result_type, None, pointer, memory_access, additional_params)
+                let loaded =
+                    builder.load(result_type, None, pointer, memory_access, additional_params)?;
+                builder.guard_load(result_type, loaded, in_bounds, None)
             }
 
             FloatSource::Extracted { vector, index } => {
@@ -1186,7 +1805,7 @@ impl Translation for &Float {
                         let false_label = builder.id();
                         let merge_label = builder.id();
 
-                        let result = Rc::new(Pointer::new_variable(
+                        let result = Arc::new(Pointer::new_variable(
                             PointerSize::Skinny,
                             StorageClass::Function,
                             kind,
@@ -1195,9 +1814,7 @@ impl Translation for &Float {
                         ))
                         .translate(module, function, builder)?;
 
-                        let current_block = builder.selected_block();
                         builder.selection_merge(merge_label, SelectionControl::FLATTEN)?;
-                        builder.select_block(current_block)?;
                         builder.branch_conditional(
                             is_nan,
                             true_label,
@@ -1256,9 +1873,7 @@ impl Translation for &Float {
                         let false_label = builder.id();
                         let merge_label = builder.id();
 
-                        let current_block = builder.selected_block();
                         builder.selection_merge(merge_label, SelectionControl::FLATTEN)?;
-                        builder.select_block(current_block)?;
                         builder.branch_conditional(
                             is_nan,
                             true_label,
@@ -1266,7 +1881,7 @@ impl Translation for &Float {
                             [nan_odds, other_odds],
                         )?;
 
-                        let result = Rc::new(Pointer::new_variable(
+                        let result = Arc::new(Pointer::new_variable(
                             PointerSize::Skinny,
                             StorageClass::Function,
                             kind,
@@ -1304,7 +1919,7 @@ impl Translation for &Float {
     }
 }
 
-impl Translation for &Rc<Pointer> {
+impl Translation for &Arc<Pointer> {
     fn translate(
         self,
         module: &ModuleBuilder,
@@ -1315,6 +1930,22 @@ impl Translation for &Rc<Pointer> {
             return Ok(res);
         }
 
+        // Loads of promoted variables are replaced by the value they would have loaded
+        if let (PointerSource::Loaded { pointer, .. }, Some(function)) = (&self.source, function) {
+            if let Some(value) = function.promoted_pointer(pointer) {
+                let res = value.translate(module, Some(function), builder)?;
+                self.translation.set(Some(res));
+                return Ok(res);
+            }
+        }
+
+        // Decayed pointers share the array's id, which access chains then index into
+        if let PointerSource::Decayed { array } = &self.source {
+            let res = array.translate(module, function, builder)?;
+            self.translation.set(Some(res));
+            return Ok(res);
+        }
+
         let pointer_type = Type::pointer(
             self.kind.to_pointer_size(),
             self.storage_class,
@@ -1326,10 +1957,16 @@ impl Translation for &Rc<Pointer> {
             PointerSource::FunctionParam => builder.function_parameter(pointer_type),
 
             PointerSource::Casted { prev } => {
-                let prev = prev.translate(module, function, builder)?;
-                builder.bitcast(pointer_type, None, prev)
+                let prev_word = prev.translate(module, function, builder)?;
+                match prev.pointee == self.pointee {
+                    // Only the offset into the pointee changed
+                    true => Ok(prev_word),
+                    false => builder.bitcast(pointer_type, None, prev_word),
+                }
             }
 
+            PointerSource::Decayed { .. } => return Err(Error::unexpected()),
+
             PointerSource::FromInteger(value) => {
                 let integer_value = value.translate(module, function, builder)?;
                 builder.convert_u_to_ptr(pointer_type, None, integer_value)
@@ -1367,22 +2004,7 @@ impl Translation for &Rc<Pointer> {
                     .map(|x| x.translate(module, function, builder))
                     .transpose()?;
 
-                let mut operands = vec![Operand::StorageClass(self.storage_class)];
-                if let Some(val) = initializer {
-                    operands.push(Operand::IdRef(val));
-                }
-
-                let id = builder.id();
-                let variable =
-                    Instruction::new(Op::Variable, Some(pointer_type), Some(id), operands);
-
-                match self.storage_class == StorageClass::Function
-                    && builder.selected_block().is_some()
-                {
-                    true => builder.insert_into_block(rspirv::dr::InsertPoint::Begin, variable)?,
-                    false => builder.module_mut().types_global_values.push(variable),
-                }
-
+                let id = builder.variable(pointer_type, None, self.storage_class, initializer);
                 decorators.iter().for_each(|x| x.translate(id, builder));
                 Ok(id)
             }
@@ -1412,10 +2034,12 @@ impl Translation for &Vector {
             } => {
                 let pointee = &pointer.pointee;
                 let storage_class = pointer.storage_class;
-                let pointer = translate_to_skinny(pointer, module, function, builder)?;
+                let (pointer, in_bounds) = translate_guarded(pointer, module, function, builder)?;
 
                 let (memory_access, additional_params) = additional_access_info(*log2_alignment);
-                builder.load(result_type, None, pointer, memory_access, additional_params)
+                let loaded =
+                    builder.load(result_type, None, pointer, memory_access, additional_params)?;
+                builder.guard_load(result_type, loaded, in_bounds, Some(self.element_count))
             }
             VectorSource::Select {
                 selector,
@@ -1427,6 +2051,106 @@ impl Translation for &Vector {
                 let condition = selector.translate(module, function, builder)?;
                 builder.select(result_type, None, condition, object_1, object_2)
             }
+            VectorSource::FunctionParam => builder.function_parameter(result_type),
+            VectorSource::FunctionCall { function_id, args } => {
+                let function_id = function_id.get().ok_or_else(Error::unexpected)?;
+                let args = args
+                    .iter()
+                    .map(|x| x.translate(module, function, builder))
+                    .collect::<Result<Vec<_>, _>>()?;
+
+                builder.function_call(result_type, None, function_id, args)
+            }
+            VectorSource::Splat(value) => {
+                let component = value.translate(module, function, builder)?;
+                let constituents = vec![component; self.element_count as usize];
+                builder.composite(result_type, constituents)
+            }
+            VectorSource::Construct(components) => {
+                let constituents = components
+                    .iter()
+                    .map(|x| x.translate(module, function, builder))
+                    .collect::<Result<Vec<_>, _>>()?;
+
+                builder.composite(result_type, constituents)
+            }
+            VectorSource::Bitcast(vector) => {
+                let operand = vector.translate(module, function, builder)?;
+                builder.bitcast(result_type, None, operand)
+            }
+            VectorSource::Shuffle {
+                vector_1,
+                vector_2,
+                components,
+            } => {
+                let vector_1 = vector_1.translate(module, function, builder)?;
+                let vector_2 = vector_2.translate(module, function, builder)?;
+                builder.vector_shuffle(
+                    result_type,
+                    None,
+                    vector_1,
+                    vector_2,
+                    components.iter().copied(),
+                )
+            }
+            VectorSource::Inserted {
+                vector,
+                value,
+                index,
+            } => {
+                let composite = vector.translate(module, function, builder)?;
+                let object = value.translate(module, function, builder)?;
+                builder.composite_insert(result_type, None, object, composite, Some(*index))
+            }
+            VectorSource::Unary { source, op1 } => {
+                let operand = op1.translate(module, function, builder)?;
+                match (source, self.is_float()) {
+                    (VectorUnarySource::Not, _) => builder.not(result_type, None, operand),
+                    (VectorUnarySource::Negate, false) => {
+                        builder.s_negate(result_type, None, operand)
+                    }
+                    (VectorUnarySource::Negate, true) => {
+                        builder.f_negate(result_type, None, operand)
+                    }
+                }
+            }
+            VectorSource::Binary { source, op1, op2 } => {
+                let operand_1 = op1.translate(module, function, builder)?;
+                let operand_2 = op2.translate(module, function, builder)?;
+                match (source, self.is_float()) {
+                    (VectorBinarySource::Add, false) => {
+                        builder.i_add(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Add, true) => {
+                        builder.f_add(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Sub, false) => {
+                        builder.i_sub(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Sub, true) => {
+                        builder.f_sub(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Mul, false) => {
+                        builder.i_mul(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Mul, true) => {
+                        builder.f_mul(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Div, true) => {
+                        builder.f_div(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::And, false) => {
+                        builder.bitwise_and(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Or, false) => {
+                        builder.bitwise_or(result_type, None, operand_1, operand_2)
+                    }
+                    (VectorBinarySource::Xor, false) => {
+                        builder.bitwise_xor(result_type, None, operand_1, operand_2)
+                    }
+                    _ => return Err(Error::invalid_operand()),
+                }
+            }
         }?;
 
         self.translation.set(Some(res));
@@ -1482,10 +2206,7 @@ impl Translation for &Operation {
 
             Operation::Label(x) => {
                 let label = x.translate(module, function, builder)?;
-                builder.insert_into_block(
-                    rspirv::dr::InsertPoint::End,
-                    rspirv::dr::Instruction::new(Op::Label, None, Some(label), Vec::new()),
-                )?;
+                builder.begin_block(Some(label))?;
                 return Ok(label);
             }
 
@@ -1493,14 +2214,11 @@ impl Translation for &Operation {
                 let function =
                     function.ok_or_else(|| Error::msg("Branches must be inside a function"))?;
 
-                let selected = builder.selected_block();
                 let target_label = label.translate(module, Some(function), builder)?;
 
                 // TODO control flow
 
-                let res = builder.branch(target_label);
-                builder.select_block(selected)?;
-                res
+                builder.branch(target_label)
             }
 
             Operation::BranchConditional {
@@ -1511,43 +2229,9 @@ impl Translation for &Operation {
                 let function =
                     function.ok_or_else(|| Error::msg("Branches must be inside a function"))?;
 
-                let current_block = function.block_of(self).ok_or_else(Error::unexpected)?;
-                let true_block = function.block(true_label).last();
-                let false_block = function.block(false_label).last();
-
                 // control flow
-                let (merge_block, continue_target) = match (true_block, false_block) {
-                    // Both blocks end up branching to the same block.
-                    // This is probably a structured if
-                    (
-                        Some(Operation::Branch { label }),
-                        Some(Operation::Branch { label: label1 }),
-                    ) if Rc::ptr_eq(label, label1) => (Some(label.clone()), None),
-
-                    // True block ends up branching to the current label.
-                    // True block is probably the continue target, leaving the false block as the "exit" branch
-                    (Some(Operation::Branch { label }), _) if label == current_block => {
-                        (Some(false_label.clone()), Some(true_label.clone()))
-                    }
-
-                    // True block ends up branching to the false label.
-                    (Some(Operation::Branch { label }), _) if label == false_label => {
-                        (Some(false_label.clone()), None)
-                    }
-
-                    (_, Some(Operation::Branch { label })) if label == true_label => {
-                        (Some(true_label.clone()), None)
-                    }
-
-                    // False block ends up branching to the current label.
-                    // False block is probably the continue target, leaving the true block as the "exit" branch
-                    (_, Some(Operation::Branch { label })) if label == current_block => {
-                        (Some(true_label.clone()), Some(false_label.clone()))
-                    }
-                    _ => (None, None),
-                };
+                let (merge_block, continue_target) = function.structure_of(self)?;
 
-                let selected = builder.selected_block();
                 let true_label = true_label.translate(module, Some(function), builder)?;
                 let false_label = false_label.translate(module, Some(function), builder)?;
 
@@ -1563,9 +2247,7 @@ impl Translation for &Operation {
                         if let Some(merge_block) = merge_block {
                             let merge_block =
                                 merge_block.translate(module, Some(function), builder)?;
-                            let block = builder.selected_block();
                             builder.selection_merge(merge_block, SelectionControl::NONE)?;
-                            builder.select_block(block)?;
                         }
 
                         builder.switch(selector, true_label, Some((zero, false_label)))
@@ -1575,7 +2257,6 @@ impl Translation for &Operation {
                         let condition = condition.translate(module, Some(function), builder)?;
 
                         // control flow
-                        let block = builder.selected_block();
                         match (merge_block, continue_target) {
                             (Some(merge_block), None) => {
                                 let merge_block =
@@ -1602,13 +2283,10 @@ impl Translation for &Operation {
 
                             _ => return Err(Error::unexpected()),
                         }
-                        builder.select_block(block)?;
 
                         builder.branch_conditional(condition, true_label, false_label, None)
                     }
-                }?;
-
-                builder.select_block(selected)
+                }
             }
 
             Operation::Store {
@@ -1687,31 +2365,63 @@ impl Translation for &Operation {
                 Ok(())
             }
 
-            Operation::Nop => {
-                let selected = builder.selected_block();
-                builder.nop()?;
-                builder.select_block(selected)
+            Operation::AtomicStore { target, value } => {
+                if value.ty(module)? == Type::Scalar(ScalarType::I64) {
+                    builder.require(Capability::Int64Atomics);
+                }
+
+                let storage_class = target.storage_class;
+                let pointer = translate_to_skinny(target, module, function, builder)?;
+                let scope = atomic::memory_scope(storage_class, module) as u32;
+                let scope = translate_constant_u32(scope, module, function, builder)?;
+                let semantics = atomic::semantics(storage_class, AtomicAccess::Write, module);
+                let semantics =
+                    translate_constant_u32(semantics.bits(), module, function, builder)?;
+                let value = value.translate(module, function, builder)?;
+
+                builder.atomic_store(pointer, scope, semantics, value)
+            }
+
+            Operation::MemoryBarrier { scope, semantics } => {
+                let scope = translate_constant_u32(*scope as u32, module, function, builder)?;
+                let semantics =
+                    translate_constant_u32(semantics.bits(), module, function, builder)?;
+                builder.memory_barrier(scope, semantics)
+            }
+
+            Operation::ControlBarrier {
+                execution,
+                scope,
+                semantics,
+            } => {
+                let execution =
+                    translate_constant_u32(*execution as u32, module, function, builder)?;
+                let scope = translate_constant_u32(*scope as u32, module, function, builder)?;
+                let semantics =
+                    translate_constant_u32(semantics.bits(), module, function, builder)?;
+                builder.control_barrier(execution, scope, semantics)
             }
 
-            Operation::Unreachable => {
-                let selected = builder.selected_block();
-                builder.unreachable()?;
-                builder.select_block(selected)
+            Operation::Nop => builder.nop(),
+
+            Operation::Line(offset) => {
+                let file = module
+                    .debug_info
+                    .as_ref()
+                    .and_then(|x| x.file.get())
+                    .ok_or_else(Error::unexpected)?;
+
+                builder.line(file, *offset, 0)
             }
 
+            Operation::Unreachable => builder.unreachable(),
+
             Operation::Return { value: Some(value) } => {
-                let selected = builder.selected_block();
                 let value = value.clone().translate(module, function, builder)?;
-                let res = builder.ret_value(value);
-                builder.select_block(selected)?;
-                res
+                builder.ret_value(value)
             }
 
-            Operation::Return { value: None } => {
-                let selected = builder.selected_block();
-                builder.ret()?;
-                builder.select_block(selected)
-            }
+            Operation::Return { value: None } => builder.ret(),
         }?;
 
         return Ok(0);
@@ -1719,7 +2429,7 @@ impl Translation for &Operation {
 }
 
 impl Deref for Builder {
-    type Target = rspirv::dr::Builder;
+    type Target = Emitter;
 
     fn deref(&self) -> &Self::Target {
         &self.inner
@@ -1744,18 +2454,240 @@ fn additional_access_info(log2_alignment: Option<u32>) -> (Option<MemoryAccess>,
     }
 }
 
+fn translate_subgroup(
+    source: &SubgroupSource,
+    result_type: spirv::Word,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+    builder: &mut Builder,
+) -> Result<spirv::Word> {
+    builder.require(source.required_capability());
+    let execution =
+        translate_constant_u32(spirv::Scope::Subgroup as u32, module, function, builder)?;
+
+    return Ok(match source {
+        SubgroupSource::Elect => builder.group_non_uniform_elect(result_type, None, execution)?,
+
+        SubgroupSource::All(predicate) => {
+            let predicate = predicate.translate(module, function, builder)?;
+            builder.group_non_uniform_all(result_type, None, execution, predicate)?
+        }
+
+        SubgroupSource::Any(predicate) => {
+            let predicate = predicate.translate(module, function, builder)?;
+            builder.group_non_uniform_any(result_type, None, execution, predicate)?
+        }
+
+        SubgroupSource::Ballot {
+            predicate,
+            component,
+        } => {
+            let predicate = predicate.translate(module, function, builder)?;
+            let component_type = builder.type_int(32, 0);
+            let mask_type = builder.type_vector(component_type, 4);
+            let mask = builder.group_non_uniform_ballot(mask_type, None, execution, predicate)?;
+
+            match component.get_constant_value()? {
+                Some(IntConstantSource::Short(x)) => {
+                    builder.composite_extract(result_type, None, mask, Some(x))?
+                }
+                _ => {
+                    let index = component.translate(module, function, builder)?;
+                    builder.vector_extract_dynamic(result_type, None, mask, index)?
+                }
+            }
+        }
+
+        SubgroupSource::BroadcastFirst(value) => {
+            let value = value.translate(module, function, builder)?;
+            builder.group_non_uniform_broadcast_first(result_type, None, execution, value)?
+        }
+
+        SubgroupSource::Shuffle { value, id } => {
+            let value = value.translate(module, function, builder)?;
+            let id = id.translate(module, function, builder)?;
+            builder.group_non_uniform_shuffle(result_type, None, execution, value, id)?
+        }
+
+        SubgroupSource::Arithmetic {
+            kind,
+            operation,
+            value,
+        } => {
+            let is_float = matches!(value, Value::Float(_));
+            let value = value.translate(module, function, builder)?;
+            let operation = *operation;
+
+            match (kind, is_float) {
+                (SubgroupArithmetic::Add, false) => builder.group_non_uniform_i_add(
+                    result_type,
+                    None,
+                    execution,
+                    operation,
+                    value,
+                    None,
+                )?,
+                (SubgroupArithmetic::Add, true) => builder.group_non_uniform_f_add(
+                    result_type,
+                    None,
+                    execution,
+                    operation,
+                    value,
+                    None,
+                )?,
+                (SubgroupArithmetic::Min { signed: true }, false) => builder
+                    .group_non_uniform_s_min(
+                        result_type,
+                        None,
+                        execution,
+                        operation,
+                        value,
+                        None,
+                    )?,
+                (SubgroupArithmetic::Min { signed: false }, false) => builder
+                    .group_non_uniform_u_min(
+                        result_type,
+                        None,
+                        execution,
+                        operation,
+                        value,
+                        None,
+                    )?,
+                (SubgroupArithmetic::Min { .. }, true) => builder.group_non_uniform_f_min(
+                    result_type,
+                    None,
+                    execution,
+                    operation,
+                    value,
+                    None,
+                )?,
+                (SubgroupArithmetic::Max { signed: true }, false) => builder
+                    .group_non_uniform_s_max(
+                        result_type,
+                        None,
+                        execution,
+                        operation,
+                        value,
+                        None,
+                    )?,
+                (SubgroupArithmetic::Max { signed: false }, false) => builder
+                    .group_non_uniform_u_max(
+                        result_type,
+                        None,
+                        execution,
+                        operation,
+                        value,
+                        None,
+                    )?,
+                (SubgroupArithmetic::Max { .. }, true) => builder.group_non_uniform_f_max(
+                    result_type,
+                    None,
+                    execution,
+                    operation,
+                    value,
+                    None,
+                )?,
+            }
+        }
+    });
+}
+
+/// `LocalSizeId` is only available from SPIR-V 1.2, and Vulkan only accepts it with the
+/// `maintenance4` feature, so elsewhere the workgroup size is specialized through the
+/// `WorkgroupSize` built-in, which overrides the default size of the `LocalSize` execution mode.
+///
+/// There can only be one `WorkgroupSize` built-in in a module, so every entry point with a
+/// specialized workgroup size must share it.
+fn translate_local_size_id(
+    size: [SpecConstant; 3],
+    function_id: spirv::Word,
+    module: &ModuleBuilder,
+    builder: &mut Builder,
+) -> Result<()> {
+    if module.version >= Version::V1_2 && !module.platform.is_vulkan() {
+        let ids = translate_workgroup_ids(size, builder);
+        builder.execution_mode_id(function_id, SpirvExecutionMode::LocalSizeId, ids);
+        return Ok(());
+    }
+
+    match builder.workgroup_size {
+        Some((prev, _)) if prev != size => return Err(Error::msg(
+            "Every entry point with a specialized workgroup size must share it's spec constants",
+        )),
+        Some(_) => {}
+        None => {
+            let ids = translate_workgroup_ids(size, builder);
+            let u32_type = builder.type_int(32, 0);
+            let size_type = builder.type_vector(u32_type, 3);
+            let workgroup_size = builder.spec_constant_composite(size_type, ids);
+            builder.decorate(
+                workgroup_size,
+                Decoration::BuiltIn,
+                Some(Operand::BuiltIn(BuiltIn::WorkgroupSize)),
+            );
+            builder.workgroup_size = Some((size, workgroup_size));
+        }
+    }
+
+    builder.execution_mode(
+        function_id,
+        SpirvExecutionMode::LocalSize,
+        size.map(|x| x.default),
+    );
+    return Ok(());
+}
+
+fn translate_workgroup_ids(size: [SpecConstant; 3], builder: &mut Builder) -> [spirv::Word; 3] {
+    let u32_type = builder.type_int(32, 0);
+    return size.map(|x| {
+        let id = builder.spec_constant_u32(u32_type, x.default);
+        builder.decorate(
+            id,
+            Decoration::SpecId,
+            Some(Operand::LiteralInt32(x.spec_id)),
+        );
+        id
+    });
+}
+
+/// Scopes and memory semantics are passed to instructions as ids of unsigned constants.
+fn translate_constant_u32(
+    value: u32,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+    builder: &mut Builder,
+) -> Result<spirv::Word> {
+    return Integer::new_constant_u32(value).translate(module, function, builder);
+}
+
 fn translate_to_skinny(
-    pointer: &Rc<Pointer>,
+    pointer: &Arc<Pointer>,
     module: &ModuleBuilder,
     function: Option<&FunctionBuilder>,
     builder: &mut Builder,
 ) -> Result<spirv::Word> {
+    return translate_guarded(pointer, module, function, builder).map(|(pointer, _)| pointer);
+}
+
+/// Like [`translate_to_skinny`], but with [checked](BoundsCheckKind::Checked) bounds it also
+/// results in the condition under which the access is in bounds, unless it's known to always be.
+fn translate_guarded(
+    pointer: &Arc<Pointer>,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+    builder: &mut Builder,
+) -> Result<(spirv::Word, Option<spirv::Word>)> {
+    if let Some((vector, count)) = vector_component(pointer, module) {
+        return translate_component(pointer, vector, count, module, function, builder);
+    }
+
     let pointer_word = pointer.translate(module, function, builder)?;
     let mut indexes = Vec::with_capacity(2);
+    let mut in_bounds = None;
 
     let result_type = match pointer.is_structured() {
         true => {
-            let zero = Rc::new(Integer::new_constant_usize(0, module))
+            let zero = Arc::new(Integer::new_constant_usize(0, module))
                 .translate(module, function, builder)?;
             indexes.push(zero);
 
@@ -1780,22 +2712,338 @@ fn translate_to_skinny(
             .comptime_byte_size(module)
             .ok_or_else(Error::unexpected)?;
 
-        let stride = Rc::new(Integer::new_constant_usize(stride, module));
-        let offset = pointer
+        let stride = Arc::new(Integer::new_constant_usize(stride, module));
+        let index = pointer
             .byte_offset()
-            .unwrap_or_else(|| Rc::new(Integer::new_constant_usize(0, module)))
-            .u_div(stride, true, module)?
-            .translate(module, function, builder)?;
+            .unwrap_or_else(|| Arc::new(Integer::new_constant_usize(0, module)))
+            .u_div(stride, true, module)?;
+
+        let mut offset = index.translate(module, function, builder)?;
+        if let Some(check) = bounds_check(
+            pointer,
+            pointer_word,
+            &index,
+            offset,
+            module,
+            function,
+            builder,
+        )? {
+            offset = check.clamped;
+            if module.bounds_checks == BoundsCheckKind::Checked {
+                in_bounds = Some(check.in_bounds);
+            }
+        }
 
         indexes.push(offset);
     }
 
-    return match indexes.is_empty() {
-        true => Ok(pointer_word),
-        false => builder
-            .access_chain(result_type, None, pointer_word, indexes)
-            .map_err(Into::into),
+    let pointer = match indexes.is_empty() {
+        true => pointer_word,
+        false => builder.access_chain(result_type, None, pointer_word, indexes)?,
+    };
+
+    return Ok((pointer, in_bounds));
+}
+
+/// Pointer into a structured buffer of vectors, and the vector's component count, if `pointer`
+/// is the scalar component of one of it's vectors. Logical addressing can't cast pointers, so
+/// those are accessed through the buffer instead.
+fn vector_component<'a>(
+    pointer: &'a Pointer,
+    module: &ModuleBuilder,
+) -> Option<(&'a Arc<Pointer>, u32)> {
+    if module.addressing_model != AddressingModel::Logical || !pointer.is_fat() {
+        return None;
+    }
+
+    let vector = match &pointer.source {
+        PointerSource::Casted { prev } if prev.is_fat() && prev.is_structured() => prev,
+        _ => return None,
     };
+
+    return match (&pointer.pointee, &vector.pointee) {
+        (Type::Scalar(elem), Type::Composite(CompositeType::Vector(vector_elem, count)))
+            if elem == vector_elem =>
+        {
+            Some((vector, *count))
+        }
+        _ => None,
+    };
+}
+
+/// Access chain to the component of the buffer's vector that `pointer` points to (see
+/// [`vector_component`]).
+fn translate_component(
+    pointer: &Pointer,
+    vector: &Arc<Pointer>,
+    count: u32,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+    builder: &mut Builder,
+) -> Result<(spirv::Word, Option<spirv::Word>)> {
+    let array = vector.translate(module, function, builder)?;
+    let elem_size = pointer
+        .pointee
+        .comptime_byte_size(module)
+        .ok_or_else(Error::unexpected)?;
+
+    let zero = Arc::new(Integer::new_constant_usize(0, module));
+    let byte_offset = pointer.byte_offset().unwrap_or_else(|| zero.clone());
+    let index = byte_offset.clone().u_div(
+        Arc::new(Integer::new_constant_usize(elem_size * count, module)),
+        true,
+        module,
+    )?;
+    let component = byte_offset
+        .u_div(
+            Arc::new(Integer::new_constant_usize(elem_size, module)),
+            true,
+            module,
+        )?
+        .u_rem(Arc::new(Integer::new_constant_usize(count, module)), module)?;
+
+    let mut index_word = index.translate(module, function, builder)?;
+    let mut in_bounds = None;
+    if let Some(check) = bounds_check(vector, array, &index, index_word, module, function, builder)?
+    {
+        index_word = check.clamped;
+        if module.bounds_checks == BoundsCheckKind::Checked {
+            in_bounds = Some(check.in_bounds);
+        }
+    }
+
+    let pointee_type = pointer
+        .pointee
+        .clone()
+        .translate(module, function, builder)?;
+    let result_type = builder.type_pointer(None, pointer.storage_class, pointee_type);
+    let indexes = [
+        zero.translate(module, function, builder)?,
+        index_word,
+        component.translate(module, function, builder)?,
+    ];
+
+    let pointer = builder.access_chain(result_type, None, array, indexes)?;
+    return Ok((pointer, in_bounds));
+}
+
+/// Guard of an access to the `index`-th element of the array `pointer` points into (with id
+/// `array`), if it's length is known and the index may be out of it's bounds.
+fn bounds_check(
+    pointer: &Pointer,
+    array: spirv::Word,
+    index: &Integer,
+    index_word: spirv::Word,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+    builder: &mut Builder,
+) -> Result<Option<BoundsCheck>> {
+    if module.bounds_checks == BoundsCheckKind::Unchecked {
+        return Ok(None);
+    }
+
+    // Structured buffers end with a runtime array, and decayed pointers point into a fixed one
+    let length = match &pointer.source {
+        _ if pointer.is_structured() => None,
+        PointerSource::Decayed { array: decayed } => match &decayed.pointee {
+            Type::Composite(CompositeType::Array(_, length)) => Some(*length),
+            _ => return Ok(None),
+        },
+        _ => return Ok(None),
+    };
+
+    if let (Some(length), Some(bound)) = (length, index_bound(index, module, function)) {
+        if bound <= length as u64 {
+            builder.bounds_stats.elided += 1;
+            return Ok(None);
+        }
+    }
+
+    if let Some(check) = builder.bounds_checks.get(&(array, index_word)) {
+        builder.bounds_stats.reused += 1;
+        return Ok(Some(*check));
+    }
+
+    let kind = index.kind(module)?;
+    let index_type = builder.type_int(
+        match kind {
+            IntegerKind::Short => 32,
+            IntegerKind::Long => 64,
+        },
+        0,
+    );
+
+    let (length, last) = match (length, kind) {
+        (Some(length), IntegerKind::Short) => (
+            builder.constant_u32(index_type, length),
+            builder.constant_u32(index_type, length.saturating_sub(1)),
+        ),
+        (Some(length), IntegerKind::Long) => (
+            builder.constant_u64(index_type, length as u64),
+            builder.constant_u64(index_type, length.saturating_sub(1) as u64),
+        ),
+        (None, kind) => {
+            let length_type = builder.type_int(32, 0);
+            let mut length = builder.array_length(length_type, None, array, 0)?;
+            if kind == IntegerKind::Long {
+                length = builder.u_convert(index_type, None, length)?;
+            }
+
+            let (zero, one) = match kind {
+                IntegerKind::Short => (
+                    builder.constant_u32(index_type, 0),
+                    builder.constant_u32(index_type, 1),
+                ),
+                IntegerKind::Long => (
+                    builder.constant_u64(index_type, 0),
+                    builder.constant_u64(index_type, 1),
+                ),
+            };
+
+            // Empty arrays don't have a last element, so instead of wrapping around, their
+            // accesses are clamped to the first one
+            let boolean = builder.type_bool();
+            let is_empty = builder.i_equal(boolean, None, length, zero)?;
+            let last = builder.i_sub(index_type, None, length, one)?;
+            (
+                length,
+                builder.select(index_type, None, is_empty, zero, last)?,
+            )
+        }
+    };
+
+    let boolean = builder.type_bool();
+    let in_bounds = builder.u_less_than(boolean, None, index_word, length)?;
+    let clamped = builder.select(index_type, None, in_bounds, index_word, last)?;
+
+    let check = BoundsCheck { in_bounds, clamped };
+    builder.bounds_checks.insert((array, index_word), check);
+    builder.bounds_stats.emitted += 1;
+    return Ok(Some(check));
+}
+
+/// Exclusive upper bound of the values `index` may evaluate to, if one is known.
+fn index_bound(
+    index: &Integer,
+    module: &ModuleBuilder,
+    function: Option<&FunctionBuilder>,
+) -> Option<u64> {
+    if let Some(value) = index.get_constant_value().ok()? {
+        return match value {
+            IntConstantSource::Short(x) => Some(x as u64 + 1),
+            IntConstantSource::Long(x) => x.checked_add(1),
+        };
+    }
+
+    let bound = |op: &Integer| index_bound(op, module, function);
+    let shifted = |op: &Integer, f: &dyn Fn(u64) -> u64| Some(f(bound(op)?.checked_sub(1)?) + 1);
+
+    // Additions, multiplications and left shifts wrap around, so they're only bounded while their
+    // largest result fits in the index
+    let max = |op: &Integer| bound(op)?.checked_sub(1);
+    let max_value = match index.kind(module).ok()? {
+        IntegerKind::Short => u32::MAX as u64,
+        IntegerKind::Long => u64::MAX,
+    };
+    let wrapping = |largest: Option<u64>| largest.filter(|x| *x <= max_value)?.checked_add(1);
+
+    return match &index.source {
+        IntegerSource::Binary { source, op1, op2 } => match (source, op2.get_constant_value()) {
+            (IntBinarySource::And, _) => match (bound(op1), bound(op2)) {
+                (Some(x), Some(y)) => Some(u64::min(x, y)),
+                (x, y) => x.or(y),
+            },
+
+            // The remainder is always lower than the divisor
+            (IntBinarySource::URem, _) => {
+                let divisor = bound(op2).map(|x| x.saturating_sub(1));
+                match (bound(op1), divisor) {
+                    (Some(x), Some(y)) => Some(u64::min(x, y)),
+                    (x, y) => x.or(y),
+                }
+            }
+
+            (IntBinarySource::UShr, Ok(Some(shift))) => match shift {
+                IntConstantSource::Short(shift @ 0..=63) => shifted(op1, &|x| x >> shift),
+                IntConstantSource::Long(shift @ 0..=63) => shifted(op1, &|x| x >> shift),
+                _ => None,
+            },
+
+            (IntBinarySource::UDiv, Ok(Some(divisor))) => match divisor {
+                IntConstantSource::Short(divisor @ 1..) => shifted(op1, &|x| x / divisor as u64),
+                IntConstantSource::Long(divisor @ 1..) => shifted(op1, &|x| x / divisor),
+                _ => None,
+            },
+
+            (IntBinarySource::Add, _) => wrapping(max(op1)?.checked_add(max(op2)?)),
+            (IntBinarySource::Mul, _) => wrapping(max(op1)?.checked_mul(max(op2)?)),
+            (IntBinarySource::Shl, Ok(Some(shift))) => match shift {
+                IntConstantSource::Short(shift @ 0..=31) => {
+                    wrapping(max(op1)?.checked_mul(1 << shift))
+                }
+                IntConstantSource::Long(shift @ 0..=63) => {
+                    wrapping(max(op1)?.checked_mul(1 << shift))
+                }
+                _ => None,
+            },
+
+            _ => None,
+        },
+
+        IntegerSource::Conversion(IntConversionSource::FromShort {
+            signed: false,
+            value,
+        }) => bound(value).or(Some(1 << 32)),
+
+        IntegerSource::Select {
+            true_value,
+            false_value,
+            ..
+        } => Some(u64::max(bound(true_value)?, bound(false_value)?)),
+
+        // Local invocation ids are lower than the entry point's workgroup size
+        IntegerSource::Extracted { vector, index } => match &vector.source {
+            VectorSource::Loaded { pointer, .. }
+                if builtin(pointer) == Some(BuiltIn::LocalInvocationId) =>
+            {
+                let local_size = local_size(function?)?;
+                match index.get_constant_value().ok()? {
+                    Some(IntConstantSource::Short(i @ 0..=2)) => {
+                        Some(local_size[i as usize] as u64)
+                    }
+                    _ => local_size.into_iter().max().map(u64::from),
+                }
+            }
+            _ => None,
+        },
+
+        _ => None,
+    };
+}
+
+/// Built-in variable `pointer` points to, if any.
+fn builtin(pointer: &Pointer) -> Option<BuiltIn> {
+    return match &pointer.source {
+        PointerSource::Variable { decorators, .. } => decorators.iter().find_map(|x| match x {
+            VariableDecorator::BuiltIn(builtin) => Some(*builtin),
+            _ => None,
+        }),
+        _ => None,
+    };
+}
+
+/// Workgroup size of the entry point, if it's known at compile time. Sizes given by
+/// specialization constants may change when the pipeline is created, so they aren't.
+fn local_size(function: &FunctionBuilder) -> Option<[u32; 3]> {
+    return function
+        .entry_point
+        .as_ref()?
+        .execution_modes
+        .iter()
+        .find_map(|x| match x {
+            ExecutionMode::LocalSize(x, y, z) => Some([*x, *y, *z]),
+            _ => None,
+        });
 }
 
 fn fast_fmin(
@@ -1833,9 +3081,7 @@ fn fast_fmin(
     }
 
     let condition = builder.f_unord_less_than_equal(boolean, None, operand_1, operand_2)?;
-    builder
-        .select(result_type, None, condition, operand_1, operand_2)
-        .map_err(Into::into)
+    builder.select(result_type, None, condition, operand_1, operand_2)
 }
 
 fn fast_fmax(
@@ -1873,7 +3119,5 @@ fn fast_fmax(
     }
 
     let condition = builder.f_unord_greater_than_equal(boolean, None, operand_1, operand_2)?;
-    builder
-        .select(result_type, None, condition, operand_1, operand_2)
-        .map_err(Into::into)
+    builder.select(result_type, None, condition, operand_1, operand_2)
 }
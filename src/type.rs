@@ -24,7 +24,7 @@ impl PointerSize {
     }
 }
 
-#[derive(Debug, Clone, PartialEq, Hash, Serialize, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash, Serialize, Deserialize)]
 #[serde(untagged)]
 pub enum Type {
     Pointer {
@@ -47,9 +47,10 @@ pub enum ScalarType {
     Bool,
 }
 
-#[derive(Debug, Clone, PartialEq, Hash, Serialize, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash, Serialize, Deserialize)]
 pub enum CompositeType {
     Vector(ScalarType, u32),
+    Array(Box<Type>, u32),
 }
 
 impl Type {
@@ -66,6 +67,9 @@ impl Type {
             Type::Pointer { storage_class, .. } => module.spirv_address_bytes(*storage_class),
             Type::Scalar(x) => x.byte_size(),
             Type::Composite(CompositeType::Vector(elem, count)) => Some(elem.byte_size()? * count),
+            Type::Composite(CompositeType::Array(elem, length)) => {
+                Some(elem.comptime_byte_size(module)? * length)
+            }
         }
     }
 
@@ -123,9 +127,16 @@ impl ScalarType {
 }
 
 impl CompositeType {
+    /// Canonical representation of a `v128`, reinterpreted into the required lane shape when used.
+    pub const V128: CompositeType = CompositeType::Vector(ScalarType::I32, 4);
+
     pub fn vector(elem: impl Into<ScalarType>, count: u32) -> CompositeType {
         return CompositeType::Vector(elem.into(), count);
     }
+
+    pub fn array(elem: impl Into<Type>, length: u32) -> CompositeType {
+        return CompositeType::Array(Box::new(elem.into()), length);
+    }
 }
 
 /* CONVERSIONS */
@@ -178,7 +189,7 @@ impl From<ValType> for Type {
             ValType::I64 => Type::Scalar(ScalarType::I64),
             ValType::F32 => Type::Scalar(ScalarType::F32),
             ValType::F64 => Type::Scalar(ScalarType::F64),
-            ValType::V128 => todo!(),
+            ValType::V128 => Type::Composite(CompositeType::V128),
             ValType::Ref(_) => todo!(),
         }
     }
@@ -0,0 +1,76 @@
+//! Lowering of the atomics of the threads proposal.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::spirv::{MemorySemantics, Op, Scope};
+use serde_json::json;
+
+#[test]
+fn scopes_and_semantics() {
+    let wat = r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32)
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.set 2
+    local.get 1
+    local.get 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.atomic.load
+    i32.atomic.rmw.add
+    drop
+    atomic.fence
+    local.get 1
+    i32.const 1
+    i32.atomic.rmw.xchg
+    drop)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#;
+
+    let mut config = config(1, json!("i32"));
+    config["features"] = features(false, true);
+    let compilation = compile(wat, config);
+    let module = compilation.module().unwrap();
+
+    // Storage buffers are shared by the whole device, and the GLSL memory model keeps the
+    // sequential consistency of Wasm atomics
+    let device = Scope::Device as u32;
+    let semantics = MemorySemantics::SEQUENTIALLY_CONSISTENT | MemorySemantics::UNIFORM_MEMORY;
+
+    for opcode in [Op::AtomicLoad, Op::AtomicIAdd, Op::AtomicExchange] {
+        let atomics = instructions(module, opcode);
+        assert_eq!(atomics.len(), 1, "{opcode:?}");
+        assert_eq!(
+            constant_operand(module, atomics[0], 1),
+            device,
+            "{opcode:?}"
+        );
+        assert_eq!(
+            constant_operand(module, atomics[0], 2),
+            semantics.bits(),
+            "{opcode:?}"
+        );
+    }
+
+    // Fences order every kind of memory an invocation can share
+    let fence = instructions(module, Op::MemoryBarrier);
+    assert_eq!(fence.len(), 1);
+    assert_eq!(constant_operand(module, fence[0], 0), device);
+    assert_eq!(
+        constant_operand(module, fence[0], 1),
+        (semantics | MemorySemantics::WORKGROUP_MEMORY).bits()
+    );
+}
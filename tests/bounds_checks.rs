@@ -0,0 +1,61 @@
+//! Bounds checks of accesses through fat pointers.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::spirv::Op;
+use serde_json::{json, Value};
+use wasm2spirv::Compilation;
+
+fn checked(wat: &str, mut config: Value, kind: &str) -> Compilation {
+    config["bounds_checks"] = json!(kind);
+    return compile(wat, config);
+}
+
+#[test]
+fn runtime_arrays() {
+    let square = square_like("    local.tee 3\n    local.get 3\n    i32.mul\n", "");
+    let config = config(1, json!("i32"));
+
+    let compilation = checked(&square, config.clone(), "unchecked");
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::ULessThan), 0);
+    assert_eq!(count(module, Op::Select), 0);
+
+    // One check per buffer, against it's runtime length, which may be zero
+    let compilation = checked(&square, config.clone(), "clamped");
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::ArrayLength), 2);
+    assert_eq!(count(module, Op::IEqual), 2);
+    assert_eq!(count(module, Op::ULessThan), 2);
+    assert_eq!(count(module, Op::Select), 4);
+
+    // Only the load results in zero when out of bounds
+    let compilation = checked(&square, config, "checked");
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::ULessThan), 2);
+    assert_eq!(count(module, Op::Select), 5);
+}
+
+#[test]
+fn fixed_arrays() {
+    // The masked index into the workgroup array is always in bounds, unlike the others
+    let compilation = checked(WORKGROUP, workgroup_config(), "clamped");
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::ArrayLength), 2);
+    assert_eq!(count(module, Op::ULessThan), 3);
+}
+
+#[test]
+fn local_invocation_ids() {
+    // Once it's forwarded, the local invocation id is known to be lower than the workgroup size,
+    // so neither access to the workgroup array is checked
+    let mut config = workgroup_config();
+    config["optimization"] = json!("basic");
+    let compilation = checked(WORKGROUP, config, "clamped");
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::ArrayLength), 2);
+    assert_eq!(count(module, Op::ULessThan), 2);
+}
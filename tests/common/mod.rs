@@ -0,0 +1,210 @@
+//! Helpers shared by the integration tests, which compile small modules and look into the
+//! instructions they're translated into.
+
+#![allow(dead_code)]
+
+use rspirv::{
+    dr::{Instruction, Module, Operand},
+    spirv::{Capability, Op, Word},
+};
+use serde_json::{json, Value};
+use wasm2spirv::{config::Config, Compilation};
+
+/// Compute shader that reads from the buffer of it's first parameter and writes into the one of
+/// it's second, both with elements of type `pointee`.
+pub fn config(entry: u32, pointee: Value) -> Value {
+    let buffer = |binding: u32| {
+        json!({
+            "type": {
+                "size": "fat",
+                "storage_class": "StorageBuffer",
+                "pointee": pointee,
+            },
+            "kind": {
+                "descriptor_set": {
+                    "storage_class": "StorageBuffer",
+                    "set": 0,
+                    "binding": binding,
+                }
+            }
+        })
+    };
+
+    return json!({
+        "platform": { "vulkan": "1.1" },
+        "addressing_model": "logical",
+        "memory_model": "GLSL450",
+        "capabilities": { "dynamic": [] },
+        "extensions": ["SPV_KHR_storage_buffer_storage_class"],
+        "functions": {
+            entry.to_string(): {
+                "execution_model": "GLCompute",
+                "execution_modes": [{ "local_size": [64, 1, 1] }],
+                "params": {
+                    "0": buffer(0),
+                    "1": buffer(1),
+                }
+            }
+        }
+    });
+}
+
+pub fn features(simd: bool, threads: bool) -> Value {
+    json!({
+        "memory64": false,
+        "saturating_float_to_int": false,
+        "simd": simd,
+        "threads": threads,
+    })
+}
+
+/// Compiles and validates the module, panicking with it's assembly if it's invalid.
+pub fn compile(wat: &str, config: Value) -> Compilation {
+    let config: Config = serde_json::from_value(config).unwrap();
+    let wasm = wat::parse_str(wat).unwrap();
+    let compilation = Compilation::new(config, &wasm).unwrap();
+    if let Err(e) = compilation.validate() {
+        panic!("{e}\n{}", compilation.assembly().unwrap());
+    }
+    return compilation;
+}
+
+/// Entry point `1`, storing `body` (applied to the element of the source buffer at the
+/// invocation's index) into the destination buffer. `body` may use local `3` as scratch space.
+pub fn square_like(body: &str, rest: &str) -> String {
+    return format!(
+        r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32 i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+{body}    i32.store)
+{rest}  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#
+    );
+}
+
+/// Copies the source buffer through a workgroup array, reading it back from the neighbouring
+/// invocation after a barrier.
+pub const WORKGROUP: &str = r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (type (;2;) (func (result i32)))
+  (type (;3;) (func))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (import "spir_global" "gl_LocalInvocationID" (func (;1;) (type 0)))
+  (import "spir_workgroup" "shared" (func (;2;) (type 2)))
+  (import "spir_global" "barrier" (func (;3;) (type 3)))
+  (func (;4;) (type 1) (param i32 i32)
+    (local i32 i32)
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.set 2
+    i32.const 0
+    call 1
+    local.set 3
+    call 2
+    local.get 3
+    i32.const 2
+    i32.shl
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+    i32.store
+    call 3
+    local.get 1
+    local.get 2
+    i32.add
+    call 2
+    local.get 3
+    i32.const 1
+    i32.xor
+    i32.const 63
+    i32.and
+    i32.const 2
+    i32.shl
+    i32.add
+    i32.load
+    i32.store)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 4)))
+"#;
+
+/// Configuration of [`WORKGROUP`], with it's array of 64 integers.
+pub fn workgroup_config() -> Value {
+    let mut config = config(4, json!("i32"));
+    config["workgroup_arrays"] = json!([{ "name": "shared", "type": "i32", "length": 64 }]);
+    return config;
+}
+
+/// Instructions of the module with the given opcode, in order.
+pub fn instructions(module: &Module, opcode: Op) -> Vec<&Instruction> {
+    return module
+        .all_inst_iter()
+        .filter(|x| x.class.opcode == opcode)
+        .collect();
+}
+
+pub fn count(module: &Module, opcode: Op) -> usize {
+    return instructions(module, opcode).len();
+}
+
+/// Instruction with the given result id.
+pub fn definition(module: &Module, id: Word) -> &Instruction {
+    return module
+        .all_inst_iter()
+        .find(|x| x.result_id == Some(id))
+        .unwrap_or_else(|| panic!("%{id} isn't defined"));
+}
+
+/// Id the `index`-th operand refers to.
+pub fn id_operand(instruction: &Instruction, index: usize) -> Word {
+    return match &instruction.operands[index] {
+        Operand::IdRef(x) | Operand::IdScope(x) | Operand::IdMemorySemantics(x) => *x,
+        other => panic!("{other:?} isn't an id"),
+    };
+}
+
+/// Value of the 32-bit integer constant the `index`-th operand refers to.
+pub fn constant_operand(module: &Module, instruction: &Instruction, index: usize) -> u32 {
+    let constant = definition(module, id_operand(instruction, index));
+    return match (constant.class.opcode, constant.operands.first()) {
+        (Op::Constant | Op::SpecConstant, Some(Operand::LiteralInt32(x))) => *x,
+        _ => panic!("{constant:?} isn't a 32-bit integer constant"),
+    };
+}
+
+/// Component count of the vector type `id`, if it's one.
+pub fn vector_size(module: &Module, id: Word) -> Option<u32> {
+    let ty = definition(module, id);
+    return match (ty.class.opcode, ty.operands.get(1)) {
+        (Op::TypeVector, Some(Operand::LiteralInt32(x))) => Some(*x),
+        _ => None,
+    };
+}
+
+pub fn has_capability(module: &Module, capability: Capability) -> bool {
+    return module
+        .capabilities
+        .iter()
+        .any(|x| x.operands.first() == Some(&Operand::Capability(capability)));
+}
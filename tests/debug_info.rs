@@ -0,0 +1,50 @@
+//! Names and code offsets carried over as debug info.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{dr::Operand, spirv::Op};
+use serde_json::json;
+use wasm2spirv::Compilation;
+
+fn square(debug_info: bool) -> Compilation {
+    let wat = square_like("    local.tee 3\n    local.get 3\n    i32.mul\n", "")
+        .replace("(func (;1;) (type 1)", "(func $square (;1;) (type 1)");
+
+    let mut config = config(1, json!("i32"));
+    config["debug_info"] = json!(debug_info);
+    return compile(&wat, config);
+}
+
+#[test]
+fn names_and_lines() {
+    let compilation = square(true);
+    let module = compilation.module().unwrap();
+
+    // Lines are declared against the module's file
+    let file = instructions(module, Op::String);
+    assert_eq!(file.len(), 1);
+    let file = file[0].result_id.unwrap();
+    let lines = instructions(module, Op::Line);
+    assert!(!lines.is_empty());
+    assert!(lines.iter().all(|x| id_operand(x, 0) == file));
+
+    let name = Operand::LiteralString("square".to_string());
+    let named = module
+        .debug_names
+        .iter()
+        .find(|x| x.class.opcode == Op::Name && x.operands.get(1) == Some(&name))
+        .map(|x| id_operand(x, 0))
+        .expect("The function isn't named");
+    assert_eq!(definition(module, named).class.opcode, Op::Function);
+}
+
+#[test]
+fn disabled() {
+    let compilation = square(false);
+    let module = compilation.module().unwrap();
+    assert_eq!(count(module, Op::String), 0);
+    assert_eq!(count(module, Op::Line), 0);
+}
@@ -0,0 +1,116 @@
+//! Incremental recompilation against clean compilations of the same module.
+
+#![cfg(all(
+    feature = "cache",
+    any(feature = "spvt-validate", feature = "naga-validate")
+))]
+
+use std::collections::BTreeMap;
+use wasm2spirv::{config::Config, incremental::IncrementalCache, Compilation};
+
+/// Entry point of `square`, passing the loaded value through functions `2`, `3` and `4`.
+///
+/// Function `4` reads `gl_GlobalInvocationID`, a global variable, so it's never reused.
+fn module(xor: i32) -> Vec<u8> {
+    let wat = format!(
+        r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+    call 2
+    call 3
+    call 4
+    i32.store)
+  (func (;2;) (type 0) (param i32) (result i32)
+    local.get 0
+    local.get 0
+    i32.mul
+    i32.const 1
+    i32.add)
+  (func (;3;) (type 0) (param i32) (result i32)
+    local.get 0
+    i32.const {xor}
+    i32.xor)
+  (func (;4;) (type 0) (param i32) (result i32)
+    i32.const 0
+    call 0
+    local.get 0
+    i32.add)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#
+    );
+    return wat::parse_str(wat).unwrap();
+}
+
+fn config() -> Config {
+    serde_json::from_str(include_str!("../examples/square/square.json")).unwrap()
+}
+
+/// Number of instructions of every opcode, which doesn't depend on how ids are numbered.
+fn histogram(compilation: &Compilation) -> BTreeMap<String, usize> {
+    let mut result = BTreeMap::new();
+    for instruction in compilation.module().unwrap().all_inst_iter() {
+        *result
+            .entry(format!("{:?}", instruction.class.opcode))
+            .or_default() += 1;
+    }
+    return result;
+}
+
+#[test]
+fn matches_clean_compilation() -> color_eyre::Result<()> {
+    let _ = color_eyre::install();
+    let mut cache = IncrementalCache::new();
+
+    let first = Compilation::new_incremental(config(), &module(7), &mut cache)?;
+    first.validate()?;
+    assert_eq!(
+        histogram(&first),
+        histogram(&Compilation::new(config(), &module(7))?)
+    );
+
+    // Neither the entry point nor the function that reads a global variable are kept
+    assert_eq!(cache.len(), 2);
+
+    // Function `2` is spliced back in, while `3` (which changed) and `4` are translated again
+    let second = Compilation::new_incremental(config(), &module(9), &mut cache)?;
+    second.validate()?;
+    assert_eq!(cache.len(), 2);
+
+    let clean = Compilation::new(config(), &module(9))?;
+    clean.validate()?;
+    assert_eq!(histogram(&second), histogram(&clean));
+    assert_eq!(second.words()?.len(), clean.words()?.len());
+    return Ok(());
+}
+
+#[test]
+fn skips_functions_with_debug_lines() -> color_eyre::Result<()> {
+    let _ = color_eyre::install();
+    let mut cache = IncrementalCache::new();
+    let mut config = config();
+    config.debug_info = true;
+
+    let compilation = Compilation::new_incremental(config.clone(), &module(7), &mut cache)?;
+    compilation.validate()?;
+    assert!(cache.is_empty());
+
+    let clean = Compilation::new(config, &module(7))?;
+    assert_eq!(histogram(&compilation), histogram(&clean));
+    return Ok(());
+}
@@ -0,0 +1,178 @@
+//! The native optimization levels, which must keep every module valid.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::spirv::Op;
+use serde_json::{json, Value};
+use wasm2spirv::{config::Config, Compilation};
+
+macro_rules! examples {
+    ($($name:literal),+ $(,)?) => {
+        &[$((
+            $name,
+            include_str!(concat!("../examples/", $name, "/", $name, ".wat")),
+            include_str!(concat!("../examples/", $name, "/", $name, ".json")),
+        )),+]
+    };
+}
+
+const EXAMPLES: &[(&str, &str, &str)] =
+    examples!["cast", "dot", "fragment", "min", "saxpy", "square"];
+
+#[test]
+fn optimization_levels() {
+    for level in ["none", "basic"] {
+        for (name, wat, config) in EXAMPLES {
+            let mut config: Value = serde_json::from_str(config).unwrap();
+            config["optimization"] = json!(level);
+
+            let config: Config = serde_json::from_value(config).unwrap();
+            let wasm = wat::parse_str(wat).unwrap();
+            let compilation = Compilation::new(config, &wasm).unwrap();
+            if let Err(e) = compilation.validate() {
+                panic!("{name} at level {level}: {e}");
+            }
+        }
+    }
+}
+
+/// Number of conditional branches left from a block with a constant branch out of it.
+fn conditional_branches(level: &str) -> usize {
+    let body = "    local.set 3
+    block
+      i32.const 1
+      br_if 0
+      local.get 3
+      i32.const 2
+      i32.mul
+      local.set 3
+    end
+    local.get 3
+";
+
+    let mut config = config(1, json!("i32"));
+    config["optimization"] = json!(level);
+    let compilation = compile(&square_like(body, ""), config);
+    let module = compilation.module().unwrap();
+    return count(module, Op::Switch) + count(module, Op::BranchConditional);
+}
+
+#[test]
+fn constant_branches() {
+    assert_eq!(conditional_branches("none"), 1);
+    assert_eq!(conditional_branches("basic"), 0);
+}
+
+#[test]
+fn constant_loop_exit() {
+    // A loop only recognized from the conditional branch of it's header
+    let body = "    local.set 3
+    block
+      loop
+        i32.const 1
+        br_if 1
+        local.get 3
+        i32.const 1
+        i32.add
+        local.set 3
+        br 0
+      end
+    end
+    local.get 3
+";
+
+    for level in ["none", "basic"] {
+        let mut config = config(1, json!("i32"));
+        config["optimization"] = json!(level);
+        let compilation = compile(&square_like(body, ""), config);
+        assert_eq!(
+            count(compilation.module().unwrap(), Op::LoopMerge),
+            1,
+            "{level}"
+        );
+    }
+}
+
+/// Number of loads added by reading the local written by `local.set 3` twice.
+fn local_loads(level: &str) -> usize {
+    let loads = |body: &str| {
+        let mut config = config(1, json!("i32"));
+        config["optimization"] = json!(level);
+        let compilation = compile(&square_like(body, ""), config);
+        count(compilation.module().unwrap(), Op::Load)
+    };
+
+    let body = "    local.set 3
+    local.get 3
+    local.get 3
+    i32.mul
+";
+    return loads(body) - loads("    local.set 3\n    i32.const 1\n");
+}
+
+#[test]
+fn forwarded_locals() {
+    assert_eq!(local_loads("none"), 2);
+    assert_eq!(local_loads("basic"), 0);
+}
+
+#[test]
+fn nested_fallthrough() {
+    // Fallthrough blocks nested in an if, inside of a loop
+    let body = "    local.set 3
+    block
+      loop
+        local.get 3
+        i32.const 100
+        i32.ge_u
+        br_if 1
+        local.get 3
+        i32.const 1
+        i32.and
+        if
+          block
+            block
+              local.get 3
+              i32.const 3
+              i32.mul
+              local.set 3
+            end
+          end
+        else
+          block
+            local.get 3
+            i32.const 1
+            i32.shr_u
+            local.set 3
+          end
+        end
+        block
+          local.get 3
+          i32.const 1
+          i32.add
+          local.set 3
+        end
+        br 0
+      end
+    end
+    local.get 3
+";
+
+    // Merging the fallthrough blocks must keep the structure of the control flow
+    let merges = ["none", "basic"].map(|level| {
+        let mut config = config(1, json!("i32"));
+        config["optimization"] = json!(level);
+        let compilation = compile(&square_like(body, ""), config);
+        let module = compilation.module().unwrap();
+        (
+            count(module, Op::LoopMerge),
+            count(module, Op::SelectionMerge),
+        )
+    });
+
+    assert_eq!(merges[0].0, 1);
+    assert_eq!(merges[0], merges[1]);
+}
@@ -0,0 +1,67 @@
+//! Functions built on multiple threads, which must translate exactly as they do on one.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use serde_json::json;
+
+#[test]
+fn deterministic_capabilities() {
+    // Every helper requires a different capability while it's being built
+    let wat = r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (type (;2;) (func (result i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (import "spir_global" "subgroupElect" (func (;1;) (type 2)))
+  (import "spir_global" "subgroupAdd" (func (;2;) (type 0)))
+  (import "spir_global" "subgroupAll" (func (;3;) (type 0)))
+  (import "spir_global" "subgroupBroadcastFirst" (func (;4;) (type 0)))
+  (func (;5;) (type 1) (param i32 i32)
+    (local i32 i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+    local.tee 3
+    call 6
+    local.get 3
+    call 7
+    i32.add
+    local.get 3
+    call 8
+    i32.add
+    i32.store)
+  (func (;6;) (type 0) (param i32) (result i32)
+    local.get 0
+    call 2
+    call 1
+    i32.add)
+  (func (;7;) (type 0) (param i32) (result i32)
+    local.get 0
+    call 3)
+  (func (;8;) (type 0) (param i32) (result i32)
+    local.get 0
+    call 4)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 5)))
+"#;
+
+    let serial = compile(wat, config(5, json!("i32")));
+    for _ in 0..8 {
+        let mut config = config(5, json!("i32"));
+        config["parallel"] = json!(true);
+        let parallel = compile(wat, config);
+        assert_eq!(parallel.words().unwrap(), serial.words().unwrap());
+    }
+}
@@ -0,0 +1,73 @@
+//! Lowering of `v128` operators into SPIR-V vectors.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{dr::Operand, spirv::Op};
+use serde_json::json;
+
+#[test]
+fn lanes() {
+    let wat = r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 4
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    v128.load
+    v128.const i32x4 1 2 3 4
+    i32x4.add
+    i32x4.extract_lane 3
+    i32x4.splat
+    v128.store)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#;
+
+    let mut config = config(1, json!({ "Vector": ["i32", 4] }));
+    config["features"] = features(true, false);
+    let compilation = compile(wat, config);
+    let module = compilation.module().unwrap();
+
+    // The addition is done on whole vectors
+    let add = instructions(module, Op::IAdd)
+        .into_iter()
+        .filter(|x| vector_size(module, x.result_type.unwrap()) == Some(4))
+        .count();
+    assert_eq!(add, 1);
+
+    let lane = instructions(module, Op::CompositeExtract)
+        .into_iter()
+        .find(|x| x.operands.get(1) == Some(&Operand::LiteralInt32(3)))
+        .and_then(|x| x.result_id)
+        .expect("The lane isn't extracted");
+
+    // The splat repeats the extracted lane into every component
+    assert!(instructions(module, Op::CompositeConstruct)
+        .into_iter()
+        .any(|x| x.operands.len() == 4 && (0..4).all(|i| id_operand(x, i) == lane)));
+
+    for opcode in [Op::Load, Op::Store] {
+        let vector = instructions(module, opcode).into_iter().any(|x| {
+            let value = match opcode {
+                Op::Load => x.result_type.unwrap(),
+                _ => definition(module, id_operand(x, 1)).result_type.unwrap(),
+            };
+            vector_size(module, value) == Some(4)
+        });
+        assert!(vector, "No {opcode:?} of a vector");
+    }
+}
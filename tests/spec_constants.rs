@@ -0,0 +1,87 @@
+//! Globals and workgroup sizes lowered into specialization constants.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{
+    dr::{Module, Operand},
+    spirv::{BuiltIn, Decoration, ExecutionMode, Op, Word},
+};
+use serde_json::json;
+
+/// Specialization id of `id`, if it's decorated with one.
+fn spec_id(module: &Module, id: Word) -> Option<u32> {
+    return module.annotations.iter().find_map(|x| {
+        match (x.class.opcode, x.operands.as_slice()) {
+            (
+                Op::Decorate,
+                [Operand::IdRef(target), Operand::Decoration(Decoration::SpecId), Operand::LiteralInt32(spec_id)],
+            ) if *target == id => Some(*spec_id),
+            _ => None,
+        }
+    });
+}
+
+#[test]
+fn globals() {
+    let wat = square_like(
+        "    global.get 0\n    i32.mul\n",
+        "  (global (;0;) i32 (i32.const 3))\n",
+    );
+
+    let mut config = config(1, json!("i32"));
+    config["spec_constants"] = json!({ "0": 7 });
+    let compilation = compile(&wat, config);
+    let module = compilation.module().unwrap();
+
+    // The global's initializer is the default value
+    let constants = instructions(module, Op::SpecConstant);
+    assert_eq!(constants.len(), 1);
+    assert_eq!(constants[0].operands, [Operand::LiteralInt32(3)]);
+    assert_eq!(spec_id(module, constants[0].result_id.unwrap()), Some(7));
+}
+
+#[test]
+fn workgroup_size() {
+    let mut config = config(1, json!("i32"));
+    config["functions"]["1"]["execution_modes"] = json!([{
+        "local_size_id": [
+            { "spec_id": 0, "default": 64 },
+            { "spec_id": 1, "default": 1 },
+            { "spec_id": 2, "default": 1 },
+        ]
+    }]);
+
+    let wat = square_like("    local.tee 3\n    local.get 3\n    i32.mul\n", "");
+    let compilation = compile(&wat, config);
+    let module = compilation.module().unwrap();
+
+    // Vulkan specializes the size through the WorkgroupSize built-in, which overrides LocalSize
+    let size = module
+        .annotations
+        .iter()
+        .find(|x| {
+            x.class.opcode == Op::Decorate
+                && x.operands.get(2) == Some(&Operand::BuiltIn(BuiltIn::WorkgroupSize))
+        })
+        .map(|x| id_operand(x, 0))
+        .expect("The workgroup size isn't decorated");
+
+    let composite = definition(module, size);
+    assert_eq!(composite.class.opcode, Op::SpecConstantComposite);
+    for (i, (default, expected)) in [(64, 0), (1, 1), (1, 2)].into_iter().enumerate() {
+        let component = definition(module, id_operand(composite, i));
+        assert_eq!(component.operands, [Operand::LiteralInt32(default)]);
+        assert_eq!(
+            spec_id(module, component.result_id.unwrap()),
+            Some(expected)
+        );
+    }
+
+    assert!(instructions(module, Op::ExecutionMode)
+        .into_iter()
+        .any(|x| x.operands.get(1) == Some(&Operand::ExecutionMode(ExecutionMode::LocalSize))));
+    assert_eq!(count(module, Op::ExecutionModeId), 0);
+}
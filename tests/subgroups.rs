@@ -0,0 +1,85 @@
+//! Subgroup operations imported from `spir_global`.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{
+    dr::Operand,
+    spirv::{Capability, GroupOperation, Op, Scope},
+};
+use serde_json::json;
+
+#[test]
+fn reduce_and_elect() {
+    let wat = r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (type (;2;) (func (result i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (import "spir_global" "subgroupAdd" (func (;1;) (type 0)))
+  (import "spir_global" "subgroupElect" (func (;2;) (type 2)))
+  (func (;3;) (type 1) (param i32 i32)
+    (local i32)
+    local.get 1
+    i32.const 0
+    call 0
+    i32.const 2
+    i32.shl
+    local.tee 2
+    i32.add
+    local.get 0
+    local.get 2
+    i32.add
+    i32.load
+    call 1
+    call 2
+    i32.add
+    i32.store)
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 3)))
+"#;
+
+    let compilation = compile(wat, config(3, json!("i32")));
+    let module = compilation.module().unwrap();
+    let subgroup = Scope::Subgroup as u32;
+
+    let add = instructions(module, Op::GroupNonUniformIAdd);
+    assert_eq!(add.len(), 1);
+    assert_eq!(constant_operand(module, add[0], 0), subgroup);
+    assert_eq!(
+        add[0].operands[1],
+        Operand::GroupOperation(GroupOperation::Reduce)
+    );
+
+    let elect = instructions(module, Op::GroupNonUniformElect);
+    assert_eq!(elect.len(), 1);
+    assert_eq!(constant_operand(module, elect[0], 0), subgroup);
+
+    assert!(has_capability(module, Capability::GroupNonUniform));
+    assert!(has_capability(
+        module,
+        Capability::GroupNonUniformArithmetic
+    ));
+}
+
+#[test]
+fn requires_spirv_1_3() {
+    let wat = r#"(module
+  (type (;0;) (func (result i32)))
+  (import "spir_global" "subgroupElect" (func (;0;) (type 0)))
+  (func (;1;) (type 0) (result i32)
+    call 0)
+  (export "elect" (func 1)))
+"#;
+
+    let mut config = config(1, json!("i32"));
+    config["platform"] = json!({ "vulkan": "1.0" });
+    config["functions"] = json!({});
+
+    let config = serde_json::from_value(config).unwrap();
+    let wasm = wat::parse_str(wat).unwrap();
+    assert!(wasm2spirv::Compilation::new(config, &wasm).is_err());
+}
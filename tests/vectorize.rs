@@ -0,0 +1,101 @@
+//! Merging of contiguous scalar stores into vector ones.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{dr::Module, spirv::Op};
+use serde_json::json;
+
+/// Stores the constants `1` to `4` into the destination buffer, `stride` bytes apart from the
+/// invocation's 16-byte aligned offset.
+fn stores(stride: u32) -> String {
+    let mut body = String::new();
+    for i in 0..4 {
+        body += &format!(
+            "    local.get 1
+    local.get 2
+    i32.add
+    i32.const {}
+    i32.store offset={}
+",
+            i + 1,
+            i * stride
+        );
+    }
+
+    return format!(
+        r#"(module
+  (type (;0;) (func (param i32) (result i32)))
+  (type (;1;) (func (param i32 i32)))
+  (import "spir_global" "gl_GlobalInvocationID" (func (;0;) (type 0)))
+  (func (;1;) (type 1) (param i32 i32)
+    (local i32)
+    i32.const 0
+    call 0
+    i32.const 6
+    i32.shl
+    local.set 2
+{body}  )
+  (memory (;0;) 16)
+  (export "memory" (memory 0))
+  (export "Main" (func 1)))
+"#
+    );
+}
+
+/// Stores of a constant, and stores of a vector.
+fn store_counts(module: &Module) -> (usize, usize) {
+    let stores = instructions(module, Op::Store);
+    let scalar = stores
+        .iter()
+        .filter(|x| definition(module, id_operand(x, 1)).class.opcode == Op::Constant)
+        .count();
+    let vector = stores
+        .iter()
+        .filter(|x| {
+            let value = definition(module, id_operand(x, 1));
+            value
+                .result_type
+                .and_then(|ty| vector_size(module, ty))
+                .is_some()
+        })
+        .count();
+    return (scalar, vector);
+}
+
+#[test]
+fn strided_stores() {
+    let mut config = config(1, json!("i32"));
+    config["optimization"] = json!("basic");
+    let compilation = compile(&stores(8), config);
+    assert_eq!(store_counts(compilation.module().unwrap()), (4, 0));
+}
+
+#[test]
+fn logical_stores() {
+    // Logical addressing can't reinterpret the buffer through a pointer cast
+    let mut config = config(1, json!("i32"));
+    config["optimization"] = json!("basic");
+    let compilation = compile(&stores(4), config);
+    assert_eq!(store_counts(compilation.module().unwrap()), (4, 0));
+}
+
+#[test]
+fn logical_vector_stores() {
+    // Every component of a vector of the buffer is stored, so it's stored as a whole
+    let mut config = config(1, json!({ "Vector": ["i32", 4] }));
+    config["optimization"] = json!("basic");
+    let compilation = compile(&stores(4), config);
+    assert_eq!(store_counts(compilation.module().unwrap()), (0, 1));
+}
+
+#[test]
+fn logical_component_stores() {
+    // Components are stored through access chains into the buffer's vectors
+    let mut config = config(1, json!({ "Vector": ["i32", 4] }));
+    config["optimization"] = json!("basic");
+    let compilation = compile(&stores(8), config);
+    assert_eq!(store_counts(compilation.module().unwrap()), (4, 0));
+}
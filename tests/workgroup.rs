@@ -0,0 +1,52 @@
+//! Workgroup arrays imported from `spir_workgroup`, and the barriers that synchronize them.
+
+#![cfg(feature = "spvt-validate")]
+
+mod common;
+
+use common::*;
+use rspirv::{
+    dr::Operand,
+    spirv::{MemorySemantics, Op, Scope, StorageClass},
+};
+
+#[test]
+fn shared_array() {
+    let compilation = compile(WORKGROUP, workgroup_config());
+    let module = compilation.module().unwrap();
+
+    // A single array of 64 integers, however many times it's imported
+    let variables = instructions(module, Op::Variable)
+        .into_iter()
+        .filter(|x| x.operands[0] == Operand::StorageClass(StorageClass::Workgroup))
+        .collect::<Vec<_>>();
+    assert_eq!(variables.len(), 1);
+
+    let pointer = definition(module, variables[0].result_type.unwrap());
+    let array = definition(module, id_operand(pointer, 1));
+    assert_eq!(array.class.opcode, Op::TypeArray);
+    assert_eq!(constant_operand(module, array, 1), 64);
+
+    // Both accesses index into the array itself
+    let array_id = variables[0].result_id.unwrap();
+    let chains = instructions(module, Op::AccessChain)
+        .into_iter()
+        .filter(|x| id_operand(x, 0) == array_id)
+        .count();
+    assert_eq!(chains, 2);
+
+    let barrier = instructions(module, Op::ControlBarrier);
+    assert_eq!(barrier.len(), 1);
+    assert_eq!(
+        constant_operand(module, barrier[0], 0),
+        Scope::Workgroup as u32
+    );
+    assert_eq!(
+        constant_operand(module, barrier[0], 1),
+        Scope::Workgroup as u32
+    );
+    assert_eq!(
+        constant_operand(module, barrier[0], 2),
+        (MemorySemantics::ACQUIRE_RELEASE | MemorySemantics::WORKGROUP_MEMORY).bits()
+    );
+}